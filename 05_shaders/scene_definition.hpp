@@ -36,14 +36,15 @@ inline SimpleScene createCubeScene(MaterialFactory &aMaterialFactory, GeometryFa
 				"material",
 				RenderStyle::Solid,
 				{
-					{ "configuration", static_cast<unsigned int>(DIFFUSE) },
 					// { "configuration", static_cast<unsigned int>(DEBUG) },
 					{ "u_diffuseTexture", TextureInfo("brick_wall/Brick_Wall_012_COLOR.jpg") },
 					{ "u_specularTexture", TextureInfo("brick_wall/Brick_Wall_012_ROUGH.jpg") },
 					{ "u_normalTexture", TextureInfo("brick_wall/Brick_Wall_012_NORM.jpg") },
 					{ "u_displacementTexture", TextureInfo("brick_wall/Brick_Wall_012_DISP.png") },
 					{ "u_ambientOccTexture", TextureInfo("brick_wall/Brick_Wall_012_OCC.jpg") },
-				}
+				},
+				false,
+				DIFFUSE
 				)
 			);
 		cube->addMaterial(
@@ -68,13 +69,14 @@ inline SimpleScene createCubeScene(MaterialFactory &aMaterialFactory, GeometryFa
 				"material",
 				RenderStyle::Solid,
 				{
-					{ "configuration", static_cast<unsigned int>(DIFFUSE | SPECULAR | BUMP) },
 					{ "u_diffuseTexture", TextureInfo("brick_wall/Brick_Wall_012_COLOR.jpg") },
 					{ "u_specularTexture", TextureInfo("brick_wall/Brick_Wall_012_ROUGH.jpg") },
 					{ "u_normalTexture", TextureInfo("brick_wall/Brick_Wall_012_NORM.jpg") },
 					{ "u_displacementTexture", TextureInfo("brick_wall/Brick_Wall_012_DISP.png") },
 					{ "u_ambientOccTexture", TextureInfo("brick_wall/Brick_Wall_012_OCC.jpg") },
-				}
+				},
+				false,
+				DIFFUSE | SPECULAR | BUMP
 				)
 			);
 		cube->addMaterial(
@@ -9,7 +9,12 @@ const uint SHADOW = 1 << 5;
 const uint DEBUG = 1 << 7;
 
 
+#ifdef PERMUTATION_MASK
+// Specialized variant - disabled features are removed by the compiler
+const uint configuration = PERMUTATION_MASK;
+#else
 uniform uint configuration = DIFFUSE;
+#endif
 
 const vec3 lightColor = vec3(1.0, 1.0, 1.0);
 const float lightPower = 1.0;
@@ -20,6 +20,11 @@ constexpr unsigned int AMBIENT_OCC = 1 << 4;
 constexpr unsigned int SHADOW = 1 << 5;
 constexpr unsigned int DEBUG = 1 << 7;
 
+// Permutations of the noise programs
+constexpr unsigned int PERLIN_NOISE = 1;
+constexpr unsigned int SIMPLEX_NOISE = 1 << 1;
+constexpr unsigned int WORLEY_NOISE = 1 << 2;
+
 
 inline SimpleScene createNoiseDemonstrationScene(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) {
 	SimpleScene scene;
@@ -34,9 +39,10 @@ inline SimpleScene createNoiseDemonstrationScene(MaterialFactory &aMaterialFacto
 				"noise_2d",
 				RenderStyle::Solid,
 				{
-					{"u_noiseScale", 15.0f},
-					{"u_selectedNoise", 0}
-				}
+					{"u_noiseScale", 15.0f}
+				},
+				false,
+				PERLIN_NOISE
 				)
 			);
 		plane->addMaterial(
@@ -61,9 +67,10 @@ inline SimpleScene createNoiseDemonstrationScene(MaterialFactory &aMaterialFacto
 				"noise_2d",
 				RenderStyle::Solid,
 				{
-					{"u_noiseScale", 10.0f},
-					{"u_selectedNoise", 1}
-				}
+					{"u_noiseScale", 10.0f}
+				},
+				false,
+				SIMPLEX_NOISE
 				)
 			);
 		plane->addMaterial(
@@ -88,9 +95,10 @@ inline SimpleScene createNoiseDemonstrationScene(MaterialFactory &aMaterialFacto
 				"noise_animated",
 				RenderStyle::Solid,
 				{
-					{"u_noiseScale", 15.0f},
-					{"u_selectedNoise", 0}
-				}
+					{"u_noiseScale", 15.0f}
+				},
+				false,
+				PERLIN_NOISE
 				)
 			);
 		plane->addMaterial(
@@ -115,9 +123,10 @@ inline SimpleScene createNoiseDemonstrationScene(MaterialFactory &aMaterialFacto
 				"noise_animated",
 				RenderStyle::Solid,
 				{
-					{"u_noiseScale", 10.0f},
-					{"u_selectedNoise", 1}
-				}
+					{"u_noiseScale", 10.0f}
+				},
+				false,
+				SIMPLEX_NOISE
 				)
 			);
 		plane->addMaterial(
@@ -148,9 +157,10 @@ inline SimpleScene createMonkeyScene(MaterialFactory &aMaterialFactory, Geometry
 					"noise_3d",
 					RenderStyle::Solid,
 					{
-						{"u_noiseScale", 10.0f},
-						{"u_selectedNoise", 1}
-					})
+						{"u_noiseScale", 10.0f}
+					},
+					false,
+					SIMPLEX_NOISE)
 				);
 		mesh->addMaterial(
 				"wireframe",
@@ -185,11 +195,11 @@ inline SimpleScene createTerrainScene(MaterialFactory &aMaterialFactory, Geometr
 				{
 					{"u_inner", 32},
 					{"u_outer", 32},
-					{"u_selectedNoise", 1},
 					{"u_maxDisplacement", 0.3f},
 					{"u_noiseScale", 2.0f},
 				},
-				true)
+				true,
+				SIMPLEX_NOISE)
 			);
 		plane->addMaterial(
 			"wireframe",
@@ -199,13 +209,13 @@ inline SimpleScene createTerrainScene(MaterialFactory &aMaterialFactory, Geometr
 				{
 					{"u_inner", 32},
 					{"u_outer", 32},
-					{"u_selectedNoise", 1},
 					{"u_maxDisplacement", 0.3f},
 					{"u_noiseScale", 2.0f},
 					{"u_solidColor", glm::vec4(0,0,0,1)}
 
 				},
-				true)
+				true,
+				SIMPLEX_NOISE)
 			);
 		plane->prepareRenderData(aMaterialFactory, aGeometryFactory);
 		scene.addObject(plane);
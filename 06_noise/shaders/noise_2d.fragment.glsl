@@ -10,7 +10,11 @@ in vec2 f_texCoord;
 
 uniform float u_noiseScale = 10.0;
 
+#ifdef PERMUTATION_MASK
+const int u_selectedNoise = findLSB(PERMUTATION_MASK);
+#else
 uniform int u_selectedNoise = 0;
+#endif
 
 float noise_2d(vec2 coords) {
 	if (u_selectedNoise == 0) {
@@ -9,7 +9,11 @@ in vec3 f_position;
 in vec2 f_texCoord;
 
 uniform float u_noiseScale = 10.0;
+#ifdef PERMUTATION_MASK
+const int u_selectedNoise = findLSB(PERMUTATION_MASK);
+#else
 uniform int u_selectedNoise = 0;
+#endif
 
 float noise_3d(vec3 coords) {
 	if (u_selectedNoise == 0) {
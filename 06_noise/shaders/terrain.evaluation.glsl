@@ -18,7 +18,11 @@ uniform mat4 u_viewMat;
 uniform mat4 u_projMat;
 
 uniform float u_noiseScale = 10.0;
+#ifdef PERMUTATION_MASK
+const int u_selectedNoise = findLSB(PERMUTATION_MASK);
+#else
 uniform int u_selectedNoise = 0;
+#endif
 uniform float u_maxDisplacement = 0.2;
 
 float noise_2d(vec2 coords) {
@@ -30,8 +30,26 @@ struct Config {
 	bool showSolid = true;
 	bool showWireframe = false;
 	bool showRaycasted = true;
+	bool brickSkipping = true;
+	bool distanceField = false;
+	bool showSampleCount = false;
+	bool cachedSlices = true;
+
+	// Render mode of the raycasted materials, see addMIPMaterials() and addIsosurfaceMaterials()
+	std::string raycastMode() const {
+		std::string skipping = !brickSkipping ? "_no_skipping" : (distanceField ? "_distance_field" : "");
+		return std::string(showSampleCount ? "samples" : "raycast") + skipping;
+	}
+
+	// Solid render mode, only the animated slice has the full volume variant, see createAnimationScene()
+	std::string solidMode() const {
+		return cachedSlices ? "solid" : "solid_full_volume";
+	}
 };
 
+// Index of the animation scene in the scene list
+constexpr int cAnimationSceneIdx = 1;
+
 int main() {
 	// Initialize GLFW
 	if (!glfwInit()) {
@@ -75,6 +93,12 @@ int main() {
 					case GLFW_KEY_4:
 						config.currentSceneIdx = 3;
 						break;
+					case GLFW_KEY_5:
+						config.currentSceneIdx = 4;
+						break;
+					case GLFW_KEY_6:
+						config.currentSceneIdx = 5;
+						break;
 					case GLFW_KEY_W:
 						toggle("Show wireframe", config.showWireframe);
 						break;
@@ -84,6 +108,18 @@ int main() {
 					case GLFW_KEY_R:
 						toggle("Show raycasted", config.showRaycasted);
 						break;
+					case GLFW_KEY_B:
+						toggle("Brick skipping", config.brickSkipping);
+						break;
+					case GLFW_KEY_D:
+						toggle("Distance field skipping", config.distanceField);
+						break;
+					case GLFW_KEY_C:
+						toggle("Show sample count", config.showSampleCount);
+						break;
+					case GLFW_KEY_T:
+						toggle("Cached slices", config.cachedSlices);
+						break;
 					}
 				}
 			});
@@ -91,35 +127,52 @@ int main() {
 		OGLMaterialFactory materialFactory;
 		materialFactory.loadShadersFromDir("./shaders/");
 		// materialFactory.loadTexturesFromDir("./textures/");
-		materialFactory.load3DTexturesFromDir("./3d_textures/");
+		// Windowed 8-bit textures - a quarter of the float volumes, half of the 16-bit ones
+		materialFactory.load3DTexturesFromDir("./3d_textures/", OGLMaterialFactory::cDefaultResidencyBudget, VolumeFormat::Normalized8);
+		float skullIsoValue = materialFactory.getVolumeStatistics("lebka1.dump").toSampledValue(cSkullIsoValue);
+		materialFactory.createEmptySpaceDistanceTexture("lebka1.dump", skullIsoValue);
+		int animationSliceCount = materialFactory.createVolumeSliceCache("intestine.dump");
 
 		OGLGeometryFactory geometryFactory;
 
 
-		std::array<SimpleScene, 4> scenes {
-			createSphereScene(materialFactory, geometryFactory),
-			createAnimationScene(materialFactory, geometryFactory),
-			createMIPScene1(materialFactory, geometryFactory),
-			createMIPScene2(materialFactory, geometryFactory),
-		};
+		std::vector<SimpleScene> scenes;
+		scenes.push_back(createSphereScene(materialFactory, geometryFactory));
+		scenes.push_back(createAnimationScene(materialFactory, geometryFactory, animationSliceCount));
+		scenes.push_back(createMIPScene1(materialFactory, geometryFactory));
+		scenes.push_back(createMIPScene2(materialFactory, geometryFactory));
+		scenes.push_back(createIsosurfaceScene(materialFactory, geometryFactory, skullIsoValue));
+		// Volumes over the residency budget stream through a brick cache
+		for (const auto &name : materialFactory.getPagedVolumeNames()) {
+			auto window = materialFactory.getVolumeStatistics(name).sampledWindow();
+			scenes.push_back(createPagedMIPScene(materialFactory, geometryFactory, name, glm::vec2(window.lower, window.upper)));
+		}
 
 		Renderer renderer(materialFactory);
 
 		renderer.initialize();
 		window.runLoop([&] {
-			renderer.setCurrentTime(float(window.elapsedTime()));
+			if (config.currentSceneIdx >= int(scenes.size())) {
+				config.currentSceneIdx = 0;
+			}
+			float elapsedTime = float(window.elapsedTime());
+			if (config.currentSceneIdx == cAnimationSceneIdx && config.cachedSlices) {
+				// Uploads only the slices the animation moved into since the last frame
+				materialFactory.updateVolumeSliceCaches(cAnimationSpeed * elapsedTime);
+			}
+			renderer.setCurrentTime(elapsedTime);
 			renderer.clear();
 			if (config.showSolid) {
 				GL_CHECK(glDisable(GL_POLYGON_OFFSET_LINE));
 				GL_CHECK(glPolygonOffset(0.0f, 0.0f));
 				GL_CHECK(glPolygonMode(GL_FRONT_AND_BACK, GL_FILL));
-				renderer.renderScene(scenes[config.currentSceneIdx], camera, RenderOptions{"solid"});
+				renderer.renderScene(scenes[config.currentSceneIdx], camera, RenderOptions{config.solidMode()});
 			}
 			if (config.showRaycasted) {
 				GL_CHECK(glDisable(GL_POLYGON_OFFSET_LINE));
 				GL_CHECK(glPolygonOffset(0.0f, 0.0f));
 				GL_CHECK(glPolygonMode(GL_FRONT_AND_BACK, GL_FILL));
-				renderer.renderScene(scenes[config.currentSceneIdx], camera, RenderOptions{"raycast"});
+				renderer.renderScene(scenes[config.currentSceneIdx], camera, RenderOptions{config.raycastMode()});
 			}
 			if (config.showWireframe) {
 				GL_CHECK(glPolygonMode(GL_FRONT_AND_BACK, GL_LINE));
@@ -127,6 +180,7 @@ int main() {
 				GL_CHECK(glPolygonOffset(-1.0f, -1.0f));
 				renderer.renderScene(scenes[config.currentSceneIdx], camera, RenderOptions{"wireframe"});
 			}
+			materialFactory.updatePagedVolumes();
 		});
 	} catch (ShaderCompilationError &exc) {
 		std::cerr
@@ -20,6 +20,101 @@ constexpr unsigned int AMBIENT_OCC = 1 << 4;
 constexpr unsigned int SHADOW = 1 << 5;
 constexpr unsigned int DEBUG = 1 << 7;
 
+// Permutations of the mip program
+constexpr unsigned int BRICK_SKIPPING = 1;
+constexpr unsigned int SAMPLE_COUNT = 1 << 1;
+constexpr unsigned int PAGED = 1 << 2;
+
+// Permutations of the isosurface program
+constexpr unsigned int OCTREE = 1;
+constexpr unsigned int DISTANCE_FIELD = 1 << 1;
+constexpr unsigned int ISOSURFACE_SAMPLE_COUNT = 1 << 2;
+
+// Permutations of the animated_texture program
+constexpr unsigned int CACHED_SLICES = 1;
+
+// u_speed of the animated slice, the slice caches are updated with the same animation time
+constexpr float cAnimationSpeed = 0.5f;
+
+// Bone surface of the skull scan, in the stored units of the file - see VolumeStatistics::toSampledValue()
+constexpr float cSkullIsoValue = 1310.0f;
+
+// Window of the normalized volume textures
+inline const glm::vec2 cIdentityWindow(0.0f, 1.0f);
+
+/**
+ * Render modes for the MIP raycaster - "raycast" with empty space skipping, "_no_skipping"
+ * variants march the whole volume, "samples" variants show the number of texture samples per ray.
+ * MIP has no iso value to build a distance field for, "_distance_field" modes use the brick skipping.
+ * Volumes loaded through a brick cache need aPaged, see OGLMaterialFactory::load3DTexturesFromDir().
+ * aIntensityWindow is in the sampled units, native volumes pass VolumeStatistics::sampledWindow().
+ */
+inline void addMIPMaterials(MeshObject &aObject, const std::string &aVolumeName, glm::vec2 aIntensityWindow = cIdentityWindow, bool aPaged = false) {
+	for (auto [mode, permutation] : {
+			std::pair{ "raycast", BRICK_SKIPPING },
+			std::pair{ "raycast_distance_field", BRICK_SKIPPING },
+			std::pair{ "raycast_no_skipping", 0u },
+			std::pair{ "samples", BRICK_SKIPPING | SAMPLE_COUNT },
+			std::pair{ "samples_distance_field", BRICK_SKIPPING | SAMPLE_COUNT },
+			std::pair{ "samples_no_skipping", SAMPLE_COUNT } })
+	{
+		MaterialParameterValues parameters = {
+			{ "u_volumeData", TextureInfo(aVolumeName) },
+			{ "u_brickData", TextureInfo(aVolumeName + cBrickTextureSuffix) },
+			{ "u_intensityWindow", aIntensityWindow },
+			{ "stepSize", 0.01f },
+		};
+		if (aPaged) {
+			parameters["u_pageTable"] = TextureInfo(aVolumeName + cPageTableTextureSuffix);
+			permutation |= PAGED;
+		}
+		aObject.addMaterial(
+			mode,
+			MaterialParameters(
+				"mip",
+				RenderStyle::Solid,
+				parameters,
+				false,
+				permutation
+				)
+			);
+	}
+}
+
+/**
+ * Render modes for the isosurface raycaster, named as in addMIPMaterials() - "raycast" skips through
+ * the min-max octree, "_distance_field" variants jump by the empty space distance field instead.
+ * aIsoValue is in the sampled units. The distance field texture has to be created for it first,
+ * see OGLMaterialFactory::createEmptySpaceDistanceTexture().
+ */
+inline void addIsosurfaceMaterials(MeshObject &aObject, const std::string &aVolumeName, float aIsoValue) {
+	for (auto [mode, permutation] : {
+			std::pair{ "raycast", OCTREE },
+			std::pair{ "raycast_distance_field", DISTANCE_FIELD },
+			std::pair{ "raycast_no_skipping", 0u },
+			std::pair{ "samples", OCTREE | ISOSURFACE_SAMPLE_COUNT },
+			std::pair{ "samples_distance_field", DISTANCE_FIELD | ISOSURFACE_SAMPLE_COUNT },
+			std::pair{ "samples_no_skipping", ISOSURFACE_SAMPLE_COUNT } })
+	{
+		aObject.addMaterial(
+			mode,
+			MaterialParameters(
+				"isosurface",
+				RenderStyle::Solid,
+				{
+					{ "u_volumeData", TextureInfo(aVolumeName) },
+					{ "u_brickData", TextureInfo(aVolumeName + cBrickTextureSuffix) },
+					{ "u_distanceData", TextureInfo(aVolumeName + cDistanceTextureSuffix) },
+					{ "u_isoValue", aIsoValue },
+					{ "stepSize", 0.005f },
+				},
+				false,
+				permutation
+				)
+			);
+	}
+}
+
 
 inline SimpleScene createSphereScene(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) {
 	SimpleScene scene;
@@ -52,7 +147,12 @@ inline SimpleScene createSphereScene(MaterialFactory &aMaterialFactory, Geometry
 	return scene;
 }
 
-inline SimpleScene createAnimationScene(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) {
+/**
+ * "solid" blends the two slices cached by OGLMaterialFactory::createVolumeSliceCache(), which returned aSliceCount,
+ * "solid_full_volume" samples the 3D texture.
+ */
+inline SimpleScene createAnimationScene(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory, int aSliceCount) {
+	const std::string volumeName = "intestine.dump";
 	SimpleScene scene;
 	{
 		auto plane = std::make_shared<Plane>();
@@ -66,9 +166,23 @@ inline SimpleScene createAnimationScene(MaterialFactory &aMaterialFactory, Geome
 				"animated_texture",
 				RenderStyle::Solid,
 				{
-					{ "u_volumeData", TextureInfo("intestine.dump") },
-					{ "u_intensityMultiplier", 30.0f },
-					{ "u_speed", 0.5f },
+					{ "u_evenSlice", TextureInfo(volumeName + cEvenSliceTextureSuffix) },
+					{ "u_oddSlice", TextureInfo(volumeName + cOddSliceTextureSuffix) },
+					{ "u_sliceCount", aSliceCount },
+					{ "u_speed", cAnimationSpeed },
+				},
+				false,
+				CACHED_SLICES
+				)
+			);
+		plane->addMaterial(
+			"solid_full_volume",
+			MaterialParameters(
+				"animated_texture",
+				RenderStyle::Solid,
+				{
+					{ "u_volumeData", TextureInfo(volumeName) },
+					{ "u_speed", cAnimationSpeed },
 				}
 				)
 			);
@@ -93,18 +207,32 @@ inline SimpleScene createMIPScene1(MaterialFactory &aMaterialFactory, GeometryFa
 
 		cube->setName("CUBE1");
 		cube->setScale(glm::vec3(1.0, 1.0f, 1.5f));
+		addMIPMaterials(*cube, "intestine.dump");
 		cube->addMaterial(
-			"raycast",
+			"wireframe",
 			MaterialParameters(
-				"mip",
-				RenderStyle::Solid,
+				"solid_color",
+				RenderStyle::Wireframe,
 				{
-					{ "u_volumeData", TextureInfo("intestine.dump") },
-					{ "u_intensityMultiplier", 30.0f },
-					{ "stepSize", 0.01f },
 				}
 				)
 			);
+		cube->prepareRenderData(aMaterialFactory, aGeometryFactory);
+		scene.addObject(cube);
+	}
+	return scene;
+}
+
+inline SimpleScene createMIPScene2(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) {
+	SimpleScene scene;
+	{
+		auto cube = std::make_shared<Cube>();
+
+		cube->setName("CUBE1");
+		cube->setScale(glm::vec3(1.0, 1.0f, 1.0f));
+		addMIPMaterials(*cube, "lebka1.dump");
+		// addMIPMaterials(*cube, "vertebra16.mhd");
+		// addMIPMaterials(*cube, "mrt16_angio2.mhd");
 		cube->addMaterial(
 			"wireframe",
 			MaterialParameters(
@@ -120,27 +248,37 @@ inline SimpleScene createMIPScene1(MaterialFactory &aMaterialFactory, GeometryFa
 	return scene;
 }
 
-inline SimpleScene createMIPScene2(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) {
+inline SimpleScene createIsosurfaceScene(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory, float aIsoValue) {
 	SimpleScene scene;
 	{
 		auto cube = std::make_shared<Cube>();
 
 		cube->setName("CUBE1");
 		cube->setScale(glm::vec3(1.0, 1.0f, 1.0f));
+		addIsosurfaceMaterials(*cube, "lebka1.dump", aIsoValue);
 		cube->addMaterial(
-			"raycast",
+			"wireframe",
 			MaterialParameters(
-				"mip",
-				RenderStyle::Solid,
+				"solid_color",
+				RenderStyle::Wireframe,
 				{
-					{ "u_volumeData", TextureInfo("lebka1.dump") },
-					// { "u_volumeData", TextureInfo("vertebra16.mhd") },
-					// { "u_volumeData", TextureInfo("mrt16_angio2.mhd") },
-					{ "u_intensityMultiplier", 20.0f },
-					{ "stepSize", 0.01f },
 				}
 				)
 			);
+		cube->prepareRenderData(aMaterialFactory, aGeometryFactory);
+		scene.addObject(cube);
+	}
+	return scene;
+}
+
+inline SimpleScene createPagedMIPScene(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory, const std::string &aVolumeName, glm::vec2 aIntensityWindow) {
+	SimpleScene scene;
+	{
+		auto cube = std::make_shared<Cube>();
+
+		cube->setName("CUBE1");
+		cube->setScale(glm::vec3(1.0, 1.0f, 1.0f));
+		addMIPMaterials(*cube, aVolumeName, aIntensityWindow, true);
 		cube->addMaterial(
 			"wireframe",
 			MaterialParameters(
@@ -155,4 +293,3 @@ inline SimpleScene createMIPScene2(MaterialFactory &aMaterialFactory, GeometryFa
 	}
 	return scene;
 }
-
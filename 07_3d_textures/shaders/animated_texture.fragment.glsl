@@ -2,18 +2,36 @@
 
 
 in vec2 f_texCoord; // Fragment position passed in from vertex shader
+#ifdef CACHED_SLICES_ENABLED
+// Two slices around the animated coordinate, uploaded by VolumeSliceCache - slice s lives in the texture of its parity
+uniform sampler2D u_evenSlice;
+uniform sampler2D u_oddSlice;
+uniform int u_sliceCount = 1;
+#else
 uniform sampler3D u_volumeData; // 3D texture containing the volume data
+#endif
 uniform float u_elapsedTime = 0.0;
 uniform float u_speed = 1.0;
-uniform float u_intensityMultiplier = 1.0;
+uniform vec2 u_intensityWindow = vec2(0.0, 1.0); // Sampled values mapped to black and white, identity for normalized volumes
 
 out vec4 out_fragColor; // Output fragment color
 
 void main() {
 	float time = u_speed * u_elapsedTime;
 	float newCoord = abs(time - int(time / 2.0) * 2 - 1.0);
+#ifdef CACHED_SLICES_ENABLED
+	// Linear filtering along z of the 3D texture, blending the lower and upper slice
+	float slice = newCoord * float(u_sliceCount) - 0.5;
+	float lowerSlice = floor(slice);
+	float even = texture(u_evenSlice, f_texCoord).r;
+	float odd = texture(u_oddSlice, f_texCoord).r;
+	bool lowerIsEven = mod(lowerSlice, 2.0) == 0.0;
+	float intensity = mix(lowerIsEven ? even : odd, lowerIsEven ? odd : even, slice - lowerSlice);
+#else
 	vec3 texCoords = vec3(f_texCoord, newCoord);
-	float intensity = texture(u_volumeData, texCoords).r;
-	// multiplied to get into visible range
-	out_fragColor = vec4(vec3(u_intensityMultiplier * intensity), 1.0);
+	// Level 0 - the mip levels keep the maximum for the MIP raycaster and would brighten minified slices
+	float intensity = textureLod(u_volumeData, texCoords, 0.0).r;
+#endif
+	intensity = clamp((intensity - u_intensityWindow.x) / (u_intensityWindow.y - u_intensityWindow.x), 0.0, 1.0);
+	out_fragColor = vec4(vec3(intensity), 1.0);
 }
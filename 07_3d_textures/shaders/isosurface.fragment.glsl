@@ -0,0 +1,156 @@
+#version 430 core
+
+
+in vec3 f_position; // Fragment position in world space
+uniform vec3 u_viewPos; // Camera position
+uniform sampler3D u_volumeData; // 3D texture containing the volume data
+uniform mat4 u_invModelMat; // Inverse model matrix
+uniform mat3 u_normalMat;
+uniform float u_isoValue = 0.1; // Rendered isosurface, in the sampled (normalized) units
+uniform vec3 u_surfaceColor = vec3(0.9, 0.8, 0.7);
+
+uniform float stepSize = 0.005; // Sampling step size along the ray
+const int cMaxSampleCount = 1000;
+const int cRefinementSteps = 6;
+
+#if defined(OCTREE_ENABLED) || defined(DISTANCE_FIELD_ENABLED)
+#define SPACE_SKIPPING 1
+uniform sampler3D u_brickData; // Min-max octree, mip level l holds the octree level l, see MinMaxOctree
+uniform int u_brickSize = 16; // Leaf brick edge in voxels
+#endif
+#ifdef DISTANCE_FIELD_ENABLED
+uniform sampler3D u_distanceData; // Brick distance to the nearest brick containing u_isoValue
+#endif
+
+out vec4 out_fragColor; // Output fragment color
+
+float computeExitDistance(vec3 point1, vec3 point2, vec3 entryPoint, vec3 rayDir) {
+	vec3 invDir = 1.0 / rayDir; // Inverse of the ray direction
+	vec3 tMin = (point1 - entryPoint) * invDir;
+	vec3 tMax = (point2 - entryPoint) * invDir;
+
+	// When ray direction component is negative, swap tMin and tMax for that component
+	vec3 t = max(tMin, tMax);
+
+	return min(min(t.x, t.y), t.z);
+}
+
+// We assume that we are mapping cube [-0.5, 0.5]
+vec3 positionToTexCoords(vec3 position) {
+	return position + vec3(0.5);
+}
+
+bool containsIsoValue(vec2 range) {
+	return range.x <= u_isoValue && u_isoValue <= range.y;
+}
+
+// The mip levels of the volume keep the maximum for the MIP raycaster, which would move the surface outwards.
+// The surface is always traced on level 0, the octree and distance field skipping keep distant volumes cheap.
+float sampleVolume(vec3 texCoords) {
+	return textureLod(u_volumeData, texCoords, 0.0).r;
+}
+
+vec3 computeGradient(vec3 texCoords) {
+	vec3 offset = 1.0 / vec3(textureSize(u_volumeData, 0));
+	return vec3(
+		sampleVolume(texCoords + vec3(offset.x, 0.0, 0.0)) - sampleVolume(texCoords - vec3(offset.x, 0.0, 0.0)),
+		sampleVolume(texCoords + vec3(0.0, offset.y, 0.0)) - sampleVolume(texCoords - vec3(0.0, offset.y, 0.0)),
+		sampleVolume(texCoords + vec3(0.0, 0.0, offset.z)) - sampleVolume(texCoords - vec3(0.0, 0.0, offset.z)));
+}
+
+void main() {
+	// Compute the ray direction in world space
+	vec3 rayDir = normalize(f_position - u_viewPos);
+	// Transform the ray direction into the model's local space
+	vec3 localRayDir = normalize((u_invModelMat * vec4(rayDir, 0.0)).xyz);
+
+	// Compute intersection points in the local coordinates
+	vec4 pos = u_invModelMat * vec4(f_position, 1.0);
+	vec3 entryPoint = pos.xyz / pos.w;
+	float distance = computeExitDistance(vec3(-0.5), vec3(0.5), entryPoint, localRayDir);
+	int stepCount = min(cMaxSampleCount, int(distance / stepSize));
+
+	vec3 volumeSize = vec3(textureSize(u_volumeData, 0));
+#ifdef SPACE_SKIPPING
+	ivec3 leafCount = ivec3(ceil(volumeSize / float(u_brickSize)));
+	int levelCount = textureQueryLevels(u_brickData);
+	float maxVolumeSize = max(max(volumeSize.x, volumeSize.y), volumeSize.z);
+#endif
+
+	// Side of the iso value the previous step lies on - skipped steps keep the side of the sample before them.
+	// Mirrors VolumeRaycaster::traceIsosurface(), so tools/isosurface_reference can check the skipping.
+	bool previousAbove = false;
+	bool hasPrevious = false;
+	bool hit = false;
+	float hitDistance = 0.0;
+	int sampleCount = 0;
+	int i = 0;
+	while (i < stepCount) {
+		float t = i * stepSize;
+		vec3 texCoords = positionToTexCoords(entryPoint + t * localRayDir);
+#ifdef SPACE_SKIPPING
+		ivec3 leaf = clamp(ivec3(texCoords * volumeSize) / u_brickSize, ivec3(0), leafCount - 1);
+		vec2 range = texelFetch(u_brickData, leaf, 0).rg;
+		bool rangeAbove = range.x > u_isoValue;
+		// An empty region on the other side of the iso value means a crossing right before it - sample it
+		if (!containsIsoValue(range) && (!hasPrevious || previousAbove == rangeAbove)) {
+			int level = 0;
+			float skipEnd = 0.0;
+#ifdef OCTREE_ENABLED
+			// Climb to the largest empty node
+			while (level + 1 < levelCount && !containsIsoValue(texelFetch(u_brickData, leaf >> (level + 1), level + 1).rg)) {
+				++level;
+			}
+#else
+			float brickDistance = texelFetch(u_distanceData, leaf, 0).r;
+			skipEnd = t + (brickDistance - 1.0) * float(u_brickSize) / maxVolumeSize;
+#endif
+			ivec3 node = leaf >> level;
+			int nodeSize = u_brickSize << level;
+			vec3 nodeStart = vec3(node * nodeSize) / volumeSize - vec3(0.5);
+			vec3 nodeEnd = vec3((node + 1) * nodeSize) / volumeSize - vec3(0.5);
+			float nodeExit = computeExitDistance(nodeStart, nodeEnd, entryPoint, localRayDir);
+			i = max(max(i + 1, int(floor(nodeExit / stepSize)) + 1), int(floor(skipEnd / stepSize)));
+			previousAbove = rangeAbove;
+			hasPrevious = true;
+			continue;
+		}
+#endif
+		float value = sampleVolume(texCoords);
+		++sampleCount;
+		bool above = value > u_isoValue;
+		if (hasPrevious && above != previousAbove) {
+			// The step before lies on the previous side, bisect the last step
+			float low = t - stepSize;
+			float high = t;
+			for (int step = 0; step < cRefinementSteps; ++step) {
+				float middle = 0.5 * (low + high);
+				++sampleCount;
+				if ((sampleVolume(positionToTexCoords(entryPoint + middle * localRayDir)) > u_isoValue) == previousAbove) {
+					low = middle;
+				} else {
+					high = middle;
+				}
+			}
+			hit = true;
+			hitDistance = 0.5 * (low + high);
+			break;
+		}
+		previousAbove = above;
+		hasPrevious = true;
+		++i;
+	}
+#ifdef SAMPLE_COUNT_ENABLED
+	// Heat map of the texture samples taken along the ray
+	out_fragColor = vec4(vec3(float(sampleCount) / float(cMaxSampleCount)) * vec3(4.0, 2.0, 1.0), 1.0);
+#else
+	if (!hit) {
+		discard;
+	}
+	vec3 hitPoint = entryPoint + hitDistance * localRayDir;
+	// Values fall off towards the outside of the surface
+	vec3 normal = normalize(u_normalMat * -computeGradient(positionToTexCoords(hitPoint)));
+	float diff = abs(dot(normal, rayDir));
+	out_fragColor = vec4((0.15 + 0.85 * diff) * u_surfaceColor, 1.0);
+#endif
+}
@@ -5,13 +5,31 @@ in vec3 f_position; // Fragment position passed in from vertex shader
 uniform vec3 u_viewPos; // Camera position
 uniform sampler3D u_volumeData; // 3D texture containing the volume data
 uniform mat4 u_invModelMat; // Inverse model matrix
-uniform float u_intensityMultiplier = 1.0;
+uniform vec2 u_intensityWindow = vec2(0.0, 1.0); // Sampled values mapped to black and white, identity for normalized volumes
 
 uniform float stepSize = 0.01; // Sampling step size along the ray
+uniform float u_lodBias = 0.0; // Added to the mip level picked from the voxel footprint, negative values sharpen. Unused with brick skipping
+const int cMaxSampleCount = 1000;
+
+#ifdef BRICK_SKIPPING_ENABLED
+uniform sampler3D u_brickData; // Per-brick (min, max) of the volume, see BrickGrid
+uniform int u_brickSize = 16; // Brick edge in voxels
+uniform float u_skipThreshold = 0.0; // Bricks with maximum below this value are treated as empty
+#endif
+
+#ifdef PAGED_ENABLED
+// u_volumeData is the brick atlas of a VolumeBrickCache, bricks are stored with a one voxel apron
+uniform usampler3D u_pageTable; // Atlas slot + 1 of each resident brick, 0 when not resident
+layout(std430, binding = 0) buffer BrickRequests {
+	ivec4 pagedVolumeSize; // Voxels in xyz, brick edge in w
+	uint requestedBricks[]; // Set for every brick a ray touches, read back by VolumeBrickCache::update()
+};
+const int cBrickApron = 1;
+#endif
 
 out vec4 out_fragColor; // Output fragment color
 
-vec3 computeExitPoint(vec3 point1, vec3 point2, vec3 entryPoint, vec3 rayDir) {
+float computeExitDistance(vec3 point1, vec3 point2, vec3 entryPoint, vec3 rayDir) {
 	vec3 invDir = 1.0 / rayDir; // Inverse of the ray direction
 	vec3 tMin = (point1 - entryPoint) * invDir;
 	vec3 tMax = (point2 - entryPoint) * invDir;
@@ -19,12 +37,12 @@ vec3 computeExitPoint(vec3 point1, vec3 point2, vec3 entryPoint, vec3 rayDir) {
 	// When ray direction component is negative, swap tMin and tMax for that component
 	vec3 t = max(tMin, tMax);
 
-	float tExit = min(min(t.x, t.y), t.z);
+	return min(min(t.x, t.y), t.z);
+}
 
+vec3 computeExitPoint(vec3 point1, vec3 point2, vec3 entryPoint, vec3 rayDir) {
 	// Compute the exit point using tExit
-	vec3 exitPoint = entryPoint + tExit * rayDir;
-
-	return exitPoint;
+	return entryPoint + computeExitDistance(point1, point2, entryPoint, rayDir) * rayDir;
 }
 
 // We assume that we are mapping cube [-0.5, 0.5]
@@ -32,6 +50,39 @@ vec3 positionToTexCoords(vec3 position) {
 	return position + vec3(0.5);
 }
 
+vec3 getVolumeSize() {
+#ifdef PAGED_ENABLED
+	return vec3(pagedVolumeSize.xyz);
+#else
+	return vec3(textureSize(u_volumeData, 0));
+#endif
+}
+
+// Angle of the cone one pixel covers along the ray. Derivatives are undefined inside
+// the non-uniform control flow of the ray march, so this is called at the start of main().
+float computePixelAngle(vec3 rayDir) {
+	return max(length(dFdx(rayDir)), length(dFdy(rayDir)));
+}
+
+// Mip level at which one voxel covers about one pixel, for samples cameraDistance away from the camera
+float computeLod(float pixelAngle, float cameraDistance, float maxVolumeSize) {
+	return max(0.0, log2(max(pixelAngle * cameraDistance * maxVolumeSize, 1e-6)) + u_lodBias);
+}
+
+#ifdef PAGED_ENABLED
+// Samples the resident brick through the page table, the caller checks the residency
+float samplePagedVolume(vec3 texCoords, ivec3 brick, uint page) {
+	int brickSize = pagedVolumeSize.w;
+	int slotEdge = brickSize + 2 * cBrickApron;
+	ivec3 atlasSize = textureSize(u_volumeData, 0);
+	ivec3 atlasSlots = atlasSize / slotEdge;
+	int slot = int(page) - 1;
+	ivec3 slotCoords = ivec3(slot % atlasSlots.x, (slot / atlasSlots.x) % atlasSlots.y, slot / (atlasSlots.x * atlasSlots.y));
+	vec3 brickPosition = texCoords * getVolumeSize() - vec3(brick * brickSize);
+	return texture(u_volumeData, (vec3(slotCoords * slotEdge + cBrickApron) + brickPosition) / vec3(atlasSize)).r;
+}
+#endif
+
 void main() {
 	// Initialize maximum intensity to a low value
 	float maxIntensity = 0.0;
@@ -40,6 +91,7 @@ void main() {
 	vec3 rayDir = normalize(f_position - u_viewPos);
 	// Transform the ray direction into the model's local space
 	vec3 localRayDir = normalize((u_invModelMat * vec4(rayDir, 0.0)).xyz);
+	float pixelAngle = computePixelAngle(localRayDir);
 
 	// Compute intersection points in the local coordinates
 	vec4 pos = u_invModelMat * vec4(f_position, 1.0);
@@ -48,14 +100,73 @@ void main() {
 
 	// How many steps will fit into the line between entry and exit
 	float distance = length(entryPoint - exitPoint);
-	int stepCount = min(1000, int(distance/stepSize));
+	int stepCount = min(cMaxSampleCount, int(distance/stepSize));
 
-	for (int i = 0; i < stepCount; ++i) {
-		vec3 sampleCoords = entryPoint + (i * 0.01 * localRayDir);
+	vec3 volumeSize = getVolumeSize();
+	// Far rays read the coarse levels of the max pyramid, so the cost follows the screen coverage instead of the voxel count
+	vec4 viewPos = u_invModelMat * vec4(u_viewPos, 1.0);
+	float cameraDistance = length(entryPoint - viewPos.xyz / viewPos.w);
+	float maxVolumeSize = max(max(volumeSize.x, volumeSize.y), volumeSize.z);
+#ifdef BRICK_SKIPPING_ENABLED
+	ivec3 brickCount = textureSize(u_brickData, 0);
+#endif
+#ifdef PAGED_ENABLED
+	ivec3 pageCount = textureSize(u_pageTable, 0);
+	int lastRequest = -1;
+#endif
+	int sampleCount = 0;
+	int i = 0;
+	while (i < stepCount) {
+		vec3 sampleCoords = entryPoint + (i * stepSize * localRayDir);
 		vec3 texCoords = positionToTexCoords(sampleCoords);
-	 	float intensity = texture(u_volumeData, texCoords).r;
+#ifdef BRICK_SKIPPING_ENABLED
+		// The brick cannot raise the maximum - jump to the first step behind it
+		ivec3 brick = clamp(ivec3(texCoords * volumeSize) / u_brickSize, ivec3(0), brickCount - 1);
+		float brickMax = texelFetch(u_brickData, brick, 0).g;
+		if (brickMax <= max(maxIntensity, u_skipThreshold)) {
+			vec3 brickStart = vec3(brick * u_brickSize) / volumeSize - vec3(0.5);
+			vec3 brickEnd = vec3((brick + 1) * u_brickSize) / volumeSize - vec3(0.5);
+			float brickExit = computeExitDistance(brickStart, brickEnd, entryPoint, localRayDir);
+			i = max(i + 1, int(floor(brickExit / stepSize)) + 1);
+			continue;
+		}
+#endif
+#ifdef PAGED_ENABLED
+		ivec3 page = clamp(ivec3(texCoords * volumeSize) / pagedVolumeSize.w, ivec3(0), pageCount - 1);
+		int pageIndex = (page.z * pageCount.y + page.y) * pageCount.x + page.x;
+		if (pageIndex != lastRequest) {
+			requestedBricks[pageIndex] = 1u;
+			lastRequest = pageIndex;
+		}
+		uint slot = texelFetch(u_pageTable, page, 0).r;
+		if (slot == 0u) {
+			// Not streamed in yet - the requested brick shows up in one of the next frames
+			vec3 pageStart = vec3(page * pagedVolumeSize.w) / volumeSize - vec3(0.5);
+			vec3 pageEnd = vec3((page + 1) * pagedVolumeSize.w) / volumeSize - vec3(0.5);
+			float pageExit = computeExitDistance(pageStart, pageEnd, entryPoint, localRayDir);
+			i = max(i + 1, int(floor(pageExit / stepSize)) + 1);
+			continue;
+		}
+		float intensity = samplePagedVolume(texCoords, page, slot);
+#else
+#ifdef BRICK_SKIPPING_ENABLED
+		// The brick maxima are those of level 0 - a coarser sample may exceed them, so skipping would change the image
+		float lod = 0.0;
+#else
+		float lod = computeLod(pixelAngle, cameraDistance + i * stepSize, maxVolumeSize);
+#endif
+		float intensity = textureLod(u_volumeData, texCoords, lod).r;
+#endif
 		maxIntensity = max(maxIntensity, intensity);
+		++sampleCount;
+		++i;
 	}
-	// Set the fragment color to the maximum intensity found, encoded as grayscale, multiplied to get into visible range
-	out_fragColor = vec4(vec3(u_intensityMultiplier * maxIntensity), 1.0);
+#ifdef SAMPLE_COUNT_ENABLED
+	// Heat map of the texture samples taken along the ray
+	out_fragColor = vec4(vec3(float(sampleCount) / float(cMaxSampleCount)) * vec3(4.0, 2.0, 1.0), 1.0);
+#else
+	// Set the fragment color to the maximum intensity found, encoded as grayscale after windowing
+	float windowed = clamp((maxIntensity - u_intensityWindow.x) / (u_intensityWindow.y - u_intensityWindow.x), 0.0, 1.0);
+	out_fragColor = vec4(vec3(windowed), 1.0);
+#endif
 }
@@ -97,11 +97,13 @@ int main() {
 		materialFactory.loadTexturesFromDir("./data/textures/");
 
 		OGLGeometryFactory geometryFactory;
+		MaterialTable materialTable({ "u_diffuseTexture" });
 
 
 		std::array<SimpleScene, 1> scenes {
-			createIslandScene(materialFactory, geometryFactory),
+			createIslandScene(materialFactory, geometryFactory, materialTable),
 		};
+		materialTable.upload();
 
 		Renderer renderer(materialFactory);
 		window.onResize([&camera, &window, &renderer](int width, int height) {
@@ -116,6 +118,7 @@ int main() {
 			// renderer.shadowMapPass(scenes[config.currentSceneIdx], camera);
 
 			renderer.clear();
+			materialTable.bind();
 			renderer.geometryPass(scenes[config.currentSceneIdx], camera, light, RenderOptions{"solid"});
 			renderer.compositingPass(light);
 		});
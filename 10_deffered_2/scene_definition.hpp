@@ -11,6 +11,10 @@
 #include "material_factory.hpp"
 #include "geometry_factory.hpp"
 #include "simple_scene.hpp"
+#include "material_table.hpp"
+
+// Permutations of the material_deffered program
+constexpr unsigned int MATERIAL_TABLE = 1;
 
 
 std::vector<glm::vec3> generatePalmPositions() {
@@ -46,14 +50,22 @@ std::vector<glm::vec3> generatePalmPositions() {
 }
 
 
-inline SimpleScene createIslandScene(MaterialFactory& aMaterialFactory, GeometryFactory& aGeometryFactory) {
+inline SimpleScene createIslandScene(MaterialFactory& aMaterialFactory, GeometryFactory& aGeometryFactory, MaterialTable& aMaterialTable) {
 	SimpleScene scene;
+	// Palette textured objects read the texture from the material table, so drawing them does not rebind textures
+	int palleteMaterialId = aMaterialTable.addMaterial(
+			aMaterialFactory,
+			{
+				{ "u_diffuseTexture", TextureInfo("island/pallete.png") },
+			});
 	auto palleteMaterial = MaterialParameters(
 			"material_deffered",
 			RenderStyle::Solid,
 			{
-				{ "u_diffuseTexture", TextureInfo("island/pallete.png") },
-			}
+				{ "u_materialId", palleteMaterialId },
+			},
+			false,
+			MATERIAL_TABLE
 			);
 	{
 		auto island = std::make_shared<LoadedMeshObject>("./data/geometry/island/island.obj");
@@ -1,6 +1,11 @@
 #version 430 core
 
+#ifdef MATERIAL_TABLE_ENABLED
+#include "material_table"
+uniform int u_materialId = 0;
+#else
 layout(binding = 0) uniform sampler2D u_diffuseTexture;
+#endif
 layout(binding = 1) uniform sampler2D u_shadowMap;
 /* layout(binding = 1) uniform sampler2D u_specularTexture; */
 /* layout(binding = 2) uniform sampler2D u_normalTexture; */
@@ -40,7 +45,11 @@ vec2 poissonDisk[16] = vec2[](
 );
 
 void main() {
+#ifdef MATERIAL_TABLE_ENABLED
+	out_color = sampleMaterialTexture(u_materialId, 0, texCoords);
+#else
 	out_color = texture(u_diffuseTexture, texCoords);
+#endif
 	out_normal = normalize(normal);
 	out_position = position.xyz/position.w;
 
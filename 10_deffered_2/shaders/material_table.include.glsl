@@ -0,0 +1,26 @@
+// Material data packed by MaterialTable (utils/material_table.hpp)
+struct MaterialRecord {
+	vec4 color;
+	// x: texture array index (-1 if the slot is empty), y: layer
+	ivec4 textures[4];
+};
+
+layout(std430, binding = 0) readonly buffer MaterialTable {
+	MaterialRecord materials[];
+};
+
+layout(binding = 8) uniform sampler2DArray u_materialTextures[4];
+
+vec4 sampleMaterialTexture(int materialId, int slot, vec2 uv) {
+	ivec4 ref = materials[materialId].textures[slot];
+	// Since GLSL 4.00 sampler arrays take dynamically uniform indices, but the texture array index comes from the
+	// per-pixel material and differs between neighbouring invocations of a deferred pass - branch to constant indices.
+	// Layers of the same texture array, in turn, can be selected per pixel, which is why materials share arrays.
+	switch (ref.x) {
+	case 0: return texture(u_materialTextures[0], vec3(uv, ref.y));
+	case 1: return texture(u_materialTextures[1], vec3(uv, ref.y));
+	case 2: return texture(u_materialTextures[2], vec3(uv, ref.y));
+	case 3: return texture(u_materialTextures[3], vec3(uv, ref.y));
+	}
+	return materials[materialId].color;
+}
@@ -7,38 +7,247 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <functional>
+#include <chrono>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <cstdio>
 #include <stb/stb_image.h>
 #include <stb/stb_image_write.h>
 #include <filesystem>
 
-// Function to save a buffer to a PNG file with a zero-padded index
-inline void save_png(const std::filesystem::path& directory, const std::vector<cl_uchar>& buffer, int width, int height, int channels, int iteration) {
-	if (!std::filesystem::exists(directory)) {
-		std::filesystem::create_directories(directory);
+inline std::string to_lower(std::string text) {
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	return text;
+}
+
+// Formats of the saved frames. PNG is compressed by stb_image_write, the others are cheap enough for bulk frame dumps
+// to be bound by the disk instead of the encoder:
+// - Pgm: binary PGM for 1 channel, PPM for 3 and PAM for others, the header and the pixels as they are
+// - Raw: only the pixels, rows of width * channels bytes
+// - Qoi: the lossless QOI format, runs and small differences of neighbouring pixels, grayscale as RGB
+enum class FrameFormat { Png, Pgm, Raw, Qoi };
+
+struct FrameSettings {
+	FrameFormat format = FrameFormat::Png;
+	// zlib level of the PNG encoder, 0 to 9, lower is faster
+	int pngCompression = 8;
+	// -1 tries all PNG filters on every row, 0 to 4 forces one, 0 (none) is the fastest
+	int pngFilter = -1;
+};
+
+// Frame settings from the FRAME_FORMAT (png, pgm, raw or qoi), PNG_COMPRESSION and PNG_FILTER environment variables
+inline FrameSettings frame_settings_from_environment() {
+	FrameSettings settings;
+	if (const char* format = std::getenv("FRAME_FORMAT")) {
+		std::string name = to_lower(format);
+		if (name == "png") {
+			settings.format = FrameFormat::Png;
+		} else if (name == "pgm") {
+			settings.format = FrameFormat::Pgm;
+		} else if (name == "raw") {
+			settings.format = FrameFormat::Raw;
+		} else if (name == "qoi") {
+			settings.format = FrameFormat::Qoi;
+		} else {
+			throw std::runtime_error("Unknown FRAME_FORMAT \"" + name + "\", expected png, pgm, raw or qoi");
+		}
+	}
+	if (const char* compression = std::getenv("PNG_COMPRESSION")) {
+		settings.pngCompression = std::clamp(std::atoi(compression), 0, 9);
+	}
+	if (const char* filter = std::getenv("PNG_FILTER")) {
+		settings.pngFilter = std::clamp(std::atoi(filter), -1, 4);
 	}
-	// std::vector<cl_uchar> tmp(buffer.size());
-	// std::transform(buffer.begin(), buffer.end(), tmp.begin(), [](const auto &val) { return val * 255; });
-	std::ostringstream filename;
-	filename << "output_" << std::setw(3) << std::setfill('0') << iteration << ".png";
-	stbi_write_png((directory / filename.str()).c_str(), width, height, channels, buffer.data(), width);
+	return settings;
 }
 
-// Function to load a grayscale image from a file
-inline std::vector<cl_uchar> load_grayscale_image(const std::filesystem::path& filepath, int& width, int& height) {
-	int channels;
-	stbi_uc* data = stbi_load(filepath.string().c_str(), &width, &height, &channels, STBI_grey);
-	if (!data) {
-		throw std::runtime_error("Failed to load image: " + filepath.string());
+// stb_image_write keeps the PNG settings in globals, they must be set before frames are written on other threads
+inline void apply_png_settings(const FrameSettings& settings) {
+	stbi_write_png_compression_level = settings.pngCompression;
+	stbi_write_force_png_filter = settings.pngFilter;
+}
+
+inline const char* frame_extension(FrameFormat format) {
+	switch (format) {
+	case FrameFormat::Pgm: return ".pgm";
+	case FrameFormat::Raw: return ".raw";
+	case FrameFormat::Qoi: return ".qoi";
+	default: return ".png";
+	}
+}
+
+// Path of the frame file of an iteration, the index is zero-padded
+inline std::filesystem::path frame_path(const std::filesystem::path& directory, int iteration, FrameFormat format = FrameFormat::Png) {
+	char filename[32];
+	std::snprintf(filename, sizeof(filename), "output_%03d%s", iteration, frame_extension(format));
+	return directory / filename;
+}
+
+// QOI encoding of the pixels, 1 and 3 channels as RGB, 2 and 4 as RGBA
+inline std::vector<uint8_t> encode_qoi(const unsigned char* pixels, int width, int height, int channels) {
+	struct Pixel {
+		uint8_t r, g, b, a;
+		bool operator==(const Pixel& other) const {
+			return r == other.r && g == other.g && b == other.b && a == other.a;
+		}
+	};
+	int qoiChannels = channels == 2 || channels == 4 ? 4 : 3;
+	size_t pixelCount = size_t(width) * height;
+	// Header, at most one tag byte more than the channels per pixel and the end marker
+	std::vector<uint8_t> bytes(14 + pixelCount * (qoiChannels + 1) + 8);
+	uint8_t* out = bytes.data();
+	auto put32 = [&](uint32_t value) {
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			*out++ = uint8_t(value >> shift);
+		}
+	};
+	*out++ = 'q';
+	*out++ = 'o';
+	*out++ = 'i';
+	*out++ = 'f';
+	put32(uint32_t(width));
+	put32(uint32_t(height));
+	*out++ = uint8_t(qoiChannels);
+	// sRGB with linear alpha
+	*out++ = 0;
+
+	Pixel index[64] = {};
+	Pixel previous = { 0, 0, 0, 255 };
+	int run = 0;
+	for (size_t i = 0; i < pixelCount; ++i) {
+		const unsigned char* source = pixels + i * channels;
+		Pixel pixel;
+		pixel.r = source[0];
+		pixel.g = channels >= 3 ? source[1] : source[0];
+		pixel.b = channels >= 3 ? source[2] : source[0];
+		pixel.a = channels == 2 ? source[1] : channels == 4 ? source[3] : 255;
+
+		if (pixel == previous) {
+			// QOI_OP_RUN
+			if (++run == 62 || i + 1 == pixelCount) {
+				*out++ = uint8_t(0xc0 | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0) {
+			*out++ = uint8_t(0xc0 | (run - 1));
+			run = 0;
+		}
+		int hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+		if (index[hash] == pixel) {
+			// QOI_OP_INDEX
+			*out++ = uint8_t(hash);
+		} else if (pixel.a == previous.a) {
+			index[hash] = pixel;
+			int dr = int8_t(pixel.r - previous.r);
+			int dg = int8_t(pixel.g - previous.g);
+			int db = int8_t(pixel.b - previous.b);
+			int drDg = dr - dg;
+			int dbDg = db - dg;
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+				// QOI_OP_DIFF
+				*out++ = uint8_t(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+			} else if (dg >= -32 && dg <= 31 && drDg >= -8 && drDg <= 7 && dbDg >= -8 && dbDg <= 7) {
+				// QOI_OP_LUMA
+				*out++ = uint8_t(0x80 | (dg + 32));
+				*out++ = uint8_t((drDg + 8) << 4 | (dbDg + 8));
+			} else {
+				// QOI_OP_RGB
+				*out++ = 0xfe;
+				*out++ = pixel.r;
+				*out++ = pixel.g;
+				*out++ = pixel.b;
+			}
+		} else {
+			index[hash] = pixel;
+			// QOI_OP_RGBA
+			*out++ = 0xff;
+			*out++ = pixel.r;
+			*out++ = pixel.g;
+			*out++ = pixel.b;
+			*out++ = pixel.a;
+		}
+		previous = pixel;
 	}
-	if (channels != 1) {
-		stbi_image_free(data);
-		throw std::runtime_error("Not a grayscale image: " + filepath.string());
+	for (int i = 0; i < 7; ++i) {
+		*out++ = 0;
 	}
-	std::vector<cl_uchar> buffer(data, data + width * height);
-	stbi_image_free(data);
-	return buffer;
+	*out++ = 1;
+	bytes.resize(out - bytes.data());
+	return bytes;
 }
 
+// Writes the pixels in the format, returns false when the file could not be written.
+// The PNG settings must have been applied with apply_png_settings().
+inline bool write_frame(const std::filesystem::path& path, FrameFormat format, const unsigned char* pixels, int width, int height, int channels) {
+	size_t pixelBytes = size_t(width) * height * channels;
+	if (format == FrameFormat::Png) {
+		return stbi_write_png(path.string().c_str(), width, height, channels, pixels, width * channels) != 0;
+	}
+	std::ofstream file(path, std::ios::binary);
+	if (format == FrameFormat::Qoi) {
+		std::vector<uint8_t> bytes = encode_qoi(pixels, width, height, channels);
+		file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+		return bool(file);
+	}
+	if (format == FrameFormat::Pgm) {
+		char header[96];
+		int length = channels == 1 || channels == 3
+			? std::snprintf(header, sizeof(header), "P%d\n%d %d\n255\n", channels == 1 ? 5 : 6, width, height)
+			: std::snprintf(header, sizeof(header), "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nENDHDR\n", width, height, channels);
+		file.write(header, length);
+	}
+	file.write(reinterpret_cast<const char*>(pixels), std::streamsize(pixelBytes));
+	return bool(file);
+}
+
+// Saves the pixels as the frame file of an iteration, PNG unless the settings choose another format
+inline void save_frame(const std::filesystem::path& directory, const std::vector<uint8_t>& buffer, int width, int height, int channels, int iteration,
+	const FrameSettings& settings = FrameSettings())
+{
+	std::filesystem::create_directories(directory);
+	apply_png_settings(settings);
+	std::filesystem::path path = frame_path(directory, iteration, settings.format);
+	if (!write_frame(path, settings.format, buffer.data(), width, height, channels)) {
+		throw std::runtime_error("Failed to write " + path.string());
+	}
+}
+
+// Pixels decoded by stb_image, handed over without a copy and freed with stbi_image_free
+struct GrayscaleImage {
+	std::unique_ptr<uint8_t, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+	int width = 0;
+	int height = 0;
+
+	uint8_t* data() const {
+		return pixels.get();
+	}
+
+	size_t size() const {
+		return size_t(width) * height;
+	}
+};
+
+// Loads an image as 8 bit grayscale, stb_image converts color images while decoding
+inline GrayscaleImage load_grayscale_image(const std::filesystem::path& filepath) {
+	GrayscaleImage image;
+	int channels;
+	image.pixels.reset(stbi_load(filepath.string().c_str(), &image.width, &image.height, &channels, STBI_grey));
+	if (!image.pixels) {
+		throw std::runtime_error("Failed to load image: " + filepath.string() + " (" + stbi_failure_reason() + ")");
+	}
+	return image;
+}
+
+// The rest needs the OpenCL headers, builds without OpenCL use only the image I/O above with the CPU stencil engine
+#ifdef HAVE_OPENCL
 
 // Function to load an OpenCL kernel source code from a text file
 inline std::string load_kernel(const std::filesystem::path& filepath) {
@@ -80,3 +289,269 @@ inline void printAvailablePlatformsAndDevices(std::vector<cl::Platform> &platfor
 		}
 	}
 }
+
+// Device named by selector - a device type (gpu, cpu, accelerator) or a part of the device or platform name, case
+// insensitive. "cpu" or "pocl" run on the portable CPU runtime where no GPU is available. The default device if empty.
+inline cl::Device select_device(const std::vector<cl::Platform>& platforms, const std::string& selector) {
+	if (selector.empty()) {
+		return cl::Device::getDefault();
+	}
+	std::string lowerSelector = to_lower(selector);
+	cl_device_type type = lowerSelector == "gpu" ? CL_DEVICE_TYPE_GPU :
+		lowerSelector == "cpu" ? CL_DEVICE_TYPE_CPU :
+		lowerSelector == "accelerator" ? CL_DEVICE_TYPE_ACCELERATOR :
+		0;
+	for (const auto& platform : platforms) {
+		std::vector<cl::Device> devices;
+		platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+		std::string platformName = to_lower(platform.getInfo<CL_PLATFORM_NAME>());
+		for (const auto& device : devices) {
+			bool matches = type != 0 ? (device.getInfo<CL_DEVICE_TYPE>() & type) != 0 :
+				to_lower(device.getInfo<CL_DEVICE_NAME>()).find(lowerSelector) != std::string::npos || platformName.find(lowerSelector) != std::string::npos;
+			if (matches) {
+				return device;
+			}
+		}
+	}
+	throw std::runtime_error("No OpenCL device matches \"" + selector + "\"");
+}
+
+// 64-bit FNV-1a hash of the text, chained over several texts by passing the previous hash
+inline uint64_t hash_text(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+	for (unsigned char c : text) {
+		hash = (hash ^ c) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// Launch statistics of a kernel from the profiling events, in milliseconds between CL_PROFILING_COMMAND_START and END
+struct KernelProfile {
+	std::string name;
+	int launches = 0;
+	double totalMs = 0.0;
+	double minMs = std::numeric_limits<double>::max();
+	double maxMs = 0.0;
+};
+
+// OpenCL setup shared by the demos:
+// - the device comes from the OPENCL_DEVICE environment variable, see select_device()
+// - programs are loaded from binaries cached in OPENCL_CACHE_DIR ("kernel_cache" by default, empty disables the cache),
+//   keyed by the hash of the source and the build options and by the device and driver
+// - the queue has profiling enabled, the launches of enqueue_kernel() are summed up per kernel by print_profile()
+class ClRuntime {
+public:
+	ClRuntime() {
+		std::vector<cl::Platform> platforms;
+		cl::Platform::get(&platforms);
+		if (platforms.empty()) {
+			throw std::runtime_error("No OpenCL platforms found");
+		}
+		printAvailablePlatformsAndDevices(platforms);
+
+		const char* selector = std::getenv("OPENCL_DEVICE");
+		device = select_device(platforms, selector != nullptr ? selector : "");
+		context = cl::Context({ device });
+		queue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+		const char* cacheDirectory = std::getenv("OPENCL_CACHE_DIR");
+		cacheDir = cacheDirectory != nullptr ? cacheDirectory : "kernel_cache";
+		std::cout << "Using " << device.getInfo<CL_DEVICE_NAME>() << " (" << device.getInfo<CL_DEVICE_VERSION>() << ", driver " << device.getInfo<CL_DRIVER_VERSION>() << ")\n";
+	}
+
+	// Program of the kernel source file built for the device, from the binary cache when the source, options and driver did not change
+	cl::Program build_program(const std::filesystem::path& sourcePath, const std::string& options = "") {
+		std::string source = load_kernel(sourcePath);
+		uint64_t key = hash_text(source);
+		for (const auto& part : { options, device.getInfo<CL_DEVICE_NAME>(), device.getInfo<CL_DEVICE_VERSION>(), device.getInfo<CL_DRIVER_VERSION>() }) {
+			key = hash_text(part, key);
+		}
+		std::ostringstream binaryName;
+		binaryName << sourcePath.stem().string() << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+		std::filesystem::path binaryPath = cacheDir.empty() ? std::filesystem::path() : cacheDir / binaryName.str();
+
+		if (!binaryPath.empty() && std::filesystem::exists(binaryPath)) {
+			std::ifstream file(binaryPath, std::ios::binary);
+			std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			cl_int error = CL_SUCCESS;
+			cl::Program program(context, { device }, { { binary.data(), binary.size() } }, nullptr, &error);
+			// A stale or foreign binary is rebuilt from the source
+			if (error == CL_SUCCESS && program.build({ device }, options.c_str()) == CL_SUCCESS) {
+				std::cout << "Loaded " << sourcePath.string() << " from " << binaryPath.string() << "\n";
+				return program;
+			}
+		}
+
+		cl::Program program(context, source);
+		if (program.build({ device }, options.c_str()) != CL_SUCCESS) {
+			throw std::runtime_error("Failed to build " + sourcePath.string() + ":\n" + program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
+		}
+		if (!binaryPath.empty()) {
+			save_binary(program, binaryPath);
+		}
+		return program;
+	}
+
+	// Enqueues the kernel on the queue and records its event for the profile
+	void enqueue_kernel(const cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local = cl::NullRange) {
+		cl::Event event;
+		cl_int error = queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, nullptr, &event);
+		if (error != CL_SUCCESS) {
+			throw std::runtime_error("Failed to enqueue a kernel: " + std::to_string(error));
+		}
+		launches.emplace_back(kernel.getInfo<CL_KERNEL_FUNCTION_NAME>(), event);
+		// Long runs keep only the events still in flight, completed ones are folded into the profiles
+		if (launches.size() >= maxPendingLaunches) {
+			fold_launches(false);
+		}
+	}
+
+	// Statistics of the recorded launches per kernel, waits for the queue
+	std::vector<KernelProfile> get_profile() {
+		queue.finish();
+		fold_launches(true);
+		std::vector<KernelProfile> result;
+		for (auto& entry : profiles) {
+			result.push_back(entry.second);
+		}
+		std::sort(result.begin(), result.end(), [](const KernelProfile& a, const KernelProfile& b) { return a.totalMs > b.totalMs; });
+		return result;
+	}
+
+	// Table of the kernels by their total device time
+	void print_profile(std::ostream& stream = std::cout) {
+		auto profiles = get_profile();
+		stream << std::left << std::setw(28) << "Kernel" << std::right << std::setw(10) << "Launches"
+			<< std::setw(12) << "Total ms" << std::setw(12) << "Mean ms" << std::setw(12) << "Min ms" << std::setw(12) << "Max ms" << "\n";
+		stream << std::fixed << std::setprecision(3);
+		for (const auto& profile : profiles) {
+			stream << std::left << std::setw(28) << profile.name << std::right << std::setw(10) << profile.launches
+				<< std::setw(12) << profile.totalMs << std::setw(12) << profile.totalMs / profile.launches
+				<< std::setw(12) << profile.minMs << std::setw(12) << profile.maxMs << "\n";
+		}
+		stream << std::defaultfloat;
+	}
+
+	cl::Device device;
+	cl::Context context;
+	cl::CommandQueue queue;
+
+private:
+	static constexpr size_t maxPendingLaunches = 1024;
+
+	// Adds the completed launches to the profiles and drops their events. The queue is in order, so the completed
+	// launches come first. Unless all launches are complete, waits for the older half of the pending launches, which
+	// bounds the events kept when the host runs far ahead of the device.
+	void fold_launches(bool allComplete) {
+		size_t completed = 0;
+		for (auto& [name, event] : launches) {
+			if (!allComplete && event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE) {
+				if (completed >= launches.size() / 2) {
+					break;
+				}
+				event.wait();
+			}
+			double ms = (event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>()) * 1e-6;
+			KernelProfile& profile = profiles[name];
+			profile.name = name;
+			++profile.launches;
+			profile.totalMs += ms;
+			profile.minMs = std::min(profile.minMs, ms);
+			profile.maxMs = std::max(profile.maxMs, ms);
+			++completed;
+		}
+		launches.erase(launches.begin(), launches.begin() + completed);
+	}
+
+	// Writes through a temporary file, concurrent runs never read a partial binary
+	void save_binary(const cl::Program& program, const std::filesystem::path& binaryPath) {
+		size_t binarySize = 0;
+		if (clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, nullptr) != CL_SUCCESS || binarySize == 0) {
+			return;
+		}
+		std::vector<unsigned char> binary(binarySize);
+		unsigned char* binaryData = binary.data();
+		if (clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(binaryData), &binaryData, nullptr) != CL_SUCCESS) {
+			return;
+		}
+		std::filesystem::create_directories(binaryPath.parent_path());
+		std::filesystem::path temporaryPath = binaryPath;
+		temporaryPath += ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+		}
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, binaryPath, error);
+		if (!error) {
+			std::cout << "Cached the binary of the program in " << binaryPath.string() << "\n";
+		}
+	}
+
+	std::filesystem::path cacheDir;
+	// Launches not yet folded into profiles
+	std::vector<std::pair<std::string, cl::Event>> launches;
+	std::map<std::string, KernelProfile> profiles;
+};
+
+// Work-group size of the tiled stencil kernels, one work-item per cell of the tile
+struct TileSize {
+	int x;
+	int y;
+};
+
+inline size_t round_up(size_t value, size_t multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+// Global range of a tiled kernel, rounded up to whole tiles - the kernels skip the cells outside of the grid
+inline cl::NDRange tiled_global_range(int width, int height, const TileSize& tile) {
+	return cl::NDRange(round_up(width, tile.x), round_up(height, tile.y));
+}
+
+// Local memory of the (tile + halo) block of cellBytes values
+inline size_t tile_local_bytes(const TileSize& tile, int halo, size_t cellBytes) {
+	return size_t(tile.x + 2 * halo) * (tile.y + 2 * halo) * cellBytes;
+}
+
+// Tile sizes the kernel can run with on the device - within its work-group size limit and the local memory,
+// and not larger than the grid
+inline std::vector<TileSize> get_tile_candidates(const cl::Kernel& kernel, const cl::Device& device, int halo, size_t cellBytes, int width, int height) {
+	static const TileSize candidates[] = { {8, 8}, {16, 4}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {32, 16}, {64, 4}, {64, 8}, {128, 2} };
+	size_t maxWorkItems = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	cl_ulong localBytes = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+	std::vector<TileSize> result;
+	for (const auto& tile : candidates) {
+		if (size_t(tile.x) * tile.y <= maxWorkItems && tile_local_bytes(tile, halo, cellBytes) <= localBytes && tile.x <= width && tile.y <= height) {
+			result.push_back(tile);
+		}
+	}
+	if (result.empty()) {
+		throw std::runtime_error("No tile size fits the device");
+	}
+	return result;
+}
+
+// The candidate with the fastest launches, launch(tile) enqueues one launch of the kernel.
+// Each candidate is warmed up once and then timed over several launches.
+inline TileSize autotune_tile_size(cl::CommandQueue& queue, const std::vector<TileSize>& candidates, const std::function<void(const TileSize&)>& launch, int launches = 5) {
+	using Clock = std::chrono::steady_clock;
+	TileSize best = candidates.front();
+	double bestTime = std::numeric_limits<double>::max();
+	for (const auto& tile : candidates) {
+		launch(tile);
+		queue.finish();
+		auto start = Clock::now();
+		for (int i = 0; i < launches; ++i) {
+			launch(tile);
+		}
+		queue.finish();
+		double time = std::chrono::duration<double>(Clock::now() - start).count();
+		if (time < bestTime) {
+			bestTime = time;
+			best = tile;
+		}
+	}
+	std::cout << "Autotuned tile size " << best.x << "x" << best.y << ": " << bestTime / launches * 1000.0 << " ms per launch\n";
+	return best;
+}
+
+#endif
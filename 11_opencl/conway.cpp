@@ -1,13 +1,25 @@
+#ifdef HAVE_OPENCL
 #include <CL/cl.hpp>
 //#include <CL/opencl.hpp>
+#endif
 #include <vector>
 #include <iostream>
 #include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <random>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 
 #include "cl_utils.hpp"
+#include "packed_life.hpp"
+#include "hashlife.hpp"
+#include "cpu_stencil.hpp"
+#ifdef HAVE_OPENCL
+#include "frame_pipeline.hpp"
+#include "strip_stencil.hpp"
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -17,28 +29,322 @@
 const int width = 256;
 const int height = 256;
 const int iterations = 100;
+// Default of --steps, generations per launch of game_of_life_temporal
+const int steps_per_launch = 1;
 
-int main() {
+// Defaults of --benchmark
+const int benchmark_size = 65536;
+const int benchmark_generations = 10;
+
+// Grid size and default of --scaling
+const int scaling_size = 4096;
+const int scaling_generations = 100;
+
+// Grid size and default of --cpu-benchmark
+const int cpu_benchmark_size = 4096;
+const int cpu_benchmark_generations = 100;
+
+// Defaults of --hashlife and the size limit of its images
+const int hashlife_step_log2 = 16;
+const int hashlife_steps = 8;
+const int hashlife_image_size = 1024;
+// Gosper glider gun, the default pattern of --hashlife
+const char* const glider_gun_rle = "x = 36, y = 9, rule = B3/S23\n"
+	"24bo$22bobo$12b2o6b2o12b2o$11bo3bo4b2o12b2o$2o8bo5bo3b2o$2o8bo3bob2o4bobo$10bo5bo7bo$11bo3bo$12b2o!";
+
+using Clock = std::chrono::steady_clock;
+
+#ifdef HAVE_OPENCL
+// Launches a (current, next, int, int) stencil kernel for the generations and swaps the buffers in between,
+// the last generation ends up in current. Returns the seconds until the queue finished.
+double run_generations(cl::CommandQueue& queue, cl::Kernel& kernel, cl::Buffer& current, cl::Buffer& next, int arg2, int arg3, const cl::NDRange& global, int generations) {
+	kernel.setArg(2, arg2);
+	kernel.setArg(3, arg3);
+	auto start = Clock::now();
+	for (int i = 0; i < generations; ++i) {
+		kernel.setArg(0, current);
+		kernel.setArg(1, next);
+		queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, cl::NullRange);
+		std::swap(current, next);
+	}
+	queue.finish();
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Runs game_of_life_packed from the initial words, the first launch compiles the kernel on the device and is not timed
+std::vector<uint64_t> run_packed(cl::Context& context, cl::CommandQueue& queue, cl::Kernel& kernel, const std::vector<uint64_t>& initial, int wordsPerRow, int height, int generations, double& seconds) {
+	size_t bytes = initial.size() * sizeof(uint64_t);
+	cl::Buffer current(context, CL_MEM_READ_WRITE, bytes);
+	cl::Buffer next(context, CL_MEM_READ_WRITE, bytes);
+	cl::NDRange global(wordsPerRow, height);
+	run_generations(queue, kernel, current, next, wordsPerRow, height, global, 1);
+	queue.enqueueWriteBuffer(current, CL_TRUE, 0, bytes, initial.data());
+	seconds = run_generations(queue, kernel, current, next, wordsPerRow, height, global, generations);
+	std::vector<uint64_t> result(initial.size());
+	queue.enqueueReadBuffer(current, CL_TRUE, 0, bytes, result.data());
+	return result;
+}
+
+// Largest grid edge up to size whose byte buffers the device can allocate, game_of_life indexes with int
+int get_byte_grid_size(const cl::Device& device, int size) {
+	cl_ulong maxAllocation = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+	int byteSize = std::min(size, 32768);
+	while (byteSize > cells_per_word && cl_ulong(byteSize) * byteSize > maxAllocation) {
+		byteSize = std::max(cells_per_word, byteSize / 2 / cells_per_word * cells_per_word);
+	}
+	return byteSize;
+}
+
+// Reports the cell updates per second of game_of_life, game_of_life_packed and the CPU reference step_packed().
+// Both kernels must agree on the byte grid, the packed kernel must match the CPU on the full grid.
+bool run_benchmark(cl::Context& context, const cl::Device& device, cl::Program& program, cl::CommandQueue& queue, int size, int generations) {
+	if (size % cells_per_word != 0) {
+		throw std::runtime_error("Benchmark grid size must be a multiple of 64");
+	}
+	std::mt19937_64 gen(42);
+	std::cout << "Benchmarking " << generations << " generations on " << device.getInfo<CL_DEVICE_NAME>() << "\n";
+
+	// The byte grid is smaller when its buffers do not fit the device
+	int byteSize = get_byte_grid_size(device, size);
+	std::vector<cl_uchar> cells(size_t(byteSize) * byteSize);
+	for (auto& cell : cells) {
+		cell = cl_uchar(gen() & 1);
+	}
+	cl::Kernel byteKernel(program, "game_of_life");
+	cl::Buffer byteCurrent(context, CL_MEM_READ_WRITE, cells.size());
+	cl::Buffer byteNext(context, CL_MEM_READ_WRITE, cells.size());
+	cl::NDRange byteGlobal(byteSize, byteSize);
+	run_generations(queue, byteKernel, byteCurrent, byteNext, byteSize, byteSize, byteGlobal, 1);
+	queue.enqueueWriteBuffer(byteCurrent, CL_TRUE, 0, cells.size(), cells.data());
+	double byteTime = run_generations(queue, byteKernel, byteCurrent, byteNext, byteSize, byteSize, byteGlobal, generations);
+	std::vector<cl_uchar> byteResult(cells.size());
+	queue.enqueueReadBuffer(byteCurrent, CL_TRUE, 0, byteResult.size(), byteResult.data());
+
+	cl::Kernel packedKernel(program, "game_of_life_packed");
+	double packedCheckTime = 0.0;
+	auto packedCheck = run_packed(context, queue, packedKernel, pack_cells(cells, byteSize, byteSize), byteSize / cells_per_word, byteSize, generations, packedCheckTime);
+	bool kernelsMatch = packedCheck == pack_cells(byteResult, byteSize, byteSize);
+
+	int wordsPerRow = size / cells_per_word;
+	std::vector<uint64_t> words(size_t(wordsPerRow) * size);
+	for (auto& word : words) {
+		word = gen();
+	}
+	double packedTime = 0.0;
+	auto packedResult = run_packed(context, queue, packedKernel, words, wordsPerRow, size, generations, packedTime);
+
+	std::vector<uint64_t> next(words.size());
+	auto cpuStart = Clock::now();
+	for (int i = 0; i < generations; ++i) {
+		step_packed(words, next, wordsPerRow, size);
+		std::swap(words, next);
+	}
+	double cpuTime = std::chrono::duration<double>(Clock::now() - cpuStart).count();
+	bool cpuMatches = packedResult == words;
+
+	double byteRate = double(byteSize) * byteSize * generations / byteTime;
+	double packedRate = double(size) * size * generations / packedTime;
+	double cpuRate = double(size) * size * generations / cpuTime;
+	std::cout << "game_of_life " << byteSize << "x" << byteSize << ": " << byteRate / 1e9 << " G cell updates/s\n"
+		<< "game_of_life_packed " << size << "x" << size << ": " << packedRate / 1e9 << " G cell updates/s (" << packedRate / byteRate << "x)\n"
+		<< "CPU SIMD reference " << size << "x" << size << ": " << cpuRate / 1e9 << " G cell updates/s\n"
+		<< "Packed kernel matches the byte kernel: " << (kernelsMatch ? "yes" : "NO") << "\n"
+		<< "Packed kernel matches the CPU reference: " << (cpuMatches ? "yes" : "NO") << "\n";
+	return kernelsMatch && cpuMatches;
+}
+
+// Splits a random grid into strips over 1 to N sub-devices, see get_strip_devices(). Every device count must reproduce
+// game_of_life on the single device.
+bool run_scaling(cl::Context& context, const cl::Device& device, cl::Program& program, cl::CommandQueue& queue, int generations) {
+	std::mt19937 gen(42);
+	std::vector<cl_uchar> cells(size_t(scaling_size) * scaling_size);
+	for (auto& cell : cells) {
+		cell = cl_uchar(gen() & 1);
+	}
+	cl::Kernel kernel(program, "game_of_life");
+	cl::Buffer current(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, cells.size(), cells.data());
+	cl::Buffer next(context, CL_MEM_READ_WRITE, cells.size());
+	run_generations(queue, kernel, current, next, scaling_size, scaling_size, cl::NDRange(scaling_size, scaling_size), generations);
+	std::vector<cl_uchar> expected(cells.size());
+	queue.enqueueReadBuffer(current, CL_TRUE, 0, expected.size(), expected.data());
+
+	return run_strip_scaling(get_strip_devices(device), load_kernel("kernels/conway.cl"), "game_of_life_strip", scaling_size, scaling_size, sizeof(cl_uchar), true,
+		cells.data(), expected.data(), generations, [](StripStencil&) {});
+}
+
+#endif
+
+// Advances the pattern by 2^stepLog2 generations per step on the CPU with Hashlife and saves the box of its living cells
+// after each step, zoomed out to fit hashlife_image_size pixels
+void run_hashlife(int stepLog2, int steps, const std::filesystem::path& patternPath, const FrameSettings& frameSettings) {
+	std::string pattern = glider_gun_rle;
+	if (!patternPath.empty()) {
+		std::ifstream file(patternPath);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open pattern file: " + patternPath.string());
+		}
+		pattern.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	Hashlife life;
+	life.set_cells(parse_rle(pattern));
+	// Zoomed out far beyond the root the pattern is a part of one pixel, rendering must light it from a viewport
+	// starting before the root
+	if (life.population() > 0) {
+		std::vector<uint8_t> overview = life.render(-(int64_t(1) << 40), -(int64_t(1) << 40), 2, 2, 40);
+		if (std::none_of(overview.begin(), overview.end(), [](uint8_t pixel) { return pixel > 0; })) {
+			throw std::runtime_error("Hashlife render lost the pattern at zoom 2^40");
+		}
+	}
+	std::cout << "Hashlife: " << life.population() << " cells, 2^" << stepLog2 << " generations per step\n";
+
+	for (int step = 1; step <= steps; ++step) {
+		auto start = Clock::now();
+		life.step(stepLog2);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		std::cout << "Generation " << life.generation() << ": " << life.population() << " cells, " << life.node_count() << " nodes, " << seconds * 1000.0 << " ms";
+		Hashlife::Bounds bounds = life.bounds();
+		if (bounds.empty()) {
+			std::cout << "\n";
+			continue;
+		}
+		int zoomLog2 = 0;
+		while (((bounds.maxX - bounds.minX) >> zoomLog2) >= hashlife_image_size || ((bounds.maxY - bounds.minY) >> zoomLog2) >= hashlife_image_size) {
+			++zoomLog2;
+		}
+		// One more pixel for the rounding of the corner to the zoom
+		int imageWidth = int((bounds.maxX - bounds.minX) >> zoomLog2) + 2;
+		int imageHeight = int((bounds.maxY - bounds.minY) >> zoomLog2) + 2;
+		std::cout << ", " << imageWidth << "x" << imageHeight << " pixels of 2^" << zoomLog2 << " cells\n";
+		save_frame("hashlife_out", life.render(bounds.minX, bounds.minY, imageWidth, imageHeight, zoomLog2), imageWidth, imageHeight, 1, step, frameSettings);
+	}
+}
+
+// Runs the demo on the CPU stencil engine without OpenCL, game_of_life on the same torus
+void run_cpu(const FrameSettings& frameSettings) {
+	std::vector<uint8_t> current(width * height);
+	std::vector<uint8_t> next(current.size());
+	std::random_device rd;
+	std::mt19937 gen(rd());
+	std::uniform_int_distribution<> dis(0, 1);
+	for (auto& cell : current) {
+		cell = uint8_t(dis(gen));
+	}
+	WorkStealingPool pool;
+	std::cout << "Running on the CPU with " << pool.size() << " threads\n";
+
+	std::vector<uint8_t> image(current.size());
+	auto save = [&](int generation) {
+		std::transform(current.begin(), current.end(), image.begin(), [](uint8_t cell) { return uint8_t(cell * 255); });
+		save_frame("conway_out", image, width, height, 1, generation, frameSettings);
+	};
+	auto start = Clock::now();
+	save(0);
+	for (int generation = 0; generation < iterations; ++generation) {
+		std::cout << "Creating generation " << generation << " ...\n";
+		run_stencil(LifeRule(), current.data(), next.data(), width, height, Boundary::Periodic, pool);
+		std::swap(current, next);
+		save(generation + 1);
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::cout << "Saved " << iterations + 1 << " frames in " << seconds << " s (" << (iterations + 1) / seconds << " frames/s)\n";
+}
+
+#ifdef HAVE_OPENCL
+// Compares the cell updates per second of game_of_life with the CPU stencil engine on the same random grid,
+// both must end with the same cells
+bool run_cpu_benchmark(cl::Context& context, const cl::Device& device, cl::Program& program, cl::CommandQueue& queue, int generations) {
+	std::mt19937 gen(42);
+	std::vector<cl_uchar> cells(size_t(cpu_benchmark_size) * cpu_benchmark_size);
+	for (auto& cell : cells) {
+		cell = cl_uchar(gen() & 1);
+	}
+	double updates = double(cells.size()) * generations;
+	std::cout << "Benchmarking " << generations << " generations on " << cpu_benchmark_size << "x" << cpu_benchmark_size << " cells\n";
+
+	// The first launch compiles the kernel on the device and is not timed
+	cl::Kernel kernel(program, "game_of_life");
+	cl::Buffer current(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, cells.size(), cells.data());
+	cl::Buffer next(context, CL_MEM_READ_WRITE, cells.size());
+	cl::NDRange global(cpu_benchmark_size, cpu_benchmark_size);
+	run_generations(queue, kernel, current, next, cpu_benchmark_size, cpu_benchmark_size, global, 1);
+	queue.enqueueWriteBuffer(current, CL_TRUE, 0, cells.size(), cells.data());
+	double deviceSeconds = run_generations(queue, kernel, current, next, cpu_benchmark_size, cpu_benchmark_size, global, generations);
+	std::vector<cl_uchar> expected(cells.size());
+	queue.enqueueReadBuffer(current, CL_TRUE, 0, expected.size(), expected.data());
+
+	WorkStealingPool pool;
+	std::vector<uint8_t> cpuCurrent(cells.begin(), cells.end());
+	std::vector<uint8_t> cpuNext(cells.size());
+	auto start = Clock::now();
+	for (int i = 0; i < generations; ++i) {
+		run_stencil(LifeRule(), cpuCurrent.data(), cpuNext.data(), cpu_benchmark_size, cpu_benchmark_size, Boundary::Periodic, pool);
+		std::swap(cpuCurrent, cpuNext);
+	}
+	double cpuSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	bool matches = std::equal(cpuCurrent.begin(), cpuCurrent.end(), expected.begin());
+
+	std::cout << "OpenCL game_of_life on " << device.getInfo<CL_DEVICE_NAME>() << ": " << updates / deviceSeconds / 1e9 << " G cell updates/s\n"
+		<< "CPU stencil engine on " << pool.size() << " threads: " << updates / cpuSeconds / 1e9 << " G cell updates/s ("
+		<< deviceSeconds / cpuSeconds << "x the OpenCL rate)\n"
+		<< "CPU stencil engine matches game_of_life: " << (matches ? "yes" : "NO") << "\n";
+	return matches;
+}
+#endif
+
+// Usage: 11_conway [--steps <generations>] | [--benchmark [<grid size> [<generations>]]] | [--scaling [<generations>]]
+//	| [--hashlife [<log2 generations per step> [<steps> [<pattern.rle>]]]] | [--cpu] | [--cpu-benchmark [<generations>]]
+//	--steps		generations advanced per launch and between the saved frames, 1 by default
+//	--benchmark	compares the byte and the bit-packed kernel instead of writing the frames, 65536 and 10 by default
+//	--scaling	splits a 4096x4096 grid into strips over 1 to N sub-devices of the device, 100 generations by default
+//	--hashlife	runs the pattern on the CPU with Hashlife, the Gosper glider gun for 8 steps of 2^16 generations by default
+//	--cpu		writes the frames with the CPU stencil engine, also the fallback without an OpenCL platform
+//	--cpu-benchmark	compares game_of_life with the CPU stencil engine on a 4096x4096 grid, 100 generations by default
+// Built without OpenCL (HAVE_OPENCL undefined) only --hashlife and --cpu are available, the frames run on the CPU by default.
+int main(int argc, char** argv) {
 	try {
+		FrameSettings frameSettings = frame_settings_from_environment();
+		if (argc > 1 && std::strcmp(argv[1], "--hashlife") == 0) {
+			int stepLog2 = argc > 2 ? std::stoi(argv[2]) : hashlife_step_log2;
+			int steps = argc > 3 ? std::stoi(argv[3]) : hashlife_steps;
+			run_hashlife(stepLog2, steps, argc > 4 ? argv[4] : "", frameSettings);
+			return 0;
+		}
+#ifndef HAVE_OPENCL
+		if (argc > 1 && std::strcmp(argv[1], "--cpu") != 0) {
+			throw std::runtime_error(std::string(argv[1]) + " needs OpenCL, this build has only the CPU stencil engine");
+		}
+		run_cpu(frameSettings);
+#else
 		std::vector<cl::Platform> platforms;
 		cl::Platform::get(&platforms);
-		if (platforms.empty()) {
-			std::cout << "No OpenCL platforms found." << std::endl;
-			return 1;
+		if (platforms.empty() || (argc > 1 && std::strcmp(argv[1], "--cpu") == 0)) {
+			if (platforms.empty()) {
+				std::cout << "No OpenCL platforms found, falling back to the CPU\n";
+			}
+			run_cpu(frameSettings);
+			return 0;
 		}
-		printAvailablePlatformsAndDevices(platforms);
-
-		// Initialize OpenCL context, device, and command queue
-		cl::Platform platform = cl::Platform::getDefault();
-		cl::Device device = cl::Device::getDefault();
-		cl::Context context({ device });
 
-		std::filesystem::path kernelPath = "kernels/conway.cl";
-		std::string kernelSource = load_kernel(kernelPath);
+		// Device from OPENCL_DEVICE, program from the binary cache and a profiling queue
+		ClRuntime runtime;
+		cl::Program program = runtime.build_program("kernels/conway.cl");
+		cl::Device& device = runtime.device;
+		cl::Context& context = runtime.context;
+		cl::CommandQueue& queue = runtime.queue;
 
-		cl::Program program(context, kernelSource);
-		program.build({ device });
-		cl::CommandQueue queue(context, device);
+		if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+			int size = argc > 2 ? std::stoi(argv[2]) : benchmark_size;
+			int generations = argc > 3 ? std::stoi(argv[3]) : benchmark_generations;
+			return run_benchmark(context, device, program, queue, size, generations) ? 0 : 1;
+		}
+		if (argc > 1 && std::strcmp(argv[1], "--scaling") == 0) {
+			int generations = argc > 2 ? std::stoi(argv[2]) : scaling_generations;
+			return run_scaling(context, device, program, queue, generations) ? 0 : 1;
+		}
+		if (argc > 1 && std::strcmp(argv[1], "--cpu-benchmark") == 0) {
+			int generations = argc > 2 ? std::stoi(argv[2]) : cpu_benchmark_generations;
+			return run_cpu_benchmark(context, device, program, queue, generations) ? 0 : 1;
+		}
 
 		// Create random initial buffer
 		std::vector<cl_uchar> buffer(width * height);
@@ -55,45 +361,86 @@ int main() {
 		cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, buffer.size() * sizeof(cl_uchar));
 
 
+		// Generations per launch, the temporally blocked kernel keeps the intermediate ones in local memory
+		int stepsPerLaunch = argc > 2 && std::strcmp(argv[1], "--steps") == 0 ? std::max(1, std::stoi(argv[2])) : steps_per_launch;
+
 		// Set kernel arguments
-		cl::Kernel kernel(program, "game_of_life");
+		cl::Kernel kernel(program, "game_of_life_temporal");
 		kernel.setArg(0, currentBuffer);
 		kernel.setArg(1, nextBuffer);
 		kernel.setArg(2, width);
 		kernel.setArg(3, height);
+		kernel.setArg(4, stepsPerLaunch);
+
+		// Tile size with the fastest launches on this device, the candidates write only the next buffer.
+		// Two blocks of the tile with a halo of stepsPerLaunch cells are in local memory.
+		TileSize tile = autotune_tile_size(queue, get_tile_candidates(kernel, device, stepsPerLaunch, 2 * sizeof(cl_uchar), width, height), [&](const TileSize& candidate) {
+			kernel.setArg(5, cl::Local(tile_local_bytes(candidate, stepsPerLaunch, 2 * sizeof(cl_uchar))));
+			queue.enqueueNDRangeKernel(kernel, cl::NullRange, tiled_global_range(width, height, candidate), cl::NDRange(candidate.x, candidate.y));
+		});
+		kernel.setArg(5, cl::Local(tile_local_bytes(tile, stepsPerLaunch, 2 * sizeof(cl_uchar))));
+		cl::NDRange globalRange = tiled_global_range(width, height, tile);
+		cl::NDRange localRange(tile.x, tile.y);
+
+		// One launch must reproduce stepsPerLaunch generations of game_of_life bit for bit
+		{
+			cl::Kernel referenceKernel(program, "game_of_life");
+			cl::Buffer referenceCurrent(context, CL_MEM_READ_WRITE, buffer.size() * sizeof(cl_uchar));
+			cl::Buffer referenceNext(context, CL_MEM_READ_WRITE, buffer.size() * sizeof(cl_uchar));
+			queue.enqueueCopyBuffer(currentBuffer, referenceCurrent, 0, 0, buffer.size() * sizeof(cl_uchar));
+			run_generations(queue, referenceKernel, referenceCurrent, referenceNext, width, height, cl::NDRange(width, height), stepsPerLaunch);
+			queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalRange, localRange);
+			std::vector<cl_uchar> expected(buffer.size());
+			std::vector<cl_uchar> blocked(buffer.size());
+			queue.enqueueReadBuffer(referenceCurrent, CL_TRUE, 0, expected.size() * sizeof(cl_uchar), expected.data());
+			queue.enqueueReadBuffer(nextBuffer, CL_TRUE, 0, blocked.size() * sizeof(cl_uchar), blocked.data());
+			if (blocked != expected) {
+				throw std::runtime_error("game_of_life_temporal differs from game_of_life");
+			}
+			std::cout << "game_of_life_temporal matches " << stepsPerLaunch << " generations of game_of_life\n";
+		}
 
 		cl::Kernel scaleKernel(program, "scale_to_255");
 		scaleKernel.setArg(0, nextBuffer);
 		scaleKernel.setArg(1, outputBuffer);
 		scaleKernel.setArg(2, static_cast<int>(buffer.size()));
 
+		// The frames are read and encoded in the background while the next generations run
+		FramePipeline frames(context, queue, "conway_out", width, height, 1, frameSettings);
+		auto start = Clock::now();
+
 		// Get the initial state
 		queue.enqueueWriteBuffer(nextBuffer, CL_TRUE, 0, buffer.size() * sizeof(cl_uchar), buffer.data());
-		queue.enqueueNDRangeKernel(scaleKernel, cl::NullRange, cl::NDRange(buffer.size()), cl::NullRange);
-		queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, buffer.size() * sizeof(cl_uchar), buffer.data());
-		save_png("conway_out", buffer, width, height, 1, 0);
+		runtime.enqueue_kernel(scaleKernel, cl::NDRange(buffer.size()));
+		frames.enqueue(outputBuffer, 0);
+		int frameCount = 1;
 
-		for (int i = 0; i < iterations; ++i) {
-			std::cout << "Creating generation " << i << " ...\n";
+		for (int generation = 0; generation < iterations; generation += stepsPerLaunch) {
+			int steps = std::min(stepsPerLaunch, iterations - generation);
+			std::cout << "Creating generation " << generation + steps - 1 << " ...\n";
 			// Execute kernel
-			queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange);
-			// queue.finish();
+			kernel.setArg(4, steps);
+			runtime.enqueue_kernel(kernel, globalRange, localRange);
 
 			// Scale buffer values for black and white output
-			queue.enqueueNDRangeKernel(scaleKernel, cl::NullRange, cl::NDRange(buffer.size()), cl::NullRange);
-			// queue.finish();
-
-			// Read result
-			queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, buffer.size() * sizeof(cl_uchar), buffer.data());
+			runtime.enqueue_kernel(scaleKernel, cl::NDRange(buffer.size()));
 
-			// Save to PNG
-			save_png("conway_out", buffer, width, height, 1, i+1);
+			// Read the result and save it, the in-order queue runs the next scale only after the read
+			frames.enqueue(outputBuffer, generation + steps);
+			++frameCount;
 
 			// Swap buffers
 			std::swap(currentBuffer, nextBuffer);
 			kernel.setArg(0, currentBuffer);
 			kernel.setArg(1, nextBuffer);
+			scaleKernel.setArg(0, nextBuffer);
 		}
+		frames.finish();
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		std::cout << "Saved " << frameCount << " frames in " << seconds << " s (" << frameCount / seconds << " frames/s), encoding took "
+			<< frames.encode_seconds() << " s on " << frames.writer_count() << " writer threads\n";
+		runtime.print_profile();
+#endif
 	} catch (std::exception& e) {
 		std::cerr << "Error: " << e.what() << std::endl;
 	}
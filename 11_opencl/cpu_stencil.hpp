@@ -0,0 +1,305 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CPU_STENCIL_SSE2 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_STENCIL_AVX2 1
+#endif
+
+// CPU fallback of the stencil kernels without OpenCL: the update rules of game_of_life and diffusion_step on
+// cache-blocked tiles, vectorized with SSE2 (AVX2 when the compiler targets it) and run on a work-stealing thread pool.
+
+// Thread pool for parallel loops over many small tasks. The tasks of a loop are dealt out in contiguous blocks to
+// one queue per thread, a thread that runs out of work steals from the front of the other queues.
+class WorkStealingPool {
+public:
+	// threadCount 0 uses all hardware threads, the calling thread of parallel_for() is one of them
+	explicit WorkStealingPool(int threadCount = 0) {
+		if (threadCount <= 0) {
+			threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+		}
+		queues = std::vector<Queue>(threadCount);
+		for (int i = 1; i < threadCount; ++i) {
+			workers.emplace_back(&WorkStealingPool::work, this, i);
+		}
+	}
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		started.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	int size() const {
+		return int(queues.size());
+	}
+
+	// Runs task(i) for i in [0, count) and returns when all are done
+	void parallel_for(size_t count, const std::function<void(size_t)>& task) {
+		if (count == 0) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		currentTask = &task;
+		remaining = count;
+		for (size_t i = 0; i < queues.size(); ++i) {
+			std::lock_guard<std::mutex> queueLock(queues[i].mutex);
+			for (size_t index = count * i / queues.size(); index < count * (i + 1) / queues.size(); ++index) {
+				queues[i].tasks.push_back(index);
+			}
+		}
+		++generation;
+		lock.unlock();
+		started.notify_all();
+
+		run_tasks(0);
+		lock.lock();
+		finished.wait(lock, [&] { return remaining == 0; });
+		currentTask = nullptr;
+	}
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	void work(int index) {
+		uint64_t seenGeneration = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				started.wait(lock, [&] { return stopping || generation != seenGeneration; });
+				if (stopping) {
+					return;
+				}
+				seenGeneration = generation;
+			}
+			run_tasks(index);
+		}
+	}
+
+	// Own tasks from the back, stolen ones from the front
+	bool pop_task(int index, size_t& task) {
+		for (size_t i = 0; i < queues.size(); ++i) {
+			Queue& queue = queues[(index + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty()) {
+				if (i == 0) {
+					task = queue.tasks.back();
+					queue.tasks.pop_back();
+				} else {
+					task = queue.tasks.front();
+					queue.tasks.pop_front();
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run_tasks(int index) {
+		size_t task;
+		while (pop_task(index, task)) {
+			// Set before the tasks were queued and kept until all of them are done
+			(*currentTask)(task);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--remaining == 0) {
+				finished.notify_all();
+			}
+		}
+	}
+
+	std::vector<Queue> queues;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	const std::function<void(size_t)>* currentTask = nullptr;
+	size_t remaining = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+};
+
+// Handling of the neighbours outside of the grid
+enum class Boundary {
+	// Wrapped around, the torus of game_of_life
+	Periodic,
+	// The grid ends at its edges and the cells outside are missing - dead for Game of Life, left out of the mean of
+	// the neighbours like in diffusion_step
+	Clamped
+};
+
+// Rules update a run of count cells of a row. up, mid and down point to the first cell of the row above, the row and
+// the row below, cells -1 to count are valid and missing cells are 0. neighbours is the number of existing 4-neighbours,
+// the same for all cells of the run.
+
+// game_of_life on cells of 0 and 1
+struct LifeRule {
+	using Cell = uint8_t;
+
+	void apply_row(const Cell* up, const Cell* mid, const Cell* down, Cell* out, int count, int /*neighbours*/) const {
+		int x = 0;
+#ifdef CPU_STENCIL_AVX2
+		for (; x + 32 <= count; x += 32) {
+			auto load = [&](const Cell* row, int offset) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x + offset)); };
+			__m256i sum = _mm256_add_epi8(_mm256_add_epi8(_mm256_add_epi8(load(up, -1), load(up, 0)), _mm256_add_epi8(load(up, 1), load(mid, -1))),
+				_mm256_add_epi8(_mm256_add_epi8(load(mid, 1), load(down, -1)), _mm256_add_epi8(load(down, 0), load(down, 1))));
+			__m256i alive = _mm256_or_si256(_mm256_cmpeq_epi8(sum, _mm256_set1_epi8(3)),
+				_mm256_and_si256(_mm256_cmpeq_epi8(sum, _mm256_set1_epi8(2)), _mm256_cmpeq_epi8(load(mid, 0), _mm256_set1_epi8(1))));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_and_si256(alive, _mm256_set1_epi8(1)));
+		}
+#endif
+#ifdef CPU_STENCIL_SSE2
+		for (; x + 16 <= count; x += 16) {
+			auto load = [&](const Cell* row, int offset) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + offset)); };
+			__m128i sum = _mm_add_epi8(_mm_add_epi8(_mm_add_epi8(load(up, -1), load(up, 0)), _mm_add_epi8(load(up, 1), load(mid, -1))),
+				_mm_add_epi8(_mm_add_epi8(load(mid, 1), load(down, -1)), _mm_add_epi8(load(down, 0), load(down, 1))));
+			__m128i alive = _mm_or_si128(_mm_cmpeq_epi8(sum, _mm_set1_epi8(3)),
+				_mm_and_si128(_mm_cmpeq_epi8(sum, _mm_set1_epi8(2)), _mm_cmpeq_epi8(load(mid, 0), _mm_set1_epi8(1))));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_and_si128(alive, _mm_set1_epi8(1)));
+		}
+#endif
+		for (; x < count; ++x) {
+			int sum = up[x - 1] + up[x] + up[x + 1] + mid[x - 1] + mid[x + 1] + down[x - 1] + down[x] + down[x + 1];
+			out[x] = Cell(sum == 3 || (sum == 2 && mid[x]));
+		}
+	}
+};
+
+// diffusion_step - the additions in the same order, missing neighbours add 0
+struct DiffusionRule {
+	using Cell = float;
+	float delta;
+
+	void apply_row(const Cell* up, const Cell* mid, const Cell* down, Cell* out, int count, int neighbours) const {
+		int x = 0;
+		float divisor = float(neighbours);
+#ifdef CPU_STENCIL_AVX2
+		for (; x + 8 <= count; x += 8) {
+			__m256 center = _mm256_loadu_ps(mid + x);
+			__m256 sum = _mm256_add_ps(_mm256_setzero_ps(), _mm256_loadu_ps(mid + x - 1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(mid + x + 1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(up + x));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(down + x));
+			__m256 laplacian = _mm256_sub_ps(_mm256_div_ps(sum, _mm256_set1_ps(divisor)), center);
+			_mm256_storeu_ps(out + x, _mm256_add_ps(center, _mm256_mul_ps(_mm256_set1_ps(delta), laplacian)));
+		}
+#endif
+#ifdef CPU_STENCIL_SSE2
+		for (; x + 4 <= count; x += 4) {
+			__m128 center = _mm_loadu_ps(mid + x);
+			__m128 sum = _mm_add_ps(_mm_setzero_ps(), _mm_loadu_ps(mid + x - 1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(mid + x + 1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(up + x));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(down + x));
+			__m128 laplacian = _mm_sub_ps(_mm_div_ps(sum, _mm_set1_ps(divisor)), center);
+			_mm_storeu_ps(out + x, _mm_add_ps(center, _mm_mul_ps(_mm_set1_ps(delta), laplacian)));
+		}
+#endif
+		for (; x < count; ++x) {
+			float sum = 0.0f;
+			sum += mid[x - 1];
+			sum += mid[x + 1];
+			sum += up[x];
+			sum += down[x];
+			float laplacian = sum / divisor - mid[x];
+			out[x] = mid[x] + delta * laplacian;
+		}
+	}
+};
+
+// One step of the rule from current to next on a width x height grid, in tiles of tileWidth x tileHeight cells on the pool.
+// The interior columns of a tile row run vectorized, the cells of the first and last column one by one with their
+// neighbours resolved by the boundary.
+template<typename TRule>
+void run_stencil(const TRule& rule, const typename TRule::Cell* current, typename TRule::Cell* next, int width, int height, Boundary boundary,
+	WorkStealingPool& pool, int tileWidth = 1024, int tileHeight = 32)
+{
+	using Cell = typename TRule::Cell;
+	// Row of missing cells above the first and below the last row, readable from -1 to width
+	std::vector<Cell> missingRow(size_t(width) + 2, Cell(0));
+	const Cell* missing = missingRow.data() + 1;
+	int tilesX = (width + tileWidth - 1) / tileWidth;
+	int tilesY = (height + tileHeight - 1) / tileHeight;
+
+	pool.parallel_for(size_t(tilesX) * tilesY, [&](size_t tile) {
+		int x0 = int(tile % tilesX) * tileWidth;
+		int y0 = int(tile / tilesX) * tileHeight;
+		int x1 = std::min(x0 + tileWidth, width);
+		int y1 = std::min(y0 + tileHeight, height);
+		for (int y = y0; y < y1; ++y) {
+			const Cell* mid = current + size_t(y) * width;
+			const Cell* up = missing;
+			const Cell* down = missing;
+			int missingRows = 0;
+			if (y > 0 || boundary == Boundary::Periodic) {
+				up = current + size_t(y > 0 ? y - 1 : height - 1) * width;
+			} else {
+				++missingRows;
+			}
+			if (y < height - 1 || boundary == Boundary::Periodic) {
+				down = current + size_t(y < height - 1 ? y + 1 : 0) * width;
+			} else {
+				++missingRows;
+			}
+			Cell* out = next + size_t(y) * width;
+
+			int interiorBegin = std::max(x0, 1);
+			int interiorEnd = std::min(x1, width - 1);
+			if (interiorEnd > interiorBegin) {
+				rule.apply_row(up + interiorBegin, mid + interiorBegin, down + interiorBegin, out + interiorBegin, interiorEnd - interiorBegin, 4 - missingRows);
+			}
+
+			// First and last column with the horizontal neighbours copied next to the cell
+			for (int x : { 0, width - 1 }) {
+				if (x < x0 || x >= x1) {
+					continue;
+				}
+				Cell upCells[3];
+				Cell midCells[3];
+				Cell downCells[3];
+				int neighbours = 4 - missingRows;
+				for (int dx = -1; dx <= 1; ++dx) {
+					int nx = x + dx;
+					if (nx < 0 || nx >= width) {
+						if (boundary == Boundary::Clamped) {
+							upCells[dx + 1] = midCells[dx + 1] = downCells[dx + 1] = Cell(0);
+							--neighbours;
+							continue;
+						}
+						nx = (nx + width) % width;
+					}
+					upCells[dx + 1] = up[nx];
+					midCells[dx + 1] = mid[nx];
+					downCells[dx + 1] = down[nx];
+				}
+				rule.apply_row(upCells + 1, midCells + 1, downCells + 1, out + x, 1, neighbours);
+				if (width == 1) {
+					break;
+				}
+			}
+		}
+	});
+}
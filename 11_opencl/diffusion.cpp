@@ -1,10 +1,23 @@
+#ifdef HAVE_OPENCL
 #include <CL/cl.hpp>
 //#include <CL/opencl.hpp>
+#endif
 #include <vector>
 #include <iostream>
 #include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <limits>
 
 #include "cl_utils.hpp"
+#include "cpu_stencil.hpp"
+#ifdef HAVE_OPENCL
+#include "frame_pipeline.hpp"
+#include "multigrid.hpp"
+#include "strip_stencil.hpp"
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -13,35 +26,238 @@
 
 const int iterations = 500;
 const float delta = 0.2f;  // Diffusion strength
+const int save_interval = 50;
+// Default of --steps, iterations per launch of diffusion_step_temporal
+const int steps_per_launch = 10;
+// Default of --implicit, backward Euler steps over the diffusion time of the iterations
+const int implicit_steps = 10;
 
-int main() {
-	try {
-		std::vector<cl::Platform> platforms;
-		cl::Platform::get(&platforms);
-		if (platforms.empty()) {
-			std::cout << "No OpenCL platforms found." << std::endl;
-			return 1;
+#ifdef HAVE_OPENCL
+// Reaches the diffusion time of the explicit iterations with implicitSteps backward Euler steps and compares both paths -
+// the V-cycles of each step, the run times and the difference of the results. Returns false if a step did not converge.
+bool run_implicit_comparison(ClRuntime& runtime, const cl::Program& program, cl::Kernel& diffusionKernel, const cl::NDRange& globalRange, const cl::NDRange& localRange,
+	int stepsPerLaunch, const cl::Buffer& initial, int width, int height, int implicitSteps)
+{
+	using Clock = std::chrono::steady_clock;
+	const double tolerance = 1e-5;
+	size_t count = size_t(width) * height;
+	size_t bytes = count * sizeof(cl_float);
+	cl::Buffer current(runtime.context, CL_MEM_READ_WRITE, bytes);
+	cl::Buffer next(runtime.context, CL_MEM_READ_WRITE, bytes);
+
+	// Explicit iterations with the temporally blocked kernel
+	runtime.queue.enqueueCopyBuffer(initial, current, 0, 0, bytes);
+	runtime.queue.finish();
+	auto start = Clock::now();
+	for (int completed = 0; completed < iterations; completed += stepsPerLaunch) {
+		diffusionKernel.setArg(0, current);
+		diffusionKernel.setArg(1, next);
+		diffusionKernel.setArg(5, std::min(stepsPerLaunch, iterations - completed));
+		runtime.enqueue_kernel(diffusionKernel, globalRange, localRange);
+		std::swap(current, next);
+	}
+	runtime.queue.finish();
+	double explicitSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::vector<cl_float> explicitResult(count);
+	runtime.queue.enqueueReadBuffer(current, CL_TRUE, 0, bytes, explicitResult.data());
+
+	// Backward Euler steps, the time includes the residual readbacks of the convergence checks
+	MultigridSolver solver(runtime, program, width, height);
+	float tau = iterations * delta / implicitSteps;
+	runtime.queue.enqueueCopyBuffer(initial, current, 0, 0, bytes);
+	runtime.queue.finish();
+	start = Clock::now();
+	int totalCycles = 0;
+	bool converged = true;
+	for (int step = 0; step < implicitSteps; ++step) {
+		// The previous step is the initial guess
+		runtime.queue.enqueueCopyBuffer(current, next, 0, 0, bytes);
+		auto residuals = solver.solve(current, next, tau, tolerance);
+		totalCycles += int(residuals.size());
+		converged &= residuals.back() < tolerance;
+		std::cout << "Implicit step " << step << ": " << residuals.size() << " V-cycles, relative residual";
+		for (double residual : residuals) {
+			std::cout << " " << residual;
+		}
+		std::cout << "\n";
+		std::swap(current, next);
+	}
+	runtime.queue.finish();
+	double implicitSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::vector<cl_float> implicitResult(count);
+	runtime.queue.enqueueReadBuffer(current, CL_TRUE, 0, bytes, implicitResult.data());
+
+	double squares = 0.0;
+	double maxDifference = 0.0;
+	std::vector<cl_uchar> image(count);
+	for (size_t i = 0; i < count; ++i) {
+		double difference = double(implicitResult[i]) - explicitResult[i];
+		squares += difference * difference;
+		maxDifference = std::max(maxDifference, std::abs(difference));
+		image[i] = cl_uchar(std::clamp(implicitResult[i], 0.0f, 1.0f) * 255.0f);
+	}
+	save_frame("diffusion_implicit_out", image, width, height, 1, iterations);
+
+	std::cout << "Explicit: " << iterations << " iterations of delta " << delta << " in " << explicitSeconds * 1000.0 << " ms\n"
+		<< "Implicit: " << implicitSteps << " steps of tau " << tau << ", " << totalCycles << " V-cycles on " << solver.level_count() << " levels in "
+		<< implicitSeconds * 1000.0 << " ms (" << explicitSeconds / implicitSeconds << "x)\n"
+		<< "Difference to the explicit result: RMS " << std::sqrt(squares / count) << ", max " << maxDifference << "\n";
+	return converged;
+}
+
+// Splits the image into strips over 1 to N sub-devices, see get_strip_devices(). Every device count must reproduce
+// diffusion_step on the single device bit for bit.
+bool run_scaling(ClRuntime& runtime, const cl::Program& program, const cl::Buffer& initial, int width, int height, int scalingIterations) {
+	size_t bytes = size_t(width) * height * sizeof(cl_float);
+	std::vector<cl_float> cells(size_t(width) * height);
+	runtime.queue.enqueueReadBuffer(initial, CL_TRUE, 0, bytes, cells.data());
+	cl::Kernel kernel(program, "diffusion_step");
+	cl::Buffer current(runtime.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, cells.data());
+	cl::Buffer next(runtime.context, CL_MEM_READ_WRITE, bytes);
+	kernel.setArg(2, width);
+	kernel.setArg(3, height);
+	kernel.setArg(4, delta);
+	for (int i = 0; i < scalingIterations; ++i) {
+		kernel.setArg(0, current);
+		kernel.setArg(1, next);
+		runtime.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange);
+		std::swap(current, next);
+	}
+	std::vector<cl_float> expected(cells.size());
+	runtime.queue.enqueueReadBuffer(current, CL_TRUE, 0, bytes, expected.data());
+
+	return run_strip_scaling(get_strip_devices(runtime.device), load_kernel("kernels/diffusion.cl"), "diffusion_step_strip", width, height, sizeof(cl_float), false,
+		cells.data(), expected.data(), scalingIterations, [](StripStencil& stencil) { stencil.set_arg(6, delta); });
+}
+
+#endif
+
+// Runs the demo on the CPU stencil engine without OpenCL, diffusion_step with the same border cells
+void run_cpu(const std::filesystem::path& imagePath, const FrameSettings& frameSettings) {
+	GrayscaleImage input = load_grayscale_image(imagePath);
+	int width = input.width;
+	int height = input.height;
+	std::vector<float> current(input.size());
+	std::vector<float> next(input.size());
+	std::transform(input.data(), input.data() + input.size(), current.begin(), [](uint8_t value) { return value / 255.0f; });
+	std::vector<uint8_t> image(input.size());
+	WorkStealingPool pool;
+	std::cout << "Running on the CPU with " << pool.size() << " threads\n";
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		run_stencil(DiffusionRule{ delta }, current.data(), next.data(), width, height, Boundary::Clamped, pool);
+		std::swap(current, next);
+		if (i % save_interval == 0) {
+			std::cout << "Saving iteration " << i << " ...\n";
+			std::transform(current.begin(), current.end(), image.begin(), [](float value) { return uint8_t(value * 255.0f); });
+			save_frame("diffusion_out", image, width, height, 1, i, frameSettings);
 		}
-		printAvailablePlatformsAndDevices(platforms);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Ran " << iterations << " iterations in " << seconds << " s\n";
+}
 
-		// Initialize OpenCL context, device, and command queue
-		cl::Platform platform = cl::Platform::getDefault();
-		cl::Device device = cl::Device::getDefault();
-		cl::Context context({ device });
+#ifdef HAVE_OPENCL
+// Compares the cell updates per second of diffusion_step with the CPU stencil engine from the same image. Both add in
+// the same order without multiply-add contraction (on the host the default unless FMA is enabled), but OpenCL allows
+// 2.5 ulp for the single precision division. The averaging does not amplify differences, so the results may differ by
+// a few ulp of the [0, 1] values per iteration.
+bool run_cpu_benchmark(ClRuntime& runtime, const cl::Program& program, const cl::Buffer& initial, int width, int height, int benchmarkIterations) {
+	size_t bytes = size_t(width) * height * sizeof(cl_float);
+	std::vector<cl_float> cells(size_t(width) * height);
+	runtime.queue.enqueueReadBuffer(initial, CL_TRUE, 0, bytes, cells.data());
+	double updates = double(cells.size()) * benchmarkIterations;
+	std::cout << "Benchmarking " << benchmarkIterations << " iterations on " << width << "x" << height << " cells\n";
 
-		// Load kernel source from file
-		std::filesystem::path kernelPath = "kernels/diffusion.cl";
-		std::string kernelSource = load_kernel(kernelPath);
+	// The first launch compiles the kernel on the device and is not timed
+	cl::Kernel kernel(program, "diffusion_step");
+	cl::Buffer current(runtime.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, cells.data());
+	cl::Buffer next(runtime.context, CL_MEM_READ_WRITE, bytes);
+	kernel.setArg(2, width);
+	kernel.setArg(3, height);
+	kernel.setArg(4, delta);
+	kernel.setArg(0, current);
+	kernel.setArg(1, next);
+	runtime.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange);
+	runtime.queue.finish();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < benchmarkIterations; ++i) {
+		kernel.setArg(0, current);
+		kernel.setArg(1, next);
+		runtime.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange);
+		std::swap(current, next);
+	}
+	runtime.queue.finish();
+	double deviceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::vector<cl_float> expected(cells.size());
+	runtime.queue.enqueueReadBuffer(current, CL_TRUE, 0, bytes, expected.data());
 
-		cl::Program program(context, kernelSource);
-		program.build({ device });
-		cl::CommandQueue queue(context, device);
+	WorkStealingPool pool;
+	std::vector<float> cpuCurrent(cells.begin(), cells.end());
+	std::vector<float> cpuNext(cells.size());
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < benchmarkIterations; ++i) {
+		run_stencil(DiffusionRule{ delta }, cpuCurrent.data(), cpuNext.data(), width, height, Boundary::Clamped, pool);
+		std::swap(cpuCurrent, cpuNext);
+	}
+	double cpuSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < cells.size(); ++i) {
+		maxDifference = std::max(maxDifference, std::abs(cpuCurrent[i] - expected[i]));
+	}
+	float tolerance = benchmarkIterations * 4.0f * std::numeric_limits<float>::epsilon();
+	bool matches = maxDifference <= tolerance;
 
-		// Load initial buffer by loading a grayscale image
-		std::vector<cl_uchar> buffer;
-		int width, height;
+	std::cout << "OpenCL diffusion_step on " << runtime.device.getInfo<CL_DEVICE_NAME>() << ": " << updates / deviceSeconds / 1e9 << " G cell updates/s\n"
+		<< "CPU stencil engine on " << pool.size() << " threads: " << updates / cpuSeconds / 1e9 << " G cell updates/s ("
+		<< deviceSeconds / cpuSeconds << "x the OpenCL rate)\n"
+		<< "CPU stencil engine matches diffusion_step: " << (matches ? "yes" : "NO") << ", max difference " << maxDifference
+		<< " (tolerance " << tolerance << ")\n";
+	return matches;
+}
+#endif
+
+// Usage: 11_diffusion [--steps <iterations>] | [--implicit [<steps>]] | [--scaling [<iterations>]] | [--cpu]
+//	| [--cpu-benchmark [<iterations>]]
+//	--steps		iterations advanced per launch, launches also end at the saved iterations, 10 by default
+//	--implicit	compares the explicit iterations with backward Euler steps solved by multigrid instead of writing the frames,
+//			10 steps by default
+//	--scaling	splits the image into strips over 1 to N sub-devices of the device, 500 iterations by default
+//	--cpu		writes the frames with the CPU stencil engine, also the fallback without an OpenCL platform
+//	--cpu-benchmark	compares diffusion_step with the CPU stencil engine on the image, 500 iterations by default
+// Built without OpenCL (HAVE_OPENCL undefined) only --cpu is available, the frames run on the CPU by default.
+int main(int argc, char** argv) {
+	try {
 		std::filesystem::path imagePath = "images/input.png";
-		buffer = load_grayscale_image(imagePath, width, height);
+		FrameSettings frameSettings = frame_settings_from_environment();
+#ifndef HAVE_OPENCL
+		if (argc > 1 && std::strcmp(argv[1], "--cpu") != 0) {
+			throw std::runtime_error(std::string(argv[1]) + " needs OpenCL, this build has only the CPU stencil engine");
+		}
+		run_cpu(imagePath, frameSettings);
+#else
+		std::vector<cl::Platform> platforms;
+		cl::Platform::get(&platforms);
+		if (platforms.empty() || (argc > 1 && std::strcmp(argv[1], "--cpu") == 0)) {
+			if (platforms.empty()) {
+				std::cout << "No OpenCL platforms found, falling back to the CPU\n";
+			}
+			run_cpu(imagePath, frameSettings);
+			return 0;
+		}
+
+		// Device from OPENCL_DEVICE, program from the binary cache and a profiling queue
+		ClRuntime runtime;
+		cl::Program program = runtime.build_program("kernels/diffusion.cl");
+		cl::Device& device = runtime.device;
+		cl::Context& context = runtime.context;
+		cl::CommandQueue& queue = runtime.queue;
+
+		// Load initial buffer by loading a grayscale image, the pixels of stb_image are uploaded without a copy
+		GrayscaleImage buffer = load_grayscale_image(imagePath);
+		int width = buffer.width;
+		int height = buffer.height;
 
 
 		// Create OpenCL buffers
@@ -60,39 +276,112 @@ int main() {
 		floatToUcharKernel.setArg(1, ucharBuffer);
 		floatToUcharKernel.setArg(2, static_cast<int>(buffer.size()));
 
+		// Iterations per launch, the temporally blocked kernel keeps the intermediate ones in local memory
+		int stepsPerLaunch = argc > 2 && std::strcmp(argv[1], "--steps") == 0 ? std::max(1, std::stoi(argv[2])) : steps_per_launch;
+		int implicitSteps = 0;
+		if (argc > 1 && std::strcmp(argv[1], "--implicit") == 0) {
+			implicitSteps = argc > 2 ? std::max(1, std::stoi(argv[2])) : implicit_steps;
+		}
+
 		// Create diffusion kernel
-		cl::Kernel diffusionKernel(program, "diffusion_step");
+		cl::Kernel diffusionKernel(program, "diffusion_step_temporal");
 		diffusionKernel.setArg(0, floatBufferCurrent);
 		diffusionKernel.setArg(1, floatBufferNext);
 		diffusionKernel.setArg(2, width);
 		diffusionKernel.setArg(3, height);
 		diffusionKernel.setArg(4, delta);
+		diffusionKernel.setArg(5, stepsPerLaunch);
 
 		// Convert uchar to float
-		queue.enqueueNDRangeKernel(ucharToFloatKernel, cl::NullRange, cl::NDRange(buffer.size()), cl::NullRange);
+		runtime.enqueue_kernel(ucharToFloatKernel, cl::NDRange(buffer.size()));
 
+		if (argc > 1 && std::strcmp(argv[1], "--scaling") == 0) {
+			int scalingIterations = argc > 2 ? std::stoi(argv[2]) : iterations;
+			return run_scaling(runtime, program, floatBufferCurrent, width, height, scalingIterations) ? 0 : 1;
+		}
+		if (argc > 1 && std::strcmp(argv[1], "--cpu-benchmark") == 0) {
+			int benchmarkIterations = argc > 2 ? std::stoi(argv[2]) : iterations;
+			return run_cpu_benchmark(runtime, program, floatBufferCurrent, width, height, benchmarkIterations) ? 0 : 1;
+		}
+
+		// Tile size with the fastest launches on this device, the candidates write only the next buffer.
+		// Two blocks of the tile with a halo of stepsPerLaunch cells are in local memory.
+		TileSize tile = autotune_tile_size(queue, get_tile_candidates(diffusionKernel, device, stepsPerLaunch, 2 * sizeof(cl_float), width, height), [&](const TileSize& candidate) {
+			diffusionKernel.setArg(6, cl::Local(tile_local_bytes(candidate, stepsPerLaunch, 2 * sizeof(cl_float))));
+			queue.enqueueNDRangeKernel(diffusionKernel, cl::NullRange, tiled_global_range(width, height, candidate), cl::NDRange(candidate.x, candidate.y));
+		});
+		diffusionKernel.setArg(6, cl::Local(tile_local_bytes(tile, stepsPerLaunch, 2 * sizeof(cl_float))));
+		cl::NDRange globalRange = tiled_global_range(width, height, tile);
+		cl::NDRange localRange(tile.x, tile.y);
 
-		for (int i = 0; i < iterations; ++i) {
-			std::cout << "Running iteration " << i << " ...\n";
+		// One launch must reproduce stepsPerLaunch iterations of diffusion_step. The kernels are compiled
+		// without contraction and add in the same order, so the results are bit identical.
+		{
+			cl::Kernel referenceKernel(program, "diffusion_step");
+			cl::Buffer referenceCurrent(context, CL_MEM_READ_WRITE, buffer.size() * sizeof(cl_float));
+			cl::Buffer referenceNext(context, CL_MEM_READ_WRITE, buffer.size() * sizeof(cl_float));
+			queue.enqueueCopyBuffer(floatBufferCurrent, referenceCurrent, 0, 0, buffer.size() * sizeof(cl_float));
+			referenceKernel.setArg(2, width);
+			referenceKernel.setArg(3, height);
+			referenceKernel.setArg(4, delta);
+			for (int i = 0; i < stepsPerLaunch; ++i) {
+				referenceKernel.setArg(0, referenceCurrent);
+				referenceKernel.setArg(1, referenceNext);
+				queue.enqueueNDRangeKernel(referenceKernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange);
+				std::swap(referenceCurrent, referenceNext);
+			}
+			queue.enqueueNDRangeKernel(diffusionKernel, cl::NullRange, globalRange, localRange);
+			std::vector<cl_float> expected(buffer.size());
+			std::vector<cl_float> blocked(buffer.size());
+			queue.enqueueReadBuffer(referenceCurrent, CL_TRUE, 0, expected.size() * sizeof(cl_float), expected.data());
+			queue.enqueueReadBuffer(floatBufferNext, CL_TRUE, 0, blocked.size() * sizeof(cl_float), blocked.data());
+			if (blocked != expected) {
+				throw std::runtime_error("diffusion_step_temporal differs from diffusion_step");
+			}
+			std::cout << "diffusion_step_temporal matches " << stepsPerLaunch << " iterations of diffusion_step\n";
+		}
+
+		if (implicitSteps > 0) {
+			bool converged = run_implicit_comparison(runtime, program, diffusionKernel, globalRange, localRange, stepsPerLaunch, floatBufferCurrent, width, height, implicitSteps);
+			runtime.print_profile();
+			return converged ? 0 : 1;
+		}
+
+		// The frames are read and encoded in the background while the next iterations run
+		FramePipeline frames(context, queue, "diffusion_out", width, height, 1, frameSettings);
+		auto start = std::chrono::steady_clock::now();
+
+		// Iteration i is saved after its step, a launch never runs past the next saved iteration
+		int completed = 0;
+		while (completed < iterations) {
+			int nextSave = (completed + save_interval - 1) / save_interval * save_interval + 1;
+			int steps = std::min({ stepsPerLaunch, iterations - completed, nextSave - completed });
+			std::cout << "Running iterations " << completed << " to " << completed + steps - 1 << " ...\n";
 			// Execute diffusion kernel
-			queue.enqueueNDRangeKernel(diffusionKernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange);
+			diffusionKernel.setArg(5, steps);
+			runtime.enqueue_kernel(diffusionKernel, globalRange, localRange);
+			completed += steps;
 
 			// Swap buffers
 			std::swap(floatBufferCurrent, floatBufferNext);
 			diffusionKernel.setArg(0, floatBufferCurrent);
 			diffusionKernel.setArg(1, floatBufferNext);
 
-			if (i % 50 == 0) {
+			if ((completed - 1) % save_interval == 0) {
 				// Convert float to uchar
-				queue.enqueueNDRangeKernel(floatToUcharKernel, cl::NullRange, cl::NDRange(buffer.size()), cl::NullRange);
-
-				// Read result
-				queue.enqueueReadBuffer(ucharBuffer, CL_TRUE, 0, buffer.size() * sizeof(cl_uchar), buffer.data());
+				floatToUcharKernel.setArg(0, floatBufferCurrent);
+				runtime.enqueue_kernel(floatToUcharKernel, cl::NDRange(buffer.size()));
 
-				// Save to PNG
-				save_png("diffusion_out", buffer, width, height, 1, i);
+				// Read the result and save it, the in-order queue runs the next conversion only after the read
+				frames.enqueue(ucharBuffer, completed - 1);
 			}
 		}
+		frames.finish();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Ran " << iterations << " iterations in " << seconds << " s, encoding took "
+			<< frames.encode_seconds() << " s on " << frames.writer_count() << " writer threads\n";
+		runtime.print_profile();
+#endif
 	} catch (std::exception& e) {
 		std::cerr << "Error: " << e.what() << std::endl;
 	}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#include "cl_utils.hpp"
+
+// Saves frames of a device buffer as image files while the queue keeps running. Each frame is read without blocking into
+// one of several pinned host buffers (CL_MEM_ALLOC_HOST_PTR, mapped once), the completion callback of the read hands
+// the buffer to a pool of writer threads running write_frame(). Simulation, transfer and encoding overlap, the host
+// only waits when all buffers are still being read or encoded - the throughput is the one of the slowest stage.
+class FramePipeline {
+public:
+	// slotCount pinned frame buffers, writerCount 0 leaves one hardware thread to the host. The settings choose the
+	// format, see frame_settings_from_environment().
+	FramePipeline(const cl::Context& context, const cl::CommandQueue& queue, const std::filesystem::path& directory, int width, int height, int channels,
+		const FrameSettings& settings = FrameSettings(), int slotCount = 3, int writerCount = 0)
+		: queue(queue), directory(directory), width(width), height(height), channels(channels), frameBytes(size_t(width) * height * channels), format(settings.format)
+	{
+		std::filesystem::create_directories(directory);
+		apply_png_settings(settings);
+		for (int i = 0; i < std::max(1, slotCount); ++i) {
+			auto slot = std::make_unique<Slot>();
+			slot->pipeline = this;
+			slot->pinned = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, frameBytes);
+			cl_int error = CL_SUCCESS;
+			slot->host = static_cast<cl_uchar*>(this->queue.enqueueMapBuffer(slot->pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, frameBytes, nullptr, nullptr, &error));
+			if (error != CL_SUCCESS || slot->host == nullptr) {
+				release_slots();
+				throw std::runtime_error("Failed to map a pinned frame buffer: " + std::to_string(error));
+			}
+			freeSlots.push_back(slot.get());
+			slots.push_back(std::move(slot));
+		}
+		if (writerCount <= 0) {
+			writerCount = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+		}
+		for (int i = 0; i < writerCount; ++i) {
+			writers.emplace_back(&FramePipeline::write_frames, this);
+		}
+	}
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	~FramePipeline() {
+		wait_idle();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		frameReady.notify_all();
+		for (auto& writer : writers) {
+			writer.join();
+		}
+		release_slots();
+	}
+
+	// Reads the frame from source after the commands already in the queue and saves it as the file of iteration.
+	// Blocks until a frame buffer is free.
+	void enqueue(const cl::Buffer& source, int iteration) {
+		Slot* slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			slotFreed.wait(lock, [&] { return !freeSlots.empty(); });
+			throw_error();
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		slot->iteration = iteration;
+		cl_int error = queue.enqueueReadBuffer(source, CL_FALSE, 0, frameBytes, slot->host, nullptr, &slot->read);
+		if (error == CL_SUCCESS) {
+			error = slot->read.setCallback(CL_COMPLETE, &FramePipeline::on_read_complete, slot);
+		}
+		if (error != CL_SUCCESS) {
+			std::lock_guard<std::mutex> lock(mutex);
+			freeSlots.push_back(slot);
+			throw std::runtime_error("Failed to enqueue the read of frame " + std::to_string(iteration) + ": " + std::to_string(error));
+		}
+		// The callback fires only after the device got the read
+		queue.flush();
+	}
+
+	// Waits until all enqueued frames are written, throws the first error of a read or a write
+	void finish() {
+		wait_idle();
+		std::lock_guard<std::mutex> lock(mutex);
+		throw_error();
+	}
+
+	int writer_count() const {
+		return int(writers.size());
+	}
+
+	// Seconds the writers spent encoding, summed over the threads
+	double encode_seconds() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return encodeSeconds;
+	}
+
+private:
+	struct Slot {
+		FramePipeline* pipeline = nullptr;
+		cl::Buffer pinned;
+		cl_uchar* host = nullptr;
+		cl::Event read;
+		int iteration = 0;
+	};
+
+	// Runs on a thread of the OpenCL runtime, must not call into the queue
+	static void CL_CALLBACK on_read_complete(cl_event, cl_int status, void* userData) {
+		Slot* slot = static_cast<Slot*>(userData);
+		FramePipeline& pipeline = *slot->pipeline;
+		std::lock_guard<std::mutex> lock(pipeline.mutex);
+		if (status != CL_COMPLETE) {
+			pipeline.set_error("Reading frame " + std::to_string(slot->iteration) + " failed: " + std::to_string(status));
+			pipeline.freeSlots.push_back(slot);
+			pipeline.slotFreed.notify_all();
+			return;
+		}
+		pipeline.readFrames.push_back(slot);
+		pipeline.frameReady.notify_one();
+	}
+
+	void write_frames() {
+		using Clock = std::chrono::steady_clock;
+		while (true) {
+			Slot* slot = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				frameReady.wait(lock, [&] { return stopping || !readFrames.empty(); });
+				if (readFrames.empty()) {
+					return;
+				}
+				slot = readFrames.front();
+				readFrames.pop_front();
+			}
+			auto start = Clock::now();
+			std::filesystem::path path = frame_path(directory, slot->iteration, format);
+			bool written = write_frame(path, format, slot->host, width, height, channels);
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				encodeSeconds += seconds;
+				if (!written) {
+					set_error("Failed to write " + path.string());
+				}
+				freeSlots.push_back(slot);
+			}
+			slotFreed.notify_all();
+		}
+	}
+
+	// Until every slot was read and encoded, so no callback or writer uses a slot anymore
+	void wait_idle() {
+		std::unique_lock<std::mutex> lock(mutex);
+		slotFreed.wait(lock, [&] { return freeSlots.size() == slots.size(); });
+	}
+
+	void release_slots() {
+		for (auto& slot : slots) {
+			if (slot->host != nullptr) {
+				queue.enqueueUnmapMemObject(slot->pinned, slot->host);
+			}
+		}
+		queue.finish();
+	}
+
+	// Called with the mutex held
+	void set_error(const std::string& message) {
+		if (error.empty()) {
+			error = message;
+		}
+	}
+
+	void throw_error() const {
+		if (!error.empty()) {
+			throw std::runtime_error(error);
+		}
+	}
+
+	cl::CommandQueue queue;
+	std::filesystem::path directory;
+	int width;
+	int height;
+	int channels;
+	size_t frameBytes;
+	FrameFormat format;
+
+	std::vector<std::unique_ptr<Slot>> slots;
+	std::vector<std::thread> writers;
+
+	std::mutex mutex;
+	std::condition_variable slotFreed;
+	std::condition_variable frameReady;
+	std::vector<Slot*> freeSlots;
+	std::deque<Slot*> readFrames;
+	std::string error;
+	double encodeSeconds = 0.0;
+	bool stopping = false;
+};
@@ -0,0 +1,516 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+
+// Hashlife (Gosper) on the infinite plane for large, mostly empty Game of Life patterns. The universe is a quadtree of
+// hash-consed nodes - equal squares are stored once - and the RESULT of every node, its center advanced in time, is
+// memoized. A step advances 2^k generations in time that depends on the distinct structure, not on the area or the
+// number of generations. Nodes live in an arena indexed by 32-bit ids, collect_garbage() frees the unreachable ones.
+class Hashlife {
+public:
+	// Cell of the universe, x grows to the right and y down
+	using Cell = std::pair<int64_t, int64_t>;
+
+	// Garbage is collected after a step once the arena holds more than maxNodes nodes
+	explicit Hashlife(size_t maxNodes = size_t(1) << 24)
+		: maxNodes(maxNodes)
+	{
+		buckets.assign(size_t(1) << 16, invalid_node);
+		// The two cells of level 0, never hashed
+		nodes.push_back({ invalid_node, invalid_node, invalid_node, invalid_node, invalid_node, invalid_node, 0, 0 });
+		nodes.push_back({ invalid_node, invalid_node, invalid_node, invalid_node, invalid_node, invalid_node, 1, 0 });
+		clear();
+	}
+
+	// Removes all cells and resets the generation
+	void clear() {
+		root = empty_node(3);
+		generationCount = 0;
+	}
+
+	void set_cell(int64_t x, int64_t y, bool alive = true) {
+		while (!contains(x, y)) {
+			root = expand(root);
+		}
+		int64_t half = int64_t(1) << (nodes[root].level - 1);
+		root = set_cell(root, x + half, y + half, alive);
+	}
+
+	void set_cells(const std::vector<Cell>& cells) {
+		for (const auto& cell : cells) {
+			set_cell(cell.first, cell.second);
+		}
+	}
+
+	bool get_cell(int64_t x, int64_t y) const {
+		if (!contains(x, y)) {
+			return false;
+		}
+		int64_t half = int64_t(1) << (nodes[root].level - 1);
+		uint32_t id = root;
+		x += half;
+		y += half;
+		for (uint32_t level = nodes[root].level; level > 0; --level) {
+			const Node& node = nodes[id];
+			int64_t quarter = int64_t(1) << (level - 1);
+			bool east = x >= quarter;
+			bool south = y >= quarter;
+			id = south ? (east ? node.se : node.sw) : (east ? node.ne : node.nw);
+			x -= east ? quarter : 0;
+			y -= south ? quarter : 0;
+		}
+		return id == alive_cell;
+	}
+
+	// Advances the universe by 2^stepLog2 generations
+	void step(int stepLog2) {
+		if (stepLog2 < 0 || stepLog2 > max_level - 3) {
+			throw std::runtime_error("Hashlife step must be 2^0 to 2^" + std::to_string(max_level - 3) + " generations");
+		}
+		// The memoized results advance by the step of the level, they are recomputed for another step
+		if (stepLog2 != resultStepLog2) {
+			clear_results();
+			resultStepLog2 = stepLog2;
+		}
+		// The pattern must stay in the center quarter, at most 2^(level - 3) cells from the border of the RESULT
+		while (nodes[root].level < uint32_t(stepLog2) + 3 || !is_centered(root)) {
+			root = expand(root);
+		}
+		root = successor(root);
+		generationCount += uint64_t(1) << stepLog2;
+		if (nodes.size() - freeCount > maxNodes) {
+			collect_garbage();
+		}
+	}
+
+	uint64_t generation() const {
+		return generationCount;
+	}
+
+	uint64_t population() const {
+		return nodes[root].population;
+	}
+
+	// Nodes in the arena, without the free ones
+	size_t node_count() const {
+		return nodes.size() - freeCount;
+	}
+
+	// Frees the nodes not reachable from the universe. The memoized results are kept while the arena stays below half of
+	// the limit and dropped otherwise.
+	void collect_garbage() {
+		mark_and_sweep(true);
+		if (node_count() > maxNodes / 2) {
+			clear_results();
+			mark_and_sweep(false);
+		}
+	}
+
+	// Inclusive box of the living cells
+	struct Bounds {
+		int64_t minX = 0;
+		int64_t minY = 0;
+		int64_t maxX = -1;
+		int64_t maxY = -1;
+
+		bool empty() const {
+			return maxX < minX;
+		}
+	};
+
+	Bounds bounds() const {
+		if (nodes[root].population == 0) {
+			return {};
+		}
+		std::unordered_map<uint32_t, Bounds> memo;
+		Bounds box = bounds(root, memo);
+		int64_t half = int64_t(1) << (nodes[root].level - 1);
+		return { box.minX - half, box.minY - half, box.maxX - half, box.maxY - half };
+	}
+
+	// Grayscale image of width x height pixels with the top-left pixel at cell (x, y). A pixel covers 2^zoomLog2 x 2^zoomLog2
+	// cells, x and y are rounded down to multiples of that. Living cells are white at zoom 0, zoomed out pixels get brighter
+	// with the density of their cells.
+	std::vector<uint8_t> render(int64_t x, int64_t y, int width, int height, int zoomLog2) const {
+		std::vector<uint8_t> pixels(size_t(width) * height, 0);
+		int64_t half = int64_t(1) << (nodes[root].level - 1);
+		Viewport viewport{ floor_to(x, zoomLog2), floor_to(y, zoomLog2), width, height, zoomLog2 };
+		render(root, -half, -half, viewport, pixels);
+		return pixels;
+	}
+
+private:
+	static constexpr uint32_t invalid_node = 0xFFFFFFFFu;
+	static constexpr uint32_t dead_cell = 0;
+	static constexpr uint32_t alive_cell = 1;
+	// Coordinates of the cells of the root stay within int64_t
+	static constexpr int max_level = 62;
+
+	// Square of 2^level x 2^level cells, level 0 nodes are the cells
+	struct Node {
+		uint32_t nw;
+		uint32_t ne;
+		uint32_t sw;
+		uint32_t se;
+		uint32_t result; ///< Center of level - 1 advanced by the step of the level, invalid_node until computed
+		uint32_t next; ///< Next node of the hash bucket or of the free list
+		uint64_t population;
+		uint32_t level;
+	};
+
+	struct Viewport {
+		int64_t x;
+		int64_t y;
+		int width;
+		int height;
+		int zoomLog2;
+	};
+
+	static int64_t floor_to(int64_t value, int log2) {
+		return value >= 0 ? value >> log2 << log2 : -((-value + (int64_t(1) << log2) - 1) >> log2 << log2);
+	}
+
+	static size_t hash(uint32_t nw, uint32_t ne, uint32_t sw, uint32_t se) {
+		uint64_t h = nw * 0x9E3779B97F4A7C15ull;
+		h = (h ^ ne) * 0xC2B2AE3D27D4EB4Full;
+		h = (h ^ sw) * 0x165667B19E3779F9ull;
+		h = (h ^ se) * 0x9E3779B97F4A7C15ull;
+		return size_t(h ^ (h >> 29));
+	}
+
+	// The node with the children, created if new. Invalidates references into nodes.
+	uint32_t join(uint32_t nw, uint32_t ne, uint32_t sw, uint32_t se) {
+		size_t bucket = hash(nw, ne, sw, se) & (buckets.size() - 1);
+		for (uint32_t id = buckets[bucket]; id != invalid_node; id = nodes[id].next) {
+			const Node& node = nodes[id];
+			if (node.nw == nw && node.ne == ne && node.sw == sw && node.se == se) {
+				return id;
+			}
+		}
+		Node node{ nw, ne, sw, se, invalid_node, buckets[bucket],
+			nodes[nw].population + nodes[ne].population + nodes[sw].population + nodes[se].population, nodes[nw].level + 1 };
+		uint32_t id;
+		if (freeList != invalid_node) {
+			id = freeList;
+			freeList = nodes[id].next;
+			--freeCount;
+			nodes[id] = node;
+		} else {
+			id = uint32_t(nodes.size());
+			nodes.push_back(node);
+		}
+		buckets[bucket] = id;
+		if (nodes.size() - freeCount > buckets.size()) {
+			rehash(buckets.size() * 2);
+		}
+		return id;
+	}
+
+	void rehash(size_t bucketCount) {
+		buckets.assign(bucketCount, invalid_node);
+		for (uint32_t id = 2; id < nodes.size(); ++id) {
+			Node& node = nodes[id];
+			if (node.level == 0) {
+				continue;
+			}
+			size_t bucket = hash(node.nw, node.ne, node.sw, node.se) & (bucketCount - 1);
+			node.next = buckets[bucket];
+			buckets[bucket] = id;
+		}
+	}
+
+	uint32_t empty_node(uint32_t level) {
+		while (emptyNodes.size() <= level) {
+			if (emptyNodes.empty()) {
+				emptyNodes.push_back(dead_cell);
+			} else {
+				uint32_t child = emptyNodes.back();
+				emptyNodes.push_back(join(child, child, child, child));
+			}
+		}
+		return emptyNodes[level];
+	}
+
+	// The node in the center of a node twice its size
+	uint32_t expand(uint32_t id) {
+		uint32_t level = nodes[id].level;
+		if (level >= max_level) {
+			throw std::runtime_error("Hashlife universe exceeds 2^" + std::to_string(max_level) + " cells");
+		}
+		uint32_t empty = empty_node(level - 1);
+		Node node = nodes[id];
+		return join(
+			join(empty, empty, empty, node.nw), join(empty, empty, node.ne, empty),
+			join(empty, node.sw, empty, empty), join(node.se, empty, empty, empty));
+	}
+
+	// The center node of half the size
+	uint32_t inner(uint32_t id) {
+		Node node = nodes[id];
+		return join(nodes[node.nw].se, nodes[node.ne].sw, nodes[node.sw].ne, nodes[node.se].nw);
+	}
+
+	// All cells within the center quarter
+	bool is_centered(uint32_t id) {
+		uint64_t population = nodes[id].population;
+		uint32_t center = inner(inner(id));
+		return nodes[center].population == population;
+	}
+
+	bool contains(int64_t x, int64_t y) const {
+		int64_t half = int64_t(1) << (nodes[root].level - 1);
+		return x >= -half && x < half && y >= -half && y < half;
+	}
+
+	// x and y relative to the top-left cell of the node
+	uint32_t set_cell(uint32_t id, int64_t x, int64_t y, bool alive) {
+		Node node = nodes[id];
+		if (node.level == 0) {
+			return alive ? alive_cell : dead_cell;
+		}
+		int64_t quarter = int64_t(1) << (node.level - 1);
+		bool east = x >= quarter;
+		bool south = y >= quarter;
+		int64_t childX = x - (east ? quarter : 0);
+		int64_t childY = y - (south ? quarter : 0);
+		if (south) {
+			(east ? node.se : node.sw) = set_cell(east ? node.se : node.sw, childX, childY, alive);
+		} else {
+			(east ? node.ne : node.nw) = set_cell(east ? node.ne : node.nw, childX, childY, alive);
+		}
+		return join(node.nw, node.ne, node.sw, node.se);
+	}
+
+	// One generation of the center 2x2 cells of a 4x4 node
+	uint32_t step_4x4(uint32_t id) {
+		int cells[4][4];
+		const Node& node = nodes[id];
+		const uint32_t quadrants[4] = { node.nw, node.ne, node.sw, node.se };
+		for (int q = 0; q < 4; ++q) {
+			const Node& quadrant = nodes[quadrants[q]];
+			int x = (q & 1) * 2;
+			int y = (q >> 1) * 2;
+			cells[y][x] = quadrant.nw == alive_cell;
+			cells[y][x + 1] = quadrant.ne == alive_cell;
+			cells[y + 1][x] = quadrant.sw == alive_cell;
+			cells[y + 1][x + 1] = quadrant.se == alive_cell;
+		}
+		uint32_t next[2][2];
+		for (int y = 1; y <= 2; ++y) {
+			for (int x = 1; x <= 2; ++x) {
+				int neighbors = 0;
+				for (int dy = -1; dy <= 1; ++dy) {
+					for (int dx = -1; dx <= 1; ++dx) {
+						neighbors += (dx != 0 || dy != 0) ? cells[y + dy][x + dx] : 0;
+					}
+				}
+				bool alive = neighbors == 3 || (neighbors == 2 && cells[y][x]);
+				next[y - 1][x - 1] = alive ? alive_cell : dead_cell;
+			}
+		}
+		return join(next[0][0], next[0][1], next[1][0], next[1][1]);
+	}
+
+	// RESULT - the center of half the size advanced by 2^min(resultStepLog2, level - 2) generations. The nine overlapping
+	// subnodes of half the size are advanced, then the four quadrants of their centers - advanced again for the full step
+	// of the level or only recentered for smaller steps.
+	uint32_t successor(uint32_t id) {
+		Node node = nodes[id];
+		if (node.result != invalid_node) {
+			return node.result;
+		}
+		uint32_t result;
+		if (node.population == 0) {
+			result = empty_node(node.level - 1);
+		} else if (node.level == 2) {
+			result = step_4x4(id);
+		} else {
+			Node a = nodes[node.nw];
+			Node b = nodes[node.ne];
+			Node c = nodes[node.sw];
+			Node d = nodes[node.se];
+			uint32_t n01 = join(a.ne, b.nw, a.se, b.sw);
+			uint32_t n10 = join(a.sw, a.se, c.nw, c.ne);
+			uint32_t n11 = join(a.se, b.sw, c.ne, d.nw);
+			uint32_t n12 = join(b.sw, b.se, d.nw, d.ne);
+			uint32_t n21 = join(c.ne, d.nw, c.se, d.sw);
+			uint32_t c00 = successor(node.nw);
+			uint32_t c01 = successor(n01);
+			uint32_t c02 = successor(node.ne);
+			uint32_t c10 = successor(n10);
+			uint32_t c11 = successor(n11);
+			uint32_t c12 = successor(n12);
+			uint32_t c20 = successor(node.sw);
+			uint32_t c21 = successor(n21);
+			uint32_t c22 = successor(node.se);
+			if (resultStepLog2 < int(node.level) - 2) {
+				result = join(center(c00, c01, c10, c11), center(c01, c02, c11, c12), center(c10, c11, c20, c21), center(c11, c12, c21, c22));
+			} else {
+				uint32_t nw = successor(join(c00, c01, c10, c11));
+				uint32_t ne = successor(join(c01, c02, c11, c12));
+				uint32_t sw = successor(join(c10, c11, c20, c21));
+				uint32_t se = successor(join(c11, c12, c21, c22));
+				result = join(nw, ne, sw, se);
+			}
+		}
+		nodes[id].result = result;
+		return result;
+	}
+
+	// The center of the square of the four nodes, the size of one of them
+	uint32_t center(uint32_t nw, uint32_t ne, uint32_t sw, uint32_t se) {
+		return join(nodes[nw].se, nodes[ne].sw, nodes[sw].ne, nodes[se].nw);
+	}
+
+	void clear_results() {
+		for (auto& node : nodes) {
+			node.result = invalid_node;
+		}
+	}
+
+	// Marks the universe, the empty nodes and with keepResults the memoized results, frees the rest
+	void mark_and_sweep(bool keepResults) {
+		std::vector<uint8_t> marked(nodes.size(), 0);
+		std::vector<uint32_t> stack(emptyNodes.begin(), emptyNodes.end());
+		stack.push_back(root);
+		marked[dead_cell] = marked[alive_cell] = 1;
+		while (!stack.empty()) {
+			uint32_t id = stack.back();
+			stack.pop_back();
+			if (marked[id]) {
+				continue;
+			}
+			marked[id] = 1;
+			const Node& node = nodes[id];
+			stack.insert(stack.end(), { node.nw, node.ne, node.sw, node.se });
+			if (keepResults && node.result != invalid_node) {
+				stack.push_back(node.result);
+			}
+		}
+
+		freeList = invalid_node;
+		freeCount = 0;
+		for (uint32_t id = uint32_t(nodes.size()) - 1; id >= 2; --id) {
+			Node& node = nodes[id];
+			if (!marked[id]) {
+				node = { invalid_node, invalid_node, invalid_node, invalid_node, invalid_node, freeList, 0, 0 };
+				freeList = id;
+				++freeCount;
+			} else if (node.result != invalid_node && !marked[node.result]) {
+				node.result = invalid_node;
+			}
+		}
+		rehash(buckets.size());
+	}
+
+	// Box of the living cells relative to the top-left cell of a non-empty node
+	Bounds bounds(uint32_t id, std::unordered_map<uint32_t, Bounds>& memo) const {
+		const Node& node = nodes[id];
+		if (node.level == 0) {
+			return { 0, 0, 0, 0 };
+		}
+		auto found = memo.find(id);
+		if (found != memo.end()) {
+			return found->second;
+		}
+		int64_t quarter = int64_t(1) << (node.level - 1);
+		Bounds box;
+		const uint32_t children[4] = { node.nw, node.ne, node.sw, node.se };
+		for (int i = 0; i < 4; ++i) {
+			if (nodes[children[i]].population == 0) {
+				continue;
+			}
+			Bounds child = bounds(children[i], memo);
+			int64_t x = (i & 1) * quarter;
+			int64_t y = (i >> 1) * quarter;
+			if (box.empty()) {
+				box = { child.minX + x, child.minY + y, child.maxX + x, child.maxY + y };
+			} else {
+				box = { std::min(box.minX, child.minX + x), std::min(box.minY, child.minY + y), std::max(box.maxX, child.maxX + x), std::max(box.maxY, child.maxY + y) };
+			}
+		}
+		memo.emplace(id, box);
+		return box;
+	}
+
+	void render(uint32_t id, int64_t x, int64_t y, const Viewport& viewport, std::vector<uint8_t>& pixels) const {
+		const Node& node = nodes[id];
+		int64_t size = int64_t(1) << node.level;
+		if (node.population == 0 || x + size <= viewport.x || y + size <= viewport.y
+			|| x >= viewport.x + (int64_t(viewport.width) << viewport.zoomLog2) || y >= viewport.y + (int64_t(viewport.height) << viewport.zoomLog2)) {
+			return;
+		}
+		if (int(node.level) <= viewport.zoomLog2) {
+			// Inside one pixel, only the root can be smaller than a pixel and straddle the viewport edge. Its cells
+			// go to the pixel of its first cell inside the viewport.
+			int64_t pixelX = (std::max(x, viewport.x) - viewport.x) >> viewport.zoomLog2;
+			int64_t pixelY = (std::max(y, viewport.y) - viewport.y) >> viewport.zoomLog2;
+			size_t pixel = size_t(pixelY) * viewport.width + size_t(pixelX);
+			double density = double(node.population) / (double(size) * double(size));
+			pixels[pixel] = uint8_t(std::max<double>(pixels[pixel], 96.0 + 159.0 * density));
+			return;
+		}
+		int64_t quarter = size / 2;
+		render(node.nw, x, y, viewport, pixels);
+		render(node.ne, x + quarter, y, viewport, pixels);
+		render(node.sw, x, y + quarter, viewport, pixels);
+		render(node.se, x + quarter, y + quarter, viewport, pixels);
+	}
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> buckets;
+	std::vector<uint32_t> emptyNodes;
+	uint32_t freeList = invalid_node;
+	size_t freeCount = 0;
+	size_t maxNodes;
+	uint32_t root = dead_cell;
+	int resultStepLog2 = -1;
+	uint64_t generationCount = 0;
+};
+
+// Cells of a pattern in run length encoded (.rle) format, relative to its top-left corner
+inline std::vector<Hashlife::Cell> parse_rle(const std::string& text) {
+	std::vector<Hashlife::Cell> cells;
+	int64_t x = 0;
+	int64_t y = 0;
+	int64_t count = 0;
+	size_t position = 0;
+	while (position < text.size()) {
+		size_t lineEnd = std::min(text.find('\n', position), text.size());
+		std::string line = text.substr(position, lineEnd - position);
+		position = lineEnd + 1;
+		size_t start = line.find_first_not_of(" \t\r");
+		// Comments and the header line with the size and the rule
+		if (start == std::string::npos || line[start] == '#' || line[start] == 'x') {
+			continue;
+		}
+		for (char c : line) {
+			if (c >= '0' && c <= '9') {
+				count = count * 10 + (c - '0');
+				continue;
+			}
+			int64_t run = std::max<int64_t>(count, 1);
+			count = 0;
+			if (c == '!') {
+				return cells;
+			} else if (c == '$') {
+				y += run;
+				x = 0;
+			} else if (c == 'b' || c == '.') {
+				x += run;
+			} else if (std::isalpha(static_cast<unsigned char>(c))) {
+				for (int64_t i = 0; i < run; ++i) {
+					cells.emplace_back(x++, y);
+				}
+			}
+		}
+	}
+	return cells;
+}
@@ -20,6 +20,161 @@ __kernel void game_of_life(__global uchar* current, __global uchar* next, int wi
 	next[y * width + x] = (current_cell && (num_neighbors == 2 || num_neighbors == 3)) || (!current_cell && num_neighbors == 3);
 }
 
+// game_of_life with the (tile + 1 cell halo) block staged in local memory once per work-group, tile holds
+// (get_local_size(0) + 2) * (get_local_size(1) + 2) cells. The global size is rounded up to whole tiles,
+// the local size must not exceed the grid.
+__kernel void game_of_life_tiled(__global const uchar* current, __global uchar* next, int width, int height, __local uchar* tile)
+{
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int tile_width = local_width + 2;
+	int tile_size = tile_width * (local_height + 2);
+	int origin_x = get_group_id(0) * local_width - 1;
+	int origin_y = get_group_id(1) * local_height - 1;
+	for (int i = get_local_id(1) * local_width + get_local_id(0); i < tile_size; i += local_width * local_height) {
+		// Torus wrap - the tiles overhang the grid by less than its size
+		int tx = origin_x + i % tile_width;
+		int ty = origin_y + i / tile_width;
+		tx = tx < 0 ? tx + width : (tx >= width ? tx - width : tx);
+		ty = ty < 0 ? ty + height : (ty >= height ? ty - height : ty);
+		tile[i] = current[ty * width + tx];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) {
+		return;
+	}
+	__local const uchar* mid = tile + (get_local_id(1) + 1) * tile_width + get_local_id(0) + 1;
+	__local const uchar* up = mid - tile_width;
+	__local const uchar* down = mid + tile_width;
+	int num_neighbors = up[-1] + up[0] + up[1] + mid[-1] + mid[1] + down[-1] + down[0] + down[1];
+
+	int current_cell = mid[0];
+	next[y * width + x] = (current_cell && (num_neighbors == 2 || num_neighbors == 3)) || (!current_cell && num_neighbors == 3);
+}
+
+// game_of_life advanced by steps generations per launch (temporal blocking). The work-group stages its tile with a
+// halo of steps cells in local memory and computes each generation on a region one cell narrower per side - a trapezoid
+// in time - so only the tile itself is written back. tiles holds two blocks of
+// (get_local_size(0) + 2 * steps) * (get_local_size(1) + 2 * steps) cells. The global size is rounded up to whole tiles.
+__kernel void game_of_life_temporal(__global const uchar* current, __global uchar* next, int width, int height, int steps, __local uchar* tiles)
+{
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int work_items = local_width * local_height;
+	int local_index = get_local_id(1) * local_width + get_local_id(0);
+	int block_width = local_width + 2 * steps;
+	int block_size = block_width * (local_height + 2 * steps);
+	int origin_x = get_group_id(0) * local_width - steps;
+	int origin_y = get_group_id(1) * local_height - steps;
+	__local uchar* source = tiles;
+	__local uchar* target = tiles + block_size;
+	for (int i = local_index; i < block_size; i += work_items) {
+		// Torus wrap with modulo, the halo may be wider than the grid
+		int tx = ((origin_x + i % block_width) % width + width) % width;
+		int ty = ((origin_y + i / block_width) % height + height) % height;
+		source[i] = current[ty * width + tx];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int step = 1; step <= steps; ++step) {
+		// Cells at least step cells inside the block are valid after step generations
+		int region_width = block_width - 2 * step;
+		int region_size = region_width * (local_height + 2 * (steps - step));
+		for (int i = local_index; i < region_size; i += work_items) {
+			int index = (step + i / region_width) * block_width + step + i % region_width;
+			__local const uchar* mid = source + index;
+			__local const uchar* up = mid - block_width;
+			__local const uchar* down = mid + block_width;
+			int num_neighbors = up[-1] + up[0] + up[1] + mid[-1] + mid[1] + down[-1] + down[0] + down[1];
+			int current_cell = mid[0];
+			target[index] = (current_cell && (num_neighbors == 2 || num_neighbors == 3)) || (!current_cell && num_neighbors == 3);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		__local uchar* swap = source;
+		source = target;
+		target = swap;
+	}
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < width && y < height) {
+		next[y * width + x] = source[(get_local_id(1) + steps) * block_width + get_local_id(0) + steps];
+	}
+}
+
+// Next state of the 64 cells of center from the 8 words around it, the neighbour counts are summed with bit-parallel adders.
+// West of bit i is bit i - 1, the west of bit 0 is bit 63 of the left word.
+ulong next_generation_word(ulong up_left, ulong up, ulong up_right, ulong left, ulong center, ulong right, ulong down_left, ulong down, ulong down_right)
+{
+	ulong up_west = (up << 1) | (up_left >> 63);
+	ulong up_east = (up >> 1) | (up_right << 63);
+	ulong west = (center << 1) | (left >> 63);
+	ulong east = (center >> 1) | (right << 63);
+	ulong down_west = (down << 1) | (down_left >> 63);
+	ulong down_east = (down >> 1) | (down_right << 63);
+
+	// 2-bit neighbour count of each row - full adders above and below, half adder in the center row
+	ulong up_ones = up_west ^ up ^ up_east;
+	ulong up_twos = (up_west & up) | (up_east & (up_west ^ up));
+	ulong mid_ones = west ^ east;
+	ulong mid_twos = west & east;
+	ulong down_ones = down_west ^ down ^ down_east;
+	ulong down_twos = (down_west & down) | (down_east & (down_west ^ down));
+
+	// Ones of the total count and their carry into the twos
+	ulong ones = up_ones ^ mid_ones ^ down_ones;
+	ulong carry = (up_ones & mid_ones) | (down_ones & (up_ones ^ mid_ones));
+
+	// The count is 2 or 3 iff exactly one of the four weight two bits is set, 3 needs the ones bit, 2 a living cell
+	ulong exactly_one = (up_twos ^ mid_twos ^ down_twos ^ carry) & ~((up_twos & mid_twos) | (down_twos & carry));
+	return exactly_one & (ones | center);
+}
+
+// Bit-packed game_of_life - 64 cells per ulong, bit i of word x is the cell at column 64 * x + i.
+// One work-item per word, 9 loads per 64 cells and the torus wraps without modulo. Run with NDRange(words_per_row, height).
+__kernel void game_of_life_packed(__global const ulong* current, __global ulong* next, int words_per_row, int height)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	int xl = x == 0 ? words_per_row - 1 : x - 1;
+	int xr = x == words_per_row - 1 ? 0 : x + 1;
+	__global const ulong* up = current + (size_t)(y == 0 ? height - 1 : y - 1) * words_per_row;
+	__global const ulong* mid = current + (size_t)y * words_per_row;
+	__global const ulong* down = current + (size_t)(y == height - 1 ? 0 : y + 1) * words_per_row;
+
+	next[(size_t)y * words_per_row + x] = next_generation_word(
+		up[xl], up[x], up[xr],
+		mid[xl], mid[x], mid[xr],
+		down[xl], down[x], down[xr]);
+}
+
+// game_of_life on a strip of the grid for StripStencil in strip_stencil.hpp. The strip buffers hold rows + 2 rows,
+// strip row y + 1 is grid row first_row + y and rows 0 and rows + 1 are halos with the neighbouring rows of the torus.
+// Launched with a global offset over strip rows 1 to rows.
+__kernel void game_of_life_strip(__global const uchar* current, __global uchar* next, int width, int height, int first_row, int rows)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	int num_neighbors = 0;
+	for (int dy = -1; dy <= 1; ++dy) {
+		for (int dx = -1; dx <= 1; ++dx) {
+			if (dx == 0 && dy == 0) {
+				continue;
+			}
+			int nx = (x + dx + width) % width;
+			num_neighbors += current[(y + dy) * width + nx];
+		}
+	}
+
+	int current_cell = current[y * width + x];
+	next[y * width + x] = (current_cell && (num_neighbors == 2 || num_neighbors == 3)) || (!current_cell && num_neighbors == 3);
+}
+
 __kernel void scale_to_255(__global const uchar* input, __global uchar* output, int size) {
 	int index = get_global_id(0);
 	if (index < size) {
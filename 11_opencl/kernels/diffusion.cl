@@ -1,3 +1,6 @@
+// No multiply-add contraction, so the single step, tiled and temporally blocked kernels round identically
+#pragma OPENCL FP_CONTRACT OFF
+
 
 __kernel void uchar_to_float(__global const uchar* input, __global float* output, int size) {
 	int index = get_global_id(0);
@@ -44,3 +47,246 @@ __kernel void diffusion_step(__global float* current, __global float* next, int
 	float laplacian = diffusion / count - center;
 	next[idx] = center + delta * laplacian;
 }
+
+// diffusion_step with the (tile + 1 value halo) block staged in local memory once per work-group, tile holds
+// (get_local_size(0) + 2) * (get_local_size(1) + 2) values. The global size is rounded up to whole tiles.
+__kernel void diffusion_step_tiled(__global const float* current, __global float* next, int width, int height, float delta, __local float* tile) {
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int tile_width = local_width + 2;
+	int tile_size = tile_width * (local_height + 2);
+	int origin_x = get_group_id(0) * local_width - 1;
+	int origin_y = get_group_id(1) * local_height - 1;
+	for (int i = get_local_id(1) * local_width + get_local_id(0); i < tile_size; i += local_width * local_height) {
+		// Values outside of the grid are never read, the border cells average fewer neighbours
+		int tx = origin_x + i % tile_width;
+		int ty = origin_y + i / tile_width;
+		tile[i] = (tx >= 0 && tx < width && ty >= 0 && ty < height) ? current[ty * width + tx] : 0.0f;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) {
+		return;
+	}
+	int lidx = (get_local_id(1) + 1) * tile_width + get_local_id(0) + 1;
+
+	// Same order of the additions as diffusion_step, the results are bit identical
+	float center = tile[lidx];
+	float diffusion = 0.0f;
+	int count = 0;
+	if (x > 0) {
+		diffusion += tile[lidx - 1];
+		count++;
+	}
+	if (x < width - 1) {
+		diffusion += tile[lidx + 1];
+		count++;
+	}
+	if (y > 0) {
+		diffusion += tile[lidx - tile_width];
+		count++;
+	}
+	if (y < height - 1) {
+		diffusion += tile[lidx + tile_width];
+		count++;
+	}
+
+	float laplacian = diffusion / count - center;
+	next[y * width + x] = center + delta * laplacian;
+}
+
+// diffusion_step advanced by steps iterations per launch (temporal blocking). The work-group stages its tile with a
+// halo of steps values in local memory and computes each iteration on a region one value narrower per side - a trapezoid
+// in time - so only the tile itself is written back. tiles holds two blocks of
+// (get_local_size(0) + 2 * steps) * (get_local_size(1) + 2 * steps) values. The global size is rounded up to whole tiles.
+__kernel void diffusion_step_temporal(__global const float* current, __global float* next, int width, int height, float delta, int steps, __local float* tiles) {
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int work_items = local_width * local_height;
+	int local_index = get_local_id(1) * local_width + get_local_id(0);
+	int block_width = local_width + 2 * steps;
+	int block_size = block_width * (local_height + 2 * steps);
+	int origin_x = get_group_id(0) * local_width - steps;
+	int origin_y = get_group_id(1) * local_height - steps;
+	__local float* source = tiles;
+	__local float* target = tiles + block_size;
+	for (int i = local_index; i < block_size; i += work_items) {
+		int tx = origin_x + i % block_width;
+		int ty = origin_y + i / block_width;
+		source[i] = (tx >= 0 && tx < width && ty >= 0 && ty < height) ? current[ty * width + tx] : 0.0f;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int step = 1; step <= steps; ++step) {
+		// Values at least step values inside the block are valid after step iterations
+		int region_width = block_width - 2 * step;
+		int region_size = region_width * (local_height + 2 * (steps - step));
+		for (int i = local_index; i < region_size; i += work_items) {
+			int bx = step + i % region_width;
+			int by = step + i / region_width;
+			int x = origin_x + bx;
+			int y = origin_y + by;
+			int index = by * block_width + bx;
+			if (x < 0 || x >= width || y < 0 || y >= height) {
+				// Outside of the grid, never read
+				continue;
+			}
+			float center = source[index];
+			float diffusion = 0.0f;
+			int count = 0;
+			if (x > 0) {
+				diffusion += source[index - 1];
+				count++;
+			}
+			if (x < width - 1) {
+				diffusion += source[index + 1];
+				count++;
+			}
+			if (y > 0) {
+				diffusion += source[index - block_width];
+				count++;
+			}
+			if (y < height - 1) {
+				diffusion += source[index + block_width];
+				count++;
+			}
+			float laplacian = diffusion / count - center;
+			target[index] = center + delta * laplacian;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		__local float* swap = source;
+		source = target;
+		target = swap;
+	}
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < width && y < height) {
+		next[y * width + x] = source[(get_local_id(1) + steps) * block_width + get_local_id(0) + steps];
+	}
+}
+
+// diffusion_step on a strip of the grid for StripStencil in strip_stencil.hpp. The strip buffers hold rows + 2 rows,
+// strip row y + 1 is grid row first_row + y and rows 0 and rows + 1 are halos with the neighbouring rows. Same order
+// of the additions as diffusion_step, launched with a global offset over strip rows 1 to rows.
+__kernel void diffusion_step_strip(__global const float* current, __global float* next, int width, int height, int first_row, int rows, float delta) {
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int grid_y = first_row + y - 1;
+	int idx = y * width + x;
+
+	float center = current[idx];
+	float diffusion = 0.0f;
+	int count = 0;
+	if (x > 0) {
+		diffusion += current[idx - 1];
+		count++;
+	}
+	if (x < width - 1) {
+		diffusion += current[idx + 1];
+		count++;
+	}
+	if (grid_y > 0) {
+		diffusion += current[idx - width];
+		count++;
+	}
+	if (grid_y < height - 1) {
+		diffusion += current[idx + width];
+		count++;
+	}
+	float laplacian = diffusion / count - center;
+	next[idx] = center + delta * laplacian;
+}
+
+// Implicit (backward Euler) diffusion: a step over the diffusion time tau - tau / delta iterations of diffusion_step - solves
+//	(1 + tau) * u - tau * mean(neighbours of u) = b
+// for u with b the current values. The kernels below are the geometric multigrid V-cycle of MultigridSolver
+// in multigrid.hpp - red-black Gauss-Seidel smoothing, residual, restriction and prolongation on cell-centered grids.
+// The coarse grid of a level has half the resolution, (width + 1) / 2 by (height + 1) / 2, and a quarter of its tau.
+
+// Mean of the neighbours inside the grid, the same neighbourhood as diffusion_step
+float neighbour_mean(__global const float* u, int x, int y, int width, int height) {
+	int idx = y * width + x;
+	float sum = 0.0f;
+	int count = 0;
+	if (x > 0) {
+		sum += u[idx - 1];
+		count++;
+	}
+	if (x < width - 1) {
+		sum += u[idx + 1];
+		count++;
+	}
+	if (y > 0) {
+		sum += u[idx - width];
+		count++;
+	}
+	if (y < height - 1) {
+		sum += u[idx + width];
+		count++;
+	}
+	return count > 0 ? sum / count : u[idx];
+}
+
+// Gauss-Seidel update of the cells with (x + y) % 2 == color in place, the cells of one color only read the other one
+__kernel void implicit_smooth(__global float* u, __global const float* b, int width, int height, float tau, int color) {
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height || ((x + y) & 1) != color) {
+		return;
+	}
+	u[y * width + x] = (b[y * width + x] + tau * neighbour_mean(u, x, y, width, height)) / (1.0f + tau);
+}
+
+// r = b - A u
+__kernel void implicit_residual(__global const float* u, __global const float* b, __global float* r, int width, int height, float tau) {
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) {
+		return;
+	}
+	int idx = y * width + x;
+	r[idx] = b[idx] - ((1.0f + tau) * u[idx] - tau * neighbour_mean(u, x, y, width, height));
+}
+
+// Coarse cell as the mean of the fine cells it covers, the last column and row may cover only one
+__kernel void restrict_mean(__global const float* fine, __global float* coarse, int fine_width, int fine_height, int coarse_width, int coarse_height) {
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= coarse_width || y >= coarse_height) {
+		return;
+	}
+	int fx = 2 * x;
+	int fy = 2 * y;
+	int fx1 = min(fx + 1, fine_width - 1);
+	int fy1 = min(fy + 1, fine_height - 1);
+	float sum = fine[fy * fine_width + fx] + fine[fy * fine_width + fx1] + fine[fy1 * fine_width + fx] + fine[fy1 * fine_width + fx1];
+	coarse[y * coarse_width + x] = 0.25f * sum;
+}
+
+// Adds the bilinear interpolation of the coarse correction - weights 9/16, 3/16, 3/16 and 1/16 of the nearest
+// coarse cells, clamped at the borders
+__kernel void prolongate_add(__global const float* coarse, __global float* fine, int fine_width, int fine_height, int coarse_width, int coarse_height) {
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= fine_width || y >= fine_height) {
+		return;
+	}
+	int cx = x / 2;
+	int cy = y / 2;
+	int nx = clamp(cx + ((x & 1) ? 1 : -1), 0, coarse_width - 1);
+	int ny = clamp(cy + ((y & 1) ? 1 : -1), 0, coarse_height - 1);
+	float correction = 0.5625f * coarse[cy * coarse_width + cx]
+		+ 0.1875f * (coarse[cy * coarse_width + nx] + coarse[ny * coarse_width + cx])
+		+ 0.0625f * coarse[ny * coarse_width + nx];
+	fine[y * fine_width + x] += correction;
+}
+
+__kernel void fill_zero(__global float* buffer, int size) {
+	int index = get_global_id(0);
+	if (index < size) {
+		buffer[index] = 0.0f;
+	}
+}
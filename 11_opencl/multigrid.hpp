@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "cl_utils.hpp"
+
+// Implicit (backward Euler) diffusion steps solved with geometric multigrid V-cycles, the kernels are in kernels/diffusion.cl.
+// A step over the diffusion time tau is stable for any tau, while diffusion_step needs delta < 1. The diffusion time of
+// hundreds of explicit iterations takes a handful of steps.
+class MultigridSolver {
+public:
+	// Levels down to a coarsest grid of at most coarsest cells on its shorter side
+	MultigridSolver(ClRuntime& runtime, const cl::Program& program, int width, int height, int smoothingSweeps = 2, int coarseSweeps = 32, int coarsest = 8)
+		: runtime(runtime), smoothingSweeps(smoothingSweeps), coarseSweeps(coarseSweeps),
+		smoothKernel(program, "implicit_smooth"), residualKernel(program, "implicit_residual"),
+		restrictKernel(program, "restrict_mean"), prolongateKernel(program, "prolongate_add"), zeroKernel(program, "fill_zero")
+	{
+		for (int levelWidth = width, levelHeight = height;; levelWidth = (levelWidth + 1) / 2, levelHeight = (levelHeight + 1) / 2) {
+			Level level;
+			level.width = levelWidth;
+			level.height = levelHeight;
+			size_t bytes = size_t(levelWidth) * levelHeight * sizeof(cl_float);
+			level.r = cl::Buffer(runtime.context, CL_MEM_READ_WRITE, bytes);
+			// The finest level works on the buffers of solve()
+			if (!levels.empty()) {
+				level.u = cl::Buffer(runtime.context, CL_MEM_READ_WRITE, bytes);
+				level.b = cl::Buffer(runtime.context, CL_MEM_READ_WRITE, bytes);
+			}
+			levels.push_back(level);
+			if (std::min(levelWidth, levelHeight) <= coarsest) {
+				break;
+			}
+		}
+	}
+
+	// Solves (1 + tau) * u - tau * mean(neighbours of u) = b, u holds the initial guess. Runs V-cycles until the residual
+	// relative to b is below tolerance or for maxCycles, returns the relative residual after each cycle.
+	std::vector<double> solve(const cl::Buffer& b, cl::Buffer& u, float tau, double tolerance = 1e-5, int maxCycles = 20) {
+		Level& finest = levels.front();
+		finest.u = u;
+		finest.b = b;
+		std::vector<cl_float> values(size_t(finest.width) * finest.height);
+		runtime.queue.enqueueReadBuffer(b, CL_TRUE, 0, values.size() * sizeof(cl_float), values.data());
+		double bNorm = std::max(norm(values), std::numeric_limits<double>::min());
+
+		std::vector<double> residuals;
+		for (int cycle = 0; cycle < maxCycles; ++cycle) {
+			v_cycle(0, tau);
+			residual(finest, tau);
+			runtime.queue.enqueueReadBuffer(finest.r, CL_TRUE, 0, values.size() * sizeof(cl_float), values.data());
+			residuals.push_back(norm(values) / bNorm);
+			if (residuals.back() < tolerance) {
+				break;
+			}
+		}
+		return residuals;
+	}
+
+	int level_count() const {
+		return int(levels.size());
+	}
+
+private:
+	struct Level {
+		int width = 0;
+		int height = 0;
+		cl::Buffer u;
+		cl::Buffer b;
+		cl::Buffer r;
+	};
+
+	static double norm(const std::vector<cl_float>& values) {
+		double sum = 0.0;
+		for (float value : values) {
+			sum += double(value) * value;
+		}
+		return std::sqrt(sum);
+	}
+
+	// The coarse grid rediscretizes the operator with twice the cell size, which is a quarter of tau
+	void v_cycle(size_t index, float tau) {
+		Level& level = levels[index];
+		if (index + 1 == levels.size()) {
+			smooth(level, tau, coarseSweeps);
+			return;
+		}
+		Level& coarse = levels[index + 1];
+		smooth(level, tau, smoothingSweeps);
+		residual(level, tau);
+
+		restrictKernel.setArg(0, level.r);
+		restrictKernel.setArg(1, coarse.b);
+		set_sizes(restrictKernel, level, coarse);
+		runtime.enqueue_kernel(restrictKernel, cl::NDRange(coarse.width, coarse.height));
+
+		zeroKernel.setArg(0, coarse.u);
+		zeroKernel.setArg(1, coarse.width * coarse.height);
+		runtime.enqueue_kernel(zeroKernel, cl::NDRange(size_t(coarse.width) * coarse.height));
+		v_cycle(index + 1, tau / 4.0f);
+
+		prolongateKernel.setArg(0, coarse.u);
+		prolongateKernel.setArg(1, level.u);
+		set_sizes(prolongateKernel, level, coarse);
+		runtime.enqueue_kernel(prolongateKernel, cl::NDRange(level.width, level.height));
+		smooth(level, tau, smoothingSweeps);
+	}
+
+	// Red-black Gauss-Seidel sweeps
+	void smooth(Level& level, float tau, int sweeps) {
+		smoothKernel.setArg(0, level.u);
+		smoothKernel.setArg(1, level.b);
+		smoothKernel.setArg(2, level.width);
+		smoothKernel.setArg(3, level.height);
+		smoothKernel.setArg(4, tau);
+		for (int i = 0; i < 2 * sweeps; ++i) {
+			smoothKernel.setArg(5, i % 2);
+			runtime.enqueue_kernel(smoothKernel, cl::NDRange(level.width, level.height));
+		}
+	}
+
+	void residual(Level& level, float tau) {
+		residualKernel.setArg(0, level.u);
+		residualKernel.setArg(1, level.b);
+		residualKernel.setArg(2, level.r);
+		residualKernel.setArg(3, level.width);
+		residualKernel.setArg(4, level.height);
+		residualKernel.setArg(5, tau);
+		runtime.enqueue_kernel(residualKernel, cl::NDRange(level.width, level.height));
+	}
+
+	static void set_sizes(cl::Kernel& kernel, const Level& fine, const Level& coarse) {
+		kernel.setArg(2, fine.width);
+		kernel.setArg(3, fine.height);
+		kernel.setArg(4, coarse.width);
+		kernel.setArg(5, coarse.height);
+	}
+
+	ClRuntime& runtime;
+	int smoothingSweeps;
+	int coarseSweeps;
+	std::vector<Level> levels;
+	cl::Kernel smoothKernel;
+	cl::Kernel residualKernel;
+	cl::Kernel restrictKernel;
+	cl::Kernel prolongateKernel;
+	cl::Kernel zeroKernel;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PACKED_LIFE_SSE2 1
+#endif
+
+// Bit-packed Game of Life grid, the layout of game_of_life_packed in kernels/conway.cl:
+// 64 cells per word, bit i of word x in a row is the cell at column 64 * x + i. Rows wrap around like the torus of game_of_life.
+constexpr int cells_per_word = 64;
+
+inline std::vector<uint64_t> pack_cells(const std::vector<uint8_t>& cells, int width, int height) {
+	if (width % cells_per_word != 0) {
+		throw std::runtime_error("Packed grid width must be a multiple of 64");
+	}
+	int wordsPerRow = width / cells_per_word;
+	std::vector<uint64_t> words(size_t(wordsPerRow) * height, 0);
+	for (size_t word = 0; word < words.size(); ++word) {
+		const uint8_t* source = cells.data() + word * cells_per_word;
+		uint64_t bits = 0;
+		for (int bit = 0; bit < cells_per_word; ++bit) {
+			bits |= uint64_t(source[bit] != 0) << bit;
+		}
+		words[word] = bits;
+	}
+	return words;
+}
+
+inline std::vector<uint8_t> unpack_cells(const std::vector<uint64_t>& words, int width, int height) {
+	std::vector<uint8_t> cells(size_t(width) * height);
+	for (size_t word = 0; word < words.size(); ++word) {
+		for (int bit = 0; bit < cells_per_word; ++bit) {
+			cells[word * cells_per_word + bit] = uint8_t((words[word] >> bit) & 1);
+		}
+	}
+	return cells;
+}
+
+inline uint64_t shift_left(uint64_t word, int shift) {
+	return word << shift;
+}
+
+inline uint64_t shift_right(uint64_t word, int shift) {
+	return word >> shift;
+}
+
+#ifdef PACKED_LIFE_SSE2
+// Two consecutive words of a row
+struct WordPair {
+	__m128i words;
+};
+
+inline WordPair load_word_pair(const uint64_t* words) {
+	return { _mm_loadu_si128(reinterpret_cast<const __m128i*>(words)) };
+}
+
+inline WordPair operator&(WordPair a, WordPair b) { return { _mm_and_si128(a.words, b.words) }; }
+inline WordPair operator|(WordPair a, WordPair b) { return { _mm_or_si128(a.words, b.words) }; }
+inline WordPair operator^(WordPair a, WordPair b) { return { _mm_xor_si128(a.words, b.words) }; }
+inline WordPair operator~(WordPair a) { return { _mm_xor_si128(a.words, _mm_set1_epi32(-1)) }; }
+
+inline WordPair shift_left(WordPair pair, int shift) {
+	return { _mm_sll_epi64(pair.words, _mm_cvtsi32_si128(shift)) };
+}
+
+inline WordPair shift_right(WordPair pair, int shift) {
+	return { _mm_srl_epi64(pair.words, _mm_cvtsi32_si128(shift)) };
+}
+#endif
+
+// Next state of the 64 cells of center from the 8 words around it. The neighbour counts are summed
+// with bit-parallel adders - same logic as next_generation_word() in kernels/conway.cl.
+template<typename TWord>
+inline TWord next_generation_word(
+	TWord upLeft, TWord up, TWord upRight,
+	TWord left, TWord center, TWord right,
+	TWord downLeft, TWord down, TWord downRight)
+{
+	// Neighbour bitboards - west of bit i is bit i - 1, the west of bit 0 is bit 63 of the left word
+	TWord upWest = shift_left(up, 1) | shift_right(upLeft, 63);
+	TWord upEast = shift_right(up, 1) | shift_left(upRight, 63);
+	TWord west = shift_left(center, 1) | shift_right(left, 63);
+	TWord east = shift_right(center, 1) | shift_left(right, 63);
+	TWord downWest = shift_left(down, 1) | shift_right(downLeft, 63);
+	TWord downEast = shift_right(down, 1) | shift_left(downRight, 63);
+
+	// 2-bit neighbour count of each row - full adders above and below, half adder in the center row
+	TWord upOnes = upWest ^ up ^ upEast;
+	TWord upTwos = (upWest & up) | (upEast & (upWest ^ up));
+	TWord midOnes = west ^ east;
+	TWord midTwos = west & east;
+	TWord downOnes = downWest ^ down ^ downEast;
+	TWord downTwos = (downWest & down) | (downEast & (downWest ^ down));
+
+	// Ones of the total count and their carry into the twos
+	TWord ones = upOnes ^ midOnes ^ downOnes;
+	TWord carry = (upOnes & midOnes) | (downOnes & (upOnes ^ midOnes));
+
+	// The count is 2 or 3 iff exactly one of the four weight two bits is set, 3 needs the ones bit, 2 a living cell
+	TWord exactlyOne = (upTwos ^ midTwos ^ downTwos ^ carry) & ~((upTwos & midTwos) | (downTwos & carry));
+	return exactlyOne & (ones | center);
+}
+
+// Rows [firstRow, lastRow) of the next generation
+inline void step_packed_rows(const uint64_t* current, uint64_t* next, int wordsPerRow, int height, int firstRow, int lastRow) {
+	for (int y = firstRow; y < lastRow; ++y) {
+		const uint64_t* up = current + size_t(y == 0 ? height - 1 : y - 1) * wordsPerRow;
+		const uint64_t* mid = current + size_t(y) * wordsPerRow;
+		const uint64_t* down = current + size_t(y == height - 1 ? 0 : y + 1) * wordsPerRow;
+		uint64_t* output = next + size_t(y) * wordsPerRow;
+
+		auto stepWord = [&](int x) {
+			int xl = x == 0 ? wordsPerRow - 1 : x - 1;
+			int xr = x == wordsPerRow - 1 ? 0 : x + 1;
+			output[x] = next_generation_word(up[xl], up[x], up[xr], mid[xl], mid[x], mid[xr], down[xl], down[x], down[xr]);
+		};
+		int x = 0;
+#ifdef PACKED_LIFE_SSE2
+		// Two words per vector, the row ends wrap around and go through the scalar path
+		stepWord(x++);
+		for (; x + 3 <= wordsPerRow; x += 2) {
+			WordPair result = next_generation_word(
+				load_word_pair(up + x - 1), load_word_pair(up + x), load_word_pair(up + x + 1),
+				load_word_pair(mid + x - 1), load_word_pair(mid + x), load_word_pair(mid + x + 1),
+				load_word_pair(down + x - 1), load_word_pair(down + x), load_word_pair(down + x + 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), result.words);
+		}
+#endif
+		for (; x < wordsPerRow; ++x) {
+			stepWord(x);
+		}
+	}
+}
+
+// CPU reference of game_of_life_packed, rows are split over the hardware threads
+inline void step_packed(const std::vector<uint64_t>& current, std::vector<uint64_t>& next, int wordsPerRow, int height) {
+	int threadCount = std::max(1, std::min(int(std::thread::hardware_concurrency()), height));
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadCount; ++i) {
+		int firstRow = int(int64_t(height) * i / threadCount);
+		int lastRow = int(int64_t(height) * (i + 1) / threadCount);
+		threads.emplace_back(step_packed_rows, current.data(), next.data(), wordsPerRow, height, firstRow, lastRow);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
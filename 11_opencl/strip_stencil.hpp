@@ -0,0 +1,236 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cl_utils.hpp"
+
+// Devices to split a grid over: the sub-devices of the device partitioned by affinity domain (the NUMA nodes of a CPU),
+// else up to 4 equal partitions of its compute units, else the device alone. Only sub-devices of one parent device
+// share the strip buffers of a context coherently, separate devices of the platform are never used.
+inline std::vector<cl::Device> get_strip_devices(cl::Device device) {
+	const cl_device_partition_property affinityProperties[] = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE, 0 };
+	std::vector<cl::Device> subDevices;
+	if (device.createSubDevices(affinityProperties, &subDevices) == CL_SUCCESS && subDevices.size() > 1) {
+		return subDevices;
+	}
+	cl_uint computeUnits = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+	if (computeUnits >= 2) {
+		const cl_device_partition_property equalProperties[] = { CL_DEVICE_PARTITION_EQUALLY, cl_device_partition_property(std::max(1u, computeUnits / 4)), 0 };
+		subDevices.clear();
+		if (device.createSubDevices(equalProperties, &subDevices) == CL_SUCCESS && subDevices.size() > 1) {
+			return subDevices;
+		}
+	}
+	return { device };
+}
+
+// Runs a stencil kernel on horizontal strips of the grid, one strip per sub-device of a shared context. Each strip buffer has
+// a halo row above and below its rows, the strip kernels take (current, next, width, height, first_row, rows, ...) and
+// write the strip rows 1 to rows. Every iteration a device first computes its two boundary rows, then its interior rows
+// while a transfer queue copies the boundary rows into the halos of the neighbouring strips. Only the boundary rows of
+// the next iteration wait for the halos, so computation and halo exchange overlap.
+class StripStencil {
+public:
+	// periodic wraps the halos of the first and the last strip around like the torus of game_of_life
+	StripStencil(const std::vector<cl::Device>& devices, const std::string& source, const char* kernelName, int width, int height, size_t cellBytes, bool periodic)
+		: width(width), height(height), rowBytes(size_t(width) * cellBytes), periodic(periodic)
+	{
+		if (height < 2 * int(devices.size())) {
+			throw std::runtime_error("Each strip needs at least 2 rows");
+		}
+		context = cl::Context(devices);
+		program = cl::Program(context, source);
+		if (program.build(devices) != CL_SUCCESS) {
+			throw std::runtime_error("Failed to build " + std::string(kernelName) + ":\n" + program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices.front()));
+		}
+		int count = int(devices.size());
+		for (int i = 0; i < count; ++i) {
+			Strip strip;
+			strip.firstRow = int(int64_t(height) * i / count);
+			strip.rows = int(int64_t(height) * (i + 1) / count) - strip.firstRow;
+			size_t bytes = (strip.rows + 2) * rowBytes;
+			strip.current = cl::Buffer(context, CL_MEM_READ_WRITE, bytes);
+			strip.next = cl::Buffer(context, CL_MEM_READ_WRITE, bytes);
+			strip.computeQueue = cl::CommandQueue(context, devices[i]);
+			strip.transferQueue = cl::CommandQueue(context, devices[i]);
+			strip.kernel = cl::Kernel(program, kernelName);
+			strip.kernel.setArg(2, width);
+			strip.kernel.setArg(3, height);
+			strip.kernel.setArg(4, strip.firstRow);
+			strip.kernel.setArg(5, strip.rows);
+			strips.push_back(strip);
+		}
+	}
+
+	// Sets an argument after the strip arguments of all strip kernels
+	template<typename T>
+	void set_arg(cl_uint index, const T& value) {
+		for (auto& strip : strips) {
+			strip.kernel.setArg(index, value);
+		}
+	}
+
+	// Scatters the cells of the grid into the strips and their halos
+	void write(const void* cells) {
+		const unsigned char* source = static_cast<const unsigned char*>(cells);
+		for (auto& strip : strips) {
+			std::vector<unsigned char> rows((strip.rows + 2) * rowBytes, 0);
+			for (int row = 0; row < strip.rows + 2; ++row) {
+				int gridRow = strip.firstRow + row - 1;
+				if (periodic) {
+					gridRow = (gridRow + height) % height;
+				} else if (gridRow < 0 || gridRow >= height) {
+					// Never read, the strip kernels know the grid edges
+					continue;
+				}
+				std::memcpy(rows.data() + row * rowBytes, source + gridRow * rowBytes, rowBytes);
+			}
+			strip.computeQueue.enqueueWriteBuffer(strip.current, CL_TRUE, 0, rows.size(), rows.data());
+			strip.haloEvents.clear();
+			strip.interiorEvent = cl::Event();
+		}
+	}
+
+	// Gathers the strip rows into the cells of the grid
+	void read(void* cells) {
+		unsigned char* target = static_cast<unsigned char*>(cells);
+		for (auto& strip : strips) {
+			strip.computeQueue.enqueueReadBuffer(strip.current, CL_FALSE, rowBytes, strip.rows * rowBytes, target + strip.firstRow * rowBytes);
+		}
+		finish();
+	}
+
+	void run(int iterations) {
+		int count = int(strips.size());
+		for (int iteration = 0; iteration < iterations; ++iteration) {
+			// Boundary rows after the halos of the previous iteration arrived
+			std::vector<cl::Event> boundaryEvents(count);
+			for (auto& strip : strips) {
+				strip.kernel.setArg(0, strip.current);
+				strip.kernel.setArg(1, strip.next);
+				strip.computeQueue.enqueueNDRangeKernel(strip.kernel, cl::NDRange(0, 1), cl::NDRange(width, 1), cl::NullRange, &strip.haloEvents);
+			}
+			for (int i = 0; i < count; ++i) {
+				Strip& strip = strips[i];
+				strip.computeQueue.enqueueNDRangeKernel(strip.kernel, cl::NDRange(0, strip.rows), cl::NDRange(width, 1), cl::NullRange, nullptr, &boundaryEvents[i]);
+			}
+
+			// Halo exchange into the next buffers of the neighbours, they were last read by the interior rows of the previous iteration
+			std::vector<std::vector<cl::Event>> haloEvents(count);
+			for (int i = 0; i < count; ++i) {
+				Strip& strip = strips[i];
+				int up = i > 0 ? i - 1 : periodic ? count - 1 : -1;
+				int down = i < count - 1 ? i + 1 : periodic ? 0 : -1;
+				if (up >= 0) {
+					copy_row(strip, 1, strips[up], strips[up].rows + 1, boundaryEvents[i], haloEvents[up]);
+				}
+				if (down >= 0) {
+					copy_row(strip, strip.rows, strips[down], 0, boundaryEvents[i], haloEvents[down]);
+				}
+			}
+
+			// Interior rows during the exchange
+			for (auto& strip : strips) {
+				if (strip.rows > 2) {
+					strip.computeQueue.enqueueNDRangeKernel(strip.kernel, cl::NDRange(0, 2), cl::NDRange(width, strip.rows - 2), cl::NullRange, nullptr, &strip.interiorEvent);
+				} else {
+					strip.computeQueue.enqueueMarkerWithWaitList(nullptr, &strip.interiorEvent);
+				}
+			}
+			for (int i = 0; i < count; ++i) {
+				Strip& strip = strips[i];
+				strip.computeQueue.flush();
+				strip.transferQueue.flush();
+				std::swap(strip.current, strip.next);
+				strip.haloEvents = haloEvents[i];
+			}
+		}
+	}
+
+	void finish() {
+		for (auto& strip : strips) {
+			strip.transferQueue.finish();
+			strip.computeQueue.finish();
+		}
+	}
+
+	int device_count() const {
+		return int(strips.size());
+	}
+
+private:
+	struct Strip {
+		int firstRow = 0;
+		int rows = 0;
+		cl::Buffer current;
+		cl::Buffer next;
+		cl::CommandQueue computeQueue;
+		cl::CommandQueue transferQueue;
+		cl::Kernel kernel;
+		std::vector<cl::Event> haloEvents;
+		cl::Event interiorEvent;
+	};
+
+	// Copies a computed row of source into a halo row of the next buffer of target on the transfer queue of target
+	void copy_row(Strip& source, int sourceRow, Strip& target, int targetRow, const cl::Event& boundaryEvent, std::vector<cl::Event>& targetEvents) {
+		std::vector<cl::Event> waitEvents = { boundaryEvent };
+		if (target.interiorEvent() != nullptr) {
+			waitEvents.push_back(target.interiorEvent);
+		}
+		cl::Event event;
+		target.transferQueue.enqueueCopyBuffer(source.next, target.next, sourceRow * rowBytes, targetRow * rowBytes, rowBytes, &waitEvents, &event);
+		targetEvents.push_back(event);
+	}
+
+	int width;
+	int height;
+	size_t rowBytes;
+	bool periodic;
+	cl::Context context;
+	cl::Program program;
+	std::vector<Strip> strips;
+};
+
+// Times the iterations on the first 1 to devices.size() devices from the initial cells and prints the speedups and
+// parallel efficiencies. Every result must match the expected cells, setArgs sets the arguments after the strip ones.
+inline bool run_strip_scaling(const std::vector<cl::Device>& devices, const std::string& source, const char* kernelName, int width, int height,
+	size_t cellBytes, bool periodic, const void* initial, const void* expected, int iterations, const std::function<void(StripStencil&)>& setArgs)
+{
+	using Clock = std::chrono::steady_clock;
+	size_t bytes = size_t(width) * height * cellBytes;
+	std::vector<unsigned char> result(bytes);
+	bool matches = true;
+	double singleTime = 0.0;
+	std::cout << kernelName << " on " << width << "x" << height << " cells, " << iterations << " iterations\n"
+		<< std::setw(8) << "Devices" << std::setw(12) << "Time ms" << std::setw(10) << "Speedup" << std::setw(12) << "Efficiency" << "  Result\n";
+	for (size_t count = 1; count <= devices.size(); ++count) {
+		StripStencil stencil(std::vector<cl::Device>(devices.begin(), devices.begin() + count), source, kernelName, width, height, cellBytes, periodic);
+		setArgs(stencil);
+		// The first launches compile the kernel on the devices and are not timed
+		stencil.write(initial);
+		stencil.run(1);
+		stencil.finish();
+		stencil.write(initial);
+		auto start = Clock::now();
+		stencil.run(iterations);
+		stencil.finish();
+		double time = std::chrono::duration<double>(Clock::now() - start).count();
+		stencil.read(result.data());
+		bool same = std::memcmp(result.data(), expected, bytes) == 0;
+		matches &= same;
+		if (count == 1) {
+			singleTime = time;
+		}
+		std::cout << std::setw(8) << count << std::setw(12) << time * 1000.0 << std::setw(10) << singleTime / time
+			<< std::setw(12) << singleTime / time / count << "  " << (same ? "matches" : "DIFFERS") << "\n";
+	}
+	return matches;
+}
@@ -104,7 +104,9 @@ public:
 
 	void prepareRenderData(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) override {
 		for (auto &mode : mRenderInfos) {
-			mode.second.shaderProgram = aMaterialFactory.getShaderProgram(mode.second.materialParams.mMaterialName);
+			mode.second.shaderProgram = aMaterialFactory.getShaderProgram(
+					mode.second.materialParams.mMaterialName,
+					mode.second.materialParams.mPermutation);
 			mode.second.geometry = getGeometry(aGeometryFactory, mode.second.materialParams.mRenderStyle);
 		}
 	}
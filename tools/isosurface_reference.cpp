@@ -0,0 +1,152 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+#include "volume_raycaster.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+// Renders the isosurface of a volume on the CPU with the same ray marching as shaders/isosurface.fragment.glsl,
+// once per space skipping mode. The accelerated modes must hit exactly where the plain march does - any
+// differing pixel means the octree or the distance field skipped over the surface.
+//
+// Usage: isosurface_reference <volume file> <iso value> [--size <pixels>] [--step <step size>] [--output <png>]
+//	iso value	in the normalized units the shaders sample (uint16 volumes map to [0, 1])
+//	--output	writes the octree rendering shaded like the shader
+
+struct Config {
+	fs::path volumeFile;
+	float isoValue = 0.0f;
+	int size = 512;
+	float stepSize = 0.005f;
+	fs::path output;
+};
+
+Config parseArguments(int argc, char **argv) {
+	if (argc < 3) {
+		throw std::runtime_error("Usage: isosurface_reference <volume file> <iso value> [--size <pixels>] [--step <step size>] [--output <png>]");
+	}
+	Config config;
+	config.volumeFile = argv[1];
+	config.isoValue = std::stof(argv[2]);
+	for (int i = 3; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			config.size = std::stoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--step") == 0 && i + 1 < argc) {
+			config.stepSize = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			config.output = argv[++i];
+		} else {
+			throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+		}
+	}
+	return config;
+}
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+// Camera of the 07_3d_textures demo - at (0, 0, -3) looking at the unit cube
+Ray getCameraRay(int aX, int aY, int aSize) {
+	const float cTanHalfFov = std::tan(0.5f * 45.0f * 3.14159265f / 180.0f);
+	float u = (2.0f * (aX + 0.5f) / aSize - 1.0f) * cTanHalfFov;
+	float v = (1.0f - 2.0f * (aY + 0.5f) / aSize) * cTanHalfFov;
+	// Looking along +z with y up, x points to the left
+	return { glm::vec3(0.0f, 0.0f, -3.0f), glm::normalize(glm::vec3(-u, v, 1.0f)) };
+}
+
+struct RenderResult {
+	std::vector<IsosurfaceHit> hits;
+	std::vector<uint8_t> image;
+	double milliseconds = 0.0;
+};
+
+RenderResult render(const VolumeRaycaster &aRaycaster, const Config &aConfig, SpaceSkipping aSkipping, ThreadPool &aPool) {
+	RenderResult result;
+	result.hits.resize(size_t(aConfig.size) * aConfig.size);
+	result.image.resize(result.hits.size());
+	auto start = std::chrono::steady_clock::now();
+	parallelFor(aPool, 0, size_t(aConfig.size), 4, [&](size_t aBegin, size_t aEnd) {
+		for (int y = int(aBegin); y < int(aEnd); ++y) {
+			for (int x = 0; x < aConfig.size; ++x) {
+				size_t index = size_t(y) * aConfig.size + x;
+				auto ray = getCameraRay(x, y, aConfig.size);
+				auto cube = VolumeRaycaster::intersectCube(ray.origin, ray.direction);
+				if (!cube) {
+					continue;
+				}
+				glm::vec3 entryPoint = ray.origin + cube->first * ray.direction;
+				auto hit = aRaycaster.traceIsosurface(entryPoint, ray.direction, aConfig.stepSize, 1000, aSkipping);
+				result.hits[index] = hit;
+				if (hit.hit) {
+					glm::vec3 texCoords = entryPoint + hit.distance * ray.direction + glm::vec3(0.5f);
+					glm::vec3 gradient = aRaycaster.gradient(texCoords);
+					float diff = glm::length(gradient) > 0.0f ? std::abs(glm::dot(glm::normalize(gradient), ray.direction)) : 0.0f;
+					result.image[index] = uint8_t(255.0f * (0.15f + 0.85f * diff));
+				}
+			}
+		}
+	});
+	result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+int main(int argc, char **argv) {
+	try {
+		auto config = parseArguments(argc, argv);
+		ThreadPool pool;
+
+		auto volume = load3DFile(config.volumeFile);
+		auto buildStart = std::chrono::steady_clock::now();
+		VolumeRaycaster raycaster(*volume, 16, &pool);
+		raycaster.setIsoValue(config.isoValue);
+		auto buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+		std::cout << volume->width << "x" << volume->height << "x" << volume->depth
+			<< ", octree levels " << raycaster.octree().levels.size()
+			<< ", acceleration structures built in " << buildTime << " ms\n";
+
+		auto reference = render(raycaster, config, SpaceSkipping::None, pool);
+		int mismatchCount = 0;
+		for (auto [name, skipping] : {
+				std::pair{ "none", SpaceSkipping::None },
+				std::pair{ "octree", SpaceSkipping::Octree },
+				std::pair{ "distance field", SpaceSkipping::DistanceField } })
+		{
+			auto result = skipping == SpaceSkipping::None ? reference : render(raycaster, config, skipping, pool);
+			size_t samples = 0;
+			size_t skips = 0;
+			int hits = 0;
+			int mismatches = 0;
+			for (size_t i = 0; i < result.hits.size(); ++i) {
+				const auto &hit = result.hits[i];
+				const auto &expected = reference.hits[i];
+				samples += hit.sampleCount;
+				skips += hit.skipCount;
+				hits += hit.hit;
+				if (hit.hit != expected.hit || (hit.hit && std::abs(hit.distance - expected.distance) > 1e-5f)) {
+					++mismatches;
+				}
+			}
+			mismatchCount += mismatches;
+			std::cout << name << ": " << result.milliseconds << " ms"
+				<< ", " << hits << " hits"
+				<< ", " << double(samples) / result.hits.size() << " samples/pixel"
+				<< ", " << double(skips) / result.hits.size() << " skips/pixel"
+				<< ", " << mismatches << " pixels differ from the plain march\n";
+
+			if (skipping == SpaceSkipping::Octree && !config.output.empty()) {
+				stbi_write_png(config.output.string().c_str(), config.size, config.size, 1, result.image.data(), config.size);
+			}
+		}
+		return mismatchCount > 0 ? 1 : 0;
+	} catch (std::exception &exc) {
+		std::cerr << "Error: " << exc.what() << "\n";
+		return -1;
+	}
+}
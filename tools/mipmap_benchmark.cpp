@@ -0,0 +1,98 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "ogl_resource.hpp"
+#include "error_handling.hpp"
+#include "window.hpp"
+#include "ogl_material_factory.hpp"
+#include "mipmap_generation.hpp"
+
+// Compares generateMipChain() with glGenerateMipmap() for one large texture.
+// Usage: mipmap_benchmark [image file] - without an image a 4096x4096 RGBA test pattern is used.
+// For the software rasterizer numbers run with LIBGL_ALWAYS_SOFTWARE=1 (Mesa llvmpipe).
+
+constexpr int cRepetitions = 5;
+
+PixelImage createTestPattern(int aSize) {
+	PixelImage image;
+	image.width = aSize;
+	image.height = aSize;
+	image.channels = 4;
+	image.pixels.resize(size_t(aSize) * aSize * 4);
+	for (int y = 0; y < aSize; ++y) {
+		for (int x = 0; x < aSize; ++x) {
+			uint8_t *pixel = &image.pixels[(size_t(y) * aSize + x) * 4];
+			pixel[0] = uint8_t(x);
+			pixel[1] = uint8_t(y);
+			pixel[2] = uint8_t(((x / 16) ^ (y / 16)) & 1 ? 255 : 0);
+			pixel[3] = 255;
+		}
+	}
+	return image;
+}
+
+double measureMilliseconds(const std::function<void()> &aFunction) {
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < cRepetitions; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		aFunction();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	if (!glfwInit()) {
+		std::cerr << "Failed to initialize GLFW" << std::endl;
+		return -1;
+	}
+
+	try {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		auto window = Window(64, 64, "Mipmap benchmark");
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << "\n";
+
+		auto image = argc > 1 ? toPixelImage(*loadImage(argv[1])) : createTestPattern(4096);
+		std::cout << "Image " << image.width << "x" << image.height << ", " << image.channels << " channels, best of " << cRepetitions << " runs\n";
+
+		ThreadPool pool;
+		for (auto [filter, filterName] : { std::pair{ MipFilter::Box, "box" }, std::pair{ MipFilter::Kaiser, "kaiser" } }) {
+			MipmapOptions options;
+			options.filter = filter;
+			auto singleThread = measureMilliseconds([&] { generateMipChain(image, options); });
+			auto multiThread = measureMilliseconds([&] { generateMipChain(image, options, &pool); });
+			std::cout << "CPU " << filterName << " (sRGB): 1 thread " << singleThread << " ms, "
+				<< pool.size() << " threads " << multiThread << " ms\n";
+		}
+
+		auto texture = createTexture();
+		GLenum format = image.channels == 4 ? GL_RGBA : image.channels == 3 ? GL_RGB : image.channels == 2 ? GL_RG : GL_RED;
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture.get()));
+		GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+		GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.data()));
+		GL_CHECK(glFinish());
+		auto gpuTime = measureMilliseconds([] {
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glFinish();
+		});
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+		std::cout << "glGenerateMipmap: " << gpuTime << " ms (GL thread blocked)\n";
+	} catch (OpenGLError &exc) {
+		std::cerr << "OpenGL error: " << exc.what() << "\n";
+		return -2;
+	} catch (std::exception &exc) {
+		std::cerr << "Error: " << exc.what() << "\n";
+		return -1;
+	}
+
+	glfwTerminate();
+	return 0;
+}
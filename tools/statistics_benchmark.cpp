@@ -0,0 +1,188 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <algorithm>
+
+#include "value_statistics.hpp"
+
+// Measures the throughput of ValueStatisticsBuilder - range, moments and histogram in one pass - on random
+// uint8, uint16 and float spans or on volume files. The scalar baseline computes the same with separate
+// std::minmax_element, sum and binning passes; both results must agree.
+//
+// Usage: statistics_benchmark [--count <values>] [--repeat <count>] [<volume file>...]
+//	--count		values of each random span, 64M by default
+//	--repeat	measurements per variant, the fastest one is reported, 3 by default
+
+struct Config {
+	size_t count = size_t(64) << 20;
+	int repeat = 3;
+	std::vector<fs::path> volumeFiles;
+};
+
+Config parseArguments(int argc, char **argv) {
+	Config config;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+			config.count = std::stoull(argv[++i]);
+		} else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			config.repeat = std::max(1, std::stoi(argv[++i]));
+		} else if (argv[i][0] == '-') {
+			throw std::runtime_error("Usage: statistics_benchmark [--count <values>] [--repeat <count>] [<volume file>...]");
+		} else {
+			config.volumeFiles.push_back(argv[i]);
+		}
+	}
+	return config;
+}
+
+struct Result {
+	ValueStatistics statistics;
+	ValueHistogram histogram;
+};
+
+// Histogram the factory computes - exact bins for integers, the default bins over the value range for floats
+ValueHistogram getHistogramLayout(VoxelType aType, VoxelRange aRange) {
+	ValueHistogram histogram;
+	size_t binCount = getExactBinCount(aType);
+	if (binCount > 0) {
+		histogram.minimum = 0.0f;
+		histogram.maximum = float(binCount);
+	} else {
+		binCount = ValueStatisticsBuilder::cDefaultBinCount;
+		histogram.minimum = aRange.minimum;
+		histogram.maximum = std::max(aRange.minimum, aRange.maximum);
+	}
+	histogram.bins.resize(binCount, 0);
+	return histogram;
+}
+
+template<typename TValue>
+Result computeBaseline(const TValue *aValues, size_t aCount, const ValueHistogram &aLayout) {
+	Result result;
+	result.statistics.count = aCount;
+	auto [minimum, maximum] = std::minmax_element(aValues, aValues + aCount);
+	result.statistics.range = VoxelRange{ float(*minimum), float(*maximum) };
+	for (size_t i = 0; i < aCount; ++i) {
+		double value = double(aValues[i]);
+		result.statistics.sum += value;
+		result.statistics.sumOfSquares += value * value;
+	}
+	result.histogram = aLayout;
+	float lastBin = float(aLayout.bins.size() - 1);
+	float scale = aLayout.maximum > aLayout.minimum ? float(aLayout.bins.size()) / (aLayout.maximum - aLayout.minimum) : 0.0f;
+	for (size_t i = 0; i < aCount; ++i) {
+		++result.histogram.bins[size_t(std::clamp((float(aValues[i]) - aLayout.minimum) * scale, 0.0f, lastBin))];
+	}
+	return result;
+}
+
+Result computeBaseline(VoxelType aType, const void *aValues, size_t aCount, const ValueHistogram &aLayout) {
+	switch (aType) {
+	case VoxelType::UInt8: return computeBaseline(static_cast<const uint8_t *>(aValues), aCount, aLayout);
+	case VoxelType::UInt16: return computeBaseline(static_cast<const uint16_t *>(aValues), aCount, aLayout);
+	case VoxelType::Float32: return computeBaseline(static_cast<const float *>(aValues), aCount, aLayout);
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+Result computeStatistics(VoxelType aType, const void *aValues, size_t aCount, const ValueHistogram &aLayout, ThreadPool *aPool) {
+	ValueStatisticsBuilder builder(aType, VoxelRange{ aLayout.minimum, aLayout.maximum }, aLayout.bins.size(), aPool);
+	builder.addValues(aValues, aCount);
+	return { builder.statistics(), builder.histogram() };
+}
+
+bool isClose(double aValue, double aExpected) {
+	return std::abs(aValue - aExpected) <= 1e-9 * std::max(1.0, std::abs(aExpected));
+}
+
+bool matches(const Result &aResult, const Result &aExpected) {
+	return aResult.statistics.count == aExpected.statistics.count
+		&& aResult.statistics.range.minimum == aExpected.statistics.range.minimum
+		&& aResult.statistics.range.maximum == aExpected.statistics.range.maximum
+		&& isClose(aResult.statistics.sum, aExpected.statistics.sum)
+		&& isClose(aResult.statistics.sumOfSquares, aExpected.statistics.sumOfSquares)
+		&& aResult.histogram.bins == aExpected.histogram.bins;
+}
+
+// Fastest of aRepeat runs in seconds, aResult receives the result of the last one
+template<typename TFunction>
+double measure(int aRepeat, Result &aResult, TFunction aFunction) {
+	using Clock = std::chrono::steady_clock;
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < aRepeat; ++i) {
+		auto start = Clock::now();
+		aResult = aFunction();
+		best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+// Returns false if the kernel disagrees with the baseline
+bool benchmark(const std::string &aName, VoxelType aType, const void *aValues, size_t aCount, const Config &aConfig, ThreadPool &aPool) {
+	Result baseline;
+	Result serial;
+	Result parallel;
+	// The range of float spans comes from a previous pass, like in the factory
+	ValueStatisticsBuilder rangeBuilder(aType, &aPool);
+	rangeBuilder.addValues(aValues, aCount);
+	auto layout = getHistogramLayout(aType, rangeBuilder.statistics().range);
+	double baselineTime = measure(aConfig.repeat, baseline, [&] { return computeBaseline(aType, aValues, aCount, layout); });
+	double serialTime = measure(aConfig.repeat, serial, [&] { return computeStatistics(aType, aValues, aCount, layout, nullptr); });
+	double parallelTime = measure(aConfig.repeat, parallel, [&] { return computeStatistics(aType, aValues, aCount, layout, &aPool); });
+
+	double gigabytes = double(aCount * getVoxelSize(aType)) / 1e9;
+	const auto &statistics = parallel.statistics;
+	std::cout << aName << ": " << aCount << " values, " << layout.bins.size() << " bins"
+		<< ", range [" << statistics.range.minimum << ", " << statistics.range.maximum << "]"
+		<< ", mean " << statistics.mean() << ", deviation " << statistics.standardDeviation() << "\n"
+		<< "\tscalar baseline " << gigabytes / baselineTime << " GB/s"
+		<< ", SIMD " << gigabytes / serialTime << " GB/s on 1 thread (" << baselineTime / serialTime << "x)"
+		<< ", " << gigabytes / parallelTime << " GB/s on " << aPool.size() << " threads (" << baselineTime / parallelTime << "x)\n";
+
+	if (!matches(serial, baseline) || !matches(parallel, baseline)) {
+		std::cerr << aName << ": statistics differ from the scalar baseline\n";
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	try {
+		auto config = parseArguments(argc, argv);
+		ThreadPool pool;
+		bool passed = true;
+
+		if (config.volumeFiles.empty()) {
+			std::mt19937 generator(7);
+			std::vector<uint8_t> bytes(config.count);
+			std::uniform_int_distribution<int> byteDistribution(0, 255);
+			std::generate(bytes.begin(), bytes.end(), [&] { return uint8_t(byteDistribution(generator)); });
+			passed &= benchmark("uint8", VoxelType::UInt8, bytes.data(), bytes.size(), config, pool);
+
+			// 12-bit values like the CT volumes
+			std::vector<uint16_t> words(config.count);
+			std::uniform_int_distribution<int> wordDistribution(0, 4095);
+			std::generate(words.begin(), words.end(), [&] { return uint16_t(wordDistribution(generator)); });
+			passed &= benchmark("uint16", VoxelType::UInt16, words.data(), words.size(), config, pool);
+
+			std::vector<float> floats(config.count);
+			std::normal_distribution<float> floatDistribution(0.0f, 1.0f);
+			std::generate(floats.begin(), floats.end(), [&] { return floatDistribution(generator); });
+			passed &= benchmark("float", VoxelType::Float32, floats.data(), floats.size(), config, pool);
+		}
+		for (const auto &file : config.volumeFiles) {
+			auto volume = load3DFile(file);
+			size_t count = size_t(volume->width) * volume->height * volume->depth;
+			passed &= benchmark(file.filename().string(), volume->type(), volume->voxels(), count, config, pool);
+		}
+		return passed ? 0 : 1;
+	} catch (std::exception &exc) {
+		std::cerr << "Error: " << exc.what() << "\n";
+		return -1;
+	}
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "ogl_material_factory.hpp"
+#include "texture_compression.hpp"
+
+// Compresses every image in the texture directory into a block compressed container next to the source file.
+// OGLMaterialFactory::loadTexturesFromDir() then uploads the cooked version instead of decoding the image.
+// Images whose cooked version is newer than the source are skipped unless --force is given.
+// Before cooking, a synthetic image is round tripped through every block format and must reach the PSNR of the format
+// in cSelfChecks, so a regression of the encoders fails the cooker (exit code 1) instead of shipping worse textures.
+//
+// Usage: texture_cooker <texture dir> [--bc7] [--min-psnr <dB>] [--force]
+//	--bc7		use BC7 instead of BC1/BC3 for color textures
+//	--min-psnr	fail (exit code 1) if any texture's top level falls below this PSNR - quality regression check
+//	--force		cook all images again, e.g. after changing --bc7
+
+struct Config {
+	fs::path textureDir;
+	bool highQuality = false;
+	double minPSNR = 0.0;
+	bool force = false;
+};
+
+struct SelfCheck {
+	BlockFormat format;
+	int channels;
+	double minPSNR; ///< About 3 dB below what the encoders reach on createTestImage()
+};
+
+const SelfCheck cSelfChecks[] = {
+	{ BlockFormat::BC1, 3, 33.0 },
+	{ BlockFormat::BC3, 4, 34.0 },
+	{ BlockFormat::BC4, 1, 44.0 },
+	{ BlockFormat::BC5, 2, 44.0 },
+	{ BlockFormat::BC7, 3, 36.0 },
+	{ BlockFormat::BC7, 4, 36.0 },
+};
+
+// Smooth gradients for the endpoint interpolation and a checkerboard for the sharp edges inside blocks
+PixelImage createTestImage(int aChannels) {
+	const int cSize = 128;
+	PixelImage image{ cSize, cSize, aChannels, std::vector<uint8_t>(size_t(cSize) * cSize * aChannels) };
+	for (int y = 0; y < cSize; ++y) {
+		for (int x = 0; x < cSize; ++x) {
+			for (int c = 0; c < aChannels; ++c) {
+				double wave = 0.25 * std::sin((x * (c + 1) + y * (3 - c % 3)) * 0.05);
+				double checker = ((x / 16 + y / 16 + c) % 2 ? 0.2 : -0.2) * (c == 3 ? 0.5 : 1.0);
+				image.pixels[(size_t(y) * cSize + x) * aChannels + c] = uint8_t(std::clamp(0.5 + wave + checker, 0.0, 1.0) * 255.0 + 0.5);
+			}
+		}
+	}
+	return image;
+}
+
+// Round trips the test image through every format of cSelfChecks, false if any falls below its PSNR
+bool runSelfCheck(ThreadPool &aPool) {
+	bool passed = true;
+	for (const auto &check : cSelfChecks) {
+		auto image = createTestImage(check.channels);
+		auto level = compressLevel(image, check.format, aPool);
+		double psnr = computePSNR(image, decompressLevel(level, check.format, check.channels));
+		std::cout << "Self check " << getBlockFormatName(check.format) << " " << check.channels << " channels: PSNR " << psnr << " dB";
+		if (psnr < check.minPSNR) {
+			std::cout << ", below " << check.minPSNR << " dB\n";
+			passed = false;
+		} else {
+			std::cout << "\n";
+		}
+	}
+	return passed;
+}
+
+Config parseArguments(int argc, char **argv) {
+	if (argc < 2) {
+		throw std::runtime_error("Usage: texture_cooker <texture dir> [--bc7] [--min-psnr <dB>] [--force]");
+	}
+	Config config;
+	config.textureDir = argv[1];
+	for (int i = 2; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--bc7") == 0) {
+			config.highQuality = true;
+		} else if (std::strcmp(argv[i], "--min-psnr") == 0 && i + 1 < argc) {
+			config.minPSNR = std::stod(argv[++i]);
+		} else if (std::strcmp(argv[i], "--force") == 0) {
+			config.force = true;
+		} else {
+			throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+		}
+	}
+	return config;
+}
+
+int main(int argc, char **argv) {
+	using Clock = std::chrono::steady_clock;
+	try {
+		auto config = parseArguments(argc, argv);
+		ThreadPool pool;
+		if (!runSelfCheck(pool)) {
+			std::cerr << "Encoder self check failed, no textures were cooked\n";
+			return 1;
+		}
+		bool qualityFailed = false;
+
+		for (const auto &file : findSourceImageFiles(config.textureDir)) {
+			if (!config.force && isCookedTextureCurrent(file)) {
+				std::cout << file.filename().string() << ": up to date\n";
+				continue;
+			}
+			auto image = toPixelImage(*loadImage(file));
+
+			auto format = chooseBlockFormat(image.channels, config.highQuality);
+			auto encodeStart = Clock::now();
+			// Same color space rule as the mip chains loadTexturesFromDir() generates for uncooked images
+			auto mipmapOptions = getMipmapOptions(file);
+			auto texture = compressTexture(image, format, pool, mipmapOptions);
+			auto encodeTime = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - encodeStart).count();
+
+			double psnr = computePSNR(image, decompressLevel(texture.levels[0], format, image.channels));
+			fs::path outputPath = file.string() + cCompressedTextureExtension;
+			writeCompressedTexture(outputPath, texture);
+
+			size_t compressedSize = 0;
+			for (const auto &level : texture.levels) {
+				compressedSize += level.data.size();
+			}
+			std::cout << file.filename().string() << ": " << getBlockFormatName(format)
+				<< " " << image.width << "x" << image.height << ", " << texture.levels.size() << " levels"
+				<< (mipmapOptions.srgb ? " sRGB" : " linear")
+				<< ", ratio " << double(image.pixels.size()) * 4.0 / 3.0 / double(compressedSize)
+				<< ", encode " << encodeTime / 1000.0 << " ms"
+				<< ", PSNR " << psnr << " dB\n";
+
+			if (psnr < config.minPSNR) {
+				std::cerr << "PSNR of " << file << " below threshold " << config.minPSNR << " dB\n";
+				qualityFailed = true;
+			}
+		}
+		return qualityFailed ? 1 : 0;
+	} catch (std::exception &exc) {
+		std::cerr << "Error: " << exc.what() << "\n";
+		return -1;
+	}
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+#include "ogl_material_factory.hpp"
+#include "volume_compression.hpp"
+
+// Converts every .mhd and .dump volume in the directory into a bricked compressed container next to the source file.
+// OGLMaterialFactory::load3DTexturesFromDir() then decodes the bricks in parallel instead of reading the raw voxels.
+//
+// Usage: volume_compressor <volume dir> [--brick-size <voxels>] [--verify]
+//	--brick-size	edge of the independently decodable bricks, 32 by default
+//	--verify	decode the container and compare it with the source (exit code 1 on mismatch)
+
+struct Config {
+	fs::path volumeDir;
+	int brickSize = cDefaultCompressedBrickSize;
+	bool verify = false;
+};
+
+Config parseArguments(int argc, char **argv) {
+	if (argc < 2) {
+		throw std::runtime_error("Usage: volume_compressor <volume dir> [--brick-size <voxels>] [--verify]");
+	}
+	Config config;
+	config.volumeDir = argv[1];
+	for (int i = 2; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--brick-size") == 0 && i + 1 < argc) {
+			config.brickSize = std::stoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--verify") == 0) {
+			config.verify = true;
+		} else {
+			throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+		}
+	}
+	return config;
+}
+
+// Seconds to decode the whole volume through VolumeReader::forEachSlab(), one brick layer per slab
+double measureDecodeTime(const fs::path &aFile, ThreadPool *aPool) {
+	using Clock = std::chrono::steady_clock;
+	VolumeReader reader(aFile, aPool);
+	auto start = Clock::now();
+	reader.forEachSlab(1, [](int, int, const void *) {});
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+	using Clock = std::chrono::steady_clock;
+	try {
+		auto config = parseArguments(argc, argv);
+		ThreadPool pool;
+		bool verifyFailed = false;
+
+		for (const auto &file : findVolumeDataFiles(config.volumeDir)) {
+			if (file.extension() == cCompressedVolumeExtension) {
+				continue;
+			}
+			fs::path outputPath = file.string() + cCompressedVolumeExtension;
+			auto encodeStart = Clock::now();
+			auto stats = writeCompressedVolume(outputPath, VolumeReader(file), pool, config.brickSize);
+			double encodeTime = std::chrono::duration<double>(Clock::now() - encodeStart).count();
+
+			double serialTime = measureDecodeTime(outputPath, nullptr);
+			double parallelTime = measureDecodeTime(outputPath, &pool);
+			double gigabytes = double(stats.rawBytes) / 1e9;
+			std::cout << file.filename().string() << ": " << stats.rawBytes / (1 << 20) << " MiB -> " << stats.compressedBytes / (1 << 20) << " MiB"
+				<< ", ratio " << stats.ratio()
+				<< ", encode " << gigabytes / encodeTime << " GB/s"
+				<< ", decode " << gigabytes / serialTime << " GB/s on 1 thread, "
+				<< gigabytes / parallelTime << " GB/s on " << pool.size() << " threads\n";
+
+			if (config.verify) {
+				auto source = load3DFile(file);
+				auto decoded = load3DFile(outputPath);
+				if (decoded->type() != source->type() || std::memcmp(decoded->voxels(), source->voxels(), stats.rawBytes) != 0) {
+					std::cerr << "Decoded " << outputPath << " differs from its source\n";
+					verifyFailed = true;
+				}
+			}
+		}
+		return verifyFailed ? 1 : 0;
+	} catch (std::exception &exc) {
+		std::cerr << "Error: " << exc.what() << "\n";
+		return -1;
+	}
+}
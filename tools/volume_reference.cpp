@@ -0,0 +1,173 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <memory>
+
+#include "volume_reference_renderer.hpp"
+#include "volume_conversion.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+#include "stb/stb_image.h"
+
+// Renders a volume on the CPU like the mip or animated_texture program of 07_3d_textures and reports
+// the throughput of the scalar single thread baseline, the scalar and the packet renderer on all threads.
+// The packet image must match the scalar one; with --compare it is also checked against a golden image,
+// e.g. a screenshot of the GPU raycaster with u_lodBias at -100.
+//
+// Usage: volume_reference <volume file> [--mode mip|slice] [--size <pixels>] [--step <step size>] [--scale <x> <y> <z>]
+//		[--time <seconds>] [--window auto|<lower> <upper>] [--output <png>] [--compare <png>] [--tolerance <levels>]
+//	--scale		of the rendered cube, e.g. 1 1 1.5 for the first MIP scene
+//	--time		elapsed time of the animated slice
+//	--window	in the sampled units, auto applies the histogram window of VolumeFormat::Normalized8/16
+//	--tolerance	largest allowed difference to the golden image in 8-bit levels, 2 by default
+
+struct Config {
+	fs::path volumeFile;
+	std::string mode = "mip";
+	int size = 512;
+	float stepSize = 0.01f;
+	glm::vec3 scale = glm::vec3(1.0f);
+	float time = 0.0f;
+	bool autoWindow = false;
+	glm::vec2 window = glm::vec2(0.0f, 1.0f);
+	fs::path output;
+	fs::path compare;
+	int tolerance = 2;
+};
+
+Config parseArguments(int argc, char **argv) {
+	if (argc < 2) {
+		throw std::runtime_error("Usage: volume_reference <volume file> [--mode mip|slice] [--size <pixels>] [--step <step size>] [--scale <x> <y> <z>] "
+			"[--time <seconds>] [--window auto|<lower> <upper>] [--output <png>] [--compare <png>] [--tolerance <levels>]");
+	}
+	Config config;
+	config.volumeFile = argv[1];
+	for (int i = 2; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+			config.mode = argv[++i];
+		} else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			config.size = std::stoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--step") == 0 && i + 1 < argc) {
+			config.stepSize = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--scale") == 0 && i + 3 < argc) {
+			config.scale.x = std::stof(argv[++i]);
+			config.scale.y = std::stof(argv[++i]);
+			config.scale.z = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+			config.time = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc && std::strcmp(argv[i + 1], "auto") == 0) {
+			config.autoWindow = true;
+			++i;
+		} else if (std::strcmp(argv[i], "--window") == 0 && i + 2 < argc) {
+			config.window.x = std::stof(argv[++i]);
+			config.window.y = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			config.output = argv[++i];
+		} else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+			config.compare = argv[++i];
+		} else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			config.tolerance = std::stoi(argv[++i]);
+		} else {
+			throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+		}
+	}
+	if (config.mode != "mip" && config.mode != "slice") {
+		throw std::runtime_error("Unknown mode " + config.mode);
+	}
+	return config;
+}
+
+glm::vec2 getAutoWindow(const VolumeData &aVolume, ThreadPool &aPool) {
+	ValueStatisticsBuilder builder(aVolume.type(), aVolume.range, ValueStatisticsBuilder::cDefaultBinCount, &aPool);
+	builder.addValues(aVolume.voxels(), size_t(aVolume.width) * aVolume.height * aVolume.depth);
+	auto window = computeAutoWindow(builder.histogram());
+	float scale = getVoxelScale(aVolume.type());
+	return { window.lower * scale, window.upper * scale };
+}
+
+ReferenceImage render(const VolumeReferenceRenderer &aRenderer, const Config &aConfig, RayPacking aPacking) {
+	if (aConfig.mode == "slice") {
+		return aRenderer.renderSlice(aConfig.size, aConfig.size, SliceSettings{ aConfig.time, 1.0f, aConfig.window }, aPacking);
+	}
+	ReferenceCamera camera;
+	camera.width = aConfig.size;
+	camera.height = aConfig.size;
+	return aRenderer.renderMIP(camera, MIPSettings{ aConfig.scale, aConfig.stepSize, 1000, aConfig.window }, aPacking);
+}
+
+// Largest difference in 8-bit levels, -1 when the sizes differ
+int compareImages(const std::vector<uint8_t> &aImage, int aWidth, int aHeight, const fs::path &aGoldenFile) {
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	std::unique_ptr<unsigned char, void(*)(void*)> golden(stbi_load(aGoldenFile.string().c_str(), &width, &height, &channels, 1), stbi_image_free);
+	if (!golden) {
+		throw std::runtime_error("Failed to load " + aGoldenFile.string());
+	}
+	if (width != aWidth || height != aHeight) {
+		return -1;
+	}
+	int maxDifference = 0;
+	for (size_t i = 0; i < aImage.size(); ++i) {
+		maxDifference = std::max(maxDifference, std::abs(int(aImage[i]) - int(golden.get()[i])));
+	}
+	return maxDifference;
+}
+
+int main(int argc, char **argv) {
+	try {
+		auto config = parseArguments(argc, argv);
+		ThreadPool pool;
+
+		auto volume = load3DFile(config.volumeFile);
+		if (config.autoWindow) {
+			config.window = getAutoWindow(*volume, pool);
+			std::cout << "Auto window " << config.window.x << " - " << config.window.y << "\n";
+		}
+		VolumeReferenceRenderer serialRenderer(*volume);
+		VolumeReferenceRenderer renderer(*volume, &pool);
+
+		auto baseline = render(serialRenderer, config, RayPacking::Scalar);
+		auto scalar = render(renderer, config, RayPacking::Scalar);
+		auto packets = render(renderer, config, RayPacking::Packets);
+		for (auto [name, image] : {
+				std::pair{ "scalar, 1 thread", &baseline },
+				std::pair{ "scalar, pool", &scalar },
+				std::pair{ "packets, pool", &packets } })
+		{
+			std::cout << name << ": " << image->seconds * 1000.0 << " ms, "
+				<< image->raysPerSecond() / 1e6 << " Mrays/s, "
+				<< double(image->sampleCount) / image->seconds / 1e6 << " Msamples/s, "
+				<< baseline.seconds / image->seconds << "x\n";
+		}
+
+		float maxDifference = 0.0f;
+		for (size_t i = 0; i < packets.values.size(); ++i) {
+			maxDifference = std::max(maxDifference, std::abs(packets.values[i] - baseline.values[i]));
+		}
+		std::cout << "Largest packet vs scalar difference " << maxDifference << " on " << pool.size() << " threads\n";
+		int result = maxDifference > 1e-5f ? 1 : 0;
+
+		auto bytes = packets.toBytes();
+		if (!config.output.empty()) {
+			stbi_write_png(config.output.string().c_str(), packets.width, packets.height, 1, bytes.data(), packets.width);
+		}
+		if (!config.compare.empty()) {
+			int difference = compareImages(bytes, packets.width, packets.height, config.compare);
+			if (difference < 0) {
+				std::cout << "Golden image " << config.compare << " has a different size\n";
+				result = 1;
+			} else {
+				std::cout << "Largest difference to " << config.compare << ": " << difference << " levels\n";
+				result |= difference > config.tolerance ? 1 : 0;
+			}
+		}
+		return result;
+	} catch (std::exception &exc) {
+		std::cerr << "Error: " << exc.what() << "\n";
+		return -1;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief Assignment of virtual bricks to the slots of a fixed size cache, least recently used slots are reused first.
+ *
+ * Usage is reported per frame with touch(), a brick used in the frame the new brick is placed in
+ * is never evicted - the cache rather refuses the brick than thrash its own working set.
+ */
+class BrickResidency {
+public:
+	static constexpr size_t cNoSlot = ~size_t(0);
+
+	struct Placement {
+		size_t slot;
+		std::optional<size_t> evictedBrick;
+	};
+
+	BrickResidency(size_t aBrickCount, size_t aSlotCount)
+		: mBrickSlots(aBrickCount, cNoSlot)
+		, mSlotBricks(aSlotCount, cNoSlot)
+		, mSlotLastUse(aSlotCount, 0)
+		, mSlotPositions(aSlotCount)
+	{
+		// All slots start free at the cold end
+		for (size_t slot = 0; slot < aSlotCount; ++slot) {
+			mSlotPositions[slot] = mRecency.insert(mRecency.end(), slot);
+		}
+	}
+
+	size_t slotCount() const {
+		return mSlotBricks.size();
+	}
+
+	size_t residentCount() const {
+		return mResidentCount;
+	}
+
+	bool isResident(size_t aBrick) const {
+		return mBrickSlots[aBrick] != cNoSlot;
+	}
+
+	size_t slot(size_t aBrick) const {
+		return mBrickSlots[aBrick];
+	}
+
+	void touch(size_t aBrick, uint64_t aFrame) {
+		size_t slot = mBrickSlots[aBrick];
+		if (slot == cNoSlot) {
+			return;
+		}
+		mSlotLastUse[slot] = aFrame;
+		mRecency.splice(mRecency.begin(), mRecency, mSlotPositions[slot]);
+	}
+
+	/**
+	 * @brief Places aBrick into a free slot or the least recently used one.
+	 * @return Nothing if every slot holds a brick used in aFrame.
+	 */
+	std::optional<Placement> place(size_t aBrick, uint64_t aFrame) {
+		if (isResident(aBrick)) {
+			touch(aBrick, aFrame);
+			return Placement{ mBrickSlots[aBrick], std::nullopt };
+		}
+		size_t slot = mRecency.back();
+		Placement placement{ slot, std::nullopt };
+		if (mSlotBricks[slot] != cNoSlot) {
+			if (mSlotLastUse[slot] >= aFrame) {
+				return std::nullopt;
+			}
+			placement.evictedBrick = mSlotBricks[slot];
+			mBrickSlots[mSlotBricks[slot]] = cNoSlot;
+			--mResidentCount;
+		}
+		mSlotBricks[slot] = aBrick;
+		mBrickSlots[aBrick] = slot;
+		++mResidentCount;
+		touch(aBrick, aFrame);
+		return placement;
+	}
+
+protected:
+	std::vector<size_t> mBrickSlots;
+	std::vector<size_t> mSlotBricks;
+	std::vector<uint64_t> mSlotLastUse;
+	// Slots from the most to the least recently used
+	std::list<size_t> mRecency;
+	std::vector<std::list<size_t>::iterator> mSlotPositions;
+	size_t mResidentCount = 0;
+};
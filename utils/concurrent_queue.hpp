@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/**
+ * @brief Bounded lock-free multi-producer/multi-consumer queue.
+ *
+ * Each cell carries a sequence number telling whether it is ready for the next
+ * push or pop, so producers and consumers only contend on their own position
+ * counter (D. Vyukov's bounded MPMC queue). Capacity is rounded up to a power of two.
+ * The blocking push() and pop() sleep on the push/pop counters (C++20 atomic wait) instead of spinning.
+ */
+template<typename T>
+class ConcurrentQueue {
+public:
+	explicit ConcurrentQueue(size_t aCapacity) {
+		size_t capacity = 2;
+		while (capacity < aCapacity) {
+			capacity *= 2;
+		}
+		mMask = capacity - 1;
+		mCells = std::make_unique<Cell[]>(capacity);
+		for (size_t i = 0; i < capacity; ++i) {
+			mCells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	ConcurrentQueue(const ConcurrentQueue&) = delete;
+	ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+	/**
+	 * @return False if the queue is full.
+	 */
+	bool tryPush(T &&aValue) {
+		size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &mCells[position & mMask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+			if (difference == 0) {
+				if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = mEnqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value = std::move(aValue);
+		cell->sequence.store(position + 1, std::memory_order_release);
+		mPushCount.fetch_add(1, std::memory_order_release);
+		mPushCount.notify_all();
+		return true;
+	}
+
+	/**
+	 * @return False if the queue is empty.
+	 */
+	bool tryPop(T &aValue) {
+		size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &mCells[position & mMask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+			if (difference == 0) {
+				if (mDequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = mDequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+		aValue = std::move(cell->value);
+		cell->sequence.store(position + mMask + 1, std::memory_order_release);
+		mPopCount.fetch_add(1, std::memory_order_release);
+		mPopCount.notify_all();
+		return true;
+	}
+
+	/**
+	 * @brief Blocks until there is space in the queue.
+	 */
+	void push(T &&aValue) {
+		while (true) {
+			// Read the counter before trying, a pop in between changes it and the wait returns immediately
+			size_t popCount = mPopCount.load(std::memory_order_acquire);
+			if (tryPush(std::move(aValue))) {
+				return;
+			}
+			mPopCount.wait(popCount, std::memory_order_acquire);
+		}
+	}
+
+	/**
+	 * @brief Blocks until a value is available.
+	 */
+	T pop() {
+		T value;
+		while (true) {
+			size_t pushCount = mPushCount.load(std::memory_order_acquire);
+			if (tryPop(value)) {
+				return value;
+			}
+			mPushCount.wait(pushCount, std::memory_order_acquire);
+		}
+	}
+
+protected:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	static constexpr size_t cCacheLine = 64;
+
+	std::unique_ptr<Cell[]> mCells;
+	size_t mMask = 0;
+	alignas(cCacheLine) std::atomic<size_t> mEnqueuePosition = 0;
+	alignas(cCacheLine) std::atomic<size_t> mDequeuePosition = 0;
+	// Completed pushes and pops, the blocking calls wait on them
+	alignas(cCacheLine) std::atomic<size_t> mPushCount = 0;
+	alignas(cCacheLine) std::atomic<size_t> mPopCount = 0;
+};
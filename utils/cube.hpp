@@ -19,7 +19,9 @@ public:
 
 	void prepareRenderData(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) override {
 		for (auto &mode : mRenderInfos) {
-			mode.second.shaderProgram = aMaterialFactory.getShaderProgram(mode.second.materialParams.mMaterialName);
+			mode.second.shaderProgram = aMaterialFactory.getShaderProgram(
+					mode.second.materialParams.mMaterialName,
+					mode.second.materialParams.mPermutation);
 			getTextures(mode.second.materialParams.mParameterValues, aMaterialFactory);
 			mode.second.geometry = getGeometry(aGeometryFactory, mode.second.materialParams.mRenderStyle);
 		}
@@ -43,7 +45,9 @@ public:
 
 	void prepareRenderData(MaterialFactory &aMaterialFactory, GeometryFactory &aGeometryFactory) override {
 		for (auto &mode : mRenderInfos) {
-			mode.second.shaderProgram = aMaterialFactory.getShaderProgram(mode.second.materialParams.mMaterialName);
+			mode.second.shaderProgram = aMaterialFactory.getShaderProgram(
+					mode.second.materialParams.mMaterialName,
+					mode.second.materialParams.mPermutation);
 			getTextures(mode.second.materialParams.mParameterValues, aMaterialFactory);
 			mode.second.geometry = getGeometry(aGeometryFactory, mode.second.materialParams.mRenderStyle);
 		}
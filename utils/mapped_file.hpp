@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * Pages are loaded on first access, so mapping a multi-GB file costs only address space.
+ * Callers streaming through the file can hint the kernel with willNeed() and drop
+ * already processed ranges with release() to keep the resident set bounded.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::filesystem::path &aPath) {
+#ifdef _WIN32
+		mFile = CreateFileW(aPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Failed to open file for mapping: " + aPath.string());
+		}
+		LARGE_INTEGER size;
+		GetFileSizeEx(mFile, &size);
+		mSize = size_t(size.QuadPart);
+		if (mSize > 0) {
+			mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			mData = mMapping ? static_cast<const uint8_t *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		}
+#else
+		mFile = open(aPath.c_str(), O_RDONLY);
+		if (mFile < 0) {
+			throw std::runtime_error("Failed to open file for mapping: " + aPath.string());
+		}
+		struct stat status;
+		fstat(mFile, &status);
+		mSize = size_t(status.st_size);
+		if (mSize > 0) {
+			void *data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mFile, 0);
+			mData = data == MAP_FAILED ? nullptr : static_cast<const uint8_t *>(data);
+		}
+#endif
+		if (mSize > 0 && !mData) {
+			close();
+			throw std::runtime_error("Failed to map file: " + aPath.string());
+		}
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile &&aOther) noexcept {
+		*this = std::move(aOther);
+	}
+
+	MappedFile& operator=(MappedFile &&aOther) noexcept {
+		if (this != &aOther) {
+			close();
+			std::swap(mFile, aOther.mFile);
+			std::swap(mData, aOther.mData);
+			std::swap(mSize, aOther.mSize);
+#ifdef _WIN32
+			std::swap(mMapping, aOther.mMapping);
+#endif
+		}
+		return *this;
+	}
+
+	const uint8_t *data() const {
+		return mData;
+	}
+
+	size_t size() const {
+		return mSize;
+	}
+
+	/**
+	 * @brief Asks the kernel to start reading the range ahead of its use.
+	 */
+	void willNeed(size_t aOffset, size_t aSize) const {
+#ifndef _WIN32
+		advise(aOffset, aSize, MADV_WILLNEED);
+#endif
+	}
+
+	/**
+	 * @brief Drops the resident pages of an already processed range.
+	 */
+	void release(size_t aOffset, size_t aSize) const {
+#ifndef _WIN32
+		advise(aOffset, aSize, MADV_DONTNEED);
+#endif
+	}
+
+protected:
+#ifndef _WIN32
+	void advise(size_t aOffset, size_t aSize, int aAdvice) const {
+		static const size_t cPageSize = size_t(sysconf(_SC_PAGESIZE));
+		size_t begin = aOffset / cPageSize * cPageSize;
+		size_t end = std::min(mSize, aOffset + aSize);
+		if (mData && end > begin) {
+			madvise(const_cast<uint8_t *>(mData) + begin, end - begin, aAdvice);
+		}
+	}
+#endif
+
+	void close() {
+#ifdef _WIN32
+		if (mData) {
+			UnmapViewOfFile(mData);
+		}
+		if (mMapping) {
+			CloseHandle(mMapping);
+		}
+		if (mFile != INVALID_HANDLE_VALUE) {
+			CloseHandle(mFile);
+		}
+		mMapping = nullptr;
+		mFile = INVALID_HANDLE_VALUE;
+#else
+		if (mData) {
+			munmap(const_cast<uint8_t *>(mData), mSize);
+		}
+		if (mFile >= 0) {
+			::close(mFile);
+		}
+		mFile = -1;
+#endif
+		mData = nullptr;
+		mSize = 0;
+	}
+
+#ifdef _WIN32
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+	const uint8_t *mData = nullptr;
+	size_t mSize = 0;
+};
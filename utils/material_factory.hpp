@@ -51,18 +51,27 @@ public:
 	MaterialParameters()
 		: mRenderStyle(RenderStyle::Solid)
 		, mIsTesselation(false)
+		, mPermutation(0)
 	{}
-	MaterialParameters(const std::string &aMaterialName, RenderStyle aRenderStyle, const MaterialParameterValues &aParameterValues, bool aIsTesselation = false)
+	MaterialParameters(
+			const std::string &aMaterialName,
+			RenderStyle aRenderStyle,
+			const MaterialParameterValues &aParameterValues,
+			bool aIsTesselation = false,
+			unsigned int aPermutation = 0)
 		: mMaterialName(aMaterialName)
 		, mRenderStyle(aRenderStyle)
 		, mParameterValues(aParameterValues)
 		, mIsTesselation(aIsTesselation)
+		, mPermutation(aPermutation)
 	{}
 
 	std::string mMaterialName;
 	RenderStyle mRenderStyle;
 	MaterialParameterValues mParameterValues;
 	bool mIsTesselation;
+	// Bitmask of compile-time features (see "permutations" in .program files), 0 selects the generic program
+	unsigned int mPermutation;
 };
 
 class AShaderProgram {
@@ -76,8 +85,19 @@ inline std::string convertToIdentifier(std::string aId) {
 	return aId;
 }
 
+// Name suffix of the brick grid texture registered next to each loaded volume texture
+inline constexpr const char *cBrickTextureSuffix = ".bricks";
+// Name suffix of the empty space distance texture, see OGLMaterialFactory::createEmptySpaceDistanceTexture()
+inline constexpr const char *cDistanceTextureSuffix = ".distance";
+// Name suffix of the page table texture of a paged volume, see VolumeBrickCache
+inline constexpr const char *cPageTableTextureSuffix = ".pages";
+// Name suffixes of the even and odd slice textures of a volume, see VolumeSliceCache
+inline constexpr const char *cEvenSliceTextureSuffix = ".even_slice";
+inline constexpr const char *cOddSliceTextureSuffix = ".odd_slice";
+
 class MaterialFactory {
 public:
 	virtual std::shared_ptr<AShaderProgram> getShaderProgram(const std::string &aName) = 0;
+	virtual std::shared_ptr<AShaderProgram> getShaderProgram(const std::string &aName, unsigned int aPermutation) = 0;
 	virtual std::shared_ptr<ATexture> getTexture(const std::string &aName) = 0;
 };
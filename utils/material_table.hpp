@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <map>
+#include <cmath>
+
+#include <glad/glad.h>
+#include "ogl_material_factory.hpp"
+
+/**
+ * @brief Packs material textures into GL_TEXTURE_2D_ARRAY layers and keeps per-material
+ *		data in one shader storage buffer indexed by material ID.
+ *
+ * All arrays and the storage buffer are bound once per frame, so switching materials
+ * between draws only changes the u_materialId uniform - no texture binds are needed.
+ * Textures with the same size and internal format share one array. Shader side
+ * counterpart is in material_table.include.glsl.
+ */
+class MaterialTable {
+public:
+	static constexpr int cMaxTextureArrays = 4;
+	static constexpr int cTexturesPerMaterial = 4;
+	static constexpr GLuint cFirstTextureUnit = 8;
+	static constexpr GLuint cStorageBinding = 0;
+
+	/**
+	 * @param aTextureSlots Names of the sampler parameters mapped to the texture slots of each material
+	 *		(e.g. { "u_diffuseTexture", "u_normalTexture" }).
+	 */
+	MaterialTable(std::vector<std::string> aTextureSlots)
+		: mTextureSlots(std::move(aTextureSlots))
+	{
+		if (mTextureSlots.size() > cTexturesPerMaterial) {
+			throw OpenGLError("Material table supports at most " + std::to_string(cTexturesPerMaterial) + " textures per material");
+		}
+	}
+
+	/**
+	 * @brief Registers material textures and returns the material ID used in u_materialId.
+	 *		Call upload() after all materials were added.
+	 */
+	int addMaterial(MaterialFactory &aMaterialFactory, const MaterialParameterValues &aParameters, glm::vec4 aColor = glm::vec4(1.0f)) {
+		MaterialRecord record;
+		record.color = aColor;
+		for (auto &texture : record.textures) {
+			texture = glm::ivec4(-1, 0, 0, 0);
+		}
+		for (size_t slot = 0; slot < mTextureSlots.size(); ++slot) {
+			auto it = aParameters.find(mTextureSlots[slot]);
+			if (it == aParameters.end()) {
+				continue;
+			}
+			const TextureInfo *textureInfo = std::get_if<TextureInfo>(&(it->second));
+			if (!textureInfo) {
+				throw OpenGLError("Material parameter " + mTextureSlots[slot] + " is not a texture");
+			}
+			auto texture = textureInfo->textureData;
+			if (!texture) {
+				texture = aMaterialFactory.getTexture(textureInfo->name);
+			}
+			record.textures[slot] = assignLayer(std::static_pointer_cast<OGLTexture>(texture));
+		}
+		mMaterials.push_back(record);
+		return int(mMaterials.size() - 1);
+	}
+
+	/**
+	 * @brief Allocates the texture arrays, copies the registered textures into their layers
+	 *		(including the whole mip chain) and uploads the material records.
+	 */
+	void upload() {
+		for (auto &array : mArrays) {
+			array.texture = createTexture();
+			GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture.get()));
+			GL_CHECK(glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.internalFormat, array.width, array.height, GLsizei(array.layers.size())));
+			GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT));
+			GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT));
+			GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+			GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+			for (size_t layer = 0; layer < array.layers.size(); ++layer) {
+				for (int level = 0; level < array.levels; ++level) {
+					GL_CHECK(glCopyImageSubData(
+						array.layers[layer]->texture.get(), GL_TEXTURE_2D, level, 0, 0, 0,
+						array.texture.get(), GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer),
+						std::max(1, array.width >> level), std::max(1, array.height >> level), 1));
+				}
+			}
+		}
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+
+		mStorage = createBuffer();
+		GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, mStorage.get()));
+		GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, mMaterials.size() * sizeof(MaterialRecord), mMaterials.data(), GL_STATIC_DRAW));
+		GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+		std::cout << "Material table: " << mMaterials.size() << " materials in " << mArrays.size() << " texture arrays\n";
+	}
+
+	/**
+	 * @brief Binds all texture arrays and the material storage buffer. Call once per frame.
+	 */
+	void bind() const {
+		for (size_t i = 0; i < mArrays.size(); ++i) {
+			GL_CHECK(glActiveTexture(GL_TEXTURE0 + cFirstTextureUnit + GLuint(i)));
+			GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, mArrays[i].texture.get()));
+		}
+		GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cStorageBinding, mStorage.get()));
+	}
+
+protected:
+	// Layout matches MaterialRecord in material_table.include.glsl (std430)
+	struct MaterialRecord {
+		glm::vec4 color;
+		// x: texture array index (-1 if the slot is empty), y: layer
+		std::array<glm::ivec4, cTexturesPerMaterial> textures;
+	};
+
+	struct TextureArray {
+		GLint internalFormat;
+		int width;
+		int height;
+		int levels;
+		std::vector<std::shared_ptr<OGLTexture>> layers;
+		OpenGLResource texture;
+	};
+
+	glm::ivec4 assignLayer(const std::shared_ptr<OGLTexture> &aTexture) {
+		auto known = mLayers.find(aTexture.get());
+		if (known != mLayers.end()) {
+			return known->second;
+		}
+
+		GLint width = 0, height = 0, internalFormat = 0;
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, aTexture->texture.get()));
+		GL_CHECK(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width));
+		GL_CHECK(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height));
+		GL_CHECK(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat));
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+		internalFormat = toSizedFormat(internalFormat);
+
+		auto sameFormat = [&](const TextureArray &aArray) {
+			return aArray.width == width && aArray.height == height && aArray.internalFormat == internalFormat;
+		};
+		auto arrayIt = std::find_if(mArrays.begin(), mArrays.end(), sameFormat);
+		if (arrayIt == mArrays.end()) {
+			if (mArrays.size() == cMaxTextureArrays) {
+				throw OpenGLError("Material table - too many distinct texture formats");
+			}
+			int levels = 1 + int(std::floor(std::log2(std::max(width, height))));
+			mArrays.push_back(TextureArray{ internalFormat, width, height, levels, {}, OpenGLResource() });
+			arrayIt = std::prev(mArrays.end());
+		}
+		arrayIt->layers.push_back(aTexture);
+
+		auto reference = glm::ivec4(int(arrayIt - mArrays.begin()), int(arrayIt->layers.size() - 1), 0, 0);
+		mLayers[aTexture.get()] = reference;
+		return reference;
+	}
+
+	static GLint toSizedFormat(GLint aFormat) {
+		switch (aFormat) {
+		case GL_RED: return GL_R8;
+		case GL_RG: return GL_RG8;
+		case GL_RGB: return GL_RGB8;
+		case GL_RGBA: return GL_RGBA8;
+		default: return aFormat;
+		}
+	}
+
+	std::vector<std::string> mTextureSlots;
+	std::vector<MaterialRecord> mMaterials;
+	std::vector<TextureArray> mArrays;
+	std::map<const OGLTexture *, glm::ivec4> mLayers;
+	OpenGLResource mStorage;
+};
@@ -0,0 +1,283 @@
+#include "mipmap_generation.hpp"
+
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <numbers>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIPMAP_GENERATION_SSE2 1
+#endif
+
+namespace {
+
+// Level stored as one float plane per channel, so the filters run over contiguous rows
+struct PlanarImage {
+	int width = 0;
+	int height = 0;
+	std::vector<std::vector<float>> planes;
+};
+
+// Filter taps for a 2:1 reduction. Destination pixel x is centered between source
+// pixels 2x and 2x + 1, tap i reads source pixel 2x + 1 - cRadius + i.
+struct DownsampleFilter {
+	static constexpr int cMaxRadius = 4;
+	int radius = 1;
+	std::array<float, 2 * cMaxRadius> weights = {};
+};
+
+double besselI0(double aX) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; ++k) {
+		term *= (aX / (2.0 * k)) * (aX / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+DownsampleFilter makeFilter(MipFilter aFilter) {
+	DownsampleFilter filter;
+	if (aFilter == MipFilter::Box) {
+		filter.radius = 1;
+		filter.weights[0] = 0.5f;
+		filter.weights[1] = 0.5f;
+		return filter;
+	}
+	constexpr double cAlpha = 4.0;
+	filter.radius = DownsampleFilter::cMaxRadius;
+	double sum = 0.0;
+	std::array<double, 2 * DownsampleFilter::cMaxRadius> weights;
+	for (int i = 0; i < 2 * filter.radius; ++i) {
+		// Distance from the destination pixel center in destination pixels
+		double distance = (i - filter.radius + 0.5) / 2.0;
+		double window = distance / (filter.radius / 2.0);
+		double sinc = std::sin(std::numbers::pi * distance) / (std::numbers::pi * distance);
+		weights[i] = sinc * besselI0(cAlpha * std::sqrt(std::max(0.0, 1.0 - window * window))) / besselI0(cAlpha);
+		sum += weights[i];
+	}
+	for (int i = 0; i < 2 * filter.radius; ++i) {
+		filter.weights[i] = float(weights[i] / sum);
+	}
+	return filter;
+}
+
+struct SRGBTables {
+	static constexpr int cEncodeBuckets = 4096;
+
+	std::array<float, 256> decode;
+	// Linear values halfway between consecutive sRGB codes
+	std::array<float, 255> thresholds;
+	// Smallest code of each uniform linear bucket - the sRGB curve rises by less than one code
+	// per bucket, so encoding corrects the estimate with one or two threshold compares
+	std::array<uint8_t, cEncodeBuckets + 1> bucketCodes;
+
+	SRGBTables() {
+		auto toLinear = [](double aValue) {
+			return aValue <= 0.04045 ? aValue / 12.92 : std::pow((aValue + 0.055) / 1.055, 2.4);
+		};
+		for (int i = 0; i < 256; ++i) {
+			decode[i] = float(toLinear(i / 255.0));
+		}
+		for (int i = 0; i < 255; ++i) {
+			thresholds[i] = float(toLinear((i + 0.5) / 255.0));
+		}
+		for (int bucket = 0; bucket <= cEncodeBuckets; ++bucket) {
+			float value = float(bucket) / cEncodeBuckets;
+			bucketCodes[bucket] = uint8_t(std::upper_bound(thresholds.begin(), thresholds.end(), value) - thresholds.begin());
+		}
+	}
+
+	// aValue in [0, 1]
+	uint8_t encode(float aValue) const {
+		int code = bucketCodes[int(aValue * cEncodeBuckets)];
+		while (code < 255 && aValue >= thresholds[code]) {
+			++code;
+		}
+		return uint8_t(code);
+	}
+};
+
+const SRGBTables &getSRGBTables() {
+	static const SRGBTables tables;
+	return tables;
+}
+
+bool isSRGBChannel(int aChannel, int aChannelCount, const MipmapOptions &aOptions) {
+	return aOptions.srgb && aChannelCount >= 3 && aChannel < 3;
+}
+
+template<typename TFunction>
+void forEachRowRange(ThreadPool *aPool, int aRowCount, TFunction aFunction) {
+	constexpr size_t cRowsPerChunk = 16;
+	if (aPool) {
+		parallelFor(*aPool, 0, size_t(aRowCount), cRowsPerChunk, aFunction);
+		return;
+	}
+	for (size_t begin = 0; begin < size_t(aRowCount); begin += cRowsPerChunk) {
+		aFunction(begin, std::min(size_t(aRowCount), begin + cRowsPerChunk));
+	}
+}
+
+// Decodes aRowCount rows starting at aFirstRow into float planes
+PlanarImage toPlanar(const PixelImage &aImage, const MipmapOptions &aOptions, int aFirstRow, int aRowCount) {
+	PlanarImage planar;
+	planar.width = aImage.width;
+	planar.height = aRowCount;
+	planar.planes.resize(aImage.channels, std::vector<float>(size_t(aImage.width) * aRowCount));
+	const auto &tables = getSRGBTables();
+	const uint8_t *source = &aImage.pixels[size_t(aFirstRow) * aImage.width * aImage.channels];
+	for (int c = 0; c < aImage.channels; ++c) {
+		bool srgb = isSRGBChannel(c, aImage.channels, aOptions);
+		auto &plane = planar.planes[c];
+		for (size_t i = 0; i < plane.size(); ++i) {
+			uint8_t value = source[i * aImage.channels + c];
+			plane[i] = srgb ? tables.decode[value] : value * (1.0f / 255.0f);
+		}
+	}
+	return planar;
+}
+
+PixelImage toInterleaved(const PlanarImage &aImage, const MipmapOptions &aOptions, ThreadPool *aPool) {
+	PixelImage image;
+	image.width = aImage.width;
+	image.height = aImage.height;
+	image.channels = int(aImage.planes.size());
+	image.pixels.resize(size_t(image.width) * image.height * image.channels);
+	const auto &tables = getSRGBTables();
+	forEachRowRange(aPool, aImage.height, [&](size_t aBegin, size_t aEnd) {
+		for (int c = 0; c < image.channels; ++c) {
+			bool srgb = isSRGBChannel(c, image.channels, aOptions);
+			for (size_t i = aBegin * image.width; i < aEnd * image.width; ++i) {
+				float value = std::clamp(aImage.planes[c][i], 0.0f, 1.0f);
+				image.pixels[i * image.channels + c] = srgb ? tables.encode(value) : uint8_t(value * 255.0f + 0.5f);
+			}
+		}
+	});
+	return image;
+}
+
+// Weighted sum of source rows, vectorized across pixels
+void filterVertical(const DownsampleFilter &aFilter, const std::vector<const float *> &aRows, int aWidth, float *aOutput) {
+	int x = 0;
+#ifdef MIPMAP_GENERATION_SSE2
+	for (; x + 4 <= aWidth; x += 4) {
+		__m128 sum = _mm_setzero_ps();
+		for (size_t tap = 0; tap < aRows.size(); ++tap) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(aFilter.weights[tap]), _mm_loadu_ps(aRows[tap] + x)));
+		}
+		_mm_storeu_ps(aOutput + x, sum);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		float sum = 0.0f;
+		for (size_t tap = 0; tap < aRows.size(); ++tap) {
+			sum += aFilter.weights[tap] * aRows[tap][x];
+		}
+		aOutput[x] = sum;
+	}
+}
+
+// aPaddedRow holds the source row with aFilter.radius clamped pixels on both sides
+void filterHorizontal(const DownsampleFilter &aFilter, const float *aPaddedRow, int aWidth, float *aOutput) {
+	int taps = 2 * aFilter.radius;
+	int x = 0;
+#ifdef MIPMAP_GENERATION_SSE2
+	// Four destination pixels read every other source pixel - deinterleave the even elements of two loads
+	for (; x + 4 <= aWidth; x += 4) {
+		__m128 sum = _mm_setzero_ps();
+		for (int tap = 0; tap < taps; ++tap) {
+			const float *source = aPaddedRow + 2 * x + 1 + tap;
+			__m128 even = _mm_shuffle_ps(_mm_loadu_ps(source), _mm_loadu_ps(source + 4), _MM_SHUFFLE(2, 0, 2, 0));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(aFilter.weights[tap]), even));
+		}
+		_mm_storeu_ps(aOutput + x, sum);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		float sum = 0.0f;
+		for (int tap = 0; tap < taps; ++tap) {
+			sum += aFilter.weights[tap] * aPaddedRow[2 * x + 1 + tap];
+		}
+		aOutput[x] = sum;
+	}
+}
+
+// Rows [firstRow, firstRow + image->height) of the source level
+struct RowSlab {
+	const PlanarImage *image = nullptr;
+	int firstRow = 0;
+
+	const float *row(size_t aChannel, int aRow) const {
+		return &image->planes[aChannel][size_t(aRow - firstRow) * image->width];
+	}
+};
+
+/**
+ * aGetSlab(firstRow, rowCount, storage) returns the source rows needed by one chunk of destination rows,
+ * so the first reduction can decode the 8-bit rows per chunk instead of converting the whole image up front.
+ */
+template<typename TGetSlab>
+PlanarImage downsample(int aSourceWidth, int aSourceHeight, int aChannels, const DownsampleFilter &aFilter, ThreadPool *aPool, TGetSlab aGetSlab) {
+	PlanarImage result;
+	result.width = std::max(1, aSourceWidth / 2);
+	result.height = std::max(1, aSourceHeight / 2);
+	result.planes.resize(aChannels, std::vector<float>(size_t(result.width) * result.height));
+
+	int radius = aFilter.radius;
+	// The SIMD horizontal pass reads up to 4 floats past the last tap
+	int paddedWidth = 2 * result.width + 2 * radius + 4;
+	forEachRowRange(aPool, result.height, [&](size_t aBegin, size_t aEnd) {
+		auto sourceRow = [&](size_t aY, int aTap) {
+			return std::clamp(int(2 * aY) + 1 - radius + aTap, 0, aSourceHeight - 1);
+		};
+		int firstRow = sourceRow(aBegin, 0);
+		PlanarImage storage;
+		RowSlab slab = aGetSlab(firstRow, sourceRow(aEnd - 1, 2 * radius - 1) - firstRow + 1, storage);
+
+		std::vector<float> paddedRow(paddedWidth);
+		std::vector<const float *> rows(2 * radius);
+		for (size_t c = 0; c < size_t(aChannels); ++c) {
+			auto &resultPlane = result.planes[c];
+			for (size_t y = aBegin; y < aEnd; ++y) {
+				for (int tap = 0; tap < 2 * radius; ++tap) {
+					rows[tap] = slab.row(c, sourceRow(y, tap));
+				}
+				filterVertical(aFilter, rows, aSourceWidth, &paddedRow[radius]);
+				for (int x = 0; x < radius; ++x) {
+					paddedRow[x] = paddedRow[radius];
+				}
+				for (int x = radius + aSourceWidth; x < paddedWidth; ++x) {
+					paddedRow[x] = paddedRow[radius + aSourceWidth - 1];
+				}
+				filterHorizontal(aFilter, paddedRow.data(), result.width, &resultPlane[y * result.width]);
+			}
+		}
+	});
+	return result;
+}
+
+} // namespace
+
+std::vector<PixelImage> generateMipChain(const PixelImage &aImage, const MipmapOptions &aOptions, ThreadPool *aPool) {
+	auto filter = makeFilter(aOptions.filter);
+	std::vector<PixelImage> levels = { aImage };
+	if (aImage.width <= 1 && aImage.height <= 1) {
+		return levels;
+	}
+	auto level = downsample(aImage.width, aImage.height, aImage.channels, filter, aPool,
+		[&](int aFirstRow, int aRowCount, PlanarImage &aStorage) {
+			aStorage = toPlanar(aImage, aOptions, aFirstRow, aRowCount);
+			return RowSlab{ &aStorage, aFirstRow };
+		});
+	levels.push_back(toInterleaved(level, aOptions, aPool));
+	while (level.width > 1 || level.height > 1) {
+		level = downsample(level.width, level.height, int(level.planes.size()), filter, aPool,
+			[&level](int, int, PlanarImage &) {
+				return RowSlab{ &level, 0 };
+			});
+		levels.push_back(toInterleaved(level, aOptions, aPool));
+	}
+	return levels;
+}
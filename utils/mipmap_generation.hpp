@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+/**
+ * 8-bit image with interleaved channels, rows tightly packed.
+ */
+struct PixelImage {
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	std::vector<uint8_t> pixels;
+};
+
+enum class MipFilter {
+	Box,   ///< 2x2 average
+	Kaiser ///< Kaiser windowed sinc, 8 taps per axis - sharper, less aliasing
+};
+
+struct MipmapOptions {
+	MipFilter filter = MipFilter::Kaiser;
+	/// Color channels of RGB/RGBA images are sRGB encoded and get filtered in linear space.
+	/// One and two channel images (masks, normal map XY) and alpha are always treated as linear data.
+	bool srgb = true;
+};
+
+/**
+ * @brief Builds the full mip chain down to 1x1, result[0] is a copy of the input image.
+ *
+ * Levels are filtered in float from the previous float level, so the rounding error
+ * does not accumulate through the chain. Rows of each level are distributed over aPool
+ * if given - pass nullptr when calling from a task already running on the pool.
+ */
+std::vector<PixelImage> generateMipChain(const PixelImage &aImage, const MipmapOptions &aOptions = {}, ThreadPool *aPool = nullptr);
@@ -4,6 +4,16 @@
 #include <variant>
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "thread_pool.hpp"
+#include "concurrent_queue.hpp"
+#include "volume_pyramid.hpp"
+#include "volume_conversion.hpp"
+#include "volume_compression.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -157,6 +167,59 @@ std::string processIncludes(
 }
 
 
+std::shared_ptr<OGLShaderProgram> linkShaderProgram(const CompiledShaderStages &aShaderStages) {
+	auto program = createShaderProgram(aShaderStages);
+	auto uniforms = listShaderUniforms(program);
+	for (auto info : uniforms) {
+		std::cout
+			<< "Uniform name: " << info.name
+			<< " Type: " << getGLTypeName(info.type)
+			<< " Location: " << info.location << "\n";
+	}
+	return std::make_shared<OGLShaderProgram>(
+			std::move(program),
+			std::move(uniforms));
+}
+
+// Parses "KEY1 KEY2 KEY3=5" - keys without explicit bit index continue after the previous one
+std::map<std::string, unsigned int> parsePermutationKeys(const std::string &aProgramName, const std::string &aValue) {
+	std::map<std::string, unsigned int> keys;
+	std::istringstream iss(aValue);
+	std::string token;
+	unsigned int nextBit = 0;
+	while (iss >> token) {
+		unsigned int bit = nextBit;
+		auto pos = token.find('=');
+		if (pos != std::string::npos) {
+			bit = std::stoul(token.substr(pos + 1));
+			token = token.substr(0, pos);
+		}
+		if (bit >= 32) {
+			throw OpenGLError("Program " + aProgramName + " - permutation key " + token + " does not fit into 32bit mask");
+		}
+		keys[token] = bit;
+		nextBit = bit + 1;
+	}
+	return keys;
+}
+
+// Inserts the defines right after the #version directive and restores line numbering
+std::string injectDefines(const std::string &aSource, const std::string &aDefines) {
+	auto versionPos = aSource.find("#version");
+	if (versionPos == std::string::npos) {
+		return aDefines + "#line 1 0\n" + aSource;
+	}
+	auto lineEnd = aSource.find('\n', versionPos);
+	if (lineEnd == std::string::npos) {
+		return aSource + "\n" + aDefines;
+	}
+	auto nextLine = std::count(aSource.begin(), aSource.begin() + lineEnd, '\n') + 2;
+	return aSource.substr(0, lineEnd + 1)
+		+ aDefines
+		+ "#line " + std::to_string(nextLine) + " 0\n"
+		+ aSource.substr(lineEnd + 1);
+}
+
 const static std::map<std::string, GLenum> cShaderTypeEnums = {
 	{ "vertex", GL_VERTEX_SHADER },
 	{ "fragment", GL_FRAGMENT_SHADER },
@@ -166,13 +229,17 @@ const static std::map<std::string, GLenum> cShaderTypeEnums = {
 	{ "compute", GL_COMPUTE_SHADER },
 };
 
+const static std::string cPermutationsKey = "permutations";
+
 void OGLMaterialFactory::loadShadersFromDir(fs::path aShaderDir) {
 	aShaderDir = fs::canonical(aShaderDir);
 	ShaderProgramFiles shaderFiles = listShaderFiles(aShaderDir);
 
 	const auto &includeFiles = shaderFiles["include"];
 	using CompiledShaderMap = std::map<std::string, OpenGLResource>;
+	using ShaderSourceMap = std::map<std::string, std::string>;
 	std::map<std::string, CompiledShaderMap> compiledShaders;
+	std::map<std::string, ShaderSourceMap> shaderSources;
 	for (auto & [shaderType, enumValue] : cShaderTypeEnums) {
 		auto files = shaderFiles[shaderType];
 		std::map<std::string, OpenGLResource> shaders;
@@ -182,6 +249,7 @@ void OGLMaterialFactory::loadShadersFromDir(fs::path aShaderDir) {
 			content = processIncludes(content, includeFiles);
 			auto compiledShader = compileShader(enumValue, content);
 			shaders.emplace(shaderFile.first, std::move(compiledShader));
+			shaderSources[shaderType][shaderFile.first] = std::move(content);
 		}
 		compiledShaders[shaderType] = std::move(shaders);
 	}
@@ -191,8 +259,13 @@ void OGLMaterialFactory::loadShadersFromDir(fs::path aShaderDir) {
 		std::cout << "Creating shader program: " << programFile.first << "\n";
 		auto shaderNames = parseProgramFile(programFile.second);
 
+		ProgramTemplate programTemplate;
 		CompiledShaderStages shaderStages;
 		for (auto &[shaderType, shaderName] : shaderNames) {
+			if (shaderType == cPermutationsKey) {
+				programTemplate.permutationKeys = parsePermutationKeys(programFile.first, shaderName);
+				continue;
+			}
 			auto &compShaders = compiledShaders[shaderType];
 			auto it = compShaders.find(shaderName);
 			if (it == compShaders.end()) {
@@ -201,48 +274,72 @@ void OGLMaterialFactory::loadShadersFromDir(fs::path aShaderDir) {
 						+ shaderType + ") : " + shaderName + " was not compiled.");
 			}
 			shaderStages.push_back(&(it->second));
+			programTemplate.stageSources[cShaderTypeEnums.at(shaderType)] = shaderSources[shaderType][shaderName];
 		}
-		auto program = createShaderProgram(shaderStages);
-		auto uniforms = listShaderUniforms(program);
-		for (auto info : uniforms) {
-			std::cout
-				<< "Uniform name: " << info.name
-				<< " Type: " << getGLTypeName(info.type)
-				<< " Location: " << info.location << "\n";
+		mPrograms.emplace(programFile.first, linkShaderProgram(shaderStages));
+		if (!programTemplate.permutationKeys.empty()) {
+			mProgramTemplates.emplace(programFile.first, std::move(programTemplate));
 		}
-		mPrograms.emplace(
-				programFile.first,
-				std::make_shared<OGLShaderProgram>(
-					std::move(program),
-					std::move(uniforms)
-					));
 	}
 	auto &computeShaders = compiledShaders["compute"];
 	for (auto &shader : computeShaders) {
 		std::cout << "Creating shader program: " << shader.first << "\n";
-		auto program = createShaderProgram(CompiledShaderStages{ &(shader.second) });
-		auto uniforms = listShaderUniforms(program);
-		for (auto info : uniforms) {
-			std::cout
-				<< "Uniform name: " << info.name
-				<< " Type: " << getGLTypeName(info.type)
-				<< " Location: " << info.location << "\n";
-		}
 		mPrograms.emplace(
 				shader.first,
-				std::make_shared<OGLShaderProgram>(
-					std::move(program),
-					std::move(uniforms)
-					));
+				linkShaderProgram(CompiledShaderStages{ &(shader.second) }));
 	}
 
 }
 
-std::vector<fs::path> findImageFiles(const fs::path& aTextureDir) {
+std::shared_ptr<AShaderProgram> OGLMaterialFactory::getShaderProgram(const std::string &aName, unsigned int aPermutation) {
+	if (aPermutation == 0) {
+		return getShaderProgram(aName);
+	}
+	auto variantKey = std::make_pair(aName, aPermutation);
+	auto variantIt = mProgramVariants.find(variantKey);
+	if (variantIt != mProgramVariants.end()) {
+		return variantIt->second;
+	}
+
+	auto templateIt = mProgramTemplates.find(aName);
+	if (templateIt == mProgramTemplates.end()) {
+		throw OpenGLError("Shader program " + aName + " does not declare any permutations");
+	}
+	const ProgramTemplate &programTemplate = templateIt->second;
+
+	std::stringstream defines;
+	defines << "#define PERMUTATION_MASK " << aPermutation << "u\n";
+	unsigned int usedBits = 0;
+	for (auto &[key, bit] : programTemplate.permutationKeys) {
+		if (aPermutation & (1u << bit)) {
+			defines << "#define " << key << "_ENABLED\n";
+			usedBits |= (1u << bit);
+		}
+	}
+	if (usedBits != aPermutation) {
+		throw OpenGLError(
+				"Shader program " + aName + " - permutation mask "
+				+ std::to_string(aPermutation) + " contains undeclared keys");
+	}
+
+	std::cout << "Compiling shader program variant: " << aName << " (" << aPermutation << ")\n";
+	std::vector<OpenGLResource> shaders;
+	for (auto &[shaderType, source] : programTemplate.stageSources) {
+		shaders.push_back(compileShader(shaderType, injectDefines(source, defines.str())));
+	}
+	CompiledShaderStages shaderStages;
+	for (auto &shader : shaders) {
+		shaderStages.push_back(&shader);
+	}
+	auto program = linkShaderProgram(shaderStages);
+	mProgramVariants.emplace(variantKey, program);
+	return program;
+}
+
+std::vector<fs::path> findSourceImageFiles(const fs::path& aTextureDir) {
 	if (!fs::exists(aTextureDir) || !fs::is_directory(aTextureDir)) {
 		throw std::runtime_error("Texture dir path is not a directory or does not exist.");
 	}
-	std::cout << "Loading textures from directory: " << aTextureDir << "\n";
 	std::vector<fs::path> imageFiles;
 
 	for (const auto& entry : fs::recursive_directory_iterator(aTextureDir)) {
@@ -256,7 +353,63 @@ std::vector<fs::path> findImageFiles(const fs::path& aTextureDir) {
 			}
 		}
 	}
+	return imageFiles;
+}
+
+bool isCookedTextureCurrent(const fs::path& aSourceFile) {
+	fs::path cookedFile = aSourceFile.string() + cCompressedTextureExtension;
+	std::error_code error;
+	auto cookedTime = fs::last_write_time(cookedFile, error);
+	return !error && cookedTime >= fs::last_write_time(aSourceFile);
+}
+
+MipmapOptions getMipmapOptions(const fs::path& aImageFile) {
+	// Images are sRGB encoded color unless the name marks them as a data map - normal, roughness, occlusion,
+	// displacement... maps hold linear values. Tokens are split at non-alphanumeric characters and at camel case
+	// humps, so "Brick_Wall_012_NORM" and "cottageNM" are data maps while "OakDif" or "sea" stay sRGB.
+	static const std::array<const char *, 14> cLinearTokens = {
+		"nrm", "norm", "nm", "normal", "normals", "rough", "roughness",
+		"occ", "ao", "occlusion", "disp", "displacement", "height", "bump" };
+	auto name = aImageFile.stem().string();
+	std::vector<std::string> tokens(1);
+	for (size_t i = 0; i < name.size(); ++i) {
+		unsigned char c = name[i];
+		if (!std::isalnum(c)) {
+			tokens.emplace_back();
+			continue;
+		}
+		if (i > 0 && std::isupper(c) && std::islower(static_cast<unsigned char>(name[i - 1]))) {
+			tokens.emplace_back();
+		}
+		tokens.back().push_back(char(std::tolower(c)));
+	}
+	MipmapOptions options;
+	options.srgb = std::none_of(tokens.begin(), tokens.end(), [](const std::string &aToken) {
+		return std::find(cLinearTokens.begin(), cLinearTokens.end(), aToken) != cLinearTokens.end();
+	});
+	return options;
+}
 
+std::vector<fs::path> findImageFiles(const fs::path& aTextureDir) {
+	std::cout << "Loading textures from directory: " << aTextureDir << "\n";
+	auto imageFiles = findSourceImageFiles(aTextureDir);
+
+	// Prefer the cooked version of an image over decoding the source file, unless the source changed since cooking
+	for (auto &file : imageFiles) {
+		if (isCookedTextureCurrent(file)) {
+			file += cCompressedTextureExtension;
+		}
+	}
+	// Cooked textures shipped without their source image
+	for (const auto& entry : fs::recursive_directory_iterator(aTextureDir)) {
+		if (entry.is_regular_file() && entry.path().extension() == cCompressedTextureExtension) {
+			fs::path sourceFile = entry.path();
+			sourceFile.replace_extension();
+			if (!fs::exists(sourceFile)) {
+				imageFiles.push_back(entry.path());
+			}
+		}
+	}
 	return imageFiles;
 }
 
@@ -270,7 +423,28 @@ std::unique_ptr<ImageData> loadImage(const fs::path& filePath) {
 	return std::make_unique<ImageData>(data, width, height, channels);
 }
 
-OpenGLResource createTextureFromData(const ImageData& imgData) {
+PixelImage toPixelImage(const ImageData& imgData) {
+	PixelImage image;
+	image.width = imgData.width;
+	image.height = imgData.height;
+	image.channels = imgData.channels;
+	image.pixels.assign(imgData.data.get(), imgData.data.get() + size_t(imgData.width) * imgData.height * imgData.channels);
+	return image;
+}
+
+GLenum getImageFormat(int aChannels) {
+	switch (aChannels) {
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 3: return GL_RGB;
+	case 4: return GL_RGBA;
+	default:
+		throw OpenGLError("Unsupported number of texture channels");
+	};
+}
+
+// Creates the texture and uploads the image either from client memory or from an offset in the bound GL_PIXEL_UNPACK_BUFFER
+OpenGLResource createTextureFromPixels(const ImageData& imgData, const void *aPixels) {
 	auto textureID = createTexture();
 	GL_CHECK(glBindTexture(GL_TEXTURE_2D, textureID.get()));
 
@@ -280,38 +454,225 @@ OpenGLResource createTextureFromData(const ImageData& imgData) {
 	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
 	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
 
-	GLenum format = GL_RGB;
-	switch (imgData.channels) {
-	case 1: format = GL_RED; break;
-	case 2: format = GL_RG; break;
-	case 3: format = GL_RGB; break;
-	case 4: format = GL_RGBA; break;
+	GLenum format = getImageFormat(imgData.channels);
+
+	// stb_image rows are tightly packed
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, format, imgData.width, imgData.height, 0, format, GL_UNSIGNED_BYTE, aPixels));
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+	GL_CHECK(glGenerateMipmap(GL_TEXTURE_2D));
+	GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+
+	return textureID;
+}
+
+OpenGLResource createTextureFromData(const ImageData& imgData) {
+	return createTextureFromPixels(imgData, imgData.data.get());
+}
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+GLenum getCompressedFormat(BlockFormat aFormat) {
+	switch (aFormat) {
+	case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+	case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+	case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
 	default:
-		throw OpenGLError("Unsupported number of texture channels");
+		throw OpenGLError("Unsupported compressed texture format");
 	};
+}
 
-	GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, format, imgData.width, imgData.height, 0, format, GL_UNSIGNED_BYTE, imgData.data.get()));
-	GL_CHECK(glGenerateMipmap(GL_TEXTURE_2D));
+OpenGLResource createTextureFromCompressed(const CompressedTexture& aTexture) {
+	auto textureID = createTexture();
+	GL_CHECK(glBindTexture(GL_TEXTURE_2D, textureID.get()));
+
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(aTexture.levels.size()) - 1));
+
+	GLenum format = getCompressedFormat(aTexture.format);
+	for (size_t level = 0; level < aTexture.levels.size(); ++level) {
+		const auto &levelData = aTexture.levels[level];
+		GL_CHECK(glCompressedTexImage2D(
+				GL_TEXTURE_2D,
+				GLint(level),
+				format,
+				levelData.width,
+				levelData.height,
+				0,
+				GLsizei(levelData.data.size()),
+				levelData.data.data()));
+	}
 	GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
 
 	return textureID;
 }
 
+TextureUploadStaging::TextureUploadStaging(int aBufferCount) {
+	for (int i = 0; i < aBufferCount; ++i) {
+		mBuffers.push_back(createBuffer());
+	}
+}
+
+void *TextureUploadStaging::mapNextBuffer(GLsizeiptr aSize) {
+	auto &buffer = mBuffers[mNextBuffer];
+	mNextBuffer = (mNextBuffer + 1) % int(mBuffers.size());
+
+	GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.get()));
+	// Orphan the previous storage - the driver may still be reading it for an earlier upload
+	GL_CHECK(glBufferData(GL_PIXEL_UNPACK_BUFFER, aSize, nullptr, GL_STREAM_DRAW));
+	void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, aSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!mapped) {
+		GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+		throw OpenGLError("Failed to map texture upload buffer");
+	}
+	return mapped;
+}
+
+OpenGLResource TextureUploadStaging::createTextureFromData(const ImageData& imgData) {
+	GLsizeiptr size = GLsizeiptr(imgData.width) * imgData.height * imgData.channels;
+	std::memcpy(mapNextBuffer(size), imgData.data.get(), size);
+	GL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+	auto texture = createTextureFromPixels(imgData, nullptr);
+	GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+	return texture;
+}
+
+OpenGLResource TextureUploadStaging::createTextureFromMipChain(const std::vector<PixelImage>& aLevels) {
+	std::vector<GLsizeiptr> offsets;
+	GLsizeiptr size = 0;
+	for (const auto &level : aLevels) {
+		offsets.push_back(size);
+		size += GLsizeiptr(level.pixels.size());
+	}
+	auto mapped = static_cast<uint8_t *>(mapNextBuffer(size));
+	for (size_t i = 0; i < aLevels.size(); ++i) {
+		std::memcpy(mapped + offsets[i], aLevels[i].pixels.data(), aLevels[i].pixels.size());
+	}
+	GL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+	auto textureID = createTexture();
+	GL_CHECK(glBindTexture(GL_TEXTURE_2D, textureID.get()));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(aLevels.size()) - 1));
+
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	for (size_t i = 0; i < aLevels.size(); ++i) {
+		const auto &level = aLevels[i];
+		GLenum format = getImageFormat(level.channels);
+		GL_CHECK(glTexImage2D(GL_TEXTURE_2D, GLint(i), format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE,
+			reinterpret_cast<const void *>(offsets[i])));
+	}
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+	GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+	GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+	return textureID;
+}
+
+// Decoded mip chains waiting for the GL thread
+constexpr size_t cMaxDecodedImagesInFlight = 4;
 
 void OGLMaterialFactory::loadTexturesFromDir(fs::path aTextureDir) {
+	using Clock = std::chrono::steady_clock;
 	aTextureDir = fs::canonical(aTextureDir);
 	auto imageFiles = findImageFiles(aTextureDir);
+	auto startTime = Clock::now();
+
+	struct DecodedImage {
+		size_t fileIndex = 0;
+		std::vector<PixelImage> mipChain;
+		std::unique_ptr<CompressedTexture> compressedTexture;
+		ImageStatistics statistics;
+		std::exception_ptr error;
+	};
+	// A few images in flight - decoders wait for the GL thread instead of keeping every mip chain in memory
+	ConcurrentQueue<DecodedImage> decodedImages(cMaxDecodedImagesInFlight);
+	std::atomic<int64_t> decodeTime = 0;
+	std::atomic<bool> cancelled = false;
+
+	// Declared after the queue - the pool joins its workers before the queue is destroyed
+	ThreadPool decoders;
+	for (size_t i = 0; i < imageFiles.size(); ++i) {
+		decoders.submit([&, i] {
+			DecodedImage decoded;
+			decoded.fileIndex = i;
+			auto decodeStart = Clock::now();
+			if (cancelled) {
+				decodedImages.push(std::move(decoded));
+				return;
+			}
+			try {
+				if (imageFiles[i].extension() == cCompressedTextureExtension) {
+					decoded.compressedTexture = std::make_unique<CompressedTexture>(readCompressedTexture(imageFiles[i]));
+				} else {
+					// Mips are filtered here on the worker instead of glGenerateMipmap() on the GL thread
+					decoded.mipChain = generateMipChain(toPixelImage(*loadImage(imageFiles[i])), getMipmapOptions(imageFiles[i]));
+					decoded.statistics = computeImageStatistics(decoded.mipChain.front());
+				}
+			} catch (...) {
+				decoded.error = std::current_exception();
+			}
+			decodeTime += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - decodeStart).count();
+			decodedImages.push(std::move(decoded));
+		});
+	}
 
-	for (const auto& textureFile : imageFiles) {
-		auto imageData = loadImage(textureFile);
-		if (imageData) {
-			auto texture = createTextureFromData(*imageData);
-
-			auto name = convertToIdentifier(fs::relative(textureFile, aTextureDir).string());
+	TextureUploadStaging staging;
+	int64_t uploadTime = 0;
+	// The workers block on the bounded queue, so all results are received before an error leaves
+	std::exception_ptr error;
+	for (size_t received = 0; received < imageFiles.size(); ++received) {
+		auto decoded = decodedImages.pop();
+		if (error) {
+			continue;
+		}
+		try {
+			if (decoded.error) {
+				std::rethrow_exception(decoded.error);
+			}
+			const auto &textureFile = imageFiles[decoded.fileIndex];
+			auto uploadStart = Clock::now();
+			auto texture = decoded.compressedTexture
+				? createTextureFromCompressed(*decoded.compressedTexture)
+				: staging.createTextureFromMipChain(decoded.mipChain);
+			uploadTime += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - uploadStart).count();
+
+			// Cooked textures keep the name of their source image
+			auto relativePath = fs::relative(textureFile, aTextureDir);
+			if (relativePath.extension() == cCompressedTextureExtension) {
+				relativePath.replace_extension();
+			}
+			auto name = convertToIdentifier(relativePath.string());
 			mTextures[name] = std::make_shared<OGLTexture>(std::move(texture));
+			if (!decoded.compressedTexture) {
+				mImageStatistics[name] = std::move(decoded.statistics);
+			}
 			std::cout << "Loaded texture: " << name << " from " << textureFile << "\n";
+		} catch (...) {
+			error = std::current_exception();
+			cancelled = true;
 		}
 	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	auto totalTime = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startTime).count();
+	std::cout << "Loaded " << imageFiles.size() << " textures with " << decoders.size() << " decoding threads in " << totalTime / 1000.0 << " ms"
+		<< " (decode and mipmaps " << decodeTime / 1000.0 << " ms summed over threads"
+		<< ", upload " << uploadTime / 1000.0 << " ms on GL thread)\n";
 }
 
 std::vector<fs::path> findVolumeDataFiles(const fs::path& aTextureDir) {
@@ -327,213 +688,301 @@ std::vector<fs::path> findVolumeDataFiles(const fs::path& aTextureDir) {
 			std::transform(ext.begin(), ext.end(), ext.begin(),
 					[](unsigned char c){ return std::tolower(c); });
 
-			if (ext == ".mhd" || ext == ".dump" ) {
+			if (ext == ".mhd" || ext == ".dump" || ext == cCompressedVolumeExtension) {
 				imageFiles.push_back(entry.path());
 			}
 		}
 	}
 
+	// Prefer the compressed container over reading the raw voxels
+	std::erase_if(imageFiles, [](const fs::path &aFile) {
+		return aFile.extension() != cCompressedVolumeExtension
+			&& fs::exists(aFile.string() + cCompressedVolumeExtension);
+	});
 	return imageFiles;
 }
 
-using DataBuffer = std::variant<
-			std::vector<uint16_t>,
-			std::vector<float>
-			>;
-struct VolumeData {
-	DataBuffer data;
-	int width, height, depth;
+struct VoxelUploadFormat {
+	GLenum internalFormat;
+	GLenum type;
 };
 
-struct DimInfo {
-	int32_t minimum = 0;
-	int32_t maximum = 0;
-	float elementExtent = 1.0;
-};
+VoxelUploadFormat getVoxelUploadFormat(VoxelType aType) {
+	switch (aType) {
+	case VoxelType::UInt8: return { GL_R8, GL_UNSIGNED_BYTE };
+	case VoxelType::UInt16: return { GL_R16, GL_UNSIGNED_SHORT };
+	case VoxelType::Float32: return { GL_R32F, GL_FLOAT };
+	}
+	throw OpenGLError("Unsupported voxel type");
+}
 
-template<typename TContainer>
-void printMinMax(const TContainer &aContainer) {
-	auto minIt = std::min_element(aContainer.begin(), aContainer.end());
-	auto maxIt = std::max_element(aContainer.begin(), aContainer.end());
+// Slabs of roughly this size are staged through the PBO ring
+constexpr size_t cVolumeSlabBytes = 64 << 20;
+
+struct VolumeTextures {
+	OpenGLResource volume;
+	OpenGLResource bricks;
+	BrickGrid grid;
+	VoxelType type;
+	VoxelRange range;
+	int emptyBrickCount = 0;
+	VolumeStatistics statistics;
+};
 
-	if (minIt != aContainer.end() && maxIt != aContainer.end()) {
-		std::cout << "Minimum value: " << *minIt << std::endl;
-		std::cout << "Maximum value: " << *maxIt << std::endl;
-	} else {
-		std::cout << "The vector is empty." << std::endl;
+// RG32F texture of per-node min/max, in the units the shaders sample the volume texture in.
+// Mip level l holds octree level l, so the shaders walk the tree with texelFetch(..., l).
+OpenGLResource createBrickTexture(const MinMaxOctree& aOctree, VoxelType aType) {
+	float scale = getVoxelScale(aType);
+	auto texture = createTexture();
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, texture.get()));
+	std::vector<float> ranges;
+	for (size_t level = 0; level < aOctree.levels.size(); ++level) {
+		const auto &grid = aOctree.levels[level];
+		ranges.clear();
+		for (const auto &range : grid.ranges) {
+			ranges.push_back(range.minimum * scale);
+			ranges.push_back(range.maximum * scale);
+		}
+		GL_CHECK(glTexImage3D(GL_TEXTURE_3D, GLint(level), GL_RG32F, grid.width, grid.height, grid.depth, 0, GL_RG, GL_FLOAT, ranges.data()));
 	}
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, GLint(aOctree.levels.size() - 1)));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, 0));
+	return texture;
 }
 
-std::unique_ptr<VolumeData> loadDumpFile(const fs::path& aFilePath) {
-	std::ifstream rawFile(aFilePath, std::ios::binary);
-	uint8_t endianness;
-	rawFile.read(reinterpret_cast<char*>(&endianness), 1);
-	std::array<uint32_t, 3> header;
-	rawFile.read(reinterpret_cast<char*>(header.data()), header.size() * sizeof(uint32_t));
+VolumeTextures createVolumeTextures(OpenGLResource &&aVolume, const BrickGrid &aGrid, VoxelType aType, VoxelRange aRange, ThreadPool &aPool) {
+	int emptyBrickCount = int(std::count_if(aGrid.ranges.begin(), aGrid.ranges.end(),
+		[&aRange](const VoxelRange &aBrick) { return aBrick.maximum <= aRange.minimum; }));
+	return { std::move(aVolume), createBrickTexture(buildMinMaxOctree(aGrid, &aPool), aType), aGrid, aType, aRange, emptyBrickCount };
+}
 
-        uint32_t dimension;
-	rawFile.read(reinterpret_cast<char*>(&dimension), sizeof(uint32_t));
-	// swapBytes(dimension);
+int getSlicesPerSlab(const VolumeInfo &aInfo) {
+	return int(std::max<size_t>(1, cVolumeSlabBytes / aInfo.sliceSize()));
+}
 
-        uint32_t elementTypeID;
-	rawFile.read(reinterpret_cast<char*>(&elementTypeID), sizeof(uint32_t));
-	// swapBytes(elementTypeID);
+// Builder of the value statistics of stored voxels - integer volumes are binned over their whole type range,
+// float volumes over the range of the values seen so far
+ValueStatisticsBuilder createVolumeStatisticsBuilder(VoxelType aType, ThreadPool &aPool) {
+	size_t exactBinCount = getExactBinCount(aType);
+	return exactBinCount > 0
+		? ValueStatisticsBuilder(aType, VoxelRange{ 0.0f, float(exactBinCount) }, exactBinCount, &aPool)
+		: ValueStatisticsBuilder(aType, ValueStatisticsBuilder::cDefaultBinCount, &aPool);
+}
 
+VolumeStatistics getVolumeStatistics(const ValueStatisticsBuilder &aBuilder, VoxelType aType, VolumeFormat aFormat) {
+	VolumeStatistics statistics;
+	statistics.values = aBuilder.statistics();
+	statistics.histogram = aBuilder.histogram();
+	statistics.window = computeAutoWindow(statistics.histogram);
+	statistics.sourceType = aType;
+	statistics.format = aFormat;
+	return statistics;
+}
 
-	std::array<DimInfo, 3> extents;
-	rawFile.read(reinterpret_cast<char*>(extents.data()), extents.size() * sizeof(DimInfo));
-        uint32_t headerEnd;
-	rawFile.read(reinterpret_cast<char*>(&headerEnd), sizeof(uint32_t));
+// Value statistics and histogram of the stored voxels in a single streaming pass ahead of the upload, for the formats
+// that need the value window before converting. aBrickBuilder, if given, is fed during the pass.
+VolumeStatistics computeVolumeStatistics(const VolumeReader &aReader, VolumeFormat aFormat, ThreadPool &aPool, BrickGridBuilder *aBrickBuilder = nullptr) {
+	const auto &info = aReader.info();
+	size_t sliceVoxels = size_t(info.width) * info.height;
+	auto builder = createVolumeStatisticsBuilder(info.type, aPool);
+	aReader.forEachSlab(getSlicesPerSlab(info), [&](int aFirstSlice, int aSliceCount, const void *aVoxels) {
+		builder.addValues(aVoxels, aSliceCount * sliceVoxels);
+		if (aBrickBuilder) {
+			aBrickBuilder->addSlab(aFirstSlice, aSliceCount, aVoxels);
+		}
+	});
+	return getVolumeStatistics(builder, info.type, aFormat);
+}
 
-	std::cout << "Dimension " << dimension << " elementTypeID " << elementTypeID << "\n";
-	for (int i = 0; i < 3; ++i) {
-		std::cout << extents[i].minimum << " - " << extents[i].maximum << " - " << extents[i].elementExtent << "\n";
+VolumeTextures create3DTextureFromFile(const fs::path& aFilePath, VolumeFormat aVolumeFormat) {
+	ThreadPool pool;
+	VolumeReader reader(aFilePath, &pool);
+	const auto &info = reader.info();
+	// Native volumes upload the stored values and gather their statistics during the upload, the others need the
+	// value window of a pass ahead
+	bool convert = aVolumeFormat != VolumeFormat::Native;
+	VolumeStatistics statistics;
+	if (convert) {
+		statistics = computeVolumeStatistics(reader, aVolumeFormat, pool);
 	}
+	auto statisticsBuilder = createVolumeStatisticsBuilder(info.type, pool);
+	// Layout of the texture - the brick grid and the pyramid are built from the converted voxels, in the units the shaders sample
+	VolumeInfo textureInfo = info;
+	textureInfo.type = getVolumeFormatType(aVolumeFormat, info.type);
+	auto format = getVoxelUploadFormat(textureInfo.type);
 
-	DataBuffer buffer;
-	if (elementTypeID == 9) {
-		buffer = std::vector<float>();
-	} else if (elementTypeID == 4) {
-		buffer = std::vector<uint16_t>();
-	} else {
-		throw OpenGLError("Unsupported element type for dump loader");
+	auto texture = createTexture();
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, texture.get()));
+	GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, format.internalFormat, info.width, info.height, info.depth, 0, GL_RED, format.type, nullptr));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER));
+
+	// Rows of odd width 8/16-bit volumes are not 4 byte aligned
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	TextureUploadStaging staging;
+	BrickGridBuilder brickBuilder(textureInfo);
+	// Coarse levels keep the maximum, so MIP of a distant volume does not lose thin bright structures
+	VolumePyramidBuilder pyramidBuilder(textureInfo, VolumeReduction::Maximum, &pool);
+	VoxelRange range;
+	size_t sliceVoxels = size_t(info.width) * info.height;
+	std::vector<uint8_t> converted;
+	reader.forEachSlab(getSlicesPerSlab(info), [&](int aFirstSlice, int aSliceCount, const void *aVoxels) {
+		size_t count = aSliceCount * sliceVoxels;
+		const void *voxels = aVoxels;
+		if (convert) {
+			converted.resize(aSliceCount * textureInfo.sliceSize());
+			convertVoxels(info.type, aVoxels, statistics.window, textureInfo.type, converted.data(), count, &pool);
+			voxels = converted.data();
+		} else {
+			statisticsBuilder.addValues(aVoxels, count);
+		}
+		void *staged = staging.mapNextBuffer(GLsizeiptr(aSliceCount * textureInfo.sliceSize()));
+		range.merge(copyVoxels(textureInfo.type, voxels, staged, count));
+		GL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+		GL_CHECK(glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, aFirstSlice, info.width, info.height, aSliceCount, GL_RED, format.type, nullptr));
+		// Reads the mapped file pages or the converted copy, not the write-combined staging memory
+		brickBuilder.addSlab(aFirstSlice, aSliceCount, voxels);
+		pyramidBuilder.addSlab(aFirstSlice, aSliceCount, voxels);
+	});
+	GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+	const auto &levels = pyramidBuilder.levels();
+	for (size_t i = 0; i < levels.size(); ++i) {
+		const auto &level = levels[i];
+		GL_CHECK(glTexImage3D(GL_TEXTURE_3D, GLint(i + 1), format.internalFormat, level.width, level.height, level.depth, 0, GL_RED, format.type, level.voxels.data()));
 	}
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, GLint(levels.size())));
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, 0));
 
+	auto textures = createVolumeTextures(std::move(texture), brickBuilder.grid(), textureInfo.type, range, pool);
+	textures.statistics = convert ? std::move(statistics) : getVolumeStatistics(statisticsBuilder, info.type, aVolumeFormat);
+	return textures;
+}
 
-	int width = extents[0].maximum - extents[0].minimum;
-	int height = extents[1].maximum - extents[1].minimum;
-	int depth = extents[2].maximum - extents[2].minimum;
-
-	auto buffer2 = std::vector<float>();
-	buffer2.resize(width * height * depth);
-	std::visit([&](auto&& arg) {
-			using T = std::decay_t<decltype(arg)>;
-			using ValueType = typename T::value_type;
-			arg.resize(width * height * depth);
-			rawFile.read(reinterpret_cast<char*>(arg.data()), arg.size() * sizeof(ValueType));
+// The voxels stay in the file and stream through aCache in their native format, only the brick grid
+// and the statistics are computed up front
+VolumeTextures createPagedVolumeTextures(const fs::path& aFilePath, VolumeBrickCache &aCache) {
+	ThreadPool pool;
+	VolumeReader reader(aFilePath, &pool);
+	BrickGridBuilder brickBuilder(reader.info());
+	auto statistics = computeVolumeStatistics(reader, VolumeFormat::Native, pool, &brickBuilder);
+	auto textures = createVolumeTextures(aCache.takeAtlasTexture(), brickBuilder.grid(), reader.info().type, statistics.values.range, pool);
+	textures.statistics = std::move(statistics);
+	return textures;
+}
 
-			// std::copy(arg.begin(), arg.end(), buffer2.begin());
-			// std::transform(arg.begin(), arg.end(), buffer2.begin(), [](auto &val) {return val;});
-			// printMinMax(arg);
+void OGLMaterialFactory::load3DTexturesFromDir(fs::path aTextureDir, size_t aResidencyBudget, VolumeFormat aVolumeFormat) {
+	aTextureDir = fs::canonical(aTextureDir);
+	auto files = findVolumeDataFiles(aTextureDir);
 
-		}, buffer);
+	for (const auto& textureFile : files) {
+		// Compressed volumes keep the name of their source file
+		auto relativePath = fs::relative(textureFile, aTextureDir);
+		if (relativePath.extension() == cCompressedVolumeExtension) {
+			relativePath.replace_extension();
+		}
+		auto name = convertToIdentifier(relativePath.string());
+		auto info = readVolumeInfo(textureFile);
+		VolumeTextures textures;
+		if (info.depth * info.sliceSize() > aResidencyBudget) {
+			auto cache = std::make_unique<VolumeBrickCache>(textureFile, aResidencyBudget);
+			textures = createPagedVolumeTextures(textureFile, *cache);
+			mTextures[name + cPageTableTextureSuffix] = std::make_shared<OGLTexture>(cache->takePageTableTexture(), GL_TEXTURE_3D);
+			mBrickCaches[name] = std::move(cache);
+		} else {
+			textures = create3DTextureFromFile(textureFile, aVolumeFormat);
+		}
 
-	return std::make_unique<VolumeData>(buffer, width, height, depth);
+		mTextures[name] = std::make_shared<OGLTexture>(std::move(textures.volume), GL_TEXTURE_3D);
+		// Min-max octree over the brick grid for empty space skipping, see MinMaxOctree
+		mTextures[name + cBrickTextureSuffix] = std::make_shared<OGLTexture>(std::move(textures.bricks), GL_TEXTURE_3D);
+		mBrickGrids[name] = { std::move(textures.grid), textures.type };
+		const auto &window = textures.statistics.window;
+		std::cout << "Loaded texture: " << name << " from " << textureFile
+			<< " (values " << textures.range.minimum << " - " << textures.range.maximum
+			<< ", window " << window.lower << " - " << window.upper << " (level " << window.level() << ", width " << window.width() << ")"
+			<< ", " << textures.emptyBrickCount << " bricks contain only the minimum)\n";
+		mVolumeStatistics[name] = std::move(textures.statistics);
+		mVolumeFiles[name] = textureFile;
+	}
 }
 
-std::unique_ptr<VolumeData> loadMHDFile(const fs::path& aFilePath) {
-	std::ifstream mhdFile(aFilePath);
-	std::string line;
-	fs::path rawFilePath;
-	int width = 0, height = 0, depth = 0;
-
-	DataBuffer buffer;
-	// Parse MHD file
-	while (std::getline(mhdFile, line)) {
-		std::istringstream iss(line);
-		std::string tag, equals;
-		iss >> tag;
-		if (tag == "DimSize") {
-			iss >> equals >> width >> height >> depth;
-		} else if (tag == "ElementDataFile") {
-			std::string rawFilename;
-			iss >> equals >> rawFilename;
-			// std::getline(iss >> std::ws, rawFilename); // Read the rest of the line
-			// Assuming RAW file is in the same directory as the MHD file
-			rawFilePath = aFilePath.parent_path() / rawFilename;
-		} else if (tag == "ElementType") {
-			std::string elementType;
-			iss >> equals >> elementType;
-			if (elementType == "MET_FLOAT") {
-				buffer = std::vector<float>();
-			} else if (elementType == "MET_USHORT") {
-				buffer = std::vector<uint16_t>();
-			} else {
-				throw OpenGLError("Unsupported element type for MHD loader");
-			}
-		}
+const VolumeStatistics &OGLMaterialFactory::getVolumeStatistics(const std::string &aVolumeName) const {
+	auto it = mVolumeStatistics.find(convertToIdentifier(aVolumeName));
+	if (it == mVolumeStatistics.end()) {
+		throw OpenGLError("Volume " + aVolumeName + " not found");
 	}
+	return it->second;
+}
 
-	// Load RAW file
-	std::ifstream rawFile(rawFilePath, std::ios::binary);
-	if (!rawFile.is_open()) {
-		throw std::runtime_error("MHD loader failed to open raw file: " + rawFilePath.string());
+const ImageStatistics &OGLMaterialFactory::getImageStatistics(const std::string &aTextureName) const {
+	auto it = mImageStatistics.find(convertToIdentifier(aTextureName));
+	if (it == mImageStatistics.end()) {
+		throw OpenGLError("Statistics of texture " + aTextureName + " not found");
 	}
-
-	std::visit([&](auto&& arg) {
-			using T = std::decay_t<decltype(arg)>;
-			using ValueType = typename T::value_type;
-			arg.resize(width * height * depth);
-			rawFile.read(reinterpret_cast<char*>(arg.data()), arg.size() * sizeof(ValueType));
-
-			auto minIt = std::min_element(arg.begin(), arg.end());
-			auto maxIt = std::max_element(arg.begin(), arg.end());
-
-			if (minIt != arg.end() && maxIt != arg.end()) { // Check to ensure arg is not empty
-				std::cout << "Minimum value: " << *minIt << std::endl;
-				std::cout << "Maximum value: " << *maxIt << std::endl;
-			} else {
-				std::cout << "The vector is empty." << std::endl;
-			}
-
-		}, buffer);
-
-	return std::make_unique<VolumeData>(buffer, width, height, depth);
+	return it->second;
 }
 
-std::unique_ptr<VolumeData> load3DFile(const fs::path& aFilePath) {
-	auto ext = aFilePath.extension().string();
-	std::transform(ext.begin(), ext.end(), ext.begin(),
-			[](unsigned char c){ return std::tolower(c); });
-
-	if (ext == ".mhd") {
-		return loadMHDFile(aFilePath);
+void OGLMaterialFactory::updatePagedVolumes() {
+	for (auto &[name, cache] : mBrickCaches) {
+		cache->update();
 	}
-	if (ext == ".dump" ) {
-		return loadDumpFile(aFilePath);
-	}
-
-	throw OpenGLError("Unsupported 3d image type " + aFilePath.string());
 }
 
-
-struct TextureDataUploadVisitor {
-	void operator()(const std::vector<uint16_t>& vec) const {
-		GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_R16, volumeData.width, volumeData.height, volumeData.depth, 0, GL_RED, GL_UNSIGNED_SHORT, vec.data()));
+std::vector<std::string> OGLMaterialFactory::getPagedVolumeNames() const {
+	std::vector<std::string> names;
+	for (const auto &[name, cache] : mBrickCaches) {
+		names.push_back(name);
 	}
+	return names;
+}
 
-	void operator()(const std::vector<float>& vec) const {
-		GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, volumeData.width, volumeData.height, volumeData.depth, 0, GL_RED, GL_FLOAT, vec.data()));
+void OGLMaterialFactory::createEmptySpaceDistanceTexture(const std::string &aVolumeName, float aIsoValue) {
+	auto name = convertToIdentifier(aVolumeName);
+	auto it = mBrickGrids.find(name);
+	if (it == mBrickGrids.end()) {
+		throw OpenGLError("Volume " + aVolumeName + " not found");
 	}
-	const VolumeData& volumeData;
-};
+	const auto &grid = it->second.grid;
+	auto distance = computeEmptySpaceDistance(grid, aIsoValue / getVoxelScale(it->second.type));
 
-OpenGLResource create3DTextureFromData(const VolumeData& volumeData) {
 	auto texture = createTexture();
-	glBindTexture(GL_TEXTURE_3D, texture.get());
-	std::visit(TextureDataUploadVisitor{volumeData}, volumeData.data);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-
-	return texture;
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, texture.get()));
+	GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, grid.width, grid.height, grid.depth, 0, GL_RED, GL_FLOAT, distance.data()));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, 0));
+	mTextures[name + cDistanceTextureSuffix] = std::make_shared<OGLTexture>(std::move(texture), GL_TEXTURE_3D);
 }
 
-void OGLMaterialFactory::load3DTexturesFromDir(fs::path aTextureDir) {
-	aTextureDir = fs::canonical(aTextureDir);
-	auto files = findVolumeDataFiles(aTextureDir);
-
-	for (const auto& textureFile : files) {
-		auto imageData = load3DFile(textureFile);
-		if (imageData) {
-			auto texture = create3DTextureFromData(*imageData);
+int OGLMaterialFactory::createVolumeSliceCache(const std::string &aVolumeName) {
+	auto name = convertToIdentifier(aVolumeName);
+	auto it = mVolumeFiles.find(name);
+	if (it == mVolumeFiles.end()) {
+		throw OpenGLError("Volume " + aVolumeName + " not found");
+	}
+	auto cache = std::make_unique<VolumeSliceCache>(it->second, mVolumeStatistics.at(name));
+	mTextures[name + cEvenSliceTextureSuffix] = std::make_shared<OGLTexture>(cache->takeSliceTexture(0), GL_TEXTURE_2D);
+	mTextures[name + cOddSliceTextureSuffix] = std::make_shared<OGLTexture>(cache->takeSliceTexture(1), GL_TEXTURE_2D);
+	int sliceCount = cache->sliceCount();
+	mSliceCaches[name] = std::move(cache);
+	return sliceCount;
+}
 
-			auto name = convertToIdentifier(fs::relative(textureFile, aTextureDir).string());
-			mTextures[name] = std::make_shared<OGLTexture>(std::move(texture), GL_TEXTURE_3D);
-			std::cout << "Loaded texture: " << name << " from " << textureFile << "\n";
-		}
+void OGLMaterialFactory::updateVolumeSliceCaches(float aAnimationTime) {
+	for (auto &[name, cache] : mSliceCaches) {
+		cache->update(aAnimationTime);
 	}
 }
 
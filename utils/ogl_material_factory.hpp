@@ -11,6 +11,11 @@
 
 #include "shader.hpp"
 #include "material_factory.hpp"
+#include "texture_compression.hpp"
+#include "volume_acceleration.hpp"
+#include "volume_brick_cache.hpp"
+#include "volume_slice_cache.hpp"
+#include "volume_conversion.hpp"
 
 namespace fs = std::filesystem;
 
@@ -117,9 +122,56 @@ public:
 
 class OGLMaterialFactory: public MaterialFactory {
 public:
+	static constexpr size_t cDefaultResidencyBudget = size_t(1) << 30;
+
 	void loadShadersFromDir(fs::path aShaderDir);
 	void loadTexturesFromDir(fs::path aTextureDir);
-	void load3DTexturesFromDir(fs::path aTextureDir);
+	/**
+	 * Loads .mhd/.dump volumes. Next to each volume texture "<name>" a min-max octree texture
+	 * "<name>.bricks" (RG32F per-node min/max, one octree level per mip) is registered for empty space skipping.
+	 *
+	 * Volumes larger than aResidencyBudget bytes are paged through a VolumeBrickCache of that size -
+	 * "<name>" is then the brick atlas and "<name>.pages" its page table, render them with the PAGED
+	 * permutation and call updatePagedVolumes() every frame.
+	 *
+	 * Other volumes are uploaded in aVolumeFormat. The normalized formats apply the automatic window
+	 * of the volume histogram, see getVolumeStatistics(). Paged volumes stay native.
+	 */
+	void load3DTexturesFromDir(fs::path aTextureDir, size_t aResidencyBudget = cDefaultResidencyBudget, VolumeFormat aVolumeFormat = VolumeFormat::Native);
+
+	/**
+	 * Histogram and window of a loaded volume, maps stored values of the file to the sampled ones.
+	 */
+	const VolumeStatistics &getVolumeStatistics(const std::string &aVolumeName) const;
+
+	/**
+	 * Per channel statistics of a texture decoded from an image file, cooked ".btex" textures have none.
+	 */
+	const ImageStatistics &getImageStatistics(const std::string &aTextureName) const;
+
+	/**
+	 * Streams in the bricks requested by the last finished frames, call after rendering each frame.
+	 */
+	void updatePagedVolumes();
+
+	std::vector<std::string> getPagedVolumeNames() const;
+
+	/**
+	 * Registers "<volume>.distance" - R32F brick distance to the nearest brick which may contain aIsoValue,
+	 * see computeEmptySpaceDistance(). aIsoValue is in the units the shaders sample the volume in.
+	 */
+	void createEmptySpaceDistanceTexture(const std::string &aVolumeName, float aIsoValue);
+
+	/**
+	 * Registers "<volume>.even_slice" and "<volume>.odd_slice" for the cached-slice mode of animated_texture.program,
+	 * see VolumeSliceCache. Returns the slice count the shader needs as u_sliceCount.
+	 */
+	int createVolumeSliceCache(const std::string &aVolumeName);
+
+	/**
+	 * Uploads the slices the cached-slice materials blend at aAnimationTime (u_speed * u_elapsedTime), call before rendering the frame.
+	 */
+	void updateVolumeSliceCaches(float aAnimationTime);
 
 	std::shared_ptr<AShaderProgram> getShaderProgram(const std::string &aName) {
 		auto it = mPrograms.find(aName);
@@ -130,6 +182,13 @@ public:
 		return it->second;
 	};
 
+	/**
+	 * Returns specialized variant of the shader program. Each bit of the permutation mask
+	 * enables one of the keys declared in the "permutations" entry of the .program file.
+	 * Variants are compiled on first request and cached, permutation 0 is the generic program.
+	 */
+	std::shared_ptr<AShaderProgram> getShaderProgram(const std::string &aName, unsigned int aPermutation);
+
 	std::shared_ptr<ATexture> getTexture(const std::string &aName) {
 		auto it = mTextures.find(convertToIdentifier(aName));
 		if (it == mTextures.end()) {
@@ -140,11 +199,35 @@ public:
 	};
 
 protected:
+	struct ProgramTemplate {
+		// Shader stage type -> source with resolved includes
+		std::map<GLenum, std::string> stageSources;
+		// Permutation key -> bit index in the permutation mask
+		std::map<std::string, unsigned int> permutationKeys;
+	};
+
 	using CompiledPrograms = std::map<std::string, std::shared_ptr<OGLShaderProgram>>;
+	using ProgramVariants = std::map<std::pair<std::string, unsigned int>, std::shared_ptr<OGLShaderProgram>>;
+	using ProgramTemplates = std::map<std::string, ProgramTemplate>;
 	using Textures = std::map<std::string, std::shared_ptr<OGLTexture>>;
 
+	struct VolumeBricks {
+		BrickGrid grid;
+		VoxelType type;
+	};
+	// Volume name -> leaf brick grid, kept for the iso value dependent acceleration textures
+	using VolumeBrickGrids = std::map<std::string, VolumeBricks>;
+
 	CompiledPrograms mPrograms;
+	ProgramVariants mProgramVariants;
+	ProgramTemplates mProgramTemplates;
 	Textures mTextures;
+	VolumeBrickGrids mBrickGrids;
+	std::map<std::string, std::unique_ptr<VolumeBrickCache>> mBrickCaches;
+	std::map<std::string, std::unique_ptr<VolumeSliceCache>> mSliceCaches;
+	std::map<std::string, fs::path> mVolumeFiles;
+	std::map<std::string, VolumeStatistics> mVolumeStatistics;
+	std::map<std::string, ImageStatistics> mImageStatistics;
 };
 
 struct ImageData {
@@ -155,5 +238,59 @@ struct ImageData {
 };
 
 
+/**
+ * Ring of pixel unpack buffers for texture uploads. The image is copied into a PBO and
+ * glTexImage2D sources it from there, so the driver can transfer the data asynchronously
+ * while the loader threads keep decoding.
+ */
+class TextureUploadStaging {
+public:
+	TextureUploadStaging(int aBufferCount = 2);
+
+	OpenGLResource createTextureFromData(const ImageData& imgData);
+
+	/**
+	 * Uploads all levels of a precomputed mip chain (see generateMipChain()) through one buffer.
+	 */
+	OpenGLResource createTextureFromMipChain(const std::vector<PixelImage>& aLevels);
+
+	/**
+	 * Maps the next buffer of the ring for writing and leaves it bound to GL_PIXEL_UNPACK_BUFFER.
+	 * Unmap it with glUnmapBuffer() before sourcing a texture upload from it.
+	 */
+	void *mapNextBuffer(GLsizeiptr aSize);
+protected:
+
+	std::vector<OpenGLResource> mBuffers;
+	int mNextBuffer = 0;
+};
+
+/**
+ * Source images (jpg, png, bmp, tga) in the directory tree, without the cooked ".btex" files.
+ */
+std::vector<fs::path> findSourceImageFiles(const fs::path& aTextureDir);
+/**
+ * True if the cooked ".btex" sibling of the source image exists and is not older than the source.
+ */
+bool isCookedTextureCurrent(const fs::path& aSourceFile);
+/**
+ * Mipmap options of a source image by its file name: sRGB filtering by default, linear for data maps whose name
+ * has a token like NRM/NORM/NM, ROUGH, OCC, DISP or height. The texture cooker uses the same rule.
+ */
+MipmapOptions getMipmapOptions(const fs::path& aImageFile);
+/**
+ * Image files in the directory tree. A source image is replaced by its cooked ".btex" sibling if that is up to date.
+ */
+std::vector<fs::path> findImageFiles(const fs::path& aTextureDir);
+/**
+ * Volume files in the directory tree. A source volume is replaced by its compressed ".bvol" sibling if present.
+ */
+std::vector<fs::path> findVolumeDataFiles(const fs::path& aTextureDir);
 std::unique_ptr<ImageData> loadImage(const fs::path& filePath);
+PixelImage toPixelImage(const ImageData& imgData);
 OpenGLResource createTextureFromData(const ImageData& imgData);
+
+/**
+ * Uploads all precomputed mip levels of a block compressed texture (see texture_compression.hpp).
+ */
+OpenGLResource createTextureFromCompressed(const CompressedTexture& aTexture);
@@ -0,0 +1,700 @@
+#include "texture_compression.hpp"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESSION_SSE2 1
+#endif
+
+namespace {
+
+constexpr int cBlockPixels = 16;
+
+// Block pixels in channel-major order, so the index search can process four pixels at once
+struct BlockPixels {
+	alignas(16) std::array<std::array<float, cBlockPixels>, 4> channels;
+};
+
+struct Palette {
+	std::array<std::array<float, 4>, 16> colors;
+	int size = 0;
+};
+
+// Pixels outside of the image are replaced by the nearest edge pixel
+BlockPixels fetchBlock(const PixelImage &aImage, int aBlockX, int aBlockY) {
+	BlockPixels block;
+	for (int y = 0; y < 4; ++y) {
+		int sourceY = std::min(aBlockY * 4 + y, aImage.height - 1);
+		for (int x = 0; x < 4; ++x) {
+			int sourceX = std::min(aBlockX * 4 + x, aImage.width - 1);
+			const uint8_t *pixel = &aImage.pixels[(size_t(sourceY) * aImage.width + sourceX) * aImage.channels];
+			for (int c = 0; c < 4; ++c) {
+				block.channels[c][y * 4 + x] = c < aImage.channels ? float(pixel[c]) : (c == 3 ? 255.0f : 0.0f);
+			}
+		}
+	}
+	return block;
+}
+
+// Nearest palette entry (squared distance over aChannelCount channels) for each of the 16 pixels
+void selectIndices(
+		const BlockPixels &aBlock,
+		int aFirstChannel,
+		int aChannelCount,
+		const Palette &aPalette,
+		std::array<uint8_t, cBlockPixels> &aIndices)
+{
+#ifdef TEXTURE_COMPRESSION_SSE2
+	for (int group = 0; group < cBlockPixels; group += 4) {
+		__m128 bestDistance = _mm_set1_ps(std::numeric_limits<float>::max());
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int entry = 0; entry < aPalette.size; ++entry) {
+			__m128 distance = _mm_setzero_ps();
+			for (int c = aFirstChannel; c < aFirstChannel + aChannelCount; ++c) {
+				__m128 difference = _mm_sub_ps(
+						_mm_load_ps(&aBlock.channels[c][group]),
+						_mm_set1_ps(aPalette.colors[entry][c]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(difference, difference));
+			}
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, bestDistance));
+			bestDistance = _mm_min_ps(distance, bestDistance);
+			bestIndex = _mm_or_si128(
+					_mm_and_si128(closer, _mm_set1_epi32(entry)),
+					_mm_andnot_si128(closer, bestIndex));
+		}
+		alignas(16) std::array<int32_t, 4> indices;
+		_mm_store_si128(reinterpret_cast<__m128i *>(indices.data()), bestIndex);
+		for (int i = 0; i < 4; ++i) {
+			aIndices[group + i] = uint8_t(indices[i]);
+		}
+	}
+#else
+	for (int pixel = 0; pixel < cBlockPixels; ++pixel) {
+		float bestDistance = std::numeric_limits<float>::max();
+		for (int entry = 0; entry < aPalette.size; ++entry) {
+			float distance = 0.0f;
+			for (int c = aFirstChannel; c < aFirstChannel + aChannelCount; ++c) {
+				float difference = aBlock.channels[c][pixel] - aPalette.colors[entry][c];
+				distance += difference * difference;
+			}
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				aIndices[pixel] = uint8_t(entry);
+			}
+		}
+	}
+#endif
+}
+
+// Endpoints of the block colors projected on their principal axis
+void findPrincipalEndpoints(
+		const BlockPixels &aBlock,
+		int aChannelCount,
+		std::array<float, 4> &aMinimum,
+		std::array<float, 4> &aMaximum)
+{
+	std::array<float, 4> mean = {};
+	for (int c = 0; c < aChannelCount; ++c) {
+		for (int i = 0; i < cBlockPixels; ++i) {
+			mean[c] += aBlock.channels[c][i];
+		}
+		mean[c] /= cBlockPixels;
+	}
+	std::array<std::array<float, 4>, 4> covariance = {};
+	for (int i = 0; i < cBlockPixels; ++i) {
+		for (int a = 0; a < aChannelCount; ++a) {
+			for (int b = 0; b < aChannelCount; ++b) {
+				covariance[a][b] += (aBlock.channels[a][i] - mean[a]) * (aBlock.channels[b][i] - mean[b]);
+			}
+		}
+	}
+	// Power iteration converges to the dominant eigenvector
+	std::array<float, 4> axis = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		std::array<float, 4> next = {};
+		float length = 0.0f;
+		for (int a = 0; a < aChannelCount; ++a) {
+			for (int b = 0; b < aChannelCount; ++b) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length += next[a] * next[a];
+		}
+		if (length < 1e-12f) {
+			break;
+		}
+		length = std::sqrt(length);
+		for (int a = 0; a < aChannelCount; ++a) {
+			axis[a] = next[a] / length;
+		}
+	}
+	float minProjection = std::numeric_limits<float>::max();
+	float maxProjection = std::numeric_limits<float>::lowest();
+	for (int i = 0; i < cBlockPixels; ++i) {
+		float projection = 0.0f;
+		for (int c = 0; c < aChannelCount; ++c) {
+			projection += (aBlock.channels[c][i] - mean[c]) * axis[c];
+		}
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+	for (int c = 0; c < 4; ++c) {
+		aMinimum[c] = std::clamp(mean[c] + minProjection * axis[c], 0.0f, 255.0f);
+		aMaximum[c] = std::clamp(mean[c] + maxProjection * axis[c], 0.0f, 255.0f);
+	}
+}
+
+void writeBits(uint8_t *aBlock, int &aBitPosition, uint32_t aValue, int aBitCount) {
+	for (int i = 0; i < aBitCount; ++i, ++aBitPosition) {
+		if (aValue & (1u << i)) {
+			aBlock[aBitPosition / 8] |= uint8_t(1u << (aBitPosition % 8));
+		}
+	}
+}
+
+uint32_t readBits(const uint8_t *aBlock, int &aBitPosition, int aBitCount) {
+	uint32_t value = 0;
+	for (int i = 0; i < aBitCount; ++i, ++aBitPosition) {
+		if (aBlock[aBitPosition / 8] & (1u << (aBitPosition % 8))) {
+			value |= 1u << i;
+		}
+	}
+	return value;
+}
+
+//********************************************************************
+// BC1
+
+uint16_t packRGB565(const std::array<float, 4> &aColor) {
+	auto r = uint16_t(std::lround(aColor[0] * 31.0f / 255.0f));
+	auto g = uint16_t(std::lround(aColor[1] * 63.0f / 255.0f));
+	auto b = uint16_t(std::lround(aColor[2] * 31.0f / 255.0f));
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+std::array<float, 4> unpackRGB565(uint16_t aColor) {
+	int r = (aColor >> 11) & 31;
+	int g = (aColor >> 5) & 63;
+	int b = aColor & 31;
+	return {
+		float((r << 3) | (r >> 2)),
+		float((g << 2) | (g >> 4)),
+		float((b << 3) | (b >> 2)),
+		255.0f };
+}
+
+Palette makeBC1Palette(uint16_t aColor0, uint16_t aColor1) {
+	Palette palette;
+	auto c0 = unpackRGB565(aColor0);
+	auto c1 = unpackRGB565(aColor1);
+	palette.colors[0] = c0;
+	palette.colors[1] = c1;
+	if (aColor0 > aColor1) {
+		palette.size = 4;
+		for (int c = 0; c < 4; ++c) {
+			palette.colors[2][c] = std::floor((2.0f * c0[c] + c1[c]) / 3.0f);
+			palette.colors[3][c] = std::floor((c0[c] + 2.0f * c1[c]) / 3.0f);
+		}
+	} else {
+		palette.size = 3;
+		for (int c = 0; c < 4; ++c) {
+			palette.colors[2][c] = std::floor((c0[c] + c1[c]) / 2.0f);
+		}
+		palette.colors[3] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	}
+	return palette;
+}
+
+// Least squares fit of the two endpoints to the pixels given the selected interpolation weights
+void refineEndpoints(
+		const BlockPixels &aBlock,
+		int aChannelCount,
+		const std::array<float, cBlockPixels> &aWeights,
+		std::array<float, 4> &aEndpoint0,
+		std::array<float, 4> &aEndpoint1)
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	std::array<float, 4> ax = {}, bx = {};
+	for (int i = 0; i < cBlockPixels; ++i) {
+		float b = aWeights[i];
+		float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < aChannelCount; ++c) {
+			ax[c] += a * aBlock.channels[c][i];
+			bx[c] += b * aBlock.channels[c][i];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::abs(determinant) < 1e-6f) {
+		return;
+	}
+	for (int c = 0; c < aChannelCount; ++c) {
+		aEndpoint0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+		aEndpoint1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+	}
+}
+
+void encodeBC1Block(const BlockPixels &aBlock, uint8_t *aOutput) {
+	std::array<float, 4> minimum, maximum;
+	findPrincipalEndpoints(aBlock, 3, minimum, maximum);
+
+	uint16_t color0 = packRGB565(maximum);
+	uint16_t color1 = packRGB565(minimum);
+	std::array<uint8_t, cBlockPixels> indices = {};
+	if (color0 != color1) {
+		if (color0 < color1) {
+			std::swap(color0, color1);
+		}
+		selectIndices(aBlock, 0, 3, makeBC1Palette(color0, color1), indices);
+
+		// One refinement pass with the weights of the selected palette entries
+		constexpr std::array<float, 4> cWeights = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		std::array<float, cBlockPixels> weights;
+		for (int i = 0; i < cBlockPixels; ++i) {
+			weights[i] = cWeights[indices[i]];
+		}
+		auto endpoint0 = unpackRGB565(color0);
+		auto endpoint1 = unpackRGB565(color1);
+		refineEndpoints(aBlock, 3, weights, endpoint0, endpoint1);
+		uint16_t refined0 = packRGB565(endpoint0);
+		uint16_t refined1 = packRGB565(endpoint1);
+		if (refined0 < refined1) {
+			std::swap(refined0, refined1);
+		}
+		if (refined0 != refined1) {
+			std::array<uint8_t, cBlockPixels> refinedIndices;
+			auto refinedPalette = makeBC1Palette(refined0, refined1);
+			selectIndices(aBlock, 0, 3, refinedPalette, refinedIndices);
+
+			auto blockError = [&aBlock](const Palette &aPalette, const std::array<uint8_t, cBlockPixels> &aIndices) {
+				float error = 0.0f;
+				for (int i = 0; i < cBlockPixels; ++i) {
+					for (int c = 0; c < 3; ++c) {
+						float difference = aBlock.channels[c][i] - aPalette.colors[aIndices[i]][c];
+						error += difference * difference;
+					}
+				}
+				return error;
+			};
+			if (blockError(refinedPalette, refinedIndices) < blockError(makeBC1Palette(color0, color1), indices)) {
+				color0 = refined0;
+				color1 = refined1;
+				indices = refinedIndices;
+			}
+		}
+	}
+
+	aOutput[0] = uint8_t(color0 & 0xFF);
+	aOutput[1] = uint8_t(color0 >> 8);
+	aOutput[2] = uint8_t(color1 & 0xFF);
+	aOutput[3] = uint8_t(color1 >> 8);
+	uint32_t packedIndices = 0;
+	for (int i = 0; i < cBlockPixels; ++i) {
+		packedIndices |= uint32_t(indices[i]) << (2 * i);
+	}
+	for (int i = 0; i < 4; ++i) {
+		aOutput[4 + i] = uint8_t(packedIndices >> (8 * i));
+	}
+}
+
+void decodeBC1Block(const uint8_t *aInput, std::array<std::array<float, 4>, cBlockPixels> &aPixels) {
+	uint16_t color0 = uint16_t(aInput[0] | (aInput[1] << 8));
+	uint16_t color1 = uint16_t(aInput[2] | (aInput[3] << 8));
+	auto palette = makeBC1Palette(color0, color1);
+	uint32_t packedIndices = aInput[4] | (aInput[5] << 8) | (aInput[6] << 16) | (uint32_t(aInput[7]) << 24);
+	for (int i = 0; i < cBlockPixels; ++i) {
+		auto &color = palette.colors[(packedIndices >> (2 * i)) & 3];
+		for (int c = 0; c < 3; ++c) {
+			aPixels[i][c] = color[c];
+		}
+	}
+}
+
+//********************************************************************
+// BC4 - also used for the BC3 alpha and both BC5 channels
+
+Palette makeBC4Palette(int aChannel, uint8_t aValue0, uint8_t aValue1) {
+	Palette palette;
+	palette.colors[0][aChannel] = aValue0;
+	palette.colors[1][aChannel] = aValue1;
+	if (aValue0 > aValue1) {
+		palette.size = 8;
+		for (int i = 1; i < 7; ++i) {
+			palette.colors[1 + i][aChannel] = std::floor(((7 - i) * aValue0 + i * aValue1) / 7.0f);
+		}
+	} else {
+		palette.size = 8;
+		for (int i = 1; i < 5; ++i) {
+			palette.colors[1 + i][aChannel] = std::floor(((5 - i) * aValue0 + i * aValue1) / 5.0f);
+		}
+		palette.colors[6][aChannel] = 0.0f;
+		palette.colors[7][aChannel] = 255.0f;
+	}
+	return palette;
+}
+
+void encodeBC4Block(const BlockPixels &aBlock, int aChannel, uint8_t *aOutput) {
+	auto &values = aBlock.channels[aChannel];
+	auto [minIt, maxIt] = std::minmax_element(values.begin(), values.end());
+	auto value0 = uint8_t(std::lround(*maxIt));
+	auto value1 = uint8_t(std::lround(*minIt));
+
+	std::array<uint8_t, cBlockPixels> indices = {};
+	if (value0 != value1) {
+		selectIndices(aBlock, aChannel, 1, makeBC4Palette(aChannel, value0, value1), indices);
+	}
+	std::fill(aOutput, aOutput + 8, 0);
+	aOutput[0] = value0;
+	aOutput[1] = value1;
+	int bitPosition = 16;
+	for (int i = 0; i < cBlockPixels; ++i) {
+		writeBits(aOutput, bitPosition, indices[i], 3);
+	}
+}
+
+void decodeBC4Block(const uint8_t *aInput, int aChannel, std::array<std::array<float, 4>, cBlockPixels> &aPixels) {
+	auto palette = makeBC4Palette(aChannel, aInput[0], aInput[1]);
+	int bitPosition = 16;
+	for (int i = 0; i < cBlockPixels; ++i) {
+		aPixels[i][aChannel] = palette.colors[readBits(aInput, bitPosition, 3)][aChannel];
+	}
+}
+
+//********************************************************************
+// BC7 - mode 6 (single subset, RGBA 7.7.7.7 endpoints with unique p-bit, 4-bit indices)
+
+constexpr std::array<int, 16> cBC7Weights4 = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+Palette makeBC7Mode6Palette(const std::array<int, 4> &aEndpoint0, const std::array<int, 4> &aEndpoint1) {
+	Palette palette;
+	palette.size = 16;
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 4; ++c) {
+			palette.colors[i][c] = float(((64 - cBC7Weights4[i]) * aEndpoint0[c] + cBC7Weights4[i] * aEndpoint1[c] + 32) >> 6);
+		}
+	}
+	return palette;
+}
+
+// Picks the p-bit with the smaller quantization error, returns the expanded 8-bit endpoint
+std::array<int, 4> quantizeBC7Mode6Endpoint(const std::array<float, 4> &aEndpoint, std::array<int, 4> &aQuantized, int &aPBit) {
+	float bestError = std::numeric_limits<float>::max();
+	std::array<int, 4> expanded = {};
+	for (int pBit = 0; pBit < 2; ++pBit) {
+		std::array<int, 4> quantized, candidate;
+		float error = 0.0f;
+		for (int c = 0; c < 4; ++c) {
+			quantized[c] = std::clamp(int(std::lround((aEndpoint[c] - pBit) / 2.0f)), 0, 127);
+			candidate[c] = (quantized[c] << 1) | pBit;
+			error += (candidate[c] - aEndpoint[c]) * (candidate[c] - aEndpoint[c]);
+		}
+		if (error < bestError) {
+			bestError = error;
+			aQuantized = quantized;
+			aPBit = pBit;
+			expanded = candidate;
+		}
+	}
+	return expanded;
+}
+
+void encodeBC7Block(const BlockPixels &aBlock, uint8_t *aOutput) {
+	std::array<float, 4> minimum, maximum;
+	findPrincipalEndpoints(aBlock, 4, minimum, maximum);
+
+	std::array<int, 4> quantized0, quantized1;
+	int pBit0 = 0, pBit1 = 0;
+	auto endpoint0 = quantizeBC7Mode6Endpoint(minimum, quantized0, pBit0);
+	auto endpoint1 = quantizeBC7Mode6Endpoint(maximum, quantized1, pBit1);
+
+	std::array<uint8_t, cBlockPixels> indices;
+	selectIndices(aBlock, 0, 4, makeBC7Mode6Palette(endpoint0, endpoint1), indices);
+
+	// The most significant index bit of the first pixel is implicit zero
+	if (indices[0] >= 8) {
+		std::swap(quantized0, quantized1);
+		std::swap(pBit0, pBit1);
+		for (auto &index : indices) {
+			index = uint8_t(15 - index);
+		}
+	}
+
+	std::fill(aOutput, aOutput + 16, 0);
+	int bitPosition = 0;
+	writeBits(aOutput, bitPosition, 1u << 6, 7);
+	for (int c = 0; c < 4; ++c) {
+		writeBits(aOutput, bitPosition, quantized0[c], 7);
+		writeBits(aOutput, bitPosition, quantized1[c], 7);
+	}
+	writeBits(aOutput, bitPosition, pBit0, 1);
+	writeBits(aOutput, bitPosition, pBit1, 1);
+	writeBits(aOutput, bitPosition, indices[0], 3);
+	for (int i = 1; i < cBlockPixels; ++i) {
+		writeBits(aOutput, bitPosition, indices[i], 4);
+	}
+}
+
+void decodeBC7Block(const uint8_t *aInput, std::array<std::array<float, 4>, cBlockPixels> &aPixels) {
+	int bitPosition = 0;
+	if (readBits(aInput, bitPosition, 7) != (1u << 6)) {
+		throw std::runtime_error("Only BC7 mode 6 blocks are supported by the decoder");
+	}
+	std::array<int, 4> endpoint0, endpoint1;
+	for (int c = 0; c < 4; ++c) {
+		endpoint0[c] = int(readBits(aInput, bitPosition, 7));
+		endpoint1[c] = int(readBits(aInput, bitPosition, 7));
+	}
+	int pBit0 = int(readBits(aInput, bitPosition, 1));
+	int pBit1 = int(readBits(aInput, bitPosition, 1));
+	for (int c = 0; c < 4; ++c) {
+		endpoint0[c] = (endpoint0[c] << 1) | pBit0;
+		endpoint1[c] = (endpoint1[c] << 1) | pBit1;
+	}
+	auto palette = makeBC7Mode6Palette(endpoint0, endpoint1);
+	for (int i = 0; i < cBlockPixels; ++i) {
+		aPixels[i] = palette.colors[readBits(aInput, bitPosition, i == 0 ? 3 : 4)];
+	}
+}
+
+//********************************************************************
+
+void encodeBlock(const BlockPixels &aBlock, BlockFormat aFormat, uint8_t *aOutput) {
+	switch (aFormat) {
+	case BlockFormat::BC1:
+		encodeBC1Block(aBlock, aOutput);
+		break;
+	case BlockFormat::BC3:
+		encodeBC4Block(aBlock, 3, aOutput);
+		encodeBC1Block(aBlock, aOutput + 8);
+		break;
+	case BlockFormat::BC4:
+		encodeBC4Block(aBlock, 0, aOutput);
+		break;
+	case BlockFormat::BC5:
+		encodeBC4Block(aBlock, 0, aOutput);
+		encodeBC4Block(aBlock, 1, aOutput + 8);
+		break;
+	case BlockFormat::BC7:
+		encodeBC7Block(aBlock, aOutput);
+		break;
+	}
+}
+
+void decodeBlock(const uint8_t *aInput, BlockFormat aFormat, std::array<std::array<float, 4>, cBlockPixels> &aPixels) {
+	for (auto &pixel : aPixels) {
+		pixel = { 0.0f, 0.0f, 0.0f, 255.0f };
+	}
+	switch (aFormat) {
+	case BlockFormat::BC1:
+		decodeBC1Block(aInput, aPixels);
+		break;
+	case BlockFormat::BC3:
+		decodeBC4Block(aInput, 3, aPixels);
+		decodeBC1Block(aInput + 8, aPixels);
+		break;
+	case BlockFormat::BC4:
+		decodeBC4Block(aInput, 0, aPixels);
+		break;
+	case BlockFormat::BC5:
+		decodeBC4Block(aInput, 0, aPixels);
+		decodeBC4Block(aInput + 8, 1, aPixels);
+		break;
+	case BlockFormat::BC7:
+		decodeBC7Block(aInput, aPixels);
+		break;
+	}
+}
+
+constexpr std::array<char, 4> cMagic = { 'B', 'T', 'E', 'X' };
+constexpr uint32_t cContainerVersion = 1;
+
+template<typename T>
+void writeValue(std::ofstream &aStream, T aValue) {
+	aStream.write(reinterpret_cast<const char *>(&aValue), sizeof(T));
+}
+
+template<typename T>
+T readValue(std::ifstream &aStream) {
+	T value;
+	aStream.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return value;
+}
+
+} // namespace
+
+size_t getBlockSize(BlockFormat aFormat) {
+	switch (aFormat) {
+	case BlockFormat::BC1:
+	case BlockFormat::BC4:
+		return 8;
+	case BlockFormat::BC3:
+	case BlockFormat::BC5:
+	case BlockFormat::BC7:
+		return 16;
+	}
+	throw std::runtime_error("Unknown block format");
+}
+
+std::string getBlockFormatName(BlockFormat aFormat) {
+	return "BC" + std::to_string(static_cast<uint32_t>(aFormat));
+}
+
+BlockFormat chooseBlockFormat(int aChannels, bool aHighQuality) {
+	switch (aChannels) {
+	case 1: return BlockFormat::BC4;
+	case 2: return BlockFormat::BC5;
+	case 3: return aHighQuality ? BlockFormat::BC7 : BlockFormat::BC1;
+	case 4: return aHighQuality ? BlockFormat::BC7 : BlockFormat::BC3;
+	default:
+		throw std::runtime_error("Unsupported number of channels for block compression");
+	}
+}
+
+CompressedLevel compressLevel(const PixelImage &aImage, BlockFormat aFormat, ThreadPool &aPool) {
+	CompressedLevel level;
+	level.width = aImage.width;
+	level.height = aImage.height;
+	int blocksX = (aImage.width + 3) / 4;
+	int blocksY = (aImage.height + 3) / 4;
+	size_t blockSize = getBlockSize(aFormat);
+	level.data.resize(size_t(blocksX) * blocksY * blockSize);
+
+	parallelFor(aPool, 0, blocksY, 4, [&](size_t aBegin, size_t aEnd) {
+		for (size_t blockY = aBegin; blockY < aEnd; ++blockY) {
+			for (int blockX = 0; blockX < blocksX; ++blockX) {
+				auto block = fetchBlock(aImage, blockX, int(blockY));
+				encodeBlock(block, aFormat, &level.data[(blockY * blocksX + blockX) * blockSize]);
+			}
+		}
+	});
+	return level;
+}
+
+CompressedTexture compressTexture(const PixelImage &aImage, BlockFormat aFormat, ThreadPool &aPool, const MipmapOptions &aMipmapOptions) {
+	CompressedTexture texture;
+	texture.format = aFormat;
+	texture.channels = aImage.channels;
+	for (const auto &mip : generateMipChain(aImage, aMipmapOptions, &aPool)) {
+		texture.levels.push_back(compressLevel(mip, aFormat, aPool));
+	}
+	return texture;
+}
+
+PixelImage decompressLevel(const CompressedLevel &aLevel, BlockFormat aFormat, int aChannels) {
+	PixelImage image;
+	image.width = aLevel.width;
+	image.height = aLevel.height;
+	image.channels = aChannels;
+	image.pixels.resize(size_t(image.width) * image.height * aChannels);
+
+	int blocksX = (aLevel.width + 3) / 4;
+	int blocksY = (aLevel.height + 3) / 4;
+	size_t blockSize = getBlockSize(aFormat);
+	std::array<std::array<float, 4>, cBlockPixels> pixels;
+	for (int blockY = 0; blockY < blocksY; ++blockY) {
+		for (int blockX = 0; blockX < blocksX; ++blockX) {
+			decodeBlock(&aLevel.data[(size_t(blockY) * blocksX + blockX) * blockSize], aFormat, pixels);
+			for (int i = 0; i < cBlockPixels; ++i) {
+				int x = blockX * 4 + i % 4;
+				int y = blockY * 4 + i / 4;
+				if (x >= image.width || y >= image.height) {
+					continue;
+				}
+				for (int c = 0; c < aChannels; ++c) {
+					image.pixels[(size_t(y) * image.width + x) * aChannels + c] = uint8_t(pixels[i][c]);
+				}
+			}
+		}
+	}
+	return image;
+}
+
+double computePSNR(const PixelImage &aReference, const PixelImage &aImage) {
+	if (aReference.pixels.size() != aImage.pixels.size()) {
+		throw std::runtime_error("PSNR needs images of the same size");
+	}
+	double squaredError = 0.0;
+	for (size_t i = 0; i < aReference.pixels.size(); ++i) {
+		double difference = double(aReference.pixels[i]) - double(aImage.pixels[i]);
+		squaredError += difference * difference;
+	}
+	if (squaredError == 0.0) {
+		return std::numeric_limits<double>::infinity();
+	}
+	double meanSquaredError = squaredError / double(aReference.pixels.size());
+	return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+void writeCompressedTexture(const fs::path &aPath, const CompressedTexture &aTexture) {
+	std::ofstream file(aPath, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open compressed texture for writing: " + aPath.string());
+	}
+	uint32_t levelCount = uint32_t(aTexture.levels.size());
+	file.write(cMagic.data(), cMagic.size());
+	writeValue<uint32_t>(file, cContainerVersion);
+	writeValue<uint32_t>(file, static_cast<uint32_t>(aTexture.format));
+	writeValue<uint32_t>(file, aTexture.channels);
+	writeValue<uint32_t>(file, aTexture.levels.front().width);
+	writeValue<uint32_t>(file, aTexture.levels.front().height);
+	writeValue<uint32_t>(file, levelCount);
+
+	// Data of the smallest level follows directly after the index
+	uint64_t offset = cMagic.size() + 6 * sizeof(uint32_t) + levelCount * (2 * sizeof(uint32_t) + 2 * sizeof(uint64_t));
+	std::vector<uint64_t> offsets(levelCount);
+	for (uint32_t i = levelCount; i-- > 0;) {
+		offsets[i] = offset;
+		offset += aTexture.levels[i].data.size();
+	}
+	for (uint32_t i = 0; i < levelCount; ++i) {
+		writeValue<uint32_t>(file, aTexture.levels[i].width);
+		writeValue<uint32_t>(file, aTexture.levels[i].height);
+		writeValue<uint64_t>(file, offsets[i]);
+		writeValue<uint64_t>(file, aTexture.levels[i].data.size());
+	}
+	for (uint32_t i = levelCount; i-- > 0;) {
+		file.write(reinterpret_cast<const char *>(aTexture.levels[i].data.data()), aTexture.levels[i].data.size());
+	}
+}
+
+CompressedTexture readCompressedTexture(const fs::path &aPath) {
+	std::ifstream file(aPath, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open compressed texture: " + aPath.string());
+	}
+	std::array<char, 4> magic;
+	file.read(magic.data(), magic.size());
+	if (magic != cMagic || readValue<uint32_t>(file) != cContainerVersion) {
+		throw std::runtime_error("Not a compressed texture file: " + aPath.string());
+	}
+	CompressedTexture texture;
+	texture.format = static_cast<BlockFormat>(readValue<uint32_t>(file));
+	texture.channels = int(readValue<uint32_t>(file));
+	readValue<uint32_t>(file); // width and height are repeated in the level index
+	readValue<uint32_t>(file);
+	uint32_t levelCount = readValue<uint32_t>(file);
+
+	std::vector<uint64_t> offsets(levelCount);
+	texture.levels.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i) {
+		texture.levels[i].width = int(readValue<uint32_t>(file));
+		texture.levels[i].height = int(readValue<uint32_t>(file));
+		offsets[i] = readValue<uint64_t>(file);
+		texture.levels[i].data.resize(readValue<uint64_t>(file));
+	}
+	for (uint32_t i = 0; i < levelCount; ++i) {
+		file.seekg(std::streamoff(offsets[i]));
+		file.read(reinterpret_cast<char *>(texture.levels[i].data.data()), texture.levels[i].data.size());
+	}
+	if (!file) {
+		throw std::runtime_error("Truncated compressed texture file: " + aPath.string());
+	}
+	return texture;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "thread_pool.hpp"
+#include "mipmap_generation.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * Block compressed formats produced by the texture cooker. Every format encodes 4x4 pixel blocks.
+ */
+enum class BlockFormat : uint32_t {
+	BC1 = 1, ///< RGB, 8 bytes per block
+	BC3 = 3, ///< RGBA (BC1 color + BC4 alpha), 16 bytes per block
+	BC4 = 4, ///< single channel, 8 bytes per block
+	BC5 = 5, ///< two channels (two BC4 blocks), 16 bytes per block
+	BC7 = 7, ///< RGBA, high quality (mode 6 only), 16 bytes per block
+};
+
+struct CompressedLevel {
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> data;
+};
+
+struct CompressedTexture {
+	BlockFormat format = BlockFormat::BC1;
+	int channels = 0; ///< Channel count of the source image
+	std::vector<CompressedLevel> levels; ///< levels[0] is the full resolution image
+};
+
+inline constexpr const char *cCompressedTextureExtension = ".btex";
+
+size_t getBlockSize(BlockFormat aFormat);
+std::string getBlockFormatName(BlockFormat aFormat);
+
+/**
+ * BC4 for one channel, BC5 for two, BC1/BC3 for RGB/RGBA, or BC7 for 3 and 4 channels if aHighQuality is set.
+ */
+BlockFormat chooseBlockFormat(int aChannels, bool aHighQuality);
+
+/**
+ * Encodes one image level, rows of blocks are distributed over the pool.
+ */
+CompressedLevel compressLevel(const PixelImage &aImage, BlockFormat aFormat, ThreadPool &aPool);
+
+/**
+ * Encodes the whole mip chain of the image, the levels come from generateMipChain().
+ */
+CompressedTexture compressTexture(const PixelImage &aImage, BlockFormat aFormat, ThreadPool &aPool, const MipmapOptions &aMipmapOptions = {});
+
+/**
+ * Decodes the level back into pixels with aChannels channels - used for quality checks.
+ */
+PixelImage decompressLevel(const CompressedLevel &aLevel, BlockFormat aFormat, int aChannels);
+
+/**
+ * Peak signal to noise ratio in dB of two images of the same size, infinity for identical images.
+ */
+double computePSNR(const PixelImage &aReference, const PixelImage &aImage);
+
+/**
+ * Container layout (little endian):
+ *	header: "BTEX", version, format, channels, width, height, level count
+ *	level index: per level - width, height, data offset (from file start), data size
+ *	level data: stored from the smallest mip to the largest one, so the file can be
+ *	streamed and a coarse version displayed before the full resolution arrives
+ */
+void writeCompressedTexture(const fs::path &aPath, const CompressedTexture &aTexture);
+CompressedTexture readCompressedTexture(const fs::path &aPath);
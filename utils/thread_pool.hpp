@@ -0,0 +1,115 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+/**
+ * @brief Fixed size pool of worker threads executing submitted tasks in FIFO order.
+ *		Destructor waits until all already submitted tasks are finished.
+ */
+class ThreadPool {
+public:
+	/**
+	 * @param aThreadCount Number of workers, 0 means one per hardware thread.
+	 */
+	explicit ThreadPool(unsigned aThreadCount = 0) {
+		if (aThreadCount == 0) {
+			aThreadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (unsigned i = 0; i < aThreadCount; ++i) {
+			mWorkers.emplace_back([this] { workerLoop(); });
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mCondition.notify_all();
+		for (auto &worker : mWorkers) {
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * @brief Schedules the callable, the returned future holds its result or exception.
+	 */
+	template<typename TFunction>
+	auto submit(TFunction &&aFunction) {
+		using Result = std::invoke_result_t<std::decay_t<TFunction>>;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<TFunction>(aFunction));
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mTasks.emplace_back([task] { (*task)(); });
+		}
+		mCondition.notify_one();
+		return result;
+	}
+
+	unsigned size() const {
+		return unsigned(mWorkers.size());
+	}
+
+protected:
+	void workerLoop() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+				if (mTasks.empty()) {
+					return;
+				}
+				task = std::move(mTasks.front());
+				mTasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> mWorkers;
+	std::deque<std::function<void()>> mTasks;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping = false;
+};
+
+/**
+ * @brief Splits [aBegin, aEnd) into chunks of aChunkSize and runs aFunction(chunkBegin, chunkEnd)
+ *		for each of them on the pool. Blocks until all chunks are processed, then rethrows the first exception.
+ */
+template<typename TFunction>
+void parallelFor(ThreadPool &aPool, size_t aBegin, size_t aEnd, size_t aChunkSize, TFunction aFunction) {
+	aChunkSize = std::max<size_t>(1, aChunkSize);
+	std::vector<std::future<void>> chunks;
+	for (size_t chunkBegin = aBegin; chunkBegin < aEnd; chunkBegin += aChunkSize) {
+		size_t chunkEnd = std::min(aEnd, chunkBegin + aChunkSize);
+		chunks.push_back(aPool.submit([&aFunction, chunkBegin, chunkEnd] { aFunction(chunkBegin, chunkEnd); }));
+	}
+	// Chunks reference aFunction and the caller's locals, so all of them must finish before an exception leaves
+	std::exception_ptr error;
+	for (auto &chunk : chunks) {
+		try {
+			chunk.get();
+		} catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
@@ -0,0 +1,475 @@
+#include "value_statistics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VALUE_STATISTICS_SSE2 1
+#endif
+
+namespace {
+
+// Values per parallel chunk - large enough to amortize the per chunk histogram merge
+constexpr size_t cChunkValues = 1 << 20;
+// Values per block - binned right after their moments while still in L1, also keeps the 32-bit SIMD sums from overflowing
+constexpr size_t cBlockValues = 4096;
+
+// Maps values to the bins of a histogram, no bins when only the moments are accumulated
+struct Binning {
+	uint64_t *bins = nullptr;
+	float minimum = 0.0f;
+	float scale = 0.0f;
+	float lastBin = 0.0f;
+	bool exact = false; ///< One bin per integer value starting at 0, the value is the bin index
+};
+
+Binning getBinning(VoxelType aType, const ValueHistogram &aHistogram, uint64_t *aBins) {
+	Binning binning;
+	if (aHistogram.bins.empty()) {
+		return binning;
+	}
+	binning.bins = aBins;
+	binning.minimum = aHistogram.minimum;
+	binning.scale = aHistogram.maximum > aHistogram.minimum ? float(aHistogram.bins.size()) / (aHistogram.maximum - aHistogram.minimum) : 0.0f;
+	binning.lastBin = float(aHistogram.bins.size() - 1);
+	size_t exactBins = getExactBinCount(aType);
+	binning.exact = exactBins > 0 && aHistogram.bins.size() == exactBins && aHistogram.minimum == 0.0f && aHistogram.maximum == float(exactBins);
+	return binning;
+}
+
+void addBlock(ValueStatistics &aStatistics, size_t aCount, float aMinimum, float aMaximum, double aSum, double aSumOfSquares) {
+	if (aCount == 0) {
+		return;
+	}
+	aStatistics.count += aCount;
+	aStatistics.range.merge(VoxelRange{ aMinimum, aMaximum });
+	aStatistics.sum += aSum;
+	aStatistics.sumOfSquares += aSumOfSquares;
+}
+
+void accumulateMoments(const uint8_t *aValues, size_t aCount, ValueStatistics &aStatistics) {
+	size_t i = 0;
+	uint8_t minimum = std::numeric_limits<uint8_t>::max();
+	uint8_t maximum = 0;
+	uint64_t sum = 0;
+	uint64_t sumOfSquares = 0;
+#ifdef VALUE_STATISTICS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128i minimums = _mm_set1_epi8(char(0xFF));
+	__m128i maximums = zero;
+	__m128i sums = zero;
+	__m128i squares = zero;
+	for (; i + 16 <= aCount; i += 16) {
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aValues + i));
+		minimums = _mm_min_epu8(minimums, values);
+		maximums = _mm_max_epu8(maximums, values);
+		sums = _mm_add_epi64(sums, _mm_sad_epu8(values, zero));
+		__m128i low = _mm_unpacklo_epi8(values, zero);
+		__m128i high = _mm_unpackhi_epi8(values, zero);
+		squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+	}
+	alignas(16) std::array<uint8_t, 16> lanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), minimums);
+	minimum = *std::min_element(lanes.begin(), lanes.end());
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), maximums);
+	maximum = *std::max_element(lanes.begin(), lanes.end());
+	alignas(16) std::array<uint64_t, 2> sumLanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(sumLanes.data()), sums);
+	sum = sumLanes[0] + sumLanes[1];
+	alignas(16) std::array<uint32_t, 4> squareLanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(squareLanes.data()), squares);
+	for (uint32_t lane : squareLanes) {
+		sumOfSquares += lane;
+	}
+#endif
+	for (; i < aCount; ++i) {
+		minimum = std::min(minimum, aValues[i]);
+		maximum = std::max(maximum, aValues[i]);
+		sum += aValues[i];
+		sumOfSquares += uint32_t(aValues[i]) * aValues[i];
+	}
+	addBlock(aStatistics, aCount, minimum, maximum, double(sum), double(sumOfSquares));
+}
+
+void accumulateMoments(const uint16_t *aValues, size_t aCount, ValueStatistics &aStatistics) {
+	size_t i = 0;
+	uint16_t minimum = std::numeric_limits<uint16_t>::max();
+	uint16_t maximum = 0;
+	uint64_t sum = 0;
+	uint64_t sumOfSquares = 0;
+#ifdef VALUE_STATISTICS_SSE2
+	// Same sign bit flip as copyVoxels() - SSE2 has only signed 16-bit min/max
+	const __m128i bias = _mm_set1_epi16(int16_t(0x8000));
+	const __m128i zero = _mm_setzero_si128();
+	__m128i minimums = _mm_set1_epi16(std::numeric_limits<int16_t>::max());
+	__m128i maximums = _mm_set1_epi16(std::numeric_limits<int16_t>::min());
+	__m128i sums = zero;
+	__m128i squares = zero;
+	for (; i + 8 <= aCount; i += 8) {
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aValues + i));
+		__m128i flipped = _mm_xor_si128(values, bias);
+		minimums = _mm_min_epi16(minimums, flipped);
+		maximums = _mm_max_epi16(maximums, flipped);
+		__m128i low = _mm_unpacklo_epi16(values, zero);
+		__m128i high = _mm_unpackhi_epi16(values, zero);
+		sums = _mm_add_epi32(sums, _mm_add_epi32(low, high));
+		// 64-bit squares of the even and the odd 32-bit lanes
+		squares = _mm_add_epi64(squares, _mm_add_epi64(_mm_mul_epu32(low, low), _mm_mul_epu32(high, high)));
+		low = _mm_srli_epi64(low, 32);
+		high = _mm_srli_epi64(high, 32);
+		squares = _mm_add_epi64(squares, _mm_add_epi64(_mm_mul_epu32(low, low), _mm_mul_epu32(high, high)));
+	}
+	alignas(16) std::array<uint16_t, 8> lanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), _mm_xor_si128(minimums, bias));
+	minimum = *std::min_element(lanes.begin(), lanes.end());
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), _mm_xor_si128(maximums, bias));
+	maximum = *std::max_element(lanes.begin(), lanes.end());
+	alignas(16) std::array<uint32_t, 4> sumLanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(sumLanes.data()), sums);
+	for (uint32_t lane : sumLanes) {
+		sum += lane;
+	}
+	alignas(16) std::array<uint64_t, 2> squareLanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(squareLanes.data()), squares);
+	sumOfSquares = squareLanes[0] + squareLanes[1];
+#endif
+	for (; i < aCount; ++i) {
+		minimum = std::min(minimum, aValues[i]);
+		maximum = std::max(maximum, aValues[i]);
+		sum += aValues[i];
+		sumOfSquares += uint64_t(aValues[i]) * aValues[i];
+	}
+	addBlock(aStatistics, aCount, minimum, maximum, double(sum), double(sumOfSquares));
+}
+
+void accumulateMoments(const float *aValues, size_t aCount, ValueStatistics &aStatistics) {
+	size_t i = 0;
+	VoxelRange range;
+	double sum = 0.0;
+	double sumOfSquares = 0.0;
+#ifdef VALUE_STATISTICS_SSE2
+	__m128 minimums = _mm_set1_ps(range.minimum);
+	__m128 maximums = _mm_set1_ps(range.maximum);
+	__m128d sums = _mm_setzero_pd();
+	__m128d squares = _mm_setzero_pd();
+	for (; i + 4 <= aCount; i += 4) {
+		__m128 values = _mm_loadu_ps(aValues + i);
+		minimums = _mm_min_ps(minimums, values);
+		maximums = _mm_max_ps(maximums, values);
+		// Summed in double, float sums of large volumes lose the small values
+		__m128d low = _mm_cvtps_pd(values);
+		__m128d high = _mm_cvtps_pd(_mm_movehl_ps(values, values));
+		sums = _mm_add_pd(sums, _mm_add_pd(low, high));
+		squares = _mm_add_pd(squares, _mm_add_pd(_mm_mul_pd(low, low), _mm_mul_pd(high, high)));
+	}
+	alignas(16) std::array<float, 4> lanes;
+	_mm_store_ps(lanes.data(), minimums);
+	range.minimum = *std::min_element(lanes.begin(), lanes.end());
+	_mm_store_ps(lanes.data(), maximums);
+	range.maximum = *std::max_element(lanes.begin(), lanes.end());
+	alignas(16) std::array<double, 2> sumLanes;
+	_mm_store_pd(sumLanes.data(), sums);
+	sum = sumLanes[0] + sumLanes[1];
+	_mm_store_pd(sumLanes.data(), squares);
+	sumOfSquares = sumLanes[0] + sumLanes[1];
+#endif
+	for (; i < aCount; ++i) {
+		range.minimum = std::min(range.minimum, aValues[i]);
+		range.maximum = std::max(range.maximum, aValues[i]);
+		sum += double(aValues[i]);
+		sumOfSquares += double(aValues[i]) * double(aValues[i]);
+	}
+	addBlock(aStatistics, aCount, range.minimum, range.maximum, sum, sumOfSquares);
+}
+
+#ifdef VALUE_STATISTICS_SSE2
+// Values [i, i + 8) as two float vectors
+inline void loadFloats(const uint8_t *aValues, size_t aIndex, __m128 &aLow, __m128 &aHigh) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i values = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(aValues + aIndex)), zero);
+	aLow = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+	aHigh = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+}
+
+inline void loadFloats(const uint16_t *aValues, size_t aIndex, __m128 &aLow, __m128 &aHigh) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aValues + aIndex));
+	aLow = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+	aHigh = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+}
+
+inline void loadFloats(const float *aValues, size_t aIndex, __m128 &aLow, __m128 &aHigh) {
+	aLow = _mm_loadu_ps(aValues + aIndex);
+	aHigh = _mm_loadu_ps(aValues + aIndex + 4);
+}
+#endif
+
+template<typename TValue>
+void binValues(const TValue *aValues, size_t aCount, const Binning &aBinning) {
+	if constexpr (std::is_same_v<TValue, uint8_t>) {
+		if (aBinning.exact) {
+			// Runs of equal bytes would serialize on a single counter - four interleaved sub-histograms break the dependency
+			std::array<std::array<uint32_t, 256>, 4> counts{};
+			size_t i = 0;
+			for (; i + 4 <= aCount; i += 4) {
+				++counts[0][aValues[i]];
+				++counts[1][aValues[i + 1]];
+				++counts[2][aValues[i + 2]];
+				++counts[3][aValues[i + 3]];
+			}
+			for (; i < aCount; ++i) {
+				++counts[0][aValues[i]];
+			}
+			for (size_t bin = 0; bin < counts[0].size(); ++bin) {
+				aBinning.bins[bin] += uint64_t(counts[0][bin]) + counts[1][bin] + counts[2][bin] + counts[3][bin];
+			}
+			return;
+		}
+	}
+	if constexpr (std::is_integral_v<TValue>) {
+		if (aBinning.exact) {
+			for (size_t i = 0; i < aCount; ++i) {
+				++aBinning.bins[aValues[i]];
+			}
+			return;
+		}
+	}
+	size_t i = 0;
+#ifdef VALUE_STATISTICS_SSE2
+	const __m128 minimum = _mm_set1_ps(aBinning.minimum);
+	const __m128 scales = _mm_set1_ps(aBinning.scale);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 last = _mm_set1_ps(aBinning.lastBin);
+	alignas(16) std::array<int32_t, 8> indices;
+	for (; i + 8 <= aCount; i += 8) {
+		__m128 low, high;
+		loadFloats(aValues, i, low, high);
+		// Clamped in float, SSE2 has no 32-bit integer min/max
+		low = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(low, minimum), scales), zero), last);
+		high = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(high, minimum), scales), zero), last);
+		_mm_store_si128(reinterpret_cast<__m128i *>(indices.data()), _mm_cvttps_epi32(low));
+		_mm_store_si128(reinterpret_cast<__m128i *>(indices.data() + 4), _mm_cvttps_epi32(high));
+		for (int32_t index : indices) {
+			++aBinning.bins[index];
+		}
+	}
+#endif
+	for (; i < aCount; ++i) {
+		float bin = std::clamp((float(aValues[i]) - aBinning.minimum) * aBinning.scale, 0.0f, aBinning.lastBin);
+		++aBinning.bins[size_t(bin)];
+	}
+}
+
+template<typename TValue>
+void accumulateValues(const TValue *aValues, size_t aCount, ValueStatistics &aStatistics, const Binning &aBinning) {
+	for (size_t begin = 0; begin < aCount; begin += cBlockValues) {
+		size_t count = std::min(cBlockValues, aCount - begin);
+		accumulateMoments(aValues + begin, count, aStatistics);
+		if (aBinning.bins) {
+			binValues(aValues + begin, count, aBinning);
+		}
+	}
+}
+
+// Adds the bins of aSource to the bins of aTarget containing their centers, aTarget covers the range of aSource
+void addRebinned(ValueHistogram &aTarget, const ValueHistogram &aSource) {
+	if (aSource.minimum == aTarget.minimum && aSource.maximum == aTarget.maximum && aSource.bins.size() == aTarget.bins.size()) {
+		for (size_t bin = 0; bin < aSource.bins.size(); ++bin) {
+			aTarget.bins[bin] += aSource.bins[bin];
+		}
+		return;
+	}
+	float scale = aTarget.maximum > aTarget.minimum ? float(aTarget.bins.size()) / (aTarget.maximum - aTarget.minimum) : 0.0f;
+	float lastBin = float(aTarget.bins.size() - 1);
+	for (size_t bin = 0; bin < aSource.bins.size(); ++bin) {
+		if (aSource.bins[bin] == 0) {
+			continue;
+		}
+		float center = aSource.minimum + (float(bin) + 0.5f) * aSource.binWidth();
+		aTarget.bins[size_t(std::clamp((center - aTarget.minimum) * scale, 0.0f, lastBin))] += aSource.bins[bin];
+	}
+}
+
+template<typename TFunction>
+void visitValues(VoxelType aType, const void *aValues, TFunction aFunction) {
+	switch (aType) {
+	case VoxelType::UInt8: aFunction(static_cast<const uint8_t *>(aValues)); return;
+	case VoxelType::UInt16: aFunction(static_cast<const uint16_t *>(aValues)); return;
+	case VoxelType::Float32: aFunction(static_cast<const float *>(aValues)); return;
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+} // namespace
+
+double ValueStatistics::variance() const {
+	if (count == 0) {
+		return 0.0;
+	}
+	double average = mean();
+	return std::max(0.0, sumOfSquares / double(count) - average * average);
+}
+
+double ValueStatistics::standardDeviation() const {
+	return std::sqrt(variance());
+}
+
+void ValueStatistics::merge(const ValueStatistics &aOther) {
+	count += aOther.count;
+	range.merge(aOther.range);
+	sum += aOther.sum;
+	sumOfSquares += aOther.sumOfSquares;
+}
+
+uint64_t ValueHistogram::valueCount() const {
+	uint64_t count = 0;
+	for (uint64_t bin : bins) {
+		count += bin;
+	}
+	return count;
+}
+
+float ValueHistogram::percentile(double aFraction) const {
+	uint64_t count = valueCount();
+	if (count == 0) {
+		return minimum;
+	}
+	double target = std::clamp(aFraction, 0.0, 1.0) * double(count);
+	double accumulated = 0.0;
+	for (size_t bin = 0; bin < bins.size(); ++bin) {
+		if (bins[bin] > 0 && accumulated + double(bins[bin]) >= target) {
+			double inside = (target - accumulated) / double(bins[bin]);
+			return minimum + float((double(bin) + inside) * binWidth());
+		}
+		accumulated += double(bins[bin]);
+	}
+	return maximum;
+}
+
+size_t getExactBinCount(VoxelType aType) {
+	switch (aType) {
+	case VoxelType::UInt8: return size_t(std::numeric_limits<uint8_t>::max()) + 1;
+	case VoxelType::UInt16: return size_t(std::numeric_limits<uint16_t>::max()) + 1;
+	case VoxelType::Float32: return 0;
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+ValueStatisticsBuilder::ValueStatisticsBuilder(VoxelType aType, ThreadPool *aPool)
+	: mType(aType)
+	, mPool(aPool)
+{}
+
+ValueStatisticsBuilder::ValueStatisticsBuilder(VoxelType aType, VoxelRange aHistogramRange, size_t aBinCount, ThreadPool *aPool)
+	: mType(aType)
+	, mPool(aPool)
+{
+	mHistogram.minimum = aHistogramRange.minimum;
+	mHistogram.maximum = std::max(aHistogramRange.minimum, aHistogramRange.maximum);
+	mHistogram.bins.resize(std::max<size_t>(1, aBinCount), 0);
+}
+
+ValueStatisticsBuilder::ValueStatisticsBuilder(VoxelType aType, size_t aBinCount, ThreadPool *aPool)
+	: mType(aType)
+	, mPool(aPool)
+	, mGrowingHistogram(true)
+{
+	mHistogram.bins.resize(std::max<size_t>(1, aBinCount), 0);
+}
+
+void ValueStatisticsBuilder::addGrowingChunk(const ValueStatistics &aStatistics, const ValueHistogram &aHistogram) {
+	if (aStatistics.count == 0) {
+		return;
+	}
+	if (mStatistics.count == 0) {
+		mHistogram = aHistogram;
+	} else {
+		VoxelRange range{ mHistogram.minimum, mHistogram.maximum };
+		range.merge(aStatistics.range);
+		if (range.minimum < mHistogram.minimum || range.maximum > mHistogram.maximum) {
+			ValueHistogram widened;
+			widened.minimum = range.minimum;
+			widened.maximum = range.maximum;
+			widened.bins.resize(mHistogram.bins.size(), 0);
+			addRebinned(widened, mHistogram);
+			mHistogram = std::move(widened);
+		}
+		addRebinned(mHistogram, aHistogram);
+	}
+	mStatistics.merge(aStatistics);
+}
+
+void ValueStatisticsBuilder::addValues(const void *aValues, size_t aCount) {
+	visitValues(mType, aValues, [&](auto aTypedValues) {
+		if (mGrowingHistogram) {
+			// The range of a chunk first, then its bins while it is still in the cache
+			auto addChunk = [&](size_t aBegin, size_t aEnd, std::mutex *aMergeMutex) {
+				ValueStatistics statistics;
+				accumulateValues(aTypedValues + aBegin, aEnd - aBegin, statistics, Binning());
+				ValueHistogram histogram;
+				histogram.minimum = statistics.range.minimum;
+				histogram.maximum = std::max(statistics.range.minimum, statistics.range.maximum);
+				histogram.bins.resize(mHistogram.bins.size(), 0);
+				binValues(aTypedValues + aBegin, aEnd - aBegin, getBinning(mType, histogram, histogram.bins.data()));
+				if (aMergeMutex) {
+					std::lock_guard<std::mutex> lock(*aMergeMutex);
+					addGrowingChunk(statistics, histogram);
+				} else {
+					addGrowingChunk(statistics, histogram);
+				}
+			};
+			if (!mPool || aCount <= cChunkValues) {
+				addChunk(0, aCount, nullptr);
+				return;
+			}
+			std::mutex mergeMutex;
+			parallelFor(*mPool, 0, aCount, cChunkValues, [&](size_t aBegin, size_t aEnd) {
+				addChunk(aBegin, aEnd, &mergeMutex);
+			});
+			return;
+		}
+		if (!mPool || aCount <= cChunkValues) {
+			accumulateValues(aTypedValues, aCount, mStatistics, getBinning(mType, mHistogram, mHistogram.bins.data()));
+			return;
+		}
+		std::mutex mergeMutex;
+		parallelFor(*mPool, 0, aCount, cChunkValues, [&](size_t aBegin, size_t aEnd) {
+			ValueStatistics statistics;
+			std::vector<uint64_t> bins(mHistogram.bins.size(), 0);
+			accumulateValues(aTypedValues + aBegin, aEnd - aBegin, statistics, getBinning(mType, mHistogram, bins.data()));
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			mStatistics.merge(statistics);
+			for (size_t bin = 0; bin < bins.size(); ++bin) {
+				mHistogram.bins[bin] += bins[bin];
+			}
+		});
+	});
+}
+
+ImageStatistics computeImageStatistics(const PixelImage &aImage, ThreadPool *aPool) {
+	size_t pixelCount = size_t(aImage.width) * aImage.height;
+	size_t binCount = getExactBinCount(VoxelType::UInt8);
+	ImageStatistics statistics;
+	std::vector<uint8_t> plane(aImage.channels > 1 ? pixelCount : 0);
+	for (int channel = 0; channel < aImage.channels; ++channel) {
+		const uint8_t *values = aImage.pixels.data();
+		if (aImage.channels > 1) {
+			// Deinterleaved, so the kernel streams over a contiguous span
+			for (size_t i = 0; i < pixelCount; ++i) {
+				plane[i] = aImage.pixels[i * aImage.channels + channel];
+			}
+			values = plane.data();
+		}
+		ValueStatisticsBuilder builder(VoxelType::UInt8, VoxelRange{ 0.0f, float(binCount) }, binCount, aPool);
+		builder.addValues(values, pixelCount);
+		statistics.channels.push_back(builder.statistics());
+		statistics.histograms.push_back(builder.histogram());
+	}
+	return statistics;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "volume_data.hpp"
+#include "mipmap_generation.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Range and moments of a set of values, statistics of separate spans merge into those of their union.
+ */
+struct ValueStatistics {
+	uint64_t count = 0;
+	VoxelRange range;
+	double sum = 0.0;
+	double sumOfSquares = 0.0;
+
+	double mean() const {
+		return count > 0 ? sum / double(count) : 0.0;
+	}
+
+	/**
+	 * Population variance.
+	 */
+	double variance() const;
+
+	double standardDeviation() const;
+
+	void merge(const ValueStatistics &aOther);
+};
+
+/**
+ * Histogram of values, bins evenly cover [minimum, maximum].
+ */
+struct ValueHistogram {
+	float minimum = 0.0f;
+	float maximum = 0.0f;
+	std::vector<uint64_t> bins;
+
+	float binWidth() const {
+		return bins.empty() ? 0.0f : (maximum - minimum) / float(bins.size());
+	}
+
+	uint64_t valueCount() const;
+
+	/**
+	 * Value below which aFraction of the values lie, interpolated inside the bin.
+	 */
+	float percentile(double aFraction) const;
+};
+
+/**
+ * @brief Bin count of a histogram with one bin per value of the integer aType, 0 for Float32.
+ *
+ * Such a histogram covers [0, bin count) and needs no value range up front, see ValueStatisticsBuilder.
+ */
+size_t getExactBinCount(VoxelType aType);
+
+/**
+ * @brief Accumulates the statistics and the histogram of value spans in a single pass, spans may come in any order.
+ *
+ * Each span is processed in blocks small enough to stay in L1 - SIMD range and moments of a block are followed
+ * by its bin indices. Spans larger than a chunk run in parallel chunks on aPool if given.
+ */
+class ValueStatisticsBuilder {
+public:
+	static constexpr size_t cDefaultBinCount = 4096;
+
+	/**
+	 * Range and moments only.
+	 */
+	explicit ValueStatisticsBuilder(VoxelType aType, ThreadPool *aPool = nullptr);
+
+	/**
+	 * Also bins the values into aBinCount bins evenly covering aHistogramRange, values outside of it go to the border bins.
+	 */
+	ValueStatisticsBuilder(VoxelType aType, VoxelRange aHistogramRange, size_t aBinCount = cDefaultBinCount, ThreadPool *aPool = nullptr);
+
+	/**
+	 * Also bins the values into aBinCount bins over the range of the values added so far, for values of unknown range.
+	 * Each chunk is binned over its own range and merged by bin centers, a bin count moves by less than one bin
+	 * of the final histogram per widening of the range.
+	 */
+	ValueStatisticsBuilder(VoxelType aType, size_t aBinCount, ThreadPool *aPool = nullptr);
+
+	void addValues(const void *aValues, size_t aCount);
+
+	const ValueStatistics &statistics() const {
+		return mStatistics;
+	}
+
+	const ValueHistogram &histogram() const {
+		return mHistogram;
+	}
+
+protected:
+	void addGrowingChunk(const ValueStatistics &aStatistics, const ValueHistogram &aHistogram);
+
+	VoxelType mType;
+	ThreadPool *mPool;
+	ValueStatistics mStatistics;
+	ValueHistogram mHistogram;
+	bool mGrowingHistogram = false;
+};
+
+/**
+ * Per channel statistics and exact 256 bin histograms of an 8-bit image, the input of tone mapping and auto exposure.
+ */
+struct ImageStatistics {
+	std::vector<ValueStatistics> channels;
+	std::vector<ValueHistogram> histograms;
+};
+
+ImageStatistics computeImageStatistics(const PixelImage &aImage, ThreadPool *aPool = nullptr);
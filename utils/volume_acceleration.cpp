@@ -0,0 +1,166 @@
+#include "volume_acceleration.hpp"
+
+namespace {
+
+BrickGrid emptyGrid(int aBrickSize, int aWidth, int aHeight, int aDepth) {
+	BrickGrid grid;
+	grid.brickSize = aBrickSize;
+	grid.width = aWidth;
+	grid.height = aHeight;
+	grid.depth = aDepth;
+	grid.ranges.resize(size_t(aWidth) * aHeight * aDepth);
+	return grid;
+}
+
+int nextPowerOfTwo(int aValue) {
+	int result = 1;
+	while (result < aValue) {
+		result *= 2;
+	}
+	return result;
+}
+
+template<typename TFunction>
+void forEachBrickSlice(ThreadPool *aPool, int aDepth, TFunction aFunction) {
+	if (aPool) {
+		parallelFor(*aPool, 0, size_t(aDepth), 1, aFunction);
+		return;
+	}
+	aFunction(size_t(0), size_t(aDepth));
+}
+
+// One chamfer pass with unit weights over the 13 already visited neighbours, aDirection is 1 or -1
+void propagateDistance(std::vector<float> &aDistance, const BrickGrid &aBricks, int aDirection) {
+	int width = aBricks.width;
+	int height = aBricks.height;
+	int depth = aBricks.depth;
+	auto index = [&](int aX, int aY, int aZ) {
+		return (size_t(aZ) * height + aY) * width + aX;
+	};
+	for (int k = 0; k < depth; ++k) {
+		int z = aDirection > 0 ? k : depth - 1 - k;
+		for (int j = 0; j < height; ++j) {
+			int y = aDirection > 0 ? j : height - 1 - j;
+			for (int i = 0; i < width; ++i) {
+				int x = aDirection > 0 ? i : width - 1 - i;
+				float distance = aDistance[index(x, y, z)];
+				for (int dz = -1; dz <= 0; ++dz) {
+					for (int dy = -1; dy <= 1; ++dy) {
+						for (int dx = -1; dx <= 1; ++dx) {
+							// Neighbours preceding the brick in the scan order
+							if (dz == 0 && (dy > 0 || (dy == 0 && dx >= 0))) {
+								continue;
+							}
+							int nx = x + aDirection * dx;
+							int ny = y + aDirection * dy;
+							int nz = z + aDirection * dz;
+							if (nx < 0 || ny < 0 || nz < 0 || nx >= width || ny >= height || nz >= depth) {
+								continue;
+							}
+							distance = std::min(distance, aDistance[index(nx, ny, nz)] + 1.0f);
+						}
+					}
+				}
+				aDistance[index(x, y, z)] = distance;
+			}
+		}
+	}
+}
+
+} // namespace
+
+BrickGrid buildBrickGrid(const VolumeData &aVolume, int aBrickSize, ThreadPool *aPool) {
+	auto grid = emptyGrid(
+		aBrickSize,
+		(aVolume.width + aBrickSize - 1) / aBrickSize,
+		(aVolume.height + aBrickSize - 1) / aBrickSize,
+		(aVolume.depth + aBrickSize - 1) / aBrickSize);
+	VoxelType type = aVolume.type();
+	size_t voxelSize = getVoxelSize(type);
+	auto voxels = static_cast<const uint8_t *>(aVolume.voxels());
+
+	// Each task owns whole z-slices of bricks, the one voxel borders are read again by both neighbours
+	forEachBrickSlice(aPool, grid.depth, [&](size_t aBegin, size_t aEnd) {
+		for (int brickZ = int(aBegin); brickZ < int(aEnd); ++brickZ) {
+			int firstZ = std::max(brickZ * aBrickSize - 1, 0);
+			int lastZ = std::min((brickZ + 1) * aBrickSize + 1, aVolume.depth);
+			for (int brickY = 0; brickY < grid.height; ++brickY) {
+				int firstY = std::max(brickY * aBrickSize - 1, 0);
+				int lastY = std::min((brickY + 1) * aBrickSize + 1, aVolume.height);
+				for (int brickX = 0; brickX < grid.width; ++brickX) {
+					int firstX = std::max(brickX * aBrickSize - 1, 0);
+					int lastX = std::min((brickX + 1) * aBrickSize + 1, aVolume.width);
+					VoxelRange range;
+					if (grid.isOnFace(brickX, brickY, brickZ)) {
+						range = VoxelRange{ 0.0f, 0.0f };
+					}
+					for (int z = firstZ; z < lastZ; ++z) {
+						for (int y = firstY; y < lastY; ++y) {
+							size_t offset = ((size_t(z) * aVolume.height + y) * aVolume.width + firstX) * voxelSize;
+							range.merge(copyVoxels(type, voxels + offset, nullptr, lastX - firstX));
+						}
+					}
+					grid.at(brickX, brickY, brickZ) = range;
+				}
+			}
+		}
+	});
+	return grid;
+}
+
+MinMaxOctree buildMinMaxOctree(const BrickGrid &aLeaves, ThreadPool *aPool) {
+	MinMaxOctree octree;
+	auto leaves = emptyGrid(aLeaves.brickSize, nextPowerOfTwo(aLeaves.width), nextPowerOfTwo(aLeaves.height), nextPowerOfTwo(aLeaves.depth));
+	for (int z = 0; z < aLeaves.depth; ++z) {
+		for (int y = 0; y < aLeaves.height; ++y) {
+			for (int x = 0; x < aLeaves.width; ++x) {
+				leaves.at(x, y, z) = aLeaves.at(x, y, z);
+			}
+		}
+	}
+	octree.levels.push_back(std::move(leaves));
+
+	while (true) {
+		const auto &children = octree.levels.back();
+		if (children.width == 1 && children.height == 1 && children.depth == 1) {
+			break;
+		}
+		auto parents = emptyGrid(
+			children.brickSize * 2,
+			std::max(1, children.width / 2),
+			std::max(1, children.height / 2),
+			std::max(1, children.depth / 2));
+		forEachBrickSlice(aPool, parents.depth, [&](size_t aBegin, size_t aEnd) {
+			for (int z = int(aBegin); z < int(aEnd); ++z) {
+				for (int y = 0; y < parents.height; ++y) {
+					for (int x = 0; x < parents.width; ++x) {
+						VoxelRange range;
+						// Axes already down to one node keep a single child
+						for (int cz = 2 * z; cz < std::min(2 * z + 2, children.depth); ++cz) {
+							for (int cy = 2 * y; cy < std::min(2 * y + 2, children.height); ++cy) {
+								for (int cx = 2 * x; cx < std::min(2 * x + 2, children.width); ++cx) {
+									range.merge(children.at(cx, cy, cz));
+								}
+							}
+						}
+						parents.at(x, y, z) = range;
+					}
+				}
+			}
+		});
+		octree.levels.push_back(std::move(parents));
+	}
+	return octree;
+}
+
+std::vector<float> computeEmptySpaceDistance(const BrickGrid &aBricks, float aIsoValue) {
+	// Farther than any brick can be - rays never leave the volume through the skip
+	const float cUnreached = float(aBricks.width + aBricks.height + aBricks.depth);
+	std::vector<float> distance(aBricks.ranges.size());
+	for (size_t i = 0; i < distance.size(); ++i) {
+		distance[i] = containsValue(aBricks.ranges[i], aIsoValue) ? 0.0f : cUnreached;
+	}
+	propagateDistance(distance, aBricks, 1);
+	propagateDistance(distance, aBricks, -1);
+	return distance;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "volume_data.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * @brief Brick grid of an in-memory volume, same layout as BrickGridBuilder produces while streaming.
+ *
+ * Slabs of bricks along z are distributed over aPool if given.
+ */
+BrickGrid buildBrickGrid(const VolumeData &aVolume, int aBrickSize = 16, ThreadPool *aPool = nullptr);
+
+/**
+ * @brief Min-max octree over the brick grid.
+ *
+ * levels[0] are the leaf bricks padded to power of two counts per axis, so every level is exactly
+ * the GL mip level of the previous one and the whole tree can be uploaded as mips of one 3D texture.
+ * Padding nodes keep the empty VoxelRange. Node brickSize is the node edge in voxels.
+ */
+struct MinMaxOctree {
+	std::vector<BrickGrid> levels;
+};
+
+MinMaxOctree buildMinMaxOctree(const BrickGrid &aLeaves, ThreadPool *aPool = nullptr);
+
+/**
+ * @brief Chessboard distance (in bricks) from every brick to the nearest brick which may contain aIsoValue.
+ *
+ * A ray starting in a brick with distance d can advance (d - 1) * brickSize voxels along every axis
+ * without reaching the isosurface. aIsoValue is in the stored voxel units, as the brick ranges.
+ */
+std::vector<float> computeEmptySpaceDistance(const BrickGrid &aBricks, float aIsoValue);
+
+inline bool containsValue(const VoxelRange &aRange, float aValue) {
+	return aRange.minimum <= aValue && aValue <= aRange.maximum;
+}
@@ -0,0 +1,208 @@
+#include "volume_brick_cache.hpp"
+
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+struct BrickVoxelFormat {
+	GLenum internalFormat;
+	GLenum type;
+};
+
+BrickVoxelFormat getBrickVoxelFormat(VoxelType aType) {
+	switch (aType) {
+	case VoxelType::UInt8: return { GL_R8, GL_UNSIGNED_BYTE };
+	case VoxelType::UInt16: return { GL_R16, GL_UNSIGNED_SHORT };
+	case VoxelType::Float32: return { GL_R32F, GL_FLOAT };
+	}
+	throw OpenGLError("Unsupported voxel type");
+}
+
+// Near cubic slot grid of the atlas fitting into the budget and the 3D texture size limit
+glm::ivec3 computeAtlasSlots(size_t aResidencyBudget, int aSlotEdge, size_t aVoxelSize, size_t aBrickCount) {
+	GLint maxTextureSize = 0;
+	GL_CHECK(glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize));
+	int maxSlots = std::max(1, maxTextureSize / aSlotEdge);
+	size_t slotBytes = size_t(aSlotEdge) * aSlotEdge * aSlotEdge * aVoxelSize;
+	size_t slotCount = std::clamp<size_t>(aResidencyBudget / slotBytes, 1, aBrickCount);
+
+	int x = std::clamp(int(std::cbrt(double(slotCount))), 1, maxSlots);
+	int y = std::clamp(int(slotCount / x / x), 1, x);
+	int z = std::clamp(int(slotCount / x / y), 1, maxSlots);
+	return { x, y, z };
+}
+
+// Header of the feedback buffer, followed by one request flag per brick
+struct FeedbackHeader {
+	GLint volumeSize[3];
+	GLint brickSize;
+};
+
+} // namespace
+
+VolumeBrickCache::VolumeBrickCache(const fs::path &aFilePath, size_t aResidencyBudget, int aBrickSize)
+	: mReader(aFilePath)
+	, mBrickSize(aBrickSize)
+	, mSlotEdge(aBrickSize + 2 * cApron)
+	, mBrickCount(
+		(mReader.info().width + aBrickSize - 1) / aBrickSize,
+		(mReader.info().height + aBrickSize - 1) / aBrickSize,
+		(mReader.info().depth + aBrickSize - 1) / aBrickSize)
+	, mAtlasSlots(computeAtlasSlots(aResidencyBudget, mSlotEdge, getVoxelSize(mReader.info().type), brickCount()))
+	, mVoxelType(getBrickVoxelFormat(mReader.info().type).type)
+	, mResidency(brickCount(), size_t(mAtlasSlots.x) * mAtlasSlots.y * mAtlasSlots.z)
+	, mLoading(brickCount(), false)
+	, mRequests(brickCount())
+	, mLoadedBricks(cMaxLoadsInFlight)
+	, mLoader(std::make_unique<ThreadPool>(1))
+{
+	auto format = getBrickVoxelFormat(mReader.info().type);
+	glm::ivec3 atlasSize = mAtlasSlots * mSlotEdge;
+	mAtlas = createTexture();
+	mAtlasId = mAtlas.get();
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, mAtlasId));
+	GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, format.internalFormat, atlasSize.x, atlasSize.y, atlasSize.z, 0, GL_RED, format.type, nullptr));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+
+	std::vector<GLuint> emptyPages(brickCount(), 0);
+	mPageTable = createTexture();
+	mPageTableId = mPageTable.get();
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, mPageTableId));
+	GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_R32UI, mBrickCount.x, mBrickCount.y, mBrickCount.z, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, emptyPages.data()));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, 0));
+
+	const auto &info = mReader.info();
+	FeedbackHeader header = { { info.width, info.height, info.depth }, aBrickSize };
+	for (auto &feedback : mFeedback) {
+		feedback.buffer = createBuffer();
+		GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback.buffer.get()));
+		GL_CHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(FeedbackHeader) + brickCount() * sizeof(GLuint), nullptr, GL_DYNAMIC_READ));
+		GL_CHECK(glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(FeedbackHeader), &header));
+		GL_CHECK(glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, sizeof(FeedbackHeader), brickCount() * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+	}
+	GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+	GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cBrickRequestBinding, mFeedback[0].buffer.get()));
+	mFeedback[0].frame = mFrame;
+
+	std::cout << "Paged volume " << aFilePath << ": " << brickCount() << " bricks, atlas of "
+		<< mResidency.slotCount() << " slots (" << atlasSize.x << "x" << atlasSize.y << "x" << atlasSize.z << ")\n";
+}
+
+VolumeBrickCache::~VolumeBrickCache() {
+	mLoader.reset();
+	for (auto &feedback : mFeedback) {
+		if (feedback.fence) {
+			glDeleteSync(feedback.fence);
+		}
+	}
+}
+
+glm::ivec3 VolumeBrickCache::brickCoordinates(size_t aBrick) const {
+	return {
+		int(aBrick % mBrickCount.x),
+		int(aBrick / mBrickCount.x % mBrickCount.y),
+		int(aBrick / (size_t(mBrickCount.x) * mBrickCount.y)) };
+}
+
+void VolumeBrickCache::setPageTableEntry(size_t aBrick, GLuint aValue) {
+	auto brick = brickCoordinates(aBrick);
+	GL_CHECK(glTexSubImage3D(GL_TEXTURE_3D, 0, brick.x, brick.y, brick.z, 1, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, &aValue));
+}
+
+void VolumeBrickCache::update() {
+	// Close the frame just rendered and let the next one write into the oldest buffer
+	auto &current = mFeedback[mCurrentFeedback];
+	GL_CHECK(glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT));
+	current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	mCurrentFeedback = (mCurrentFeedback + 1) % cFeedbackFrames;
+	auto &next = mFeedback[mCurrentFeedback];
+	if (next.fence) {
+		// Written cFeedbackFrames - 1 frames ago, normally finished by now
+		GL_CHECK(glClientWaitSync(next.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e9)));
+		glDeleteSync(next.fence);
+		next.fence = nullptr;
+		processFeedback(next);
+	}
+	++mFrame;
+	next.frame = mFrame;
+	GL_CHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cBrickRequestBinding, next.buffer.get()));
+
+	uploadLoadedBricks();
+}
+
+void VolumeBrickCache::processFeedback(FeedbackBuffer &aFeedback) {
+	GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, aFeedback.buffer.get()));
+	GL_CHECK(glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(FeedbackHeader), mRequests.size() * sizeof(GLuint), mRequests.data()));
+	GL_CHECK(glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, sizeof(FeedbackHeader), mRequests.size() * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+	GL_CHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+	uint64_t frame = aFeedback.frame;
+	for (size_t brick = 0; brick < mRequests.size(); ++brick) {
+		if (!mRequests[brick]) {
+			continue;
+		}
+		if (mResidency.isResident(brick)) {
+			mResidency.touch(brick, frame);
+			continue;
+		}
+		if (mLoading[brick] || mLoadsInFlight >= cMaxLoadsInFlight) {
+			continue;
+		}
+		mLoading[brick] = true;
+		++mLoadsInFlight;
+		mLoader->submit([this, brick, frame] {
+			auto coordinates = brickCoordinates(brick);
+			LoadedBrick loaded{ brick, frame, std::vector<uint8_t>(size_t(mSlotEdge) * mSlotEdge * mSlotEdge * getVoxelSize(mReader.info().type)) };
+			// The GL thread must get every brick back, otherwise it stays loading and is never requested again
+			try {
+				mReader.readBrick(coordinates.x, coordinates.y, coordinates.z, mBrickSize, cApron, loaded.voxels.data());
+			} catch (std::exception &exc) {
+				loaded.voxels.clear();
+				loaded.error = exc.what();
+			}
+			mLoadedBricks.push(std::move(loaded));
+		});
+	}
+}
+
+void VolumeBrickCache::uploadLoadedBricks() {
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	LoadedBrick loaded;
+	for (int i = 0; i < cMaxUploadsPerFrame && mLoadedBricks.tryPop(loaded); ++i) {
+		mLoading[loaded.brick] = false;
+		--mLoadsInFlight;
+		if (!loaded.error.empty()) {
+			// Stays not resident, the rays skip it and request it again
+			std::cerr << "Failed to load brick " << loaded.brick << ": " << loaded.error << "\n";
+			continue;
+		}
+		auto placement = mResidency.place(loaded.brick, loaded.frame);
+		if (!placement) {
+			// The working set of that frame fills the whole atlas - the brick is requested again if still visible
+			continue;
+		}
+		GL_CHECK(glBindTexture(GL_TEXTURE_3D, mPageTableId));
+		if (placement->evictedBrick) {
+			setPageTableEntry(*placement->evictedBrick, 0);
+		}
+		setPageTableEntry(loaded.brick, GLuint(placement->slot + 1));
+
+		glm::ivec3 slot(
+			int(placement->slot % mAtlasSlots.x),
+			int(placement->slot / mAtlasSlots.x % mAtlasSlots.y),
+			int(placement->slot / (size_t(mAtlasSlots.x) * mAtlasSlots.y)));
+		glm::ivec3 offset = slot * mSlotEdge;
+		GL_CHECK(glBindTexture(GL_TEXTURE_3D, mAtlasId));
+		GL_CHECK(glTexSubImage3D(GL_TEXTURE_3D, 0, offset.x, offset.y, offset.z, mSlotEdge, mSlotEdge, mSlotEdge, GL_RED, mVoxelType, loaded.voxels.data()));
+	}
+	GL_CHECK(glBindTexture(GL_TEXTURE_3D, 0));
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <glm/glm.hpp>
+
+#include "ogl_resource.hpp"
+#include "volume_data.hpp"
+#include "brick_residency.hpp"
+#include "thread_pool.hpp"
+#include "concurrent_queue.hpp"
+
+/**
+ * @brief Virtual texture style residency of a volume larger than the GPU memory budget.
+ *
+ * The volume is split into bricks which stream on demand from the memory mapped file into
+ * a fixed size atlas texture, the page table texture maps every brick to its atlas slot.
+ * Shaders (PAGED permutation of mip.program) translate samples through the page table and flag
+ * every brick their rays touch in a feedback buffer. update() reads the flags of a finished
+ * frame, refreshes the LRU order, requests the missing bricks from the loader thread and
+ * uploads the bricks loaded so far, evicting the least recently used ones.
+ *
+ * The feedback buffer is bound to the fixed binding cBrickRequestBinding, so only one paged
+ * volume can be rendered per frame.
+ */
+class VolumeBrickCache {
+public:
+	static constexpr GLuint cBrickRequestBinding = 0;
+	// Voxels duplicated from the neighbours around each atlas brick, so trilinear filtering never crosses slots
+	static constexpr int cApron = 1;
+	static constexpr int cMaxLoadsInFlight = 256;
+	static constexpr int cMaxUploadsPerFrame = 64;
+
+	VolumeBrickCache(const fs::path &aFilePath, size_t aResidencyBudget, int aBrickSize = 32);
+	~VolumeBrickCache();
+
+	/**
+	 * Moves the atlas texture out, it is sampled as the volume texture in the shaders. Called once.
+	 */
+	OpenGLResource takeAtlasTexture() {
+		return std::move(mAtlas);
+	}
+
+	/**
+	 * Moves the R32UI page table texture out - atlas slot + 1 of each resident brick, 0 otherwise. Called once.
+	 */
+	OpenGLResource takePageTableTexture() {
+		return std::move(mPageTable);
+	}
+
+	const VolumeInfo &info() const {
+		return mReader.info();
+	}
+
+	/**
+	 * Call once per frame after the paged volume was rendered.
+	 */
+	void update();
+
+	size_t residentBrickCount() const {
+		return mResidency.residentCount();
+	}
+
+	size_t slotCount() const {
+		return mResidency.slotCount();
+	}
+
+	size_t brickCount() const {
+		return size_t(mBrickCount.x) * mBrickCount.y * mBrickCount.z;
+	}
+
+protected:
+	static constexpr int cFeedbackFrames = 3;
+
+	struct LoadedBrick {
+		size_t brick = 0;
+		// Read from this feedback frame, so a brick requested by the frame is not evicted by its siblings
+		uint64_t frame = 0;
+		std::vector<uint8_t> voxels;
+		// Set instead of the voxels if the read failed, e.g. a corrupted brick of a compressed volume
+		std::string error;
+	};
+
+	struct FeedbackBuffer {
+		OpenGLResource buffer;
+		GLsync fence = nullptr;
+		uint64_t frame = 0;
+	};
+
+	void processFeedback(FeedbackBuffer &aFeedback);
+	void uploadLoadedBricks();
+	void setPageTableEntry(size_t aBrick, GLuint aValue);
+	glm::ivec3 brickCoordinates(size_t aBrick) const;
+
+	VolumeReader mReader;
+	int mBrickSize;
+	int mSlotEdge;
+	glm::ivec3 mBrickCount;
+	glm::ivec3 mAtlasSlots;
+	GLenum mVoxelType;
+
+	OpenGLResource mAtlas;
+	OpenGLResource mPageTable;
+	GLuint mAtlasId = 0;
+	GLuint mPageTableId = 0;
+	std::array<FeedbackBuffer, cFeedbackFrames> mFeedback;
+	int mCurrentFeedback = 0;
+	uint64_t mFrame = 1;
+
+	BrickResidency mResidency;
+	std::vector<bool> mLoading;
+	std::vector<uint32_t> mRequests;
+	int mLoadsInFlight = 0;
+	ConcurrentQueue<LoadedBrick> mLoadedBricks;
+	// Declared last - the loader finishes its queued reads before the members they use are destroyed
+	std::unique_ptr<ThreadPool> mLoader;
+};
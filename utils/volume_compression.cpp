@@ -0,0 +1,292 @@
+#include "volume_compression.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+constexpr std::array<char, 4> cMagic = { 'B', 'V', 'O', 'L' };
+constexpr uint32_t cContainerVersion = 1;
+constexpr uint32_t cHeaderSize = uint32_t(cMagic.size()) + 7 * sizeof(uint32_t);
+// Residuals share one bit width per group - 32 residuals of any width fill whole bytes
+constexpr size_t cGroupSize = 32;
+
+template<typename T>
+void writeValue(std::ofstream &aStream, T aValue) {
+	aStream.write(reinterpret_cast<const char *>(&aValue), sizeof(T));
+}
+
+template<typename T>
+T readValue(std::ifstream &aStream) {
+	T value;
+	aStream.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return value;
+}
+
+size_t getBrickCount(const VolumeInfo &aInfo) {
+	auto bricks = [&aInfo](int aExtent) { return size_t((aExtent + aInfo.brickSize - 1) / aInfo.brickSize); };
+	return bricks(aInfo.width) * bricks(aInfo.height) * bricks(aInfo.depth);
+}
+
+// Unsigned code of the voxel bits - the predictor arithmetic wraps, so the coding is lossless for every type
+template<typename TFunction>
+void visitCodes(VoxelType aType, TFunction aFunction) {
+	switch (aType) {
+	case VoxelType::UInt8: aFunction(uint8_t()); return;
+	case VoxelType::UInt16: aFunction(uint16_t()); return;
+	case VoxelType::Float32: aFunction(uint32_t()); return;
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+template<typename TCode>
+TCode toZigZag(TCode aResidual) {
+	using Signed = std::make_signed_t<TCode>;
+	Signed residual = Signed(aResidual);
+	return TCode(TCode(TCode(residual) << 1) ^ TCode(residual >> (8 * sizeof(TCode) - 1)));
+}
+
+template<typename TCode>
+TCode fromZigZag(TCode aCode) {
+	return TCode(TCode(aCode >> 1) ^ TCode(0 - TCode(aCode & 1)));
+}
+
+// Rows of the neighbours the 3D Lorenzo predictor reads, rows outside the brick are zero
+template<typename TCode>
+struct PredictorRows {
+	const TCode *up;
+	const TCode *back;
+	const TCode *upBack;
+
+	TCode predictFirst(int aX) const {
+		return TCode(up[aX] + back[aX] - upBack[aX]);
+	}
+
+	TCode predict(const TCode *aRow, int aX) const {
+		return TCode(aRow[aX - 1] + up[aX] + back[aX] - up[aX - 1] - back[aX - 1] - upBack[aX] + upBack[aX - 1]);
+	}
+};
+
+template<typename TCode>
+PredictorRows<TCode> getPredictorRows(const TCode *aRow, const TCode *aZeros, size_t aStrideY, size_t aStrideZ, int aY, int aZ) {
+	return {
+		aY > 0 ? aRow - aStrideY : aZeros,
+		aZ > 0 ? aRow - aStrideZ : aZeros,
+		aY > 0 && aZ > 0 ? aRow - aStrideY - aStrideZ : aZeros
+	};
+}
+
+void packGroup(const uint32_t *aValues, size_t aCount, std::vector<uint8_t> &aOutput) {
+	uint32_t bits = 0;
+	for (size_t i = 0; i < aCount; ++i) {
+		bits |= aValues[i];
+	}
+	int width = int(std::bit_width(bits));
+	aOutput.push_back(uint8_t(width));
+	uint64_t buffer = 0;
+	int filled = 0;
+	for (size_t i = 0; i < cGroupSize; ++i) {
+		buffer |= uint64_t(i < aCount ? aValues[i] : 0) << filled;
+		filled += width;
+		for (; filled >= 8; filled -= 8) {
+			aOutput.push_back(uint8_t(buffer));
+			buffer >>= 8;
+		}
+	}
+}
+
+const uint8_t *unpackGroup(const uint8_t *aData, const uint8_t *aEnd, uint32_t *aValues) {
+	int width = aData < aEnd ? *aData++ : -1;
+	if (width < 0 || width > 32 || aEnd - aData < 4 * width) {
+		throw std::runtime_error("Corrupted volume brick");
+	}
+	uint64_t mask = (uint64_t(1) << width) - 1;
+	if (aEnd - aData >= 4 * width + 8) {
+		// Whole 64-bit words hold every value with its bit offset, no per value refill
+		for (size_t i = 0; i < cGroupSize; ++i) {
+			size_t bit = i * width;
+			uint64_t word;
+			std::memcpy(&word, aData + bit / 8, sizeof(word));
+			aValues[i] = uint32_t((word >> (bit % 8)) & mask);
+		}
+		return aData + 4 * width;
+	}
+	uint64_t buffer = 0;
+	int filled = 0;
+	for (size_t i = 0; i < cGroupSize; ++i) {
+		for (; filled < width; filled += 8) {
+			buffer |= uint64_t(*aData++) << filled;
+		}
+		aValues[i] = uint32_t(buffer & mask);
+		buffer >>= width;
+		filled -= width;
+	}
+	return aData;
+}
+
+template<typename TCode>
+void encodeBrick(const TCode *aVoxels, size_t aStrideY, size_t aStrideZ, int aWidth, int aHeight, int aDepth, std::vector<uint8_t> &aOutput) {
+	std::vector<TCode> zeros(aWidth, 0);
+	std::vector<uint32_t> residuals;
+	residuals.reserve(size_t(aWidth) * aHeight * aDepth);
+	for (int z = 0; z < aDepth; ++z) {
+		for (int y = 0; y < aHeight; ++y) {
+			const TCode *row = aVoxels + z * aStrideZ + y * aStrideY;
+			auto rows = getPredictorRows(row, zeros.data(), aStrideY, aStrideZ, y, z);
+			residuals.push_back(toZigZag(TCode(row[0] - rows.predictFirst(0))));
+			for (int x = 1; x < aWidth; ++x) {
+				residuals.push_back(toZigZag(TCode(row[x] - rows.predict(row, x))));
+			}
+		}
+	}
+	for (size_t i = 0; i < residuals.size(); i += cGroupSize) {
+		packGroup(residuals.data() + i, std::min(cGroupSize, residuals.size() - i), aOutput);
+	}
+}
+
+template<typename TCode>
+void decodeBrick(const uint8_t *aData, size_t aSize, TCode *aVoxels, size_t aStrideY, size_t aStrideZ, int aWidth, int aHeight, int aDepth) {
+	// All residuals are unpacked up front, so the predictor loop runs without the group bookkeeping
+	thread_local std::vector<uint32_t> residuals;
+	size_t count = size_t(aWidth) * aHeight * aDepth;
+	residuals.resize((count + cGroupSize - 1) / cGroupSize * cGroupSize);
+	const uint8_t *end = aData + aSize;
+	for (size_t i = 0; i < residuals.size(); i += cGroupSize) {
+		aData = unpackGroup(aData, end, residuals.data() + i);
+	}
+
+	std::vector<TCode> zeros(aWidth, 0);
+	const uint32_t *residual = residuals.data();
+	for (int z = 0; z < aDepth; ++z) {
+		for (int y = 0; y < aHeight; ++y) {
+			TCode *row = aVoxels + z * aStrideZ + y * aStrideY;
+			auto rows = getPredictorRows<TCode>(row, zeros.data(), aStrideY, aStrideZ, y, z);
+			row[0] = TCode(rows.predictFirst(0) + fromZigZag(TCode(residual[0])));
+			for (int x = 1; x < aWidth; ++x) {
+				row[x] = TCode(rows.predict(row, x) + fromZigZag(TCode(residual[x])));
+			}
+			residual += aWidth;
+		}
+	}
+}
+
+} // namespace
+
+std::vector<uint8_t> encodeVolumeBrick(VoxelType aType, const void *aVoxels, size_t aStrideY, size_t aStrideZ, int aWidth, int aHeight, int aDepth) {
+	std::vector<uint8_t> data;
+	visitCodes(aType, [&](auto aCode) {
+		using Code = decltype(aCode);
+		encodeBrick(static_cast<const Code *>(aVoxels), aStrideY, aStrideZ, aWidth, aHeight, aDepth, data);
+	});
+	return data;
+}
+
+void decodeVolumeBrick(VoxelType aType, const uint8_t *aData, size_t aSize, void *aVoxels, size_t aStrideY, size_t aStrideZ, int aWidth, int aHeight, int aDepth) {
+	visitCodes(aType, [&](auto aCode) {
+		using Code = decltype(aCode);
+		decodeBrick(aData, aSize, static_cast<Code *>(aVoxels), aStrideY, aStrideZ, aWidth, aHeight, aDepth);
+	});
+}
+
+VolumeCompressionStats writeCompressedVolume(const fs::path &aPath, const VolumeReader &aSource, ThreadPool &aPool, int aBrickSize) {
+	if (aSource.info().brickSize > 0) {
+		throw std::runtime_error("Volume is already compressed: " + aSource.info().dataFile.string());
+	}
+	std::ofstream file(aPath, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open compressed volume for writing: " + aPath.string());
+	}
+	VolumeInfo info = aSource.info();
+	info.brickSize = aBrickSize;
+	size_t brickCount = getBrickCount(info);
+	file.write(cMagic.data(), cMagic.size());
+	writeValue<uint32_t>(file, cContainerVersion);
+	writeValue<uint32_t>(file, static_cast<uint32_t>(info.type));
+	writeValue<uint32_t>(file, info.width);
+	writeValue<uint32_t>(file, info.height);
+	writeValue<uint32_t>(file, info.depth);
+	writeValue<uint32_t>(file, aBrickSize);
+	writeValue<uint32_t>(file, uint32_t(brickCount));
+
+	// Offsets are known once the bricks are encoded - reserve their space
+	std::vector<uint64_t> offsets;
+	offsets.reserve(brickCount + 1);
+	uint64_t offset = cHeaderSize + (brickCount + 1) * sizeof(uint64_t);
+	file.seekp(std::streamoff(offset));
+
+	int bricksX = (info.width + aBrickSize - 1) / aBrickSize;
+	int bricksY = (info.height + aBrickSize - 1) / aBrickSize;
+	size_t voxelSize = getVoxelSize(info.type);
+	std::vector<std::vector<uint8_t>> layer(size_t(bricksX) * bricksY);
+	aSource.forEachSlab(aBrickSize, [&](int, int aSliceCount, const void *aVoxels) {
+		parallelFor(aPool, 0, layer.size(), 1, [&](size_t aBegin, size_t aEnd) {
+			for (size_t brick = aBegin; brick < aEnd; ++brick) {
+				int x = int(brick % bricksX) * aBrickSize;
+				int y = int(brick / bricksX) * aBrickSize;
+				const uint8_t *source = static_cast<const uint8_t *>(aVoxels) + (size_t(y) * info.width + x) * voxelSize;
+				layer[brick] = encodeVolumeBrick(info.type, source, info.width, size_t(info.width) * info.height,
+					std::min(aBrickSize, info.width - x), std::min(aBrickSize, info.height - y), aSliceCount);
+			}
+		});
+		for (const auto &brick : layer) {
+			offsets.push_back(offset);
+			file.write(reinterpret_cast<const char *>(brick.data()), brick.size());
+			offset += brick.size();
+		}
+	});
+	offsets.push_back(offset);
+	file.seekp(cHeaderSize);
+	file.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	if (!file) {
+		throw std::runtime_error("Failed to write compressed volume: " + aPath.string());
+	}
+	return { info.depth * info.sliceSize(), offset };
+}
+
+VolumeInfo readCompressedVolumeInfo(const fs::path &aPath) {
+	std::ifstream file(aPath, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open compressed volume: " + aPath.string());
+	}
+	std::array<char, 4> magic;
+	file.read(magic.data(), magic.size());
+	if (magic != cMagic || readValue<uint32_t>(file) != cContainerVersion) {
+		throw std::runtime_error("Not a compressed volume file: " + aPath.string());
+	}
+	VolumeInfo info;
+	uint32_t type = readValue<uint32_t>(file);
+	if (type > static_cast<uint32_t>(VoxelType::Float32)) {
+		throw std::runtime_error("Unsupported element type for compressed volume loader");
+	}
+	info.type = static_cast<VoxelType>(type);
+	info.width = int(readValue<uint32_t>(file));
+	info.height = int(readValue<uint32_t>(file));
+	info.depth = int(readValue<uint32_t>(file));
+	info.brickSize = int(readValue<uint32_t>(file));
+	uint32_t brickCount = readValue<uint32_t>(file);
+	if (!file || info.brickSize <= 0 || brickCount != getBrickCount(info)) {
+		throw std::runtime_error("Corrupted compressed volume header: " + aPath.string());
+	}
+	info.dataFile = aPath;
+	info.dataOffset = cHeaderSize;
+	return info;
+}
+
+std::vector<uint64_t> readCompressedBrickOffsets(const VolumeInfo &aInfo, const MappedFile &aFile) {
+	std::vector<uint64_t> offsets(getBrickCount(aInfo) + 1);
+	size_t tableSize = offsets.size() * sizeof(uint64_t);
+	if (aInfo.dataOffset + tableSize > aFile.size()) {
+		throw std::runtime_error("Truncated compressed volume file: " + aInfo.dataFile.string());
+	}
+	std::memcpy(offsets.data(), aFile.data() + aInfo.dataOffset, tableSize);
+	if (offsets.front() < aInfo.dataOffset + tableSize || offsets.back() > aFile.size()
+		|| !std::is_sorted(offsets.begin(), offsets.end()))
+	{
+		throw std::runtime_error("Corrupted brick offsets in compressed volume file: " + aInfo.dataFile.string());
+	}
+	return offsets;
+}
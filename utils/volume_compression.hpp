@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "volume_data.hpp"
+#include "thread_pool.hpp"
+
+inline constexpr const char *cCompressedVolumeExtension = ".bvol";
+inline constexpr int cDefaultCompressedBrickSize = 32;
+
+/**
+ * Size of a volume before and after compression.
+ */
+struct VolumeCompressionStats {
+	uint64_t rawBytes = 0;
+	uint64_t compressedBytes = 0;
+
+	double ratio() const {
+		return compressedBytes > 0 ? double(rawBytes) / double(compressedBytes) : 0.0;
+	}
+};
+
+/**
+ * @brief Losslessly compresses a brick of aWidth x aHeight x aDepth voxels, rows aStrideY and slices aStrideZ voxels apart.
+ *
+ * Each voxel is predicted by the 3D Lorenzo predictor from its already coded neighbours inside the brick,
+ * the zigzag coded residuals are bit packed in groups of 32 with a per group bit width. Floats are coded
+ * through their bit patterns. The brick depends on nothing outside of it, so bricks decode independently.
+ */
+std::vector<uint8_t> encodeVolumeBrick(VoxelType aType, const void *aVoxels, size_t aStrideY, size_t aStrideZ, int aWidth, int aHeight, int aDepth);
+
+/**
+ * Inverse of encodeVolumeBrick(), writes the voxels with the given strides - straight into a slab or a dense brick.
+ */
+void decodeVolumeBrick(VoxelType aType, const uint8_t *aData, size_t aSize, void *aVoxels, size_t aStrideY, size_t aStrideZ, int aWidth, int aHeight, int aDepth);
+
+/**
+ * @brief Converts a raw volume into the bricked ".bvol" container, each brick layer is encoded in parallel on aPool.
+ *
+ * Container layout (little endian):
+ *	header: "BVOL", version, voxel type, width, height, depth, brick size, brick count
+ *	brick offsets: brick count + 1 offsets from the file start, brick i spans [offset i, offset i + 1)
+ *	brick data: bricks of aBrickSize^3 voxels clipped at the volume faces, x index fastest, so each
+ *	brick layer is one contiguous range of the file
+ */
+VolumeCompressionStats writeCompressedVolume(const fs::path &aPath, const VolumeReader &aSource, ThreadPool &aPool, int aBrickSize = cDefaultCompressedBrickSize);
+
+/**
+ * Parses the ".bvol" header, VolumeInfo::dataOffset points to the brick offsets.
+ */
+VolumeInfo readCompressedVolumeInfo(const fs::path &aPath);
+
+/**
+ * Brick offsets of a mapped ".bvol" file, checked against the file size.
+ */
+std::vector<uint64_t> readCompressedBrickOffsets(const VolumeInfo &aInfo, const MappedFile &aFile);
@@ -0,0 +1,133 @@
+#include "volume_conversion.hpp"
+
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VOLUME_CONVERSION_SSE2 1
+#endif
+
+namespace {
+
+// Voxels per parallel chunk
+constexpr size_t cChunkVoxels = 1 << 20;
+
+template<typename TFunction>
+void forEachChunk(ThreadPool *aPool, size_t aCount, TFunction aFunction) {
+	if (aPool && aCount > cChunkVoxels) {
+		parallelFor(*aPool, 0, aCount, cChunkVoxels, aFunction);
+		return;
+	}
+	aFunction(size_t(0), aCount);
+}
+
+#ifdef VOLUME_CONVERSION_SSE2
+// Voxels [i, i + 8) as two float vectors
+inline void loadFloats(const uint8_t *aSource, size_t aIndex, __m128 &aLow, __m128 &aHigh) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i values = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(aSource + aIndex)), zero);
+	aLow = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+	aHigh = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+}
+
+inline void loadFloats(const uint16_t *aSource, size_t aIndex, __m128 &aLow, __m128 &aHigh) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSource + aIndex));
+	aLow = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+	aHigh = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+}
+
+inline void loadFloats(const float *aSource, size_t aIndex, __m128 &aLow, __m128 &aHigh) {
+	aLow = _mm_loadu_ps(aSource + aIndex);
+	aHigh = _mm_loadu_ps(aSource + aIndex + 4);
+}
+#endif
+
+template<typename TSource, typename TTarget>
+void windowVoxels(const TSource *aSource, size_t aCount, const VolumeWindow &aWindow, TTarget *aDestination) {
+	constexpr float cTargetMaximum = float(std::numeric_limits<TTarget>::max());
+	float scale = aWindow.width() > 0.0f ? cTargetMaximum / aWindow.width() : 0.0f;
+	size_t i = 0;
+#ifdef VOLUME_CONVERSION_SSE2
+	const __m128 lower = _mm_set1_ps(aWindow.lower);
+	const __m128 scales = _mm_set1_ps(scale);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maximum = _mm_set1_ps(cTargetMaximum);
+	const __m128 half = _mm_set1_ps(0.5f);
+	for (; i + 8 <= aCount; i += 8) {
+		__m128 low, high;
+		loadFloats(aSource, i, low, high);
+		low = _mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(low, lower), scales), zero), maximum), half);
+		high = _mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(high, lower), scales), zero), maximum), half);
+		__m128i lowValues = _mm_cvttps_epi32(low);
+		__m128i highValues = _mm_cvttps_epi32(high);
+		if constexpr (sizeof(TTarget) == 1) {
+			__m128i words = _mm_packs_epi32(lowValues, highValues);
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(aDestination + i), _mm_packus_epi16(words, words));
+		} else {
+			// Signed saturating pack - shift the range into int16 and flip the sign bit back
+			const __m128i offset = _mm_set1_epi32(32768);
+			__m128i words = _mm_packs_epi32(_mm_sub_epi32(lowValues, offset), _mm_sub_epi32(highValues, offset));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(aDestination + i), _mm_xor_si128(words, _mm_set1_epi16(int16_t(0x8000))));
+		}
+	}
+#endif
+	for (; i < aCount; ++i) {
+		float value = std::clamp((float(aSource[i]) - aWindow.lower) * scale, 0.0f, cTargetMaximum);
+		aDestination[i] = TTarget(value + 0.5f);
+	}
+}
+
+template<typename TFunction>
+void visitVoxels(VoxelType aType, const void *aVoxels, TFunction aFunction) {
+	switch (aType) {
+	case VoxelType::UInt8: aFunction(static_cast<const uint8_t *>(aVoxels)); return;
+	case VoxelType::UInt16: aFunction(static_cast<const uint16_t *>(aVoxels)); return;
+	case VoxelType::Float32: aFunction(static_cast<const float *>(aVoxels)); return;
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+} // namespace
+
+VoxelType getVolumeFormatType(VolumeFormat aFormat, VoxelType aSourceType) {
+	switch (aFormat) {
+	case VolumeFormat::Native: return aSourceType;
+	case VolumeFormat::Normalized8: return VoxelType::UInt8;
+	case VolumeFormat::Normalized16: return VoxelType::UInt16;
+	}
+	throw std::runtime_error("Unknown volume format");
+}
+
+VolumeWindow computeAutoWindow(const ValueHistogram &aHistogram, double aLowerFraction, double aUpperFraction) {
+	VolumeWindow window{ aHistogram.percentile(aLowerFraction), aHistogram.percentile(aUpperFraction) };
+	if (window.upper <= window.lower) {
+		// Nearly constant volume - fall back to the occupied bins, the histogram may cover the whole type range
+		window.lower = aHistogram.percentile(0.0);
+		window.upper = std::max(aHistogram.percentile(1.0), window.lower + 1.0f);
+	}
+	return window;
+}
+
+void convertVoxels(
+	VoxelType aSourceType,
+	const void *aSource,
+	const VolumeWindow &aWindow,
+	VoxelType aTargetType,
+	void *aDestination,
+	size_t aCount,
+	ThreadPool *aPool)
+{
+	if (aTargetType == VoxelType::Float32) {
+		throw std::runtime_error("Volumes are normalized to 8 or 16-bit voxels only");
+	}
+	visitVoxels(aSourceType, aSource, [&](auto aTypedSource) {
+		forEachChunk(aPool, aCount, [&](size_t aBegin, size_t aEnd) {
+			if (aTargetType == VoxelType::UInt8) {
+				windowVoxels(aTypedSource + aBegin, aEnd - aBegin, aWindow, static_cast<uint8_t *>(aDestination) + aBegin);
+			} else {
+				windowVoxels(aTypedSource + aBegin, aEnd - aBegin, aWindow, static_cast<uint16_t *>(aDestination) + aBegin);
+			}
+		});
+	});
+}
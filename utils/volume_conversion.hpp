@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "volume_data.hpp"
+#include "value_statistics.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Texture format of loaded volumes - the file type as is, or windowed and normalized to 8/16 bits.
+ */
+enum class VolumeFormat {
+	Native,
+	Normalized8,
+	Normalized16
+};
+
+/**
+ * Voxel type of the texture a volume of aSourceType is converted to.
+ */
+VoxelType getVolumeFormatType(VolumeFormat aFormat, VoxelType aSourceType);
+
+/**
+ * Window/level of the stored values - lower maps to 0 and upper to 1 of the normalized texture.
+ */
+struct VolumeWindow {
+	float lower = 0.0f;
+	float upper = 1.0f;
+
+	float level() const {
+		return 0.5f * (lower + upper);
+	}
+
+	float width() const {
+		return upper - lower;
+	}
+
+	float apply(float aValue) const {
+		return std::clamp((aValue - lower) / width(), 0.0f, 1.0f);
+	}
+};
+
+/**
+ * @brief Window between the aLowerFraction and aUpperFraction percentiles.
+ *
+ * Clipping the brightest outliers replaces the hand tuned intensity multipliers the unnormalized volumes needed.
+ */
+VolumeWindow computeAutoWindow(const ValueHistogram &aHistogram, double aLowerFraction = 0.001, double aUpperFraction = 0.999);
+
+/**
+ * @brief Applies aWindow to aCount voxels of aSourceType and stores them normalized as aTargetType (UInt8 or UInt16).
+ *
+ * A single SIMD pass, runs in parallel chunks on aPool if given.
+ */
+void convertVoxels(
+	VoxelType aSourceType,
+	const void *aSource,
+	const VolumeWindow &aWindow,
+	VoxelType aTargetType,
+	void *aDestination,
+	size_t aCount,
+	ThreadPool *aPool = nullptr);
+
+/**
+ * Value statistics, histogram and window of a loaded volume and the format its texture was created in.
+ */
+struct VolumeStatistics {
+	ValueStatistics values;
+	ValueHistogram histogram;
+	VolumeWindow window; ///< In the stored units of the volume file
+	VoxelType sourceType = VoxelType::UInt16;
+	VolumeFormat format = VolumeFormat::Native;
+
+	/**
+	 * Maps a stored value of the volume file to the value the shaders sample from its texture.
+	 */
+	float toSampledValue(float aValue) const {
+		if (format == VolumeFormat::Native) {
+			return aValue * getVoxelScale(sourceType);
+		}
+		return window.apply(aValue);
+	}
+
+	/**
+	 * The window in the units the shaders sample, identity for normalized textures.
+	 */
+	VolumeWindow sampledWindow() const {
+		return { toSampledValue(window.lower), toSampledValue(window.upper) };
+	}
+};
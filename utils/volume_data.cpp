@@ -0,0 +1,459 @@
+#include "volume_data.hpp"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "volume_compression.hpp"
+#include "thread_pool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VOLUME_DATA_SSE2 1
+#endif
+
+namespace {
+
+struct DimInfo {
+	int32_t minimum = 0;
+	int32_t maximum = 0;
+	float elementExtent = 1.0;
+};
+
+VolumeInfo readDumpInfo(const fs::path& aFilePath) {
+	std::ifstream rawFile(aFilePath, std::ios::binary);
+	if (!rawFile.is_open()) {
+		throw std::runtime_error("Dump loader failed to open file: " + aFilePath.string());
+	}
+	uint8_t endianness;
+	rawFile.read(reinterpret_cast<char*>(&endianness), 1);
+	std::array<uint32_t, 3> header;
+	rawFile.read(reinterpret_cast<char*>(header.data()), header.size() * sizeof(uint32_t));
+
+	uint32_t dimension;
+	rawFile.read(reinterpret_cast<char*>(&dimension), sizeof(uint32_t));
+
+	uint32_t elementTypeID;
+	rawFile.read(reinterpret_cast<char*>(&elementTypeID), sizeof(uint32_t));
+
+	std::array<DimInfo, 3> extents;
+	rawFile.read(reinterpret_cast<char*>(extents.data()), extents.size() * sizeof(DimInfo));
+	uint32_t headerEnd;
+	rawFile.read(reinterpret_cast<char*>(&headerEnd), sizeof(uint32_t));
+
+	std::cout << "Dimension " << dimension << " elementTypeID " << elementTypeID << "\n";
+	for (int i = 0; i < 3; ++i) {
+		std::cout << extents[i].minimum << " - " << extents[i].maximum << " - " << extents[i].elementExtent << "\n";
+	}
+
+	VolumeInfo info;
+	if (elementTypeID == 9) {
+		info.type = VoxelType::Float32;
+	} else if (elementTypeID == 4) {
+		info.type = VoxelType::UInt16;
+	} else {
+		throw std::runtime_error("Unsupported element type for dump loader");
+	}
+	info.dataFile = aFilePath;
+	info.dataOffset = size_t(rawFile.tellg());
+	info.width = extents[0].maximum - extents[0].minimum;
+	info.height = extents[1].maximum - extents[1].minimum;
+	info.depth = extents[2].maximum - extents[2].minimum;
+	return info;
+}
+
+VolumeInfo readMHDInfo(const fs::path& aFilePath) {
+	std::ifstream mhdFile(aFilePath);
+	std::string line;
+	VolumeInfo info;
+
+	while (std::getline(mhdFile, line)) {
+		std::istringstream iss(line);
+		std::string tag, equals;
+		iss >> tag;
+		if (tag == "DimSize") {
+			iss >> equals >> info.width >> info.height >> info.depth;
+		} else if (tag == "ElementDataFile") {
+			std::string rawFilename;
+			iss >> equals >> rawFilename;
+			// Assuming RAW file is in the same directory as the MHD file
+			info.dataFile = aFilePath.parent_path() / rawFilename;
+		} else if (tag == "ElementType") {
+			std::string elementType;
+			iss >> equals >> elementType;
+			if (elementType == "MET_FLOAT") {
+				info.type = VoxelType::Float32;
+			} else if (elementType == "MET_UCHAR") {
+				info.type = VoxelType::UInt8;
+			} else if (elementType == "MET_USHORT") {
+				info.type = VoxelType::UInt16;
+			} else {
+				throw std::runtime_error("Unsupported element type for MHD loader");
+			}
+		}
+	}
+	return info;
+}
+
+VoxelRange copyUInt8(const uint8_t *aSource, uint8_t *aDestination, size_t aCount) {
+	size_t i = 0;
+	VoxelRange range;
+	uint8_t minimum = std::numeric_limits<uint8_t>::max();
+	uint8_t maximum = 0;
+#ifdef VOLUME_DATA_SSE2
+	__m128i minimums = _mm_set1_epi8(char(0xFF));
+	__m128i maximums = _mm_setzero_si128();
+	for (; i + 16 <= aCount; i += 16) {
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSource + i));
+		if (aDestination) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(aDestination + i), values);
+		}
+		minimums = _mm_min_epu8(minimums, values);
+		maximums = _mm_max_epu8(maximums, values);
+	}
+	alignas(16) std::array<uint8_t, 16> lanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), minimums);
+	minimum = *std::min_element(lanes.begin(), lanes.end());
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), maximums);
+	maximum = *std::max_element(lanes.begin(), lanes.end());
+#endif
+	for (; i < aCount; ++i) {
+		if (aDestination) {
+			aDestination[i] = aSource[i];
+		}
+		minimum = std::min(minimum, aSource[i]);
+		maximum = std::max(maximum, aSource[i]);
+	}
+	if (aCount > 0) {
+		range.minimum = minimum;
+		range.maximum = maximum;
+	}
+	return range;
+}
+
+VoxelRange copyUInt16(const uint16_t *aSource, uint16_t *aDestination, size_t aCount) {
+	size_t i = 0;
+	VoxelRange range;
+	uint16_t minimum = std::numeric_limits<uint16_t>::max();
+	uint16_t maximum = 0;
+#ifdef VOLUME_DATA_SSE2
+	// SSE2 has only signed 16-bit min/max - flipping the sign bit maps the unsigned order onto the signed one
+	const __m128i bias = _mm_set1_epi16(int16_t(0x8000));
+	__m128i minimums = _mm_set1_epi16(std::numeric_limits<int16_t>::max());
+	__m128i maximums = _mm_set1_epi16(std::numeric_limits<int16_t>::min());
+	for (; i + 8 <= aCount; i += 8) {
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSource + i));
+		if (aDestination) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(aDestination + i), values);
+		}
+		values = _mm_xor_si128(values, bias);
+		minimums = _mm_min_epi16(minimums, values);
+		maximums = _mm_max_epi16(maximums, values);
+	}
+	alignas(16) std::array<uint16_t, 8> lanes;
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), _mm_xor_si128(minimums, bias));
+	minimum = *std::min_element(lanes.begin(), lanes.end());
+	_mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), _mm_xor_si128(maximums, bias));
+	maximum = *std::max_element(lanes.begin(), lanes.end());
+#endif
+	for (; i < aCount; ++i) {
+		if (aDestination) {
+			aDestination[i] = aSource[i];
+		}
+		minimum = std::min(minimum, aSource[i]);
+		maximum = std::max(maximum, aSource[i]);
+	}
+	if (aCount > 0) {
+		range.minimum = minimum;
+		range.maximum = maximum;
+	}
+	return range;
+}
+
+VoxelRange copyFloat(const float *aSource, float *aDestination, size_t aCount) {
+	size_t i = 0;
+	VoxelRange range;
+#ifdef VOLUME_DATA_SSE2
+	__m128 minimums = _mm_set1_ps(range.minimum);
+	__m128 maximums = _mm_set1_ps(range.maximum);
+	for (; i + 4 <= aCount; i += 4) {
+		__m128 values = _mm_loadu_ps(aSource + i);
+		if (aDestination) {
+			_mm_storeu_ps(aDestination + i, values);
+		}
+		minimums = _mm_min_ps(minimums, values);
+		maximums = _mm_max_ps(maximums, values);
+	}
+	alignas(16) std::array<float, 4> lanes;
+	_mm_store_ps(lanes.data(), minimums);
+	range.minimum = *std::min_element(lanes.begin(), lanes.end());
+	_mm_store_ps(lanes.data(), maximums);
+	range.maximum = *std::max_element(lanes.begin(), lanes.end());
+#endif
+	for (; i < aCount; ++i) {
+		if (aDestination) {
+			aDestination[i] = aSource[i];
+		}
+		range.minimum = std::min(range.minimum, aSource[i]);
+		range.maximum = std::max(range.maximum, aSource[i]);
+	}
+	return range;
+}
+
+} // namespace
+
+size_t getVoxelSize(VoxelType aType) {
+	switch (aType) {
+	case VoxelType::UInt8: return sizeof(uint8_t);
+	case VoxelType::UInt16: return sizeof(uint16_t);
+	case VoxelType::Float32: return sizeof(float);
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+float getVoxelScale(VoxelType aType) {
+	switch (aType) {
+	case VoxelType::UInt8: return 1.0f / std::numeric_limits<uint8_t>::max();
+	case VoxelType::UInt16: return 1.0f / std::numeric_limits<uint16_t>::max();
+	case VoxelType::Float32: return 1.0f;
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+VolumeInfo readVolumeInfo(const fs::path &aFilePath) {
+	auto ext = aFilePath.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(),
+			[](unsigned char c){ return std::tolower(c); });
+
+	if (ext == ".mhd") {
+		return readMHDInfo(aFilePath);
+	}
+	if (ext == ".dump" ) {
+		return readDumpInfo(aFilePath);
+	}
+	if (ext == cCompressedVolumeExtension) {
+		return readCompressedVolumeInfo(aFilePath);
+	}
+
+	throw std::runtime_error("Unsupported 3d image type " + aFilePath.string());
+}
+
+VoxelRange copyVoxels(VoxelType aType, const void *aSource, void *aDestination, size_t aCount) {
+	switch (aType) {
+	case VoxelType::UInt8:
+		return copyUInt8(static_cast<const uint8_t *>(aSource), static_cast<uint8_t *>(aDestination), aCount);
+	case VoxelType::UInt16:
+		return copyUInt16(static_cast<const uint16_t *>(aSource), static_cast<uint16_t *>(aDestination), aCount);
+	case VoxelType::Float32:
+		return copyFloat(static_cast<const float *>(aSource), static_cast<float *>(aDestination), aCount);
+	}
+	throw std::runtime_error("Unknown voxel type");
+}
+
+VolumeReader::VolumeReader(const fs::path &aFilePath, ThreadPool *aPool)
+	: mInfo(readVolumeInfo(aFilePath))
+	, mFile(mInfo.dataFile)
+	, mPool(aPool)
+{
+	if (isCompressed()) {
+		mBrickOffsets = readCompressedBrickOffsets(mInfo, mFile);
+		return;
+	}
+	if (mInfo.dataOffset + mInfo.depth * mInfo.sliceSize() > mFile.size()) {
+		throw std::runtime_error("Volume data file is smaller than its header declares: " + mInfo.dataFile.string());
+	}
+}
+
+void VolumeReader::readBrick(int aBrickX, int aBrickY, int aBrickZ, int aBrickSize, int aApron, void *aDestination) const {
+	int edge = aBrickSize + 2 * aApron;
+	size_t voxelSize = getVoxelSize(mInfo.type);
+	int startX = aBrickX * aBrickSize - aApron;
+	int startY = aBrickY * aBrickSize - aApron;
+	int startZ = aBrickZ * aBrickSize - aApron;
+	int firstX = std::max(startX, 0);
+	int endX = std::min(startX + edge, mInfo.width);
+
+	auto destination = static_cast<uint8_t *>(aDestination);
+	std::fill_n(destination, size_t(edge) * edge * edge * voxelSize, uint8_t(0));
+	if (endX <= firstX) {
+		return;
+	}
+	int endY = std::min(startY + edge, mInfo.height);
+	int endZ = std::min(startZ + edge, mInfo.depth);
+	if (isCompressed()) {
+		// Decodes every stored brick the region overlaps and copies the overlap
+		int storedSize = mInfo.brickSize;
+		int bricksX = (mInfo.width + storedSize - 1) / storedSize;
+		int bricksY = (mInfo.height + storedSize - 1) / storedSize;
+		std::vector<uint8_t> stored(size_t(storedSize) * storedSize * storedSize * voxelSize);
+		for (int brickZ = std::max(startZ, 0) / storedSize; brickZ * storedSize < endZ; ++brickZ) {
+			for (int brickY = std::max(startY, 0) / storedSize; brickY * storedSize < endY; ++brickY) {
+				for (int brickX = firstX / storedSize; brickX * storedSize < endX; ++brickX) {
+					int x0 = brickX * storedSize;
+					int y0 = brickY * storedSize;
+					int z0 = brickZ * storedSize;
+					int width = std::min(storedSize, mInfo.width - x0);
+					int height = std::min(storedSize, mInfo.height - y0);
+					decodeBrick((size_t(brickZ) * bricksY + brickY) * bricksX + brickX, stored.data(), width, size_t(width) * height);
+					int copyX = std::max(x0, firstX);
+					size_t rowSize = (std::min(x0 + width, endX) - copyX) * voxelSize;
+					for (int z = std::max(z0, std::max(startZ, 0)); z < std::min(z0 + storedSize, endZ); ++z) {
+						for (int y = std::max(y0, std::max(startY, 0)); y < std::min(y0 + height, endY); ++y) {
+							const uint8_t *source = stored.data() + ((size_t(z - z0) * height + (y - y0)) * width + (copyX - x0)) * voxelSize;
+							size_t offset = ((size_t(z - startZ) * edge + (y - startY)) * edge + (copyX - startX)) * voxelSize;
+							std::memcpy(destination + offset, source, rowSize);
+						}
+					}
+				}
+			}
+		}
+		return;
+	}
+	for (int z = std::max(startZ, 0); z < endZ; ++z) {
+		for (int y = std::max(startY, 0); y < endY; ++y) {
+			const uint8_t *source = mFile.data() + mInfo.dataOffset
+				+ ((size_t(z) * mInfo.height + y) * mInfo.width + firstX) * voxelSize;
+			size_t offset = ((size_t(z - startZ) * edge + (y - startY)) * edge + (firstX - startX)) * voxelSize;
+			std::memcpy(destination + offset, source, (endX - firstX) * voxelSize);
+		}
+	}
+}
+
+void VolumeReader::readSlices(int aFirstSlice, int aSliceCount, void *aDestination) const {
+	size_t sliceSize = mInfo.sliceSize();
+	if (!isCompressed()) {
+		std::memcpy(aDestination, mFile.data() + mInfo.dataOffset + aFirstSlice * sliceSize, aSliceCount * sliceSize);
+		return;
+	}
+	int brickSize = mInfo.brickSize;
+	int firstLayerSlice = aFirstSlice / brickSize * brickSize;
+	int endLayerSlice = std::min(mInfo.depth, (aFirstSlice + aSliceCount + brickSize - 1) / brickSize * brickSize);
+	if (firstLayerSlice == aFirstSlice && endLayerSlice == aFirstSlice + aSliceCount) {
+		decodeSlab(aFirstSlice, aSliceCount, aDestination);
+		return;
+	}
+	std::vector<uint8_t> layers((endLayerSlice - firstLayerSlice) * sliceSize);
+	decodeSlab(firstLayerSlice, endLayerSlice - firstLayerSlice, layers.data());
+	std::memcpy(aDestination, layers.data() + (aFirstSlice - firstLayerSlice) * sliceSize, aSliceCount * sliceSize);
+}
+
+void VolumeReader::decodeSlab(int aFirstSlice, int aSliceCount, void *aDestination) const {
+	int brickSize = mInfo.brickSize;
+	int bricksX = (mInfo.width + brickSize - 1) / brickSize;
+	int bricksY = (mInfo.height + brickSize - 1) / brickSize;
+	size_t layerBricks = size_t(bricksX) * bricksY;
+	size_t brickCount = mBrickOffsets.size() - 1;
+	size_t firstBrick = size_t(aFirstSlice / brickSize) * layerBricks;
+	size_t endBrick = std::min(brickCount, size_t((aFirstSlice + aSliceCount + brickSize - 1) / brickSize) * layerBricks);
+	// Brick layers are contiguous in the file, the next slab is prefetched while this one decodes
+	size_t nextEndBrick = std::min(brickCount, 2 * endBrick - firstBrick);
+	mFile.willNeed(mBrickOffsets[endBrick], mBrickOffsets[nextEndBrick] - mBrickOffsets[endBrick]);
+
+	size_t voxelSize = getVoxelSize(mInfo.type);
+	size_t strideZ = size_t(mInfo.width) * mInfo.height;
+	auto decodeBricks = [&](size_t aBegin, size_t aEnd) {
+		for (size_t brick = aBegin; brick < aEnd; ++brick) {
+			int x = int(brick % bricksX) * brickSize;
+			int y = int(brick / bricksX % bricksY) * brickSize;
+			int z = int(brick / layerBricks) * brickSize;
+			size_t offset = (size_t(z - aFirstSlice) * strideZ + size_t(y) * mInfo.width + x) * voxelSize;
+			decodeBrick(brick, static_cast<uint8_t *>(aDestination) + offset, mInfo.width, strideZ);
+		}
+	};
+	if (mPool) {
+		parallelFor(*mPool, firstBrick, endBrick, 1, decodeBricks);
+	} else {
+		decodeBricks(firstBrick, endBrick);
+	}
+	mFile.release(mBrickOffsets[firstBrick], mBrickOffsets[endBrick] - mBrickOffsets[firstBrick]);
+}
+
+void VolumeReader::decodeBrick(size_t aBrick, void *aDestination, size_t aStrideY, size_t aStrideZ) const {
+	int brickSize = mInfo.brickSize;
+	int bricksX = (mInfo.width + brickSize - 1) / brickSize;
+	int bricksY = (mInfo.height + brickSize - 1) / brickSize;
+	int x = int(aBrick % bricksX) * brickSize;
+	int y = int(aBrick / bricksX % bricksY) * brickSize;
+	int z = int(aBrick / (size_t(bricksX) * bricksY)) * brickSize;
+	decodeVolumeBrick(mInfo.type, mFile.data() + mBrickOffsets[aBrick], mBrickOffsets[aBrick + 1] - mBrickOffsets[aBrick], aDestination,
+		aStrideY, aStrideZ, std::min(brickSize, mInfo.width - x), std::min(brickSize, mInfo.height - y), std::min(brickSize, mInfo.depth - z));
+}
+
+BrickGridBuilder::BrickGridBuilder(const VolumeInfo &aInfo, int aBrickSize)
+	: mInfo(aInfo)
+{
+	mGrid.brickSize = aBrickSize;
+	mGrid.width = (aInfo.width + aBrickSize - 1) / aBrickSize;
+	mGrid.height = (aInfo.height + aBrickSize - 1) / aBrickSize;
+	mGrid.depth = (aInfo.depth + aBrickSize - 1) / aBrickSize;
+	mGrid.ranges.resize(size_t(mGrid.width) * mGrid.height * mGrid.depth);
+	for (int z = 0; z < mGrid.depth; ++z) {
+		for (int y = 0; y < mGrid.height; ++y) {
+			for (int x = 0; x < mGrid.width; ++x) {
+				if (mGrid.isOnFace(x, y, z)) {
+					mGrid.at(x, y, z) = VoxelRange{ 0.0f, 0.0f };
+				}
+			}
+		}
+	}
+	mRowRanges.resize(mGrid.width);
+}
+
+void BrickGridBuilder::addSlab(int aFirstSlice, int aSliceCount, const void *aVoxels) {
+	int brickSize = mGrid.brickSize;
+	size_t voxelSize = getVoxelSize(mInfo.type);
+	auto voxels = static_cast<const uint8_t *>(aVoxels);
+	// Bricks whose one voxel border contains the coordinate
+	auto brickSpan = [brickSize](int aCoordinate, int aExtent) {
+		return std::pair{ std::max(aCoordinate - 1, 0) / brickSize, std::min(aCoordinate + 1, aExtent - 1) / brickSize };
+	};
+
+	for (int slice = 0; slice < aSliceCount; ++slice) {
+		auto [firstBrickZ, lastBrickZ] = brickSpan(aFirstSlice + slice, mInfo.depth);
+		for (int y = 0; y < mInfo.height; ++y) {
+			const uint8_t *row = voxels + (size_t(slice) * mInfo.height + y) * mInfo.width * voxelSize;
+			for (int brickX = 0; brickX < mGrid.width; ++brickX) {
+				int begin = std::max(brickX * brickSize - 1, 0);
+				int end = std::min((brickX + 1) * brickSize + 1, mInfo.width);
+				mRowRanges[brickX] = copyVoxels(mInfo.type, row + begin * voxelSize, nullptr, end - begin);
+			}
+			auto [firstBrickY, lastBrickY] = brickSpan(y, mInfo.height);
+			for (int brickZ = firstBrickZ; brickZ <= lastBrickZ; ++brickZ) {
+				for (int brickY = firstBrickY; brickY <= lastBrickY; ++brickY) {
+					for (int brickX = 0; brickX < mGrid.width; ++brickX) {
+						mGrid.at(brickX, brickY, brickZ).merge(mRowRanges[brickX]);
+					}
+				}
+			}
+		}
+	}
+}
+
+std::unique_ptr<VolumeData> load3DFile(const fs::path& aFilePath) {
+	VolumeReader reader(aFilePath);
+	const auto &info = reader.info();
+	auto volume = std::make_unique<VolumeData>();
+	volume->width = info.width;
+	volume->height = info.height;
+	volume->depth = info.depth;
+	switch (info.type) {
+	case VoxelType::UInt8: volume->data = std::vector<uint8_t>(); break;
+	case VoxelType::UInt16: volume->data = std::vector<uint16_t>(); break;
+	case VoxelType::Float32: volume->data = std::vector<float>(); break;
+	}
+
+	std::visit([&](auto&& arg) {
+			size_t sliceVoxels = size_t(info.width) * info.height;
+			arg.resize(sliceVoxels * info.depth);
+			reader.forEachSlab(16, [&](int aFirstSlice, int aSliceCount, const void *aVoxels) {
+				volume->range.merge(copyVoxels(info.type, aVoxels, arg.data() + aFirstSlice * sliceVoxels, aSliceCount * sliceVoxels));
+			});
+		}, volume->data);
+
+	std::cout << "Minimum value: " << volume->range.minimum << std::endl;
+	std::cout << "Maximum value: " << volume->range.maximum << std::endl;
+	return volume;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <variant>
+#include <memory>
+#include <filesystem>
+#include <algorithm>
+#include <limits>
+
+#include "mapped_file.hpp"
+
+namespace fs = std::filesystem;
+
+class ThreadPool;
+
+enum class VoxelType {
+	UInt8,
+	UInt16,
+	Float32
+};
+
+size_t getVoxelSize(VoxelType aType);
+
+/**
+ * Factor mapping stored voxel values to the values shaders sample - integer volumes are uploaded as normalized GL_R8/GL_R16.
+ */
+float getVoxelScale(VoxelType aType);
+
+/**
+ * Voxel value range, integer values are exactly representable.
+ */
+struct VoxelRange {
+	float minimum = std::numeric_limits<float>::max();
+	float maximum = std::numeric_limits<float>::lowest();
+
+	void merge(const VoxelRange &aOther) {
+		minimum = std::min(minimum, aOther.minimum);
+		maximum = std::max(maximum, aOther.maximum);
+	}
+};
+
+/**
+ * Layout of the raw voxels of a .mhd/.raw pair or a .dump file, or of the bricks of a .bvol file (see volume_compression.hpp).
+ */
+struct VolumeInfo {
+	fs::path dataFile;
+	size_t dataOffset = 0; ///< Start of the voxels in dataFile, or of the brick offsets of a compressed file
+	int width = 0;
+	int height = 0;
+	int depth = 0;
+	VoxelType type = VoxelType::UInt16;
+	int brickSize = 0; ///< Edge of the independently compressed bricks, 0 for raw voxels
+
+	size_t sliceSize() const {
+		return size_t(width) * height * getVoxelSize(type);
+	}
+};
+
+/**
+ * Parses the .mhd, .dump or .bvol header, the voxel data are not touched.
+ */
+VolumeInfo readVolumeInfo(const fs::path &aFilePath);
+
+/**
+ * @brief Copies aCount voxels and returns their value range - a single SIMD pass over the data.
+ *
+ * aDestination may be nullptr to only compute the range.
+ */
+VoxelRange copyVoxels(VoxelType aType, const void *aSource, void *aDestination, size_t aCount);
+
+/**
+ * @brief Streams the voxels of a volume file in Z-slabs straight from a memory mapping.
+ *
+ * The next slab is prefetched while the current one is processed and the pages of processed
+ * slabs are dropped, so the resident memory stays around two slabs regardless of the volume size.
+ * Slabs of a compressed file cover whole brick layers, their bricks are decoded in parallel on aPool if given.
+ */
+class VolumeReader {
+public:
+	explicit VolumeReader(const fs::path &aFilePath, ThreadPool *aPool = nullptr);
+
+	const VolumeInfo &info() const {
+		return mInfo;
+	}
+
+	bool isCompressed() const {
+		return mInfo.brickSize > 0;
+	}
+
+	/**
+	 * Calls aConsumer(firstSlice, sliceCount, const void *voxels) for consecutive slabs of at most aSlicesPerSlab slices.
+	 */
+	template<typename TConsumer>
+	void forEachSlab(int aSlicesPerSlab, TConsumer aConsumer) const {
+		aSlicesPerSlab = std::max(1, aSlicesPerSlab);
+		size_t sliceSize = mInfo.sliceSize();
+		if (isCompressed()) {
+			aSlicesPerSlab = (aSlicesPerSlab + mInfo.brickSize - 1) / mInfo.brickSize * mInfo.brickSize;
+			std::vector<uint8_t> slab;
+			for (int firstSlice = 0; firstSlice < mInfo.depth; firstSlice += aSlicesPerSlab) {
+				int sliceCount = std::min(aSlicesPerSlab, mInfo.depth - firstSlice);
+				slab.resize(sliceCount * sliceSize);
+				decodeSlab(firstSlice, sliceCount, slab.data());
+				aConsumer(firstSlice, sliceCount, static_cast<const void *>(slab.data()));
+			}
+			return;
+		}
+		for (int firstSlice = 0; firstSlice < mInfo.depth; firstSlice += aSlicesPerSlab) {
+			int sliceCount = std::min(aSlicesPerSlab, mInfo.depth - firstSlice);
+			size_t offset = mInfo.dataOffset + firstSlice * sliceSize;
+			size_t size = sliceCount * sliceSize;
+			mFile.willNeed(offset + size, size);
+			aConsumer(firstSlice, sliceCount, static_cast<const void *>(mFile.data() + offset));
+			mFile.release(offset, size);
+		}
+	}
+
+	/**
+	 * @brief Copies brick (aBrickX, aBrickY, aBrickZ) of edge aBrickSize with aApron voxels of its neighbours on each side.
+	 *
+	 * aDestination receives (aBrickSize + 2 * aApron)^3 voxels, x fastest. Voxels outside the volume are zero.
+	 */
+	void readBrick(int aBrickX, int aBrickY, int aBrickZ, int aBrickSize, int aApron, void *aDestination) const;
+
+	/**
+	 * Copies the dense slices [aFirstSlice, aFirstSlice + aSliceCount), compressed files decode the brick layers they overlap.
+	 */
+	void readSlices(int aFirstSlice, int aSliceCount, void *aDestination) const;
+
+protected:
+	// Decodes the stored bricks of the brick layers [aFirstSlice, aFirstSlice + aSliceCount) into a dense slab
+	void decodeSlab(int aFirstSlice, int aSliceCount, void *aDestination) const;
+	// Decodes stored brick aBrick, its first voxel goes to aDestination
+	void decodeBrick(size_t aBrick, void *aDestination, size_t aStrideY, size_t aStrideZ) const;
+
+	VolumeInfo mInfo;
+	MappedFile mFile;
+	ThreadPool *mPool;
+	std::vector<uint64_t> mBrickOffsets; ///< Stored brick i spans [mBrickOffsets[i], mBrickOffsets[i + 1]) of a compressed file
+};
+
+/**
+ * Coarse grid of per-brick value ranges, x index runs fastest.
+ * Each brick range also covers the one voxel wide border of its neighbours, so it bounds
+ * every trilinearly filtered sample taken inside the brick. Bricks on the volume faces include
+ * zero, the border color the samples there blend in.
+ */
+struct BrickGrid {
+	int brickSize = 16;
+	int width = 0; ///< Number of bricks along x
+	int height = 0;
+	int depth = 0;
+	std::vector<VoxelRange> ranges;
+
+	VoxelRange &at(int aX, int aY, int aZ) {
+		return ranges[(size_t(aZ) * height + aY) * width + aX];
+	}
+	const VoxelRange &at(int aX, int aY, int aZ) const {
+		return ranges[(size_t(aZ) * height + aY) * width + aX];
+	}
+
+	bool isOnFace(int aX, int aY, int aZ) const {
+		return aX == 0 || aY == 0 || aZ == 0 || aX == width - 1 || aY == height - 1 || aZ == depth - 1;
+	}
+};
+
+/**
+ * Accumulates the brick grid from the slabs produced by VolumeReader::forEachSlab(), slabs may come in any order.
+ */
+class BrickGridBuilder {
+public:
+	BrickGridBuilder(const VolumeInfo &aInfo, int aBrickSize = 16);
+
+	void addSlab(int aFirstSlice, int aSliceCount, const void *aVoxels);
+
+	const BrickGrid &grid() const {
+		return mGrid;
+	}
+
+protected:
+	VolumeInfo mInfo;
+	BrickGrid mGrid;
+	std::vector<VoxelRange> mRowRanges;
+};
+
+using DataBuffer = std::variant<
+			std::vector<uint8_t>,
+			std::vector<uint16_t>,
+			std::vector<float>
+			>;
+
+/**
+ * Whole volume in memory - for CPU side processing. GPU uploads stream from VolumeReader instead.
+ */
+struct VolumeData {
+	DataBuffer data;
+	int width, height, depth;
+	VoxelRange range;
+
+	VoxelType type() const {
+		if (std::holds_alternative<std::vector<uint8_t>>(data)) {
+			return VoxelType::UInt8;
+		}
+		return std::holds_alternative<std::vector<float>>(data) ? VoxelType::Float32 : VoxelType::UInt16;
+	}
+
+	const void *voxels() const {
+		return std::visit([](const auto &aBuffer) { return static_cast<const void *>(aBuffer.data()); }, data);
+	}
+};
+
+std::unique_ptr<VolumeData> load3DFile(const fs::path& aFilePath);
@@ -0,0 +1,363 @@
+#include "volume_pyramid.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VOLUME_PYRAMID_SSE2 1
+#endif
+
+namespace {
+
+// Source range of output voxel aIndex along an axis of aSize voxels - the last one also takes an odd leftover
+struct BlockSpan {
+	int begin;
+	int end;
+};
+
+BlockSpan getBlockSpan(int aIndex, int aSize) {
+	int outputSize = std::max(1, aSize / 2);
+	return { 2 * aIndex, aIndex == outputSize - 1 ? aSize : 2 * aIndex + 2 };
+}
+
+// Element-wise maximum of aRows into aOutput
+void maxRows(const uint8_t *const *aRows, size_t aRowCount, int aWidth, uint8_t *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	for (; x + 16 <= aWidth; x += 16) {
+		__m128i maximum = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aRows[0] + x));
+		for (size_t row = 1; row < aRowCount; ++row) {
+			maximum = _mm_max_epu8(maximum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(aRows[row] + x)));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(aOutput + x), maximum);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		uint8_t maximum = aRows[0][x];
+		for (size_t row = 1; row < aRowCount; ++row) {
+			maximum = std::max(maximum, aRows[row][x]);
+		}
+		aOutput[x] = maximum;
+	}
+}
+
+void maxRows(const uint16_t *const *aRows, size_t aRowCount, int aWidth, uint16_t *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	// SSE2 has only signed 16-bit max - flipping the sign bit maps the unsigned order onto the signed one
+	const __m128i bias = _mm_set1_epi16(int16_t(0x8000));
+	for (; x + 8 <= aWidth; x += 8) {
+		__m128i maximum = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(aRows[0] + x)), bias);
+		for (size_t row = 1; row < aRowCount; ++row) {
+			maximum = _mm_max_epi16(maximum, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(aRows[row] + x)), bias));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(aOutput + x), _mm_xor_si128(maximum, bias));
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		uint16_t maximum = aRows[0][x];
+		for (size_t row = 1; row < aRowCount; ++row) {
+			maximum = std::max(maximum, aRows[row][x]);
+		}
+		aOutput[x] = maximum;
+	}
+}
+
+void maxRows(const float *const *aRows, size_t aRowCount, int aWidth, float *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	for (; x + 4 <= aWidth; x += 4) {
+		__m128 maximum = _mm_loadu_ps(aRows[0] + x);
+		for (size_t row = 1; row < aRowCount; ++row) {
+			maximum = _mm_max_ps(maximum, _mm_loadu_ps(aRows[row] + x));
+		}
+		_mm_storeu_ps(aOutput + x, maximum);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		float maximum = aRows[0][x];
+		for (size_t row = 1; row < aRowCount; ++row) {
+			maximum = std::max(maximum, aRows[row][x]);
+		}
+		aOutput[x] = maximum;
+	}
+}
+
+// Maximum of the horizontal pairs of aColumn, the first aPairCount outputs
+int maxPairs(const uint8_t *aColumn, int aPairCount, uint8_t *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+	for (; x + 16 <= aPairCount; x += 16) {
+		__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aColumn + 2 * x));
+		__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aColumn + 2 * x + 16));
+		// The odd byte of each pair moves onto the even one, the masked even bytes pack without saturating
+		low = _mm_and_si128(_mm_max_epu8(low, _mm_srli_epi16(low, 8)), lowBytes);
+		high = _mm_and_si128(_mm_max_epu8(high, _mm_srli_epi16(high, 8)), lowBytes);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(aOutput + x), _mm_packus_epi16(low, high));
+	}
+#endif
+	for (; x < aPairCount; ++x) {
+		aOutput[x] = std::max(aColumn[2 * x], aColumn[2 * x + 1]);
+	}
+	return x;
+}
+
+int maxPairs(const uint16_t *aColumn, int aPairCount, uint16_t *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	const __m128i bias = _mm_set1_epi16(int16_t(0x8000));
+	for (; x + 8 <= aPairCount; x += 8) {
+		__m128i low = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(aColumn + 2 * x)), bias);
+		__m128i high = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(aColumn + 2 * x + 8)), bias);
+		// The odd element of each pair moves onto the even one, the sign extended even lanes pack exactly
+		low = _mm_max_epi16(low, _mm_srli_epi32(low, 16));
+		high = _mm_max_epi16(high, _mm_srli_epi32(high, 16));
+		low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+		high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(aOutput + x), _mm_xor_si128(_mm_packs_epi32(low, high), bias));
+	}
+#endif
+	for (; x < aPairCount; ++x) {
+		aOutput[x] = std::max(aColumn[2 * x], aColumn[2 * x + 1]);
+	}
+	return x;
+}
+
+int maxPairs(const float *aColumn, int aPairCount, float *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	for (; x + 4 <= aPairCount; x += 4) {
+		__m128 first = _mm_loadu_ps(aColumn + 2 * x);
+		__m128 second = _mm_loadu_ps(aColumn + 2 * x + 4);
+		__m128 even = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 odd = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(aOutput + x, _mm_max_ps(even, odd));
+	}
+#endif
+	for (; x < aPairCount; ++x) {
+		aOutput[x] = std::max(aColumn[2 * x], aColumn[2 * x + 1]);
+	}
+	return x;
+}
+
+// Element-wise sum of aRows into aOutput
+void sumRows(const uint8_t *const *aRows, size_t aRowCount, int aWidth, float *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 8 <= aWidth; x += 8) {
+		__m128 low = _mm_setzero_ps();
+		__m128 high = _mm_setzero_ps();
+		for (size_t row = 0; row < aRowCount; ++row) {
+			__m128i values = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(aRows[row] + x)), zero);
+			low = _mm_add_ps(low, _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero)));
+			high = _mm_add_ps(high, _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero)));
+		}
+		_mm_storeu_ps(aOutput + x, low);
+		_mm_storeu_ps(aOutput + x + 4, high);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		float sum = 0.0f;
+		for (size_t row = 0; row < aRowCount; ++row) {
+			sum += aRows[row][x];
+		}
+		aOutput[x] = sum;
+	}
+}
+
+void sumRows(const uint16_t *const *aRows, size_t aRowCount, int aWidth, float *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 8 <= aWidth; x += 8) {
+		__m128 low = _mm_setzero_ps();
+		__m128 high = _mm_setzero_ps();
+		for (size_t row = 0; row < aRowCount; ++row) {
+			__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aRows[row] + x));
+			low = _mm_add_ps(low, _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero)));
+			high = _mm_add_ps(high, _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero)));
+		}
+		_mm_storeu_ps(aOutput + x, low);
+		_mm_storeu_ps(aOutput + x + 4, high);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		float sum = 0.0f;
+		for (size_t row = 0; row < aRowCount; ++row) {
+			sum += aRows[row][x];
+		}
+		aOutput[x] = sum;
+	}
+}
+
+void sumRows(const float *const *aRows, size_t aRowCount, int aWidth, float *aOutput) {
+	int x = 0;
+#ifdef VOLUME_PYRAMID_SSE2
+	for (; x + 4 <= aWidth; x += 4) {
+		__m128 sum = _mm_setzero_ps();
+		for (size_t row = 0; row < aRowCount; ++row) {
+			sum = _mm_add_ps(sum, _mm_loadu_ps(aRows[row] + x));
+		}
+		_mm_storeu_ps(aOutput + x, sum);
+	}
+#endif
+	for (; x < aWidth; ++x) {
+		float sum = 0.0f;
+		for (size_t row = 0; row < aRowCount; ++row) {
+			sum += aRows[row][x];
+		}
+		aOutput[x] = sum;
+	}
+}
+
+uint8_t toVoxel(float aValue, uint8_t) {
+	return uint8_t(std::clamp(aValue + 0.5f, 0.0f, 255.0f));
+}
+
+uint16_t toVoxel(float aValue, uint16_t) {
+	return uint16_t(std::clamp(aValue + 0.5f, 0.0f, 65535.0f));
+}
+
+float toVoxel(float aValue, float) {
+	return aValue;
+}
+
+// Reduces output rows [aBeginRow, aEndRow) of one output slice from the source rows of its 2 or 3 input slices
+template<typename TVoxel>
+void reduceRows(
+	VolumeReduction aReduction,
+	const std::vector<const TVoxel *> &aSlices,
+	int aWidth,
+	int aHeight,
+	size_t aBeginRow,
+	size_t aEndRow,
+	TVoxel *aOutput)
+{
+	int outputWidth = std::max(1, aWidth / 2);
+	// Pairs below the last output voxel, which also takes the leftover of an odd width
+	int pairCount = outputWidth - 1;
+	std::vector<TVoxel> column(aReduction == VolumeReduction::Maximum ? aWidth : 0);
+	std::vector<float> sums(aReduction == VolumeReduction::Average ? aWidth : 0);
+	std::vector<const TVoxel *> rows;
+	for (size_t y = aBeginRow; y < aEndRow; ++y) {
+		auto span = getBlockSpan(int(y), aHeight);
+		rows.clear();
+		for (const TVoxel *slice : aSlices) {
+			for (int sourceY = span.begin; sourceY < span.end; ++sourceY) {
+				rows.push_back(slice + size_t(sourceY) * aWidth);
+			}
+		}
+		TVoxel *output = aOutput + y * outputWidth;
+		auto last = getBlockSpan(outputWidth - 1, aWidth);
+		if (aReduction == VolumeReduction::Maximum) {
+			maxRows(rows.data(), rows.size(), aWidth, column.data());
+			maxPairs(column.data(), pairCount, output);
+			output[outputWidth - 1] = *std::max_element(column.begin() + last.begin, column.begin() + last.end);
+		} else {
+			sumRows(rows.data(), rows.size(), aWidth, sums.data());
+			float scale = 1.0f / float(2 * rows.size());
+			for (int x = 0; x < pairCount; ++x) {
+				output[x] = toVoxel((sums[2 * x] + sums[2 * x + 1]) * scale, TVoxel());
+			}
+			float sum = 0.0f;
+			for (int x = last.begin; x < last.end; ++x) {
+				sum += sums[x];
+			}
+			output[outputWidth - 1] = toVoxel(sum / float((last.end - last.begin) * rows.size()), TVoxel());
+		}
+	}
+}
+
+} // namespace
+
+VolumePyramidBuilder::VolumePyramidBuilder(const VolumeInfo &aInfo, VolumeReduction aReduction, ThreadPool *aPool)
+	: mType(aInfo.type)
+	, mReduction(aReduction)
+	, mPool(aPool)
+{
+	int width = aInfo.width;
+	int height = aInfo.height;
+	int depth = aInfo.depth;
+	size_t voxelSize = getVoxelSize(mType);
+	while (width > 1 || height > 1 || depth > 1) {
+		PendingSlices input;
+		input.width = width;
+		input.height = height;
+		input.depth = depth;
+		mInputs.push_back(std::move(input));
+
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		depth = std::max(1, depth / 2);
+		VolumeLevel level;
+		level.width = width;
+		level.height = height;
+		level.depth = depth;
+		level.voxels.resize(size_t(width) * height * depth * voxelSize);
+		mLevels.push_back(std::move(level));
+	}
+}
+
+void VolumePyramidBuilder::addSlab(int aFirstSlice, int aSliceCount, const void *aVoxels) {
+	if (mInputs.empty()) {
+		return;
+	}
+	if (aFirstSlice != mInputs[0].nextSlice) {
+		throw std::runtime_error("Volume pyramid slabs have to come in the slice order");
+	}
+	size_t sliceSize = size_t(mInputs[0].width) * mInputs[0].height * getVoxelSize(mType);
+	const uint8_t *voxels = static_cast<const uint8_t *>(aVoxels);
+	for (int slice = 0; slice < aSliceCount; ++slice) {
+		addSlice(0, voxels + slice * sliceSize);
+	}
+}
+
+void VolumePyramidBuilder::addSlice(size_t aLevel, const uint8_t *aSlice) {
+	auto &input = mInputs[aLevel];
+	size_t voxelSize = getVoxelSize(mType);
+	size_t sliceSize = size_t(input.width) * input.height * voxelSize;
+	input.slices.emplace_back(aSlice, aSlice + sliceSize);
+	++input.nextSlice;
+
+	// Output slice whose block the buffered slices start
+	int outputSlice = (input.nextSlice - int(input.slices.size())) / 2;
+	auto span = getBlockSpan(outputSlice, input.depth);
+	if (input.nextSlice < span.end) {
+		return;
+	}
+
+	auto &level = mLevels[aLevel];
+	size_t outputSliceSize = size_t(level.width) * level.height * voxelSize;
+	uint8_t *output = level.voxels.data() + outputSlice * outputSliceSize;
+	auto reduce = [&](auto aVoxel) {
+		using Voxel = decltype(aVoxel);
+		std::vector<const Voxel *> slices;
+		for (const auto &slice : input.slices) {
+			slices.push_back(reinterpret_cast<const Voxel *>(slice.data()));
+		}
+		auto function = [&](size_t aBegin, size_t aEnd) {
+			reduceRows(mReduction, slices, input.width, input.height, aBegin, aEnd, reinterpret_cast<Voxel *>(output));
+		};
+		constexpr size_t cRowsPerChunk = 16;
+		if (mPool && size_t(level.height) > cRowsPerChunk) {
+			parallelFor(*mPool, 0, size_t(level.height), cRowsPerChunk, function);
+		} else {
+			function(0, size_t(level.height));
+		}
+	};
+	switch (mType) {
+	case VoxelType::UInt8: reduce(uint8_t()); break;
+	case VoxelType::UInt16: reduce(uint16_t()); break;
+	case VoxelType::Float32: reduce(float()); break;
+	}
+	input.slices.clear();
+
+	if (aLevel + 1 < mInputs.size()) {
+		addSlice(aLevel + 1, output);
+	}
+}
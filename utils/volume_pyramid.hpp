@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "volume_data.hpp"
+#include "thread_pool.hpp"
+
+enum class VolumeReduction {
+	Maximum, ///< Keeps the brightest voxel - MIP of a coarse level never loses a structure
+	Average
+};
+
+/**
+ * One level of a volume pyramid, voxels of the source VoxelType, x fastest.
+ */
+struct VolumeLevel {
+	int width = 0;
+	int height = 0;
+	int depth = 0;
+	std::vector<uint8_t> voxels;
+};
+
+/**
+ * @brief Builds the 3D mip chain of a volume while its slabs stream by, see VolumeReader::forEachSlab().
+ *
+ * Level sizes follow GL (floor(n / 2), at least 1) down to 1x1x1. On odd sizes the last voxel of
+ * each axis is folded into the last voxel of the next level, so no source voxel is dropped.
+ * Only the incomplete 2x2x2 blocks are buffered, the finished levels (1/7 of the source) are kept.
+ * Rows of each output slice are distributed over aPool if given.
+ */
+class VolumePyramidBuilder {
+public:
+	VolumePyramidBuilder(const VolumeInfo &aInfo, VolumeReduction aReduction, ThreadPool *aPool = nullptr);
+
+	/**
+	 * Slabs have to come in the slice order.
+	 */
+	void addSlab(int aFirstSlice, int aSliceCount, const void *aVoxels);
+
+	/**
+	 * Levels 1 to n, complete once all slices were added.
+	 */
+	const std::vector<VolumeLevel> &levels() const {
+		return mLevels;
+	}
+
+protected:
+	// Feeds one slice of level aLevel (0 is the source), reduces it once its block of slices is complete
+	void addSlice(size_t aLevel, const uint8_t *aSlice);
+
+	VoxelType mType;
+	VolumeReduction mReduction;
+	ThreadPool *mPool;
+	// mInputs[l] - slices of level l waiting for the rest of their block
+	struct PendingSlices {
+		int width = 0;
+		int height = 0;
+		int depth = 0;
+		int nextSlice = 0;
+		std::vector<std::vector<uint8_t>> slices;
+	};
+	std::vector<PendingSlices> mInputs;
+	std::vector<VolumeLevel> mLevels;
+};
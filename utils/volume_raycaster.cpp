@@ -0,0 +1,152 @@
+#include "volume_raycaster.hpp"
+
+#include <cmath>
+
+VolumeRaycaster::VolumeRaycaster(const VolumeData &aVolume, int aBrickSize, ThreadPool *aPool)
+	: mVolume(aVolume)
+	, mSize(aVolume.width, aVolume.height, aVolume.depth)
+	, mScale(getVoxelScale(aVolume.type()))
+	, mBrickSize(aBrickSize)
+	, mBricks(buildBrickGrid(aVolume, aBrickSize, aPool))
+	, mOctree(buildMinMaxOctree(mBricks, aPool))
+{
+	setIsoValue(0.0f);
+}
+
+void VolumeRaycaster::setIsoValue(float aIsoValue) {
+	mIsoValue = aIsoValue;
+	mDistance = computeEmptySpaceDistance(mBricks, aIsoValue / mScale);
+}
+
+float VolumeRaycaster::voxel(int aX, int aY, int aZ) const {
+	// GL_CLAMP_TO_BORDER with the default black border
+	if (aX < 0 || aY < 0 || aZ < 0 || aX >= mSize.x || aY >= mSize.y || aZ >= mSize.z) {
+		return 0.0f;
+	}
+	size_t index = (size_t(aZ) * mSize.y + aY) * mSize.x + aX;
+	return std::visit([&](const auto &aBuffer) { return float(aBuffer[index]); }, mVolume.data) * mScale;
+}
+
+float VolumeRaycaster::sample(glm::vec3 aTexCoords) const {
+	glm::vec3 position = aTexCoords * glm::vec3(mSize) - glm::vec3(0.5f);
+	glm::vec3 base = glm::floor(position);
+	glm::vec3 weight = position - base;
+	glm::ivec3 corner(base);
+
+	float result = 0.0f;
+	for (int dz = 0; dz <= 1; ++dz) {
+		for (int dy = 0; dy <= 1; ++dy) {
+			for (int dx = 0; dx <= 1; ++dx) {
+				float w = (dx ? weight.x : 1.0f - weight.x) * (dy ? weight.y : 1.0f - weight.y) * (dz ? weight.z : 1.0f - weight.z);
+				result += w * voxel(corner.x + dx, corner.y + dy, corner.z + dz);
+			}
+		}
+	}
+	return result;
+}
+
+glm::vec3 VolumeRaycaster::gradient(glm::vec3 aTexCoords) const {
+	glm::vec3 offset = 1.0f / glm::vec3(mSize);
+	return glm::vec3(
+		sample(aTexCoords + glm::vec3(offset.x, 0.0f, 0.0f)) - sample(aTexCoords - glm::vec3(offset.x, 0.0f, 0.0f)),
+		sample(aTexCoords + glm::vec3(0.0f, offset.y, 0.0f)) - sample(aTexCoords - glm::vec3(0.0f, offset.y, 0.0f)),
+		sample(aTexCoords + glm::vec3(0.0f, 0.0f, offset.z)) - sample(aTexCoords - glm::vec3(0.0f, 0.0f, offset.z)));
+}
+
+std::optional<std::pair<float, float>> VolumeRaycaster::intersectCube(glm::vec3 aOrigin, glm::vec3 aDirection) {
+	glm::vec3 invDirection = 1.0f / aDirection;
+	glm::vec3 t1 = (glm::vec3(-0.5f) - aOrigin) * invDirection;
+	glm::vec3 t2 = (glm::vec3(0.5f) - aOrigin) * invDirection;
+	glm::vec3 tMin = glm::min(t1, t2);
+	glm::vec3 tMax = glm::max(t1, t2);
+	float entry = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+	float exit = std::min(std::min(tMax.x, tMax.y), tMax.z);
+	if (exit <= entry) {
+		return std::nullopt;
+	}
+	return std::pair{ entry, exit };
+}
+
+float VolumeRaycaster::exitDistance(glm::vec3 aBoxStart, glm::vec3 aBoxEnd, glm::vec3 aEntryPoint, glm::vec3 aDirection) const {
+	glm::vec3 start = aBoxStart / glm::vec3(mSize) - glm::vec3(0.5f);
+	glm::vec3 end = aBoxEnd / glm::vec3(mSize) - glm::vec3(0.5f);
+	glm::vec3 invDirection = 1.0f / aDirection;
+	glm::vec3 t = glm::max((start - aEntryPoint) * invDirection, (end - aEntryPoint) * invDirection);
+	return std::min(std::min(t.x, t.y), t.z);
+}
+
+IsosurfaceHit VolumeRaycaster::traceIsosurface(glm::vec3 aEntryPoint, glm::vec3 aDirection, float aStepSize, int aMaxSampleCount, SpaceSkipping aSkipping) const {
+	IsosurfaceHit result;
+	auto cubeExit = intersectCube(aEntryPoint, aDirection);
+	if (!cubeExit) {
+		return result;
+	}
+	int stepCount = std::min(aMaxSampleCount, int(cubeExit->second / aStepSize));
+	glm::ivec3 leafCount(mBricks.width, mBricks.height, mBricks.depth);
+	float maxSize = float(std::max(std::max(mSize.x, mSize.y), mSize.z));
+
+	// Side of the iso value the previous step lies on - skipped steps keep the side of the sample before them
+	bool previousAbove = false;
+	bool hasPrevious = false;
+	int i = 0;
+	while (i < stepCount) {
+		float t = i * aStepSize;
+		glm::vec3 texCoords = aEntryPoint + t * aDirection + glm::vec3(0.5f);
+		if (aSkipping != SpaceSkipping::None) {
+			glm::ivec3 leaf = glm::clamp(glm::ivec3(texCoords * glm::vec3(mSize)) / mBrickSize, glm::ivec3(0), leafCount - 1);
+			const auto &range = mOctree.levels[0].at(leaf.x, leaf.y, leaf.z);
+			float isoValue = mIsoValue / mScale;
+			bool rangeAbove = range.minimum > isoValue;
+			// An empty region on the other side of the iso value means a crossing right before it - sample it
+			if (!containsValue(range, isoValue) && (!hasPrevious || previousAbove == rangeAbove)) {
+				int level = 0;
+				float skipEnd = 0.0f;
+				if (aSkipping == SpaceSkipping::Octree) {
+					while (level + 1 < int(mOctree.levels.size())) {
+						glm::ivec3 parent = leaf >> (level + 1);
+						if (containsValue(mOctree.levels[level + 1].at(parent.x, parent.y, parent.z), isoValue)) {
+							break;
+						}
+						++level;
+					}
+				} else {
+					float distance = mDistance[(size_t(leaf.z) * leafCount.y + leaf.y) * leafCount.x + leaf.x];
+					skipEnd = t + (distance - 1.0f) * mBrickSize / maxSize;
+				}
+				glm::ivec3 node = leaf >> level;
+				int nodeSize = mBrickSize << level;
+				float nodeExit = exitDistance(glm::vec3(node * nodeSize), glm::vec3((node + 1) * nodeSize), aEntryPoint, aDirection);
+				i = std::max({ i + 1, int(std::floor(nodeExit / aStepSize)) + 1, int(std::floor(skipEnd / aStepSize)) });
+				previousAbove = rangeAbove;
+				hasPrevious = true;
+				++result.skipCount;
+				continue;
+			}
+		}
+
+		float value = sample(texCoords);
+		++result.sampleCount;
+		bool above = value > mIsoValue;
+		if (hasPrevious && above != previousAbove) {
+			// The step before lies on the previous side, bisect the last step
+			float low = t - aStepSize;
+			float high = t;
+			for (int step = 0; step < cRefinementSteps; ++step) {
+				float middle = 0.5f * (low + high);
+				++result.sampleCount;
+				if ((sample(aEntryPoint + middle * aDirection + glm::vec3(0.5f)) > mIsoValue) == previousAbove) {
+					low = middle;
+				} else {
+					high = middle;
+				}
+			}
+			result.hit = true;
+			result.distance = 0.5f * (low + high);
+			return result;
+		}
+		previousAbove = above;
+		hasPrevious = true;
+		++i;
+	}
+	return result;
+}
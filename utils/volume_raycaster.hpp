@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+
+#include <glm/glm.hpp>
+
+#include "volume_acceleration.hpp"
+
+enum class SpaceSkipping {
+	None,         ///< March every step
+	Octree,       ///< Jump over the largest empty min-max octree node
+	DistanceField ///< Jump by the brick distance to the nearest possible surface
+};
+
+struct IsosurfaceHit {
+	bool hit = false;
+	float distance = 0.0f; ///< Along the ray from the entry point, in the local cube units
+	int sampleCount = 0;   ///< Volume samples taken including the refinement
+	int skipCount = 0;     ///< Jumps over empty space - each costs acceleration structure lookups instead
+};
+
+/**
+ * @brief CPU reference of the isosurface raycaster in shaders/isosurface.fragment.glsl.
+ *
+ * The volume is mapped to the cube [-0.5, 0.5]^3 like on the GPU, sampling emulates a trilinearly
+ * filtered texture with normalized values. Rays sample at the same positions in all skipping modes
+ * and refine crossings over the same interval, so the modes produce identical hits - the accelerated
+ * ones only take fewer samples.
+ */
+class VolumeRaycaster {
+public:
+	static constexpr int cRefinementSteps = 6;
+
+	VolumeRaycaster(const VolumeData &aVolume, int aBrickSize = 16, ThreadPool *aPool = nullptr);
+
+	/**
+	 * Iso value in the normalized sampled units, rebuilds the distance field.
+	 */
+	void setIsoValue(float aIsoValue);
+
+	float isoValue() const {
+		return mIsoValue;
+	}
+
+	float sample(glm::vec3 aTexCoords) const;
+	glm::vec3 gradient(glm::vec3 aTexCoords) const;
+
+	/**
+	 * @brief Marches the ray from aEntryPoint (on or inside the cube) in direction aDirection (normalized).
+	 */
+	IsosurfaceHit traceIsosurface(glm::vec3 aEntryPoint, glm::vec3 aDirection, float aStepSize, int aMaxSampleCount, SpaceSkipping aSkipping) const;
+
+	const MinMaxOctree &octree() const {
+		return mOctree;
+	}
+
+	const std::vector<float> &distanceField() const {
+		return mDistance;
+	}
+
+	static std::optional<std::pair<float, float>> intersectCube(glm::vec3 aOrigin, glm::vec3 aDirection);
+
+protected:
+	float voxel(int aX, int aY, int aZ) const;
+	// Distance along the ray at which it leaves the box given in voxels
+	float exitDistance(glm::vec3 aBoxStart, glm::vec3 aBoxEnd, glm::vec3 aEntryPoint, glm::vec3 aDirection) const;
+
+	const VolumeData &mVolume;
+	glm::ivec3 mSize;
+	float mScale;
+	float mIsoValue = 0.0f;
+	int mBrickSize;
+	BrickGrid mBricks;
+	MinMaxOctree mOctree;
+	std::vector<float> mDistance;
+};
@@ -0,0 +1,276 @@
+#include "volume_reference_renderer.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+
+#include "volume_raycaster.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VOLUME_REFERENCE_SSE2 1
+#endif
+
+namespace {
+
+// Keeps the trilinear footprint inside the padded volume for coordinates slightly outside the cube
+constexpr float cEdgeMargin = 1e-3f;
+
+float applyWindow(float aValue, glm::vec2 aWindow) {
+	return std::clamp((aValue - aWindow.x) / (aWindow.y - aWindow.x), 0.0f, 1.0f);
+}
+
+// Slice coordinate of animated_texture.fragment.glsl - bounces between 0 and 1
+float getSliceCoordinate(const SliceSettings &aSettings) {
+	float time = aSettings.speed * aSettings.elapsedTime;
+	return std::abs(time - float(int(time / 2.0f)) * 2.0f - 1.0f);
+}
+
+} // namespace
+
+std::vector<uint8_t> ReferenceImage::toBytes() const {
+	std::vector<uint8_t> bytes(values.size());
+	for (size_t i = 0; i < values.size(); ++i) {
+		bytes[i] = uint8_t(std::clamp(values[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+	return bytes;
+}
+
+VolumeReferenceRenderer::VolumeReferenceRenderer(const VolumeData &aVolume, ThreadPool *aPool)
+	: mSize(aVolume.width, aVolume.height, aVolume.depth)
+	, mPaddedSize(mSize + 2)
+	, mVoxels(size_t(mPaddedSize.x) * mPaddedSize.y * mPaddedSize.z, 0.0f)
+	, mPool(aPool)
+{
+	float scale = getVoxelScale(aVolume.type());
+	std::visit([&](const auto &aBuffer) {
+		for (int z = 0; z < mSize.z; ++z) {
+			for (int y = 0; y < mSize.y; ++y) {
+				const auto *source = &aBuffer[(size_t(z) * mSize.y + y) * mSize.x];
+				float *destination = &mVoxels[((size_t(z) + 1) * mPaddedSize.y + y + 1) * mPaddedSize.x + 1];
+				for (int x = 0; x < mSize.x; ++x) {
+					destination[x] = float(source[x]) * scale;
+				}
+			}
+		}
+	}, aVolume.data);
+}
+
+float VolumeReferenceRenderer::sample(glm::vec3 aTexCoords) const {
+	// Voxel centers of the padded volume lie at integer coordinates
+	glm::vec3 position = glm::clamp(aTexCoords * glm::vec3(mSize) + glm::vec3(0.5f), glm::vec3(0.0f), glm::vec3(mPaddedSize - 1) - cEdgeMargin);
+	glm::ivec3 base(position);
+	glm::vec3 weight = position - glm::vec3(base);
+
+	size_t strideY = size_t(mPaddedSize.x);
+	size_t strideZ = strideY * mPaddedSize.y;
+	const float *corner = &mVoxels[base.z * strideZ + base.y * strideY + base.x];
+	float c00 = corner[0] + (corner[1] - corner[0]) * weight.x;
+	float c10 = corner[strideY] + (corner[strideY + 1] - corner[strideY]) * weight.x;
+	float c01 = corner[strideZ] + (corner[strideZ + 1] - corner[strideZ]) * weight.x;
+	float c11 = corner[strideZ + strideY] + (corner[strideZ + strideY + 1] - corner[strideZ + strideY]) * weight.x;
+	float c0 = c00 + (c10 - c00) * weight.y;
+	float c1 = c01 + (c11 - c01) * weight.y;
+	return c0 + (c1 - c0) * weight.z;
+}
+
+void VolumeReferenceRenderer::samplePacket(const float *aX, const float *aY, const float *aZ, float *aValues) const {
+#ifdef VOLUME_REFERENCE_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+	auto toPosition = [&](const float *aCoords, int aSize, int aPaddedSize) {
+		__m128 position = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(aCoords), _mm_set1_ps(float(aSize))), half);
+		return _mm_min_ps(_mm_max_ps(position, zero), _mm_set1_ps(float(aPaddedSize - 1) - cEdgeMargin));
+	};
+	__m128 x = toPosition(aX, mSize.x, mPaddedSize.x);
+	__m128 y = toPosition(aY, mSize.y, mPaddedSize.y);
+	__m128 z = toPosition(aZ, mSize.z, mPaddedSize.z);
+	// Non-negative, truncation is the floor
+	__m128i baseX = _mm_cvttps_epi32(x);
+	__m128i baseY = _mm_cvttps_epi32(y);
+	__m128i baseZ = _mm_cvttps_epi32(z);
+	__m128 weightX = _mm_sub_ps(x, _mm_cvtepi32_ps(baseX));
+	__m128 weightY = _mm_sub_ps(y, _mm_cvtepi32_ps(baseY));
+	__m128 weightZ = _mm_sub_ps(z, _mm_cvtepi32_ps(baseZ));
+
+	alignas(16) std::array<int32_t, cPacketSize> bx, by, bz;
+	_mm_store_si128(reinterpret_cast<__m128i *>(bx.data()), baseX);
+	_mm_store_si128(reinterpret_cast<__m128i *>(by.data()), baseY);
+	_mm_store_si128(reinterpret_cast<__m128i *>(bz.data()), baseZ);
+
+	// SSE2 has no gather - the eight corners of each lane are fetched one by one
+	size_t strideY = size_t(mPaddedSize.x);
+	size_t strideZ = strideY * mPaddedSize.y;
+	alignas(16) std::array<std::array<float, cPacketSize>, 8> corners;
+	for (int lane = 0; lane < cPacketSize; ++lane) {
+		const float *corner = &mVoxels[bz[lane] * strideZ + by[lane] * strideY + bx[lane]];
+		corners[0][lane] = corner[0];
+		corners[1][lane] = corner[1];
+		corners[2][lane] = corner[strideY];
+		corners[3][lane] = corner[strideY + 1];
+		corners[4][lane] = corner[strideZ];
+		corners[5][lane] = corner[strideZ + 1];
+		corners[6][lane] = corner[strideZ + strideY];
+		corners[7][lane] = corner[strideZ + strideY + 1];
+	}
+	auto lerp = [](__m128 aFrom, __m128 aTo, __m128 aWeight) {
+		return _mm_add_ps(aFrom, _mm_mul_ps(_mm_sub_ps(aTo, aFrom), aWeight));
+	};
+	auto load = [&](int aCorner) {
+		return _mm_load_ps(corners[aCorner].data());
+	};
+	__m128 c00 = lerp(load(0), load(1), weightX);
+	__m128 c10 = lerp(load(2), load(3), weightX);
+	__m128 c01 = lerp(load(4), load(5), weightX);
+	__m128 c11 = lerp(load(6), load(7), weightX);
+	__m128 c0 = lerp(c00, c10, weightY);
+	__m128 c1 = lerp(c01, c11, weightY);
+	_mm_storeu_ps(aValues, lerp(c0, c1, weightZ));
+#else
+	for (int lane = 0; lane < cPacketSize; ++lane) {
+		aValues[lane] = sample(glm::vec3(aX[lane], aY[lane], aZ[lane]));
+	}
+#endif
+}
+
+VolumeReferenceRenderer::PixelRay VolumeReferenceRenderer::getPixelRay(const ReferenceCamera &aCamera, const MIPSettings &aSettings, int aX, int aY) const {
+	float tanHalfFov = std::tan(0.5f * aCamera.fieldOfView * std::numbers::pi_v<float> / 180.0f);
+	float aspect = float(aCamera.width) / float(aCamera.height);
+	float u = (2.0f * (aX + 0.5f) / aCamera.width - 1.0f) * tanHalfFov * aspect;
+	float v = (1.0f - 2.0f * (aY + 0.5f) / aCamera.height) * tanHalfFov;
+	glm::vec3 direction = glm::normalize(glm::vec3(-u, v, 1.0f));
+
+	// Same as the shader - the ray in the local coordinates of the scaled cube
+	PixelRay ray;
+	glm::vec3 origin = aCamera.position / aSettings.modelScale;
+	ray.direction = glm::normalize(direction / aSettings.modelScale);
+	auto cube = VolumeRaycaster::intersectCube(origin, ray.direction);
+	if (!cube) {
+		return ray;
+	}
+	ray.entryPoint = origin + cube->first * ray.direction;
+	glm::vec3 invDirection = 1.0f / ray.direction;
+	glm::vec3 t = glm::max((glm::vec3(-0.5f) - ray.entryPoint) * invDirection, (glm::vec3(0.5f) - ray.entryPoint) * invDirection);
+	float distance = std::min(std::min(t.x, t.y), t.z);
+	ray.stepCount = std::min(aSettings.maxSampleCount, int(distance / aSettings.stepSize));
+	return ray;
+}
+
+template<typename TRowFunction>
+ReferenceImage VolumeReferenceRenderer::renderTiles(int aWidth, int aHeight, TRowFunction aRenderRow) const {
+	ReferenceImage image;
+	image.width = aWidth;
+	image.height = aHeight;
+	image.values.resize(size_t(aWidth) * aHeight, 0.0f);
+	int tilesX = (aWidth + cTileSize - 1) / cTileSize;
+	int tilesY = (aHeight + cTileSize - 1) / cTileSize;
+	std::atomic<size_t> sampleCount = 0;
+	auto renderTileRange = [&](size_t aBegin, size_t aEnd) {
+		size_t samples = 0;
+		for (size_t tile = aBegin; tile < aEnd; ++tile) {
+			int x0 = int(tile % tilesX) * cTileSize;
+			int y0 = int(tile / tilesX) * cTileSize;
+			int x1 = std::min(x0 + cTileSize, aWidth);
+			for (int y = y0; y < std::min(y0 + cTileSize, aHeight); ++y) {
+				samples += aRenderRow(y, x0, x1, &image.values[size_t(y) * aWidth + x0]);
+			}
+		}
+		sampleCount += samples;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	size_t tileCount = size_t(tilesX) * tilesY;
+	if (mPool) {
+		parallelFor(*mPool, 0, tileCount, 1, renderTileRange);
+	} else {
+		renderTileRange(0, tileCount);
+	}
+	image.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	image.rayCount = size_t(aWidth) * aHeight;
+	image.sampleCount = sampleCount;
+	return image;
+}
+
+ReferenceImage VolumeReferenceRenderer::renderMIP(const ReferenceCamera &aCamera, const MIPSettings &aSettings, RayPacking aPacking) const {
+	return renderTiles(aCamera.width, aCamera.height, [&](int aY, int aBegin, int aEnd, float *aOutput) {
+		size_t samples = 0;
+		int x = aBegin;
+#ifdef VOLUME_REFERENCE_SSE2
+		for (; aPacking == RayPacking::Packets && x + cPacketSize <= aEnd; x += cPacketSize) {
+			alignas(16) std::array<float, cPacketSize> entryX, entryY, entryZ, directionX, directionY, directionZ, stepCounts;
+			int maxStepCount = 0;
+			for (int lane = 0; lane < cPacketSize; ++lane) {
+				auto ray = getPixelRay(aCamera, aSettings, x + lane, aY);
+				entryX[lane] = ray.entryPoint.x + 0.5f;
+				entryY[lane] = ray.entryPoint.y + 0.5f;
+				entryZ[lane] = ray.entryPoint.z + 0.5f;
+				directionX[lane] = ray.direction.x;
+				directionY[lane] = ray.direction.y;
+				directionZ[lane] = ray.direction.z;
+				stepCounts[lane] = float(ray.stepCount);
+				maxStepCount = std::max(maxStepCount, ray.stepCount);
+				samples += ray.stepCount;
+			}
+			__m128 counts = _mm_load_ps(stepCounts.data());
+			__m128 maximum = _mm_setzero_ps();
+			alignas(16) std::array<float, cPacketSize> texX, texY, texZ, values;
+			for (int i = 0; i < maxStepCount; ++i) {
+				// Rays which already left the cube keep their maximum
+				__m128 t = _mm_set1_ps(float(i) * aSettings.stepSize);
+				_mm_store_ps(texX.data(), _mm_add_ps(_mm_load_ps(entryX.data()), _mm_mul_ps(t, _mm_load_ps(directionX.data()))));
+				_mm_store_ps(texY.data(), _mm_add_ps(_mm_load_ps(entryY.data()), _mm_mul_ps(t, _mm_load_ps(directionY.data()))));
+				_mm_store_ps(texZ.data(), _mm_add_ps(_mm_load_ps(entryZ.data()), _mm_mul_ps(t, _mm_load_ps(directionZ.data()))));
+				samplePacket(texX.data(), texY.data(), texZ.data(), values.data());
+				__m128 active = _mm_cmplt_ps(_mm_set1_ps(float(i)), counts);
+				__m128 raised = _mm_max_ps(maximum, _mm_load_ps(values.data()));
+				maximum = _mm_or_ps(_mm_and_ps(active, raised), _mm_andnot_ps(active, maximum));
+			}
+			_mm_store_ps(values.data(), maximum);
+			for (int lane = 0; lane < cPacketSize; ++lane) {
+				aOutput[x - aBegin + lane] = stepCounts[lane] > 0.0f ? applyWindow(values[lane], aSettings.intensityWindow) : 0.0f;
+			}
+		}
+#endif
+		for (; x < aEnd; ++x) {
+			auto ray = getPixelRay(aCamera, aSettings, x, aY);
+			float maximum = 0.0f;
+			glm::vec3 entry = ray.entryPoint + glm::vec3(0.5f);
+			for (int i = 0; i < ray.stepCount; ++i) {
+				float t = float(i) * aSettings.stepSize;
+				maximum = std::max(maximum, sample(glm::vec3(entry.x + t * ray.direction.x, entry.y + t * ray.direction.y, entry.z + t * ray.direction.z)));
+			}
+			samples += ray.stepCount;
+			aOutput[x - aBegin] = ray.stepCount > 0 ? applyWindow(maximum, aSettings.intensityWindow) : 0.0f;
+		}
+		return samples;
+	});
+}
+
+ReferenceImage VolumeReferenceRenderer::renderSlice(int aWidth, int aHeight, const SliceSettings &aSettings, RayPacking aPacking) const {
+	float sliceCoordinate = getSliceCoordinate(aSettings);
+	return renderTiles(aWidth, aHeight, [&](int aY, int aBegin, int aEnd, float *aOutput) {
+		// Texture coordinate v grows upwards like on the plane
+		float v = 1.0f - (aY + 0.5f) / aHeight;
+		int x = aBegin;
+		if (aPacking == RayPacking::Packets) {
+			alignas(16) std::array<float, cPacketSize> texX, texY, texZ, values;
+			texY.fill(v);
+			texZ.fill(sliceCoordinate);
+			for (; x + cPacketSize <= aEnd; x += cPacketSize) {
+				for (int lane = 0; lane < cPacketSize; ++lane) {
+					texX[lane] = (x + lane + 0.5f) / aWidth;
+				}
+				samplePacket(texX.data(), texY.data(), texZ.data(), values.data());
+				for (int lane = 0; lane < cPacketSize; ++lane) {
+					aOutput[x - aBegin + lane] = applyWindow(values[lane], aSettings.intensityWindow);
+				}
+			}
+		}
+		for (; x < aEnd; ++x) {
+			aOutput[x - aBegin] = applyWindow(sample(glm::vec3((x + 0.5f) / aWidth, v, sliceCoordinate)), aSettings.intensityWindow);
+		}
+		return size_t(aEnd - aBegin);
+	});
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "volume_data.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Pinhole camera of the 07_3d_textures demo, looking along +z with y up and x to the left.
+ */
+struct ReferenceCamera {
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, -3.0f);
+	float fieldOfView = 45.0f; ///< Vertical, in degrees
+	int width = 512;
+	int height = 512;
+};
+
+/**
+ * Gray levels in [0, 1], rows from the top, with the work it took to render them.
+ */
+struct ReferenceImage {
+	int width = 0;
+	int height = 0;
+	std::vector<float> values;
+	size_t rayCount = 0;
+	size_t sampleCount = 0;
+	double seconds = 0.0;
+
+	double raysPerSecond() const {
+		return seconds > 0.0 ? double(rayCount) / seconds : 0.0;
+	}
+
+	std::vector<uint8_t> toBytes() const;
+};
+
+/**
+ * Uniforms of mip.program without brick skipping.
+ */
+struct MIPSettings {
+	glm::vec3 modelScale = glm::vec3(1.0f); ///< Scale of the rendered cube
+	float stepSize = 0.01f;
+	int maxSampleCount = 1000;
+	glm::vec2 intensityWindow = glm::vec2(0.0f, 1.0f);
+};
+
+/**
+ * Uniforms of animated_texture.program, the slice fills the whole image.
+ */
+struct SliceSettings {
+	float elapsedTime = 0.0f;
+	float speed = 1.0f;
+	glm::vec2 intensityWindow = glm::vec2(0.0f, 1.0f);
+};
+
+enum class RayPacking {
+	Scalar, ///< One ray at a time - the baseline the packets are checked against
+	Packets ///< cPacketSize neighbouring rays per SIMD lane set
+};
+
+/**
+ * @brief CPU reference of the mip and animated_texture programs of 07_3d_textures - a golden image oracle and a throughput baseline.
+ *
+ * Samples emulate the base level of a trilinearly filtered GL_CLAMP_TO_BORDER texture in the sampled
+ * units (getVoxelScale()), so GPU images match with the level of detail pinned to 0 (a large negative u_lodBias).
+ * The image is split into cTileSize tiles distributed over the pool, rays of a tile march in packets
+ * of cPacketSize pixels of a row with SSE2.
+ */
+class VolumeReferenceRenderer {
+public:
+	static constexpr int cTileSize = 32;
+	static constexpr int cPacketSize = 4;
+
+	VolumeReferenceRenderer(const VolumeData &aVolume, ThreadPool *aPool = nullptr);
+
+	ReferenceImage renderMIP(const ReferenceCamera &aCamera, const MIPSettings &aSettings, RayPacking aPacking = RayPacking::Packets) const;
+	ReferenceImage renderSlice(int aWidth, int aHeight, const SliceSettings &aSettings, RayPacking aPacking = RayPacking::Packets) const;
+
+	float sample(glm::vec3 aTexCoords) const;
+
+protected:
+	struct PixelRay {
+		glm::vec3 entryPoint; ///< In the local cube coordinates
+		glm::vec3 direction;
+		int stepCount = 0;    ///< 0 when the ray misses the cube
+	};
+
+	PixelRay getPixelRay(const ReferenceCamera &aCamera, const MIPSettings &aSettings, int aX, int aY) const;
+	// Samples cPacketSize texture coordinates at once, identical to cPacketSize sample() calls
+	void samplePacket(const float *aX, const float *aY, const float *aZ, float *aValues) const;
+
+	// Splits the image into tiles for the pool, aRenderRow(y, xBegin, xEnd, float *output) returns the samples taken
+	template<typename TRowFunction>
+	ReferenceImage renderTiles(int aWidth, int aHeight, TRowFunction aRenderRow) const;
+
+	glm::ivec3 mSize;
+	glm::ivec3 mPaddedSize;
+	// Sampled values with a one voxel zero border, so the filter footprint never needs bounds checks
+	std::vector<float> mVoxels;
+	ThreadPool *mPool;
+};
@@ -0,0 +1,98 @@
+#include "volume_slice_cache.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+
+struct SliceVoxelFormat {
+	GLenum internalFormat;
+	GLenum type;
+};
+
+SliceVoxelFormat getSliceVoxelFormat(VoxelType aType) {
+	switch (aType) {
+	case VoxelType::UInt8: return { GL_R8, GL_UNSIGNED_BYTE };
+	case VoxelType::UInt16: return { GL_R16, GL_UNSIGNED_SHORT };
+	case VoxelType::Float32: return { GL_R32F, GL_FLOAT };
+	}
+	throw OpenGLError("Unsupported voxel type");
+}
+
+// Slice coordinate of animated_texture.fragment.glsl - bounces between 0 and 1
+float getSliceCoordinate(float aAnimationTime) {
+	return std::abs(aAnimationTime - float(int(aAnimationTime / 2.0f)) * 2.0f - 1.0f);
+}
+
+} // namespace
+
+VolumeSliceCache::VolumeSliceCache(const fs::path &aFilePath, const VolumeStatistics &aStatistics)
+	: mReader(aFilePath)
+	, mWindow(aStatistics.window)
+	, mFormat(aStatistics.format)
+	, mTextureType(getVolumeFormatType(aStatistics.format, mReader.info().type))
+	, mVoxelType(getSliceVoxelFormat(mTextureType).type)
+{
+	const auto &info = mReader.info();
+	mResidentSlices.fill(std::numeric_limits<int>::min());
+	mSlab.resize(cSlabSlices * info.sliceSize());
+	mSlice.resize(size_t(info.width) * info.height * getVoxelSize(mTextureType));
+
+	auto format = getSliceVoxelFormat(mTextureType);
+	for (int parity = 0; parity < 2; ++parity) {
+		mTextures[parity] = createTexture();
+		mTextureIds[parity] = mTextures[parity].get();
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, mTextureIds[parity]));
+		GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, info.width, info.height, 0, GL_RED, format.type, nullptr));
+		GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+		GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+		GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER));
+		GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER));
+	}
+	GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void VolumeSliceCache::update(float aAnimationTime) {
+	const auto &info = mReader.info();
+	// Same as the 3D texture filtering along z - slices floor(slice) and floor(slice) + 1 are blended
+	int lowerSlice = int(std::floor(getSliceCoordinate(aAnimationTime) * float(info.depth) - 0.5f));
+	bool uploading = false;
+	for (int slice = lowerSlice; slice <= lowerSlice + 1; ++slice) {
+		int parity = slice & 1;
+		if (mResidentSlices[parity] == slice) {
+			continue;
+		}
+		if (!uploading) {
+			// Rows of odd width 8/16-bit slices are not 4 byte aligned
+			GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+			uploading = true;
+		}
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, mTextureIds[parity]));
+		GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, info.width, info.height, GL_RED, mVoxelType, getSlice(slice)));
+		mResidentSlices[parity] = slice;
+		++mUploadedSliceCount;
+	}
+	if (uploading) {
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+		GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+	}
+}
+
+const void *VolumeSliceCache::getSlice(int aSlice) {
+	const auto &info = mReader.info();
+	if (aSlice < 0 || aSlice >= info.depth) {
+		std::fill(mSlice.begin(), mSlice.end(), uint8_t(0));
+		return mSlice.data();
+	}
+	int slabFirstSlice = aSlice / cSlabSlices * cSlabSlices;
+	if (slabFirstSlice != mSlabFirstSlice) {
+		mReader.readSlices(slabFirstSlice, std::min(cSlabSlices, info.depth - slabFirstSlice), mSlab.data());
+		mSlabFirstSlice = slabFirstSlice;
+	}
+	const uint8_t *source = mSlab.data() + (aSlice - mSlabFirstSlice) * info.sliceSize();
+	if (mFormat == VolumeFormat::Native) {
+		return source;
+	}
+	convertVoxels(info.type, source, mWindow, mTextureType, mSlice.data(), size_t(info.width) * info.height);
+	return mSlice.data();
+}
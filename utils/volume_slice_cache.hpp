@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "ogl_resource.hpp"
+#include "volume_data.hpp"
+#include "volume_conversion.hpp"
+
+/**
+ * @brief Cached-slice mode of animated_texture.program - the two volume slices around the animated
+ * slice coordinate live in two 2D textures instead of sampling the whole 3D texture.
+ *
+ * Slice s is kept in the texture of its parity, so when the coordinate moves on by one slice only the
+ * texture holding the slice left behind is overwritten. Slices are read from the volume file in slabs of
+ * cSlabSlices and converted to the format of the volume texture (see VolumeStatistics), so the shader
+ * applies the same intensity window. Uploads per frame scale with the animation speed instead of the
+ * frame rate. Slices outside the volume are zero, like the GL_CLAMP_TO_BORDER border of the 3D texture.
+ */
+class VolumeSliceCache {
+public:
+	static constexpr int cSlabSlices = 32;
+
+	VolumeSliceCache(const fs::path &aFilePath, const VolumeStatistics &aStatistics);
+
+	/**
+	 * Moves the texture of the even (aParity 0) or odd slices out - sampled as u_evenSlice and u_oddSlice. Called once per parity.
+	 */
+	OpenGLResource takeSliceTexture(int aParity) {
+		return std::move(mTextures[aParity]);
+	}
+
+	int sliceCount() const {
+		return mReader.info().depth;
+	}
+
+	/**
+	 * Uploads the slices the shader blends at aAnimationTime (u_speed * u_elapsedTime), if not resident yet.
+	 */
+	void update(float aAnimationTime);
+
+	size_t uploadedSliceCount() const {
+		return mUploadedSliceCount;
+	}
+
+protected:
+	// Voxels of aSlice in the texture format, zero outside the volume
+	const void *getSlice(int aSlice);
+
+	VolumeReader mReader;
+	VolumeWindow mWindow;
+	VolumeFormat mFormat;
+	VoxelType mTextureType;
+	GLenum mVoxelType;
+
+	std::array<OpenGLResource, 2> mTextures;
+	std::array<GLuint, 2> mTextureIds = {};
+	std::array<int, 2> mResidentSlices;
+	size_t mUploadedSliceCount = 0;
+
+	std::vector<uint8_t> mSlab; ///< Source voxels of slices [mSlabFirstSlice, mSlabFirstSlice + cSlabSlices)
+	int mSlabFirstSlice = -1;
+	std::vector<uint8_t> mSlice; ///< Converted voxels of the last requested slice
+};